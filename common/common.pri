@@ -0,0 +1,8 @@
+# the code every app of the project shares, compiled into each of them
+INCLUDEPATH += $$PWD
+
+HEADERS += \
+    $$PWD/framecodec.h
+
+SOURCES += \
+    $$PWD/framecodec.cpp
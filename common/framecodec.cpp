@@ -0,0 +1,380 @@
+#include <QIODevice>
+#include <QtEndian>
+#include <cstring>
+
+#include "framecodec.h"
+
+FrameDecoder::FrameDecoder()
+{
+    // reserved capacity is kept by the buffer when it gets empty
+    buffer.reserve(4096);
+    readPos = 0;
+    appendPos = 0;
+    frameSizeLimit = maxFrameSize;
+    error = false;
+}
+
+void FrameDecoder::readFrom(QIODevice *device)
+{
+    qint64 available = device->bytesAvailable();
+    if (available <= 0)
+        return;
+    char *data = beginAppend((int)available);
+    qint64 bytesRead = device->read(data, available);
+    endAppend((int)qMax(bytesRead, (qint64)0));
+}
+
+char *FrameDecoder::beginAppend(int maxSize)
+{
+    compact();
+    appendPos = buffer.size();
+    buffer.resize(appendPos + maxSize);
+    return buffer.data() + appendPos;
+}
+
+void FrameDecoder::endAppend(int size)
+{
+    buffer.resize(appendPos + size);
+}
+
+void FrameDecoder::append(const char *data, int size)
+{
+    compact();
+    buffer.append(data, size);
+}
+
+bool FrameDecoder::nextFrame(const char **frame, int *frameSize)
+{
+    if (error)
+        return false;
+    int bytesLeft = buffer.size() - readPos;
+    if (bytesLeft < (int)sizeof(quint16))
+        return false;
+    const uchar *data = reinterpret_cast<const uchar *>(buffer.constData()) + readPos;
+    quint32 blockSize = qFromBigEndian<quint16>(data);
+    int headerSize = sizeof(quint16);
+    if (blockSize == 0xffff)
+    {
+        headerSize += sizeof(quint32);
+        if (bytesLeft < headerSize)
+            return false;
+        blockSize = qFromBigEndian<quint32>(data + sizeof(quint16));
+    }
+    if (blockSize > frameSizeLimit)
+    {
+        error = true;
+        return false;
+    }
+    if ((quint32)(bytesLeft - headerSize) < blockSize)
+        return false;
+    *frame = buffer.constData() + readPos + headerSize;
+    *frameSize = blockSize;
+    readPos += headerSize + blockSize;
+    return true;
+}
+
+void FrameDecoder::clear()
+{
+    buffer.resize(0);
+    readPos = 0;
+    error = false;
+}
+
+void FrameDecoder::compact()
+{
+    if (readPos == 0)
+        return;
+    // drop the consumed frames, the capacity stays
+    buffer.remove(0, readPos);
+    readPos = 0;
+}
+
+FrameBuilder::FrameBuilder(quint8 command, int sizeHint)
+{
+    // a frame known to be large gets the extended size field right away
+    headerSize = sizeHint + 1 >= 0xffff ? sizeof(quint16) + sizeof(quint32) : sizeof(quint16);
+    block.reserve(headerSize + 1 + sizeHint);
+    block.resize(headerSize);
+    block.append((char)command);
+}
+
+char *FrameBuilder::grow(int size)
+{
+    int pos = block.size();
+    block.resize(pos + size);
+    return block.data() + pos;
+}
+
+FrameBuilder &FrameBuilder::appendUInt8(quint8 value)
+{
+    block.append((char)value);
+    return *this;
+}
+
+FrameBuilder &FrameBuilder::appendUInt16(quint16 value)
+{
+    qToBigEndian<quint16>(value, reinterpret_cast<uchar *>(grow(sizeof(quint16))));
+    return *this;
+}
+
+FrameBuilder &FrameBuilder::appendUInt32(quint32 value)
+{
+    qToBigEndian<quint32>(value, reinterpret_cast<uchar *>(grow(sizeof(quint32))));
+    return *this;
+}
+
+FrameBuilder &FrameBuilder::appendUInt64(quint64 value)
+{
+    qToBigEndian<quint64>(value, reinterpret_cast<uchar *>(grow(sizeof(quint64))));
+    return *this;
+}
+
+FrameBuilder &FrameBuilder::appendRaw(const QByteArray &bytes)
+{
+    block.append(bytes);
+    return *this;
+}
+
+FrameBuilder &FrameBuilder::appendString(const QString &str)
+{
+    if (str.isNull())
+        return appendUInt32(0xffffffff);
+    int length = str.length();
+    uchar *data = reinterpret_cast<uchar *>(grow(sizeof(quint32) + length * 2));
+    qToBigEndian<quint32>(length * 2, data);
+    data += sizeof(quint32);
+    const ushort *chars = str.utf16();
+    for (int i = 0; i < length; ++i)
+        qToBigEndian<quint16>(chars[i], data + i * 2);
+    return *this;
+}
+
+FrameBuilder &FrameBuilder::appendStringList(const QStringList &list)
+{
+    appendUInt32(list.size());
+    foreach (const QString &str, list)
+        appendString(str);
+    return *this;
+}
+
+FrameBuilder &FrameBuilder::appendUInt32List(const QList<quint32> &list)
+{
+    uchar *data = reinterpret_cast<uchar *>(grow(sizeof(quint32) * (list.size() + 1)));
+    qToBigEndian<quint32>(list.size(), data);
+    foreach (quint32 value, list)
+    {
+        data += sizeof(quint32);
+        qToBigEndian<quint32>(value, data);
+    }
+    return *this;
+}
+
+FrameBuilder &FrameBuilder::appendUtf8(const QByteArray &utf8)
+{
+    char *data = grow(sizeof(quint32) + utf8.size());
+    qToBigEndian<quint32>(utf8.size(), reinterpret_cast<uchar *>(data));
+    memcpy(data + sizeof(quint32), utf8.constData(), utf8.size());
+    return *this;
+}
+
+void FrameBuilder::setUInt32At(int payloadOffset, quint32 value)
+{
+    qToBigEndian<quint32>(value, reinterpret_cast<uchar *>(block.data()) + headerSize + 1 + payloadOffset);
+}
+
+QByteArray FrameBuilder::finish()
+{
+    quint32 blockSize = block.size() - headerSize;
+    uchar *data = reinterpret_cast<uchar *>(block.data());
+    if (blockSize < 0xffff)
+    {
+        // the hint was too large, the peers of protocol version 1 need the short size field
+        if (headerSize > (int)sizeof(quint16))
+        {
+            block.remove(sizeof(quint16), sizeof(quint32));
+            data = reinterpret_cast<uchar *>(block.data());
+        }
+        qToBigEndian<quint16>(blockSize, data);
+    }
+    else
+    {
+        // [0xffff][quint32 size]
+        if (headerSize == (int)sizeof(quint16))
+        {
+            block.insert(sizeof(quint16), QByteArray(sizeof(quint32), 0));
+            data = reinterpret_cast<uchar *>(block.data());
+        }
+        qToBigEndian<quint16>(0xffff, data);
+        qToBigEndian<quint32>(blockSize, data + sizeof(quint16));
+    }
+    QByteArray frame;
+    frame.swap(block);
+    return frame;
+}
+
+bool FrameBuilder::isExtendedFrame(const QByteArray &frame)
+{
+    return frame.size() >= (int)sizeof(quint16) &&
+            (uchar)frame.at(0) == 0xff && (uchar)frame.at(1) == 0xff;
+}
+
+FrameReader::FrameReader(const char *data, int size)
+{
+    ptr = reinterpret_cast<const uchar *>(data);
+    end = ptr + size;
+    ok = true;
+}
+
+bool FrameReader::canRead(quint32 size)
+{
+    if (!ok || (quint32)(end - ptr) < size)
+    {
+        ok = false;
+        return false;
+    }
+    return true;
+}
+
+quint8 FrameReader::readUInt8()
+{
+    if (!canRead(sizeof(quint8)))
+        return 0;
+    return *ptr++;
+}
+
+quint16 FrameReader::readUInt16()
+{
+    if (!canRead(sizeof(quint16)))
+        return 0;
+    quint16 value = qFromBigEndian<quint16>(ptr);
+    ptr += sizeof(quint16);
+    return value;
+}
+
+quint32 FrameReader::readUInt32()
+{
+    if (!canRead(sizeof(quint32)))
+        return 0;
+    quint32 value = qFromBigEndian<quint32>(ptr);
+    ptr += sizeof(quint32);
+    return value;
+}
+
+quint64 FrameReader::readUInt64()
+{
+    if (!canRead(sizeof(quint64)))
+        return 0;
+    quint64 value = qFromBigEndian<quint64>(ptr);
+    ptr += sizeof(quint64);
+    return value;
+}
+
+QString FrameReader::readString()
+{
+    // [quint32 bytes count][UTF-16 big endian], 0xffffffff stands for a null string
+    quint32 bytesCount = readUInt32();
+    if (!ok || bytesCount == 0xffffffff)
+        return QString();
+    if ((bytesCount & 1) != 0 || !canRead(bytesCount))
+    {
+        ok = false;
+        return QString();
+    }
+    int length = bytesCount / 2;
+    QString str(length, Qt::Uninitialized);
+    ushort *chars = reinterpret_cast<ushort *>(str.data());
+    for (int i = 0; i < length; ++i)
+        chars[i] = qFromBigEndian<quint16>(ptr + i * 2);
+    ptr += bytesCount;
+    return str;
+}
+
+QStringList FrameReader::readStringList()
+{
+    quint32 count = readUInt32();
+    QStringList list;
+    // every string takes at least 4 bytes, don't trust the count blindly
+    if (!ok || count > (quint32)(end - ptr) / sizeof(quint32))
+    {
+        ok = false;
+        return list;
+    }
+    list.reserve(count);
+    for (quint32 i = 0; i < count && ok; ++i)
+        list.append(readString());
+    return list;
+}
+
+QList<quint32> FrameReader::readUInt32List()
+{
+    quint32 count = readUInt32();
+    QList<quint32> list;
+    if (!ok || count > (quint32)(end - ptr) / sizeof(quint32))
+    {
+        ok = false;
+        return list;
+    }
+    list.reserve(count);
+    for (quint32 i = 0; i < count; ++i)
+        list.append(readUInt32());
+    return list;
+}
+
+QByteArray FrameReader::readUtf8()
+{
+    // [quint32 bytes count][UTF-8]
+    quint32 bytesCount = readUInt32();
+    if (!canRead(bytesCount))
+        return QByteArray();
+    QByteArray utf8 = QByteArray::fromRawData(reinterpret_cast<const char *>(ptr), bytesCount);
+    ptr += bytesCount;
+    return utf8;
+}
+
+MessageText::MessageText() : hasText(false), hasUtf8(false)
+{
+}
+
+MessageText MessageText::fromString(const QString &text)
+{
+    MessageText message;
+    message.textValue = text;
+    message.hasText = true;
+    return message;
+}
+
+MessageText MessageText::fromUtf8(const QByteArray &utf8)
+{
+    MessageText message;
+    message.utf8Value = utf8;
+    message.hasUtf8 = true;
+    return message;
+}
+
+int MessageText::chunkLength(const QString &text, int pos, int maxLength)
+{
+    int length = qMin(maxLength, text.length() - pos);
+    if (length > 1 && pos + length < text.length() && text.at(pos + length - 1).isHighSurrogate())
+        length--;
+    return length;
+}
+
+const QString &MessageText::text() const
+{
+    if (!hasText)
+    {
+        textValue = QString::fromUtf8(utf8Value);
+        hasText = true;
+    }
+    return textValue;
+}
+
+const QByteArray &MessageText::utf8() const
+{
+    if (!hasUtf8)
+    {
+        utf8Value = textValue.toUtf8();
+        hasUtf8 = true;
+    }
+    return utf8Value;
+}
@@ -0,0 +1,135 @@
+#ifndef FRAMECODEC_H
+#define FRAMECODEC_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QList>
+
+class QIODevice;
+
+// splits the incoming bytes into frames: [quint16 size][size bytes],
+// since protocol version 2 a size of 0xffff is followed by the real quint32 size
+class FrameDecoder
+{
+public:
+    FrameDecoder();
+
+    // larger frames are never accepted
+    static const quint32 maxFrameSize = 16 * 1024 * 1024;
+
+    // appends everything available on the device to the receive buffer
+    void readFrom(QIODevice *device);
+    void append(const char *data, int size);
+    // lets a reader fill the buffer in place: up to maxSize bytes may be written
+    // to the returned pointer, then endAppend() tells how many have been written
+    char *beginAppend(int maxSize);
+    void endAppend(int size);
+    // points to the payload of the next complete frame (valid until the next read),
+    // returns false if the buffer holds less than a full frame
+    bool nextFrame(const char **frame, int *frameSize);
+    void clear();
+    // a lower limit for the peers that haven't registered yet
+    void setFrameSizeLimit(quint32 limit) {this->frameSizeLimit = limit;}
+    // the peer has sent a frame larger than the limit
+    bool hasError() const {return this->error;}
+
+private:
+    QByteArray buffer;
+    int readPos;
+    int appendPos;
+    quint32 frameSizeLimit;
+    bool error;
+
+    void compact();
+};
+
+// builds one frame in place of the QDataStream and finishBlock() pair: the fields are appended
+// big endian the way QDataStream writes them and the size goes in front at the end;
+// sizeHint (the bytes after the command) saves the reallocations of the large frames
+class FrameBuilder
+{
+public:
+    explicit FrameBuilder(quint8 command, int sizeHint = 0);
+
+    FrameBuilder &appendUInt8(quint8 value);
+    FrameBuilder &appendUInt16(quint16 value);
+    FrameBuilder &appendUInt32(quint32 value);
+    FrameBuilder &appendUInt64(quint64 value);
+    FrameBuilder &appendRaw(const QByteArray &bytes);
+    // [quint32 bytes count][UTF-16], 0xffffffff for a null string, as QDataStream writes a QString
+    FrameBuilder &appendString(const QString &str);
+    FrameBuilder &appendStringList(const QStringList &list);
+    FrameBuilder &appendUInt32List(const QList<quint32> &list);
+    // since protocol version 4 the strings are [quint32 size][UTF-8 bytes]
+    FrameBuilder &appendUtf8(const QByteArray &utf8);
+    FrameBuilder &appendUtf8String(const QString &str) {return appendUtf8(str.toUtf8());}
+    // the bytes appended after the command so far
+    int payloadSize() const {return this->block.size() - this->headerSize - 1;}
+    // overwrites a field appended before, e.g. a count known only at the end
+    void setUInt32At(int payloadOffset, quint32 value);
+    // the complete frame, the builder is left empty
+    QByteArray finish();
+    // the frame can't be read by the peers of protocol version 1
+    static bool isExtendedFrame(const QByteArray &frame);
+
+private:
+    QByteArray block;
+    int headerSize;
+
+    char *grow(int size);
+};
+
+// reads the fields of one frame the same way QDataStream (big endian) writes them
+class FrameReader
+{
+public:
+    FrameReader(const char *data, int size);
+
+    quint8 readUInt8();
+    quint16 readUInt16();
+    quint32 readUInt32();
+    quint64 readUInt64();
+    QString readString();
+    QStringList readStringList();
+    QList<quint32> readUInt32List();
+    // the UTF-8 bytes as they are, for relaying without decoding;
+    // no copy is made, the result is valid while the frame is
+    QByteArray readUtf8();
+    QString readUtf8String() {return QString::fromUtf8(readUtf8());}
+
+    bool isOk() const {return this->ok;}
+    int bytesLeft() const {return this->end - this->ptr;}
+
+private:
+    const uchar *ptr;
+    const uchar *end;
+    bool ok;
+
+    bool canRead(quint32 size);
+};
+
+// a message body kept in the form it has come in (UTF-16 or UTF-8),
+// converted only if some receiver needs the other one
+class MessageText
+{
+public:
+    static MessageText fromString(const QString &text);
+    static MessageText fromUtf8(const QByteArray &utf8);
+    // the length of the chunk of a long message that starts at pos: maxLength at most and never
+    // the half of a surrogate pair, so every chunk is valid UTF-8 on its own
+    static int chunkLength(const QString &text, int pos, int maxLength);
+
+    const QString &text() const;
+    const QByteArray &utf8() const;
+
+private:
+    MessageText();
+
+    mutable QString textValue;
+    mutable QByteArray utf8Value;
+    mutable bool hasText;
+    mutable bool hasUtf8;
+};
+
+#endif // FRAMECODEC_H
@@ -0,0 +1,236 @@
+#include <QtTest>
+
+#include "framecodec.h"
+
+class TestFrameCodec : public QObject
+{
+    Q_OBJECT
+
+private:
+    // the payloads of the frames of the bytes, fed to the decoder in pieces of pieceSize
+    static QList<QByteArray> decode(const QByteArray &bytes, int pieceSize, FrameDecoder *decoder);
+
+private slots:
+    void shortFrame();
+    void extendedFrame_data();
+    void extendedFrame();
+    void largeHintShortFrame();
+    void framesSplitOverReads();
+    void frameSizeLimit();
+    void stringsRoundTrip();
+    void truncatedFrame();
+    void chunkLength_data();
+    void chunkLength();
+    void chunksAreValidUtf8();
+};
+
+QList<QByteArray> TestFrameCodec::decode(const QByteArray &bytes, int pieceSize, FrameDecoder *decoder)
+{
+    QList<QByteArray> frames;
+    for (int pos = 0; pos < bytes.size(); pos += pieceSize)
+    {
+        decoder->append(bytes.constData() + pos, qMin(pieceSize, bytes.size() - pos));
+        const char *frame;
+        int frameSize;
+        while (decoder->nextFrame(&frame, &frameSize))
+            frames.append(QByteArray(frame, frameSize));
+    }
+    return frames;
+}
+
+void TestFrameCodec::shortFrame()
+{
+    QByteArray frame = FrameBuilder(7).appendUInt32(0x01020304).appendUInt8(5).finish();
+    QVERIFY(!FrameBuilder::isExtendedFrame(frame));
+    // [quint16 size][command][payload]
+    QCOMPARE(frame.size(), 2 + 1 + 5);
+    QCOMPARE(frame.left(2), QByteArray("\x00\x06", 2));
+
+    FrameDecoder decoder;
+    QList<QByteArray> frames = decode(frame, frame.size(), &decoder);
+    QCOMPARE(frames.size(), 1);
+    FrameReader in(frames.first().constData(), frames.first().size());
+    QCOMPARE(in.readUInt8(), (quint8)7);
+    QCOMPARE(in.readUInt32(), (quint32)0x01020304);
+    QCOMPARE(in.readUInt8(), (quint8)5);
+    QVERIFY(in.isOk());
+    QCOMPARE(in.bytesLeft(), 0);
+}
+
+void TestFrameCodec::extendedFrame_data()
+{
+    QTest::addColumn<int>("sizeHint");
+    QTest::addColumn<int>("payloadSize");
+
+    // the hint decides whether the size field is inserted at the end or reserved up front
+    QTest::newRow("no hint") << 0 << 70000;
+    QTest::newRow("exact hint") << 70000 + 4 << 70000;
+    QTest::newRow("the largest short frame + 1") << 0 << 0xffff - 1 - 4;
+}
+
+void TestFrameCodec::extendedFrame()
+{
+    QFETCH(int, sizeHint);
+    QFETCH(int, payloadSize);
+
+    QByteArray payload(payloadSize, 'x');
+    QByteArray frame = FrameBuilder(9, sizeHint).appendUtf8(payload).finish();
+    // the frame takes 0xffff bytes or more, the short size field would be the marker
+    QVERIFY(FrameBuilder::isExtendedFrame(frame));
+    QCOMPARE(frame.size(), 2 + 4 + 1 + 4 + payloadSize);
+
+    FrameDecoder decoder;
+    QList<QByteArray> frames = decode(frame, 4096, &decoder);
+    QCOMPARE(frames.size(), 1);
+    FrameReader in(frames.first().constData(), frames.first().size());
+    QCOMPARE(in.readUInt8(), (quint8)9);
+    QCOMPARE(in.readUtf8(), payload);
+    QVERIFY(in.isOk());
+}
+
+void TestFrameCodec::largeHintShortFrame()
+{
+    // a hint too large leaves the short size field the peers of protocol version 1 can read
+    QByteArray frame = FrameBuilder(3, 100000).appendUInt16(42).finish();
+    QVERIFY(!FrameBuilder::isExtendedFrame(frame));
+    QCOMPARE(frame.size(), 2 + 1 + 2);
+    QCOMPARE(frame.left(2), QByteArray("\x00\x03", 2));
+}
+
+void TestFrameCodec::framesSplitOverReads()
+{
+    QByteArray bytes;
+    bytes += FrameBuilder(1).appendUtf8String("first").finish();
+    bytes += FrameBuilder(2, 70000).appendUtf8(QByteArray(70000, 'y')).finish();
+    bytes += FrameBuilder(3).finish();
+
+    // the pieces split the size fields as well as the payloads
+    FrameDecoder decoder;
+    QList<QByteArray> frames = decode(bytes, 7, &decoder);
+    QCOMPARE(frames.size(), 3);
+    QCOMPARE(frames.at(0).at(0), '\x01');
+    QCOMPARE(frames.at(1).size(), 1 + 4 + 70000);
+    QCOMPARE(frames.at(2), QByteArray("\x03", 1));
+    QVERIFY(!decoder.hasError());
+}
+
+void TestFrameCodec::frameSizeLimit()
+{
+    FrameDecoder decoder;
+    decoder.setFrameSizeLimit(1024);
+    QByteArray frame = FrameBuilder(1).appendUtf8(QByteArray(2000, 'z')).finish();
+    // the size field alone is enough to refuse it
+    decoder.append(frame.constData(), 2);
+    const char *data;
+    int size;
+    QVERIFY(!decoder.nextFrame(&data, &size));
+    QVERIFY(decoder.hasError());
+
+    decoder.clear();
+    QVERIFY(!decoder.hasError());
+    QByteArray small = FrameBuilder(1).appendUInt8(0).finish();
+    decoder.append(small.constData(), small.size());
+    QVERIFY(decoder.nextFrame(&data, &size));
+    QCOMPARE(size, 2);
+}
+
+void TestFrameCodec::stringsRoundTrip()
+{
+    // a character outside of the BMP takes a surrogate pair in UTF-16 and 4 bytes in UTF-8
+    QString text = QString::fromUtf8("na\xc3\xafve \xf0\x9f\x98\x80");
+    QByteArray frame = FrameBuilder(4).appendString(text).appendString(QString()).appendString("")
+            .appendStringList(QStringList() << "a" << text).appendUInt32List(QList<quint32>() << 1 << 0xffffffff)
+            .appendUtf8String(text).appendUInt64(Q_UINT64_C(0x0102030405060708)).finish();
+
+    FrameReader in(frame.constData() + 2, frame.size() - 2);
+    QCOMPARE(in.readUInt8(), (quint8)4);
+    QCOMPARE(in.readString(), text);
+    QVERIFY(in.readString().isNull());
+    QString empty = in.readString();
+    QVERIFY(empty.isEmpty() && !empty.isNull());
+    QCOMPARE(in.readStringList(), QStringList() << "a" << text);
+    QCOMPARE(in.readUInt32List(), QList<quint32>() << 1 << 0xffffffff);
+    QCOMPARE(in.readUtf8String(), text);
+    QCOMPARE(in.readUInt64(), Q_UINT64_C(0x0102030405060708));
+    QVERIFY(in.isOk());
+    QCOMPARE(in.bytesLeft(), 0);
+}
+
+void TestFrameCodec::truncatedFrame()
+{
+    QByteArray frame = FrameBuilder(5).appendUtf8String("truncated").appendStringList(QStringList() << "x").finish();
+    // every cut of the payload leaves the reader failed, never reading past the end
+    for (int cut = 1; cut < frame.size() - 2; ++cut)
+    {
+        FrameReader in(frame.constData() + 2, cut);
+        in.readUInt8();
+        in.readUtf8();
+        in.readStringList();
+        QVERIFY2(!in.isOk(), qPrintable(QString("cut at %1").arg(cut)));
+    }
+    // a count larger than the frame can hold
+    QByteArray bogus = FrameBuilder(6).appendUInt32(0x10000000).finish();
+    FrameReader in(bogus.constData() + 3, bogus.size() - 3);
+    QVERIFY(in.readUInt32List().isEmpty());
+    QVERIFY(!in.isOk());
+}
+
+void TestFrameCodec::chunkLength_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<int>("pos");
+    QTest::addColumn<int>("maxLength");
+    QTest::addColumn<int>("length");
+
+    QString smile = QString::fromUtf8("\xf0\x9f\x98\x80");
+    QTest::newRow("plain") << QString("abcdefgh") << 0 << 3 << 3;
+    QTest::newRow("the rest") << QString("abcdefgh") << 6 << 3 << 2;
+    // the high surrogate would end the chunk, it goes to the next one with its pair
+    QTest::newRow("pair at the boundary") << QString("ab") + smile + "cd" << 0 << 3 << 2;
+    QTest::newRow("pair after the boundary") << QString("abc") + smile << 0 << 3 << 3;
+    QTest::newRow("pair inside") << QString("a") + smile + "bc" << 0 << 3 << 3;
+    QTest::newRow("pair at the end") << QString("ab") + smile << 2 << 3 << 2;
+    // a chunk of one character can't be shortened, or the message would never end
+    QTest::newRow("one character chunks") << smile << 0 << 1 << 1;
+}
+
+void TestFrameCodec::chunkLength()
+{
+    QFETCH(QString, text);
+    QFETCH(int, pos);
+    QFETCH(int, maxLength);
+    QFETCH(int, length);
+
+    QCOMPARE(MessageText::chunkLength(text, pos, maxLength), length);
+}
+
+void TestFrameCodec::chunksAreValidUtf8()
+{
+    // pairs at every offset against the chunk boundaries
+    QString text;
+    for (int i = 0; i < 50; ++i)
+        text += QString(i % 7, 'a') + QString::fromUtf8("\xf0\x9f\x98\x80");
+
+    for (int maxLength = 2; maxLength <= 9; ++maxLength)
+    {
+        QByteArray joined;
+        int length;
+        for (int pos = 0; pos < text.length(); pos += length)
+        {
+            length = MessageText::chunkLength(text, pos, maxLength);
+            QVERIFY(length > 0 && length <= maxLength);
+            QString chunk = text.mid(pos, length);
+            QVERIFY(!chunk.at(chunk.length() - 1).isHighSurrogate());
+            QVERIFY(!chunk.at(0).isLowSurrogate());
+            // the relayed chunk decodes by itself, as the receivers of protocol version 4 read it
+            QByteArray utf8 = MessageText::fromString(chunk).utf8();
+            QCOMPARE(QString::fromUtf8(utf8), chunk);
+            joined += utf8;
+        }
+        QCOMPARE(QString::fromUtf8(joined), text);
+    }
+}
+
+QTEST_APPLESS_MAIN(TestFrameCodec)
+
+#include "tst_framecodec.moc"
@@ -0,0 +1,13 @@
+TEMPLATE = app
+
+TARGET = tst_framecodec
+
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+QT = core testlib
+
+SOURCES += \
+    tst_framecodec.cpp
+
+include(../../common.pri)
@@ -1,4 +1,9 @@
-TEMPLATE     = subdirs
-
-SUBDIRS += netchatclient
-SUBDIRS += netchatserver
+TEMPLATE     = subdirs
+
+SUBDIRS += netchatclient
+SUBDIRS += netchatserver
+SUBDIRS += netchatserverd
+SUBDIRS += netchatbench
+SUBDIRS += common/tests
+SUBDIRS += netchatserver/tests
+SUBDIRS += netchatclient/tests
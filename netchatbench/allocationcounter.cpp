@@ -0,0 +1,59 @@
+#include <cstdlib>
+
+#include "allocationcounter.h"
+
+#ifdef __GLIBC__
+
+#include <QAtomicInteger>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+}
+
+// zero before any constructor runs, the first allocations come before main()
+static QBasicAtomicInteger<quint64> allocations = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+// the executable's definitions take the place of the libc ones for every library
+extern "C" void *malloc(size_t size)
+{
+    allocations.fetchAndAddRelaxed(1);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    allocations.fetchAndAddRelaxed(1);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    allocations.fetchAndAddRelaxed(1);
+    return __libc_realloc(ptr, size);
+}
+
+bool AllocationCounter::isAvailable()
+{
+    return true;
+}
+
+quint64 AllocationCounter::count()
+{
+    return allocations.load();
+}
+
+#else
+
+bool AllocationCounter::isAvailable()
+{
+    return false;
+}
+
+quint64 AllocationCounter::count()
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <QtGlobal>
+
+// counts the heap allocations of the whole process: malloc(), calloc() and realloc() are
+// replaced by counting wrappers (operator new and the Qt containers end up there too).
+// glibc only, elsewhere isAvailable() is false and the count stays 0
+namespace AllocationCounter {
+
+bool isAvailable();
+quint64 count();
+
+}
+
+#endif // ALLOCATIONCOUNTER_H
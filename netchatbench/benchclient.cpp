@@ -0,0 +1,311 @@
+#include <QUuid>
+
+#include "constants.h"
+#include "benchclient.h"
+#include "benchworker.h"
+
+// the bench speaks the UTF-8 strings and the session ids only
+static const quint8 minProtocolVersion = 4;
+
+// "<send time in usec> ..." at the start of every message the bench sends,
+// "<send time in usec>f..." for the ones of the flooders
+static bool parseStamp(const char *data, int size, quint64 *usec, bool *isFlood)
+{
+    quint64 value = 0;
+    int i = 0;
+    for (; i < size && data[i] >= '0' && data[i] <= '9'; ++i)
+        value = value * 10 + (data[i] - '0');
+    if (i == 0)
+        return false;
+    *usec = value;
+    *isFlood = i < size && data[i] == 'f';
+    return true;
+}
+
+BenchClient::BenchClient(BenchWorker *workerPtr, const QString &clientName, QObject *parent) :
+    QObject(parent), worker(workerPtr), name(clientName)
+{
+    uuid = QUuid::createUuid().toString();
+    state = Idle;
+    serverProtocolVersion = 1;
+    sessionId = 0;
+    nextStreamId = 0;
+    connectStartUsec = 0;
+    readyIndex = -1;
+    isStormPending = false;
+    isFlooder = false;
+
+    socket = new QTcpSocket(this);
+    connect(socket, SIGNAL(readyRead()), this, SLOT(onSocketReadyRead()));
+    connect(socket, SIGNAL(connected()), this, SLOT(onSocketConnected()));
+    connect(socket, SIGNAL(disconnected()), this, SLOT(onSocketDisconnected()));
+    connect(socket, SIGNAL(error(QAbstractSocket::SocketError)),
+            this, SLOT(onSocketError(QAbstractSocket::SocketError)));
+}
+
+void BenchClient::connectToServer()
+{
+    state = Connecting;
+    connectStartUsec = worker->nowUsec();
+    socket->connectToHost(worker->getConfig().address, worker->getConfig().port);
+}
+
+void BenchClient::abortConnection()
+{
+    // no disconnect is reported for the connections the bench closes itself
+    State oldState = state;
+    state = Idle;
+    if (oldState == Ready)
+        worker->onNotReady(this);
+    socket->abort();
+    this->settleStorm();
+}
+
+void BenchClient::settleStorm()
+{
+    if (!isStormPending)
+        return;
+    isStormPending = false;
+    worker->onStormSettled();
+}
+
+void BenchClient::sendMessage(const QList<quint32> &receiverIds, const QByteArray &text)
+{
+    if (text.size() > Constants::messageChunkLength)
+    {
+        this->sendMessageStream(receiverIds, text);
+        return;
+    }
+    if (receiverIds.isEmpty())
+    {
+        this->writeToSocket(FrameBuilder(Constants::comMessageToAll, text.size() + 4).appendUtf8(text).finish());
+        return;
+    }
+    this->writeToSocket(FrameBuilder(Constants::comMessageToClients, text.size() + receiverIds.size() * 4 + 8)
+                        .appendUInt32List(receiverIds).appendUtf8(text).finish());
+}
+
+void BenchClient::sendMessageStream(const QList<quint32> &receiverIds, const QByteArray &text)
+{
+    // the text is ASCII, so any cut is valid UTF-8
+    quint32 streamId = nextStreamId++;
+    quint8 kind = receiverIds.isEmpty() ? Constants::comMessageToAll : Constants::comMessageToClients;
+    int length;
+    for (int pos = 0; pos < text.size(); pos += length)
+    {
+        length = qMin(Constants::messageChunkLength, text.size() - pos);
+        quint8 flags = 0;
+        if (pos == 0)
+            flags |= Constants::chunkFirst;
+        if (pos + length >= text.size())
+            flags |= Constants::chunkLast;
+        FrameBuilder frame(Constants::comMessageChunk, length + receiverIds.size() * 4 + 16);
+        frame.appendUInt32(streamId).appendUInt8(flags);
+        if (flags & Constants::chunkFirst)
+        {
+            frame.appendUInt8(kind);
+            if (kind == Constants::comMessageToClients)
+                frame.appendUInt32List(receiverIds);
+        }
+        frame.appendUtf8(QByteArray::fromRawData(text.constData() + pos, length));
+        this->writeToSocket(frame.finish());
+    }
+}
+
+void BenchClient::writeToSocket(const QByteArray &block)
+{
+    socket->write(block);
+}
+
+void BenchClient::sendCommand(quint8 command)
+{
+    this->writeToSocket(FrameBuilder(command).finish());
+}
+
+void BenchClient::tryToRegister()
+{
+    this->writeToSocket(FrameBuilder(Constants::comRegisterRequest).appendUtf8String(uuid)
+                        .appendUtf8String(name).finish());
+}
+
+void BenchClient::onSocketConnected()
+{
+    receiveDecoder.clear();
+    incomingStreams.clear();
+    serverProtocolVersion = 1;
+    sessionId = 0;
+    state = Negotiating;
+    // the same greeting as the GUI client
+    this->writeToSocket(FrameBuilder(Constants::comClientConnected).appendString(uuid).finish());
+    this->sendCommand(Constants::comProtocolHello);
+}
+
+void BenchClient::onSocketDisconnected()
+{
+    if (state == Idle)
+        return;
+    State oldState = state;
+    state = Idle;
+    if (oldState == Ready)
+        worker->onNotReady(this);
+    worker->onDisconnected();
+    this->settleStorm();
+}
+
+void BenchClient::onSocketError(QAbstractSocket::SocketError socketError)
+{
+    Q_UNUSED(socketError);
+    // the errors of an established connection end with a disconnect
+    if (state != Connecting)
+        return;
+    state = Idle;
+    worker->onConnectFailed();
+    this->settleStorm();
+}
+
+void BenchClient::onSocketReadyRead()
+{
+    worker->onBytesReceived(socket->bytesAvailable());
+    receiveDecoder.readFrom(socket);
+    // handle every complete block in place, several of them may come at once
+    const char *frame;
+    int frameSize;
+    while (receiveDecoder.nextFrame(&frame, &frameSize))
+    {
+        processBlock(frame, frameSize);
+        // the client may be aborted by an error frame
+        if (state == Idle)
+            return;
+    }
+    if (receiveDecoder.hasError())
+        this->abortConnection();
+}
+
+void BenchClient::processBlock(const char *frame, int frameSize)
+{
+    FrameReader in(frame, frameSize);
+    quint8 command = in.readUInt8();
+
+    switch (command)
+    {
+    case Constants::comProtocolAccepted:
+    {
+        worker->onAccepted(worker->nowUsec() - connectStartUsec);
+        quint8 version = in.readUInt8();
+        serverProtocolVersion = qMin(version, Constants::protocolVersion);
+        if (serverProtocolVersion < minProtocolVersion)
+        {
+            worker->onServerError();
+            this->abortConnection();
+            return;
+        }
+        this->writeToSocket(FrameBuilder(Constants::comProtocolVersion).appendUInt8(serverProtocolVersion).finish());
+        state = Registering;
+        this->tryToRegister();
+    }
+        break;
+    case Constants::comRegistrationSuccess:
+    {
+        sessionId = in.readUInt32();
+        state = Ready;
+        worker->onRegistered(this, worker->nowUsec() - connectStartUsec);
+        this->settleStorm();
+    }
+        break;
+    case Constants::comMessageToAll:
+    {
+        // [sender id][text]
+        in.readUInt32();
+        this->onMessageText(in.readUtf8());
+    }
+        break;
+    case Constants::comMessageToClients:
+    {
+        // [sender id][receivers ids][text]
+        in.readUInt32();
+        in.readUInt32List();
+        this->onMessageText(in.readUtf8());
+    }
+        break;
+    case Constants::comMessageChunk:
+    {
+        this->processMessageChunk(in);
+    }
+        break;
+    case Constants::comPingRequest:
+    {
+        // the server measures the round trip, its timestamp goes back as it is
+        quint32 seq = in.readUInt32();
+        quint64 sentUsec = in.readUInt64();
+        this->writeToSocket(FrameBuilder(Constants::comPingReply).appendUInt32(seq).appendUInt64(sentUsec).finish());
+    }
+        break;
+    case Constants::comHeartbeat:
+    {
+        this->sendCommand(Constants::comHeartbeat);
+    }
+        break;
+    case Constants::comSlowDown:
+    {
+        worker->onSlowDown(this);
+    }
+        break;
+    case Constants::comErrClientExists:
+    case Constants::comErrNameInvalid:
+    case Constants::comErrNameUsed:
+    case Constants::comErrSlowConsumer:
+    case Constants::comErrTooManyRequests:
+    case Constants::comErrNameIllegal:
+    {
+        // the server closes the connection after an error
+        worker->onServerError();
+        this->abortConnection();
+    }
+        break;
+    default:
+        // the roster and the server messages mean nothing to the bench
+        break;
+    }
+}
+
+void BenchClient::processMessageChunk(FrameReader &in)
+{
+    quint32 streamId = in.readUInt32();
+    quint8 flags = in.readUInt8();
+    quint32 senderId = in.readUInt32();
+    // the streams ids are chosen by the senders, so they are unique per sender only
+    quint64 streamKey = ((quint64)senderId << 32) | streamId;
+    if (flags & Constants::chunkFirst)
+    {
+        quint8 kind = in.readUInt8();
+        if (kind == Constants::comMessageToClients)
+            in.readUInt32List();
+    }
+    QByteArray piece = in.readUtf8();
+    if (!in.isOk())
+        return;
+    if (flags & Constants::chunkFirst)
+    {
+        IncomingStream stream;
+        if (!parseStamp(piece.constData(), piece.size(), &stream.sentUsec, &stream.isFlood))
+            return;
+        incomingStreams.insert(streamKey, stream);
+    }
+    // the latency of a long message is the one of its last chunk
+    if (flags & Constants::chunkLast)
+    {
+        QHash<quint64, IncomingStream>::iterator it = incomingStreams.find(streamKey);
+        if (it == incomingStreams.end())
+            return;
+        worker->onDelivered(it.value().sentUsec, it.value().isFlood);
+        incomingStreams.erase(it);
+    }
+}
+
+void BenchClient::onMessageText(const QByteArray &text)
+{
+    quint64 sentUsec;
+    bool isFlood;
+    if (parseStamp(text.constData(), text.size(), &sentUsec, &isFlood))
+        worker->onDelivered(sentUsec, isFlood);
+}
@@ -0,0 +1,76 @@
+#ifndef BENCHCLIENT_H
+#define BENCHCLIENT_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QTcpSocket>
+
+#include "framecodec.h"
+
+class BenchWorker;
+
+// one simulated netchatclient: the handshake and the frames of the GUI client, no widgets.
+// The message text starts with the send time, so every delivery gives a latency sample
+class BenchClient : public QObject
+{
+    Q_OBJECT
+
+    friend class BenchWorker;
+
+public:
+    enum State {Idle, Connecting, Negotiating, Registering, Ready};
+
+    BenchClient(BenchWorker *workerPtr, const QString &clientName, QObject *parent = 0);
+
+    void connectToServer();
+    void abortConnection();
+    // to all if there are no receivers
+    void sendMessage(const QList<quint32> &receiverIds, const QByteArray &text);
+    State getState() const {return this->state;}
+    quint32 getSessionId() const {return this->sessionId;}
+    qint64 bytesToWrite() const {return this->socket->bytesToWrite();}
+
+private:
+    BenchWorker *worker;
+    QTcpSocket *socket;
+    QString uuid;
+    QString name;
+    State state;
+    quint8 serverProtocolVersion;
+    quint32 sessionId;
+    quint32 nextStreamId;
+    quint64 connectStartUsec;
+    // the position in the ready list of the worker, -1 if not there
+    int readyIndex;
+    // the storm round waits for the client to register or to fail
+    bool isStormPending;
+    // sends at the flood rate of its own instead of a share of the message rate
+    bool isFlooder;
+    FrameDecoder receiveDecoder;
+    struct IncomingStream
+    {
+        quint64 sentUsec;
+        bool isFlood;
+    };
+    // the long messages being received, by sender id and stream id
+    QHash<quint64, IncomingStream> incomingStreams;
+
+    void processBlock(const char *frame, int frameSize);
+    void processMessageChunk(FrameReader &in);
+    void onMessageText(const QByteArray &text);
+    void tryToRegister();
+    void sendCommand(quint8 command);
+    void sendMessageStream(const QList<quint32> &receiverIds, const QByteArray &text);
+    void writeToSocket(const QByteArray &block);
+    void settleStorm();
+
+private slots:
+    void onSocketConnected();
+    void onSocketDisconnected();
+    void onSocketError(QAbstractSocket::SocketError socketError);
+    void onSocketReadyRead();
+};
+
+#endif // BENCHCLIENT_H
@@ -0,0 +1,339 @@
+#include <QThread>
+#include <QTimer>
+#include <QTextStream>
+
+#include "benchrunner.h"
+
+// the clients of the last round have that long to go away before the next one connects them again
+static const int stormPauseMsec = 1000;
+// a round some clients neither register nor fail in is cut short
+static const quint64 stormRoundTimeoutUsec = 30 * 1000 * 1000;
+static const int stormCheckMsec = 10;
+
+static QJsonObject histogramToJson(const LatencyHistogram &histogram)
+{
+    QJsonObject object;
+    object["count"] = (double)histogram.getCount();
+    object["min"] = (double)histogram.getMin();
+    object["mean"] = histogram.getMean();
+    object["p50"] = (double)histogram.percentile(50);
+    object["p90"] = (double)histogram.percentile(90);
+    object["p99"] = (double)histogram.percentile(99);
+    object["p999"] = (double)histogram.percentile(99.9);
+    object["max"] = (double)histogram.getMax();
+    return object;
+}
+
+BenchRunner::BenchRunner(const BenchConfig &benchConfig, int threadsCount, double warmupSec, double durationSec,
+                         QObject *parent) :
+    QObject(parent), config(benchConfig), warmup(warmupSec), duration(durationSec)
+{
+    lastDeliveries = 0;
+    progressTimer = new QTimer(this);
+    progressTimer->setInterval(1000);
+    connect(progressTimer, SIGNAL(timeout()), this, SLOT(onProgress()));
+    stormRound = 0;
+    stormStartUsec = 0;
+    stormTimer = new QTimer(this);
+    stormTimer->setInterval(stormCheckMsec);
+    connect(stormTimer, SIGNAL(timeout()), this, SLOT(checkStormRound()));
+
+    threadsCount = qBound(1, threadsCount, config.clientsCount);
+    int firstIndex = 0;
+    for (int i = 0; i < threadsCount; ++i)
+    {
+        int count = config.clientsCount / threadsCount + (i < config.clientsCount % threadsCount ? 1 : 0);
+        // every worker runs its share of the rates
+        BenchWorker *worker = new BenchWorker(config, firstIndex, count,
+                                              (double)count / config.clientsCount, &clock);
+        QThread *thread = new QThread(this);
+        worker->moveToThread(thread);
+        connect(thread, SIGNAL(started()), worker, SLOT(start()));
+        workers.append(worker);
+        threads.append(thread);
+        firstIndex += count;
+    }
+}
+
+BenchRunner::~BenchRunner()
+{
+    foreach (QThread *thread, threads)
+    {
+        thread->quit();
+        thread->wait();
+    }
+    qDeleteAll(workers);
+}
+
+void BenchRunner::start()
+{
+    clock.start();
+    if (config.stormRounds > 0)
+    {
+        // no warm-up, everything is measured
+        foreach (BenchWorker *worker, workers)
+            worker->startMeasuring(0);
+        foreach (QThread *thread, threads)
+            thread->start();
+        progressTimer->start();
+        onMeasureStart();
+        QTimer::singleShot(stormPauseMsec, this, SLOT(startStormRound()));
+        return;
+    }
+    foreach (BenchWorker *worker, workers)
+        worker->startMeasuring((quint64)(warmup * 1e6));
+    foreach (QThread *thread, threads)
+        thread->start();
+    progressTimer->start();
+    QTimer::singleShot((int)(warmup * 1000), this, SLOT(onMeasureStart()));
+    QTimer::singleShot((int)((warmup + duration) * 1000), this, SLOT(onFinish()));
+}
+
+void BenchRunner::onMeasureStart()
+{
+    if (config.serverPid > 0)
+        serverAtStart = ProcessSample::take(config.serverPid);
+}
+
+// slot
+void BenchRunner::startStormRound()
+{
+    stormRound++;
+    stormBase = collectStats();
+    stormStartUsec = clock.nsecsElapsed() / 1000;
+    foreach (BenchWorker *worker, workers)
+        QMetaObject::invokeMethod(worker, "startStormRound", Qt::QueuedConnection, Q_ARG(int, stormRound));
+    stormTimer->start();
+}
+
+// slot
+void BenchRunner::checkStormRound()
+{
+    quint64 now = clock.nsecsElapsed() / 1000;
+    bool isComplete = true;
+    quint64 doneUsec = stormStartUsec;
+    foreach (BenchWorker *worker, workers)
+    {
+        BenchStats stats = worker->getStats();
+        if (stats.stormRound != stormRound)
+            isComplete = false;
+        else
+            doneUsec = qMax(doneUsec, stats.stormDoneUsec);
+    }
+    if (!isComplete && now - stormStartUsec < stormRoundTimeoutUsec)
+        return;
+    stormTimer->stop();
+    if (!isComplete)
+        doneUsec = now;
+    // the round lasts until the last client of all the workers is through
+    BenchStats stats = collectStats();
+    QJsonObject round;
+    round["registrations"] = (double)(stats.registrations - stormBase.registrations);
+    round["connectFailures"] = (double)(stats.connectFailures - stormBase.connectFailures);
+    round["serverErrors"] = (double)(stats.serverErrors - stormBase.serverErrors);
+    round["durationUsec"] = (double)(doneUsec - stormStartUsec);
+    round["isComplete"] = isComplete;
+    stormRounds.append(round);
+    stormRoundTimes.add(doneUsec - stormStartUsec);
+    QTextStream err(stderr);
+    err << QString("storm round %1: %2/%3 clients registered in %4 ms%5")
+           .arg(stormRound).arg(round["registrations"].toDouble()).arg(config.clientsCount)
+           .arg((doneUsec - stormStartUsec) / 1000.0, 0, 'f', 1)
+           .arg(isComplete ? QString() : QString(", timed out")) << endl;
+
+    foreach (BenchWorker *worker, workers)
+        QMetaObject::invokeMethod(worker, "endStormRound", Qt::QueuedConnection);
+    if (stormRound < config.stormRounds)
+        QTimer::singleShot(stormPauseMsec, this, SLOT(startStormRound()));
+    else
+        onFinish();
+}
+
+BenchStats BenchRunner::collectStats()
+{
+    BenchStats total;
+    foreach (BenchWorker *worker, workers)
+        total.merge(worker->getStats());
+    return total;
+}
+
+void BenchRunner::onProgress()
+{
+    // the progress goes to stderr, the output is left for the summary
+    BenchStats stats = collectStats();
+    QTextStream err(stderr);
+    err << QString("%1 s: %2/%3 clients, %4 delivered/s, p50 %5 us, p99 %6 us")
+           .arg(clock.elapsed() / 1000).arg(stats.readyClients).arg(config.clientsCount)
+           .arg(stats.deliveries - lastDeliveries)
+           .arg(stats.latency.percentile(50)).arg(stats.latency.percentile(99)) << endl;
+    lastDeliveries = stats.deliveries;
+}
+
+void BenchRunner::onFinish()
+{
+    progressTimer->stop();
+    double measuredSec = clock.nsecsElapsed() / 1e9 - (config.stormRounds > 0 ? 0 : warmup);
+    if (config.serverPid > 0)
+        serverAtEnd = ProcessSample::take(config.serverPid);
+    foreach (BenchWorker *worker, workers)
+        QMetaObject::invokeMethod(worker, "stop", Qt::BlockingQueuedConnection);
+    finalStats = collectStats();
+    makeSummary(measuredSec);
+    emit finished();
+}
+
+static QJsonObject compareValues(double now, double baseline)
+{
+    QJsonObject object;
+    object["baseline"] = baseline;
+    object["now"] = now;
+    object["changePercent"] = baseline != 0 ? (now - baseline) * 100 / baseline : 0;
+    return object;
+}
+
+QJsonObject BenchRunner::compareSummaries(const QJsonObject &summary, const QJsonObject &baseline)
+{
+    QJsonObject delivered = summary["delivered"].toObject();
+    QJsonObject baselineDelivered = baseline["delivered"].toObject();
+    QJsonObject latency = delivered["latencyUsec"].toObject();
+    QJsonObject baselineLatency = baselineDelivered["latencyUsec"].toObject();
+    QJsonObject comparison;
+    // the storm runs are compared by the accept latency and the length of the rounds
+    QJsonObject storm = summary["storm"].toObject();
+    QJsonObject baselineStorm = baseline["storm"].toObject();
+    if (!storm.isEmpty() && !baselineStorm.isEmpty())
+    {
+        QJsonObject accept = storm["acceptLatencyUsec"].toObject();
+        QJsonObject baselineAccept = baselineStorm["acceptLatencyUsec"].toObject();
+        QJsonObject rounds = storm["roundUsec"].toObject();
+        QJsonObject baselineRounds = baselineStorm["roundUsec"].toObject();
+        comparison["acceptP50Usec"] = compareValues(accept["p50"].toDouble(), baselineAccept["p50"].toDouble());
+        comparison["acceptP99Usec"] = compareValues(accept["p99"].toDouble(), baselineAccept["p99"].toDouble());
+        comparison["acceptMaxUsec"] = compareValues(accept["max"].toDouble(), baselineAccept["max"].toDouble());
+        comparison["roundP50Usec"] = compareValues(rounds["p50"].toDouble(), baselineRounds["p50"].toDouble());
+        comparison["roundMaxUsec"] = compareValues(rounds["max"].toDouble(), baselineRounds["max"].toDouble());
+        return comparison;
+    }
+    comparison["sentPerSec"] = compareValues(summary["sent"].toObject()["messagesPerSec"].toDouble(),
+                                             baseline["sent"].toObject()["messagesPerSec"].toDouble());
+    comparison["deliveredPerSec"] = compareValues(delivered["messagesPerSec"].toDouble(),
+                                                  baselineDelivered["messagesPerSec"].toDouble());
+    const char *percentiles[] = {"p50", "p99", "p999"};
+    for (int i = 0; i < 3; ++i)
+        comparison[QString(percentiles[i]) + "Usec"] = compareValues(latency[percentiles[i]].toDouble(),
+                                                                      baselineLatency[percentiles[i]].toDouble());
+    // the cost on the server side, when both runs have sampled it
+    QJsonObject server = summary["server"].toObject();
+    QJsonObject baselineServer = baseline["server"].toObject();
+    if (!server.isEmpty() && !baselineServer.isEmpty())
+    {
+        comparison["serverPeakRssKb"] = compareValues(server["peakRssKb"].toDouble(),
+                                                      baselineServer["peakRssKb"].toDouble());
+        comparison["serverCpuUsecPerDelivery"] = compareValues(server["cpuUsecPerDelivery"].toDouble(),
+                                                               baselineServer["cpuUsecPerDelivery"].toDouble());
+    }
+    return comparison;
+}
+
+void BenchRunner::makeSummary(double measuredSec)
+{
+    const BenchStats &stats = finalStats;
+    QJsonObject configObject;
+    configObject["address"] = config.address.toString();
+    configObject["port"] = config.port;
+    configObject["clients"] = config.clientsCount;
+    configObject["threads"] = workers.size();
+    configObject["connectRate"] = config.connectRate;
+    configObject["messageRate"] = config.messageRate;
+    configObject["fanout"] = config.fanout;
+    configObject["messageSize"] = config.messageSize;
+    configObject["churnRate"] = config.churnRate;
+    configObject["warmupSec"] = warmup;
+    configObject["durationSec"] = duration;
+    if (config.serverPid > 0)
+        configObject["serverPid"] = (double)config.serverPid;
+    if (config.stormRounds > 0)
+        configObject["stormRounds"] = config.stormRounds;
+    if (config.listeners > 0)
+        configObject["listeners"] = config.listeners;
+    if (config.floodersCount > 0)
+    {
+        configObject["flooders"] = config.floodersCount;
+        configObject["floodRate"] = config.floodRate;
+    }
+
+    QJsonObject connections;
+    connections["registered"] = stats.readyClients;
+    connections["registrations"] = (double)stats.registrations;
+    connections["connectFailures"] = (double)stats.connectFailures;
+    connections["disconnects"] = (double)stats.disconnects;
+    connections["reconnects"] = (double)stats.reconnects;
+    connections["serverErrors"] = (double)stats.serverErrors;
+    connections["connectLatencyUsec"] = histogramToJson(stats.connectLatency);
+    connections["acceptLatencyUsec"] = histogramToJson(stats.acceptLatency);
+
+    QJsonObject sent;
+    sent["messages"] = (double)stats.messagesSent;
+    sent["bytes"] = (double)stats.bytesSent;
+    sent["skipped"] = (double)stats.sendsSkipped;
+    sent["messagesPerSec"] = stats.messagesSent / measuredSec;
+    sent["slowDowns"] = (double)stats.slowDowns;
+
+    QJsonObject delivered;
+    delivered["messages"] = (double)stats.deliveries;
+    delivered["bytes"] = (double)stats.bytesReceived;
+    delivered["messagesPerSec"] = stats.deliveries / measuredSec;
+    delivered["bytesPerSec"] = stats.bytesReceived / measuredSec;
+    delivered["latencyUsec"] = histogramToJson(stats.latency);
+
+    summary = QJsonObject();
+    summary["config"] = configObject;
+    summary["measuredSec"] = measuredSec;
+    summary["connections"] = connections;
+    summary["sent"] = sent;
+    summary["delivered"] = delivered;
+    if (config.floodersCount > 0)
+    {
+        // the deliveries per message sent tell whether the server has throttled a side,
+        // the others should get about the fan-out, the flooders much less
+        QJsonObject flood;
+        flood["messages"] = (double)stats.floodSent;
+        flood["bytes"] = (double)stats.floodBytesSent;
+        flood["messagesPerSec"] = stats.floodSent / measuredSec;
+        flood["slowDowns"] = (double)stats.floodSlowDowns;
+        flood["deliveries"] = (double)stats.floodDeliveries;
+        flood["deliveriesPerSec"] = stats.floodDeliveries / measuredSec;
+        flood["deliveriesPerMessage"] = stats.floodSent > 0 ? (double)stats.floodDeliveries / stats.floodSent : 0;
+        flood["latencyUsec"] = histogramToJson(stats.floodLatency);
+        summary["flood"] = flood;
+        delivered["deliveriesPerMessage"] = stats.messagesSent > 0 ? (double)stats.deliveries / stats.messagesSent : 0;
+        summary["delivered"] = delivered;
+    }
+    if (config.stormRounds > 0)
+    {
+        QJsonObject storm;
+        storm["listeners"] = config.listeners;
+        storm["rounds"] = stormRounds;
+        storm["roundUsec"] = histogramToJson(stormRoundTimes);
+        storm["acceptLatencyUsec"] = histogramToJson(stats.acceptLatency);
+        storm["registerLatencyUsec"] = histogramToJson(stats.connectLatency);
+        summary["storm"] = storm;
+    }
+
+    if (serverAtStart.isValid && serverAtEnd.isValid)
+    {
+        // the CPU time is of the measured part only, the memory is what the server holds at the end
+        qint64 userMsec = serverAtEnd.userCpuMsec - serverAtStart.userCpuMsec;
+        qint64 systemMsec = serverAtEnd.systemCpuMsec - serverAtStart.systemCpuMsec;
+        QJsonObject server;
+        server["rssKb"] = (double)serverAtEnd.rssKb;
+        server["peakRssKb"] = (double)serverAtEnd.peakRssKb;
+        server["userCpuMsec"] = (double)userMsec;
+        server["systemCpuMsec"] = (double)systemMsec;
+        server["cpuPercent"] = (userMsec + systemMsec) / (measuredSec * 10);
+        server["cpuUsecPerDelivery"] = stats.deliveries > 0 ? (userMsec + systemMsec) * 1000.0 / stats.deliveries : 0;
+        server["voluntarySwitches"] = (double)(serverAtEnd.voluntarySwitches - serverAtStart.voluntarySwitches);
+        server["involuntarySwitches"] = (double)(serverAtEnd.involuntarySwitches - serverAtStart.involuntarySwitches);
+        summary["server"] = server;
+    }
+}
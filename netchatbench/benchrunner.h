@@ -0,0 +1,71 @@
+#ifndef BENCHRUNNER_H
+#define BENCHRUNNER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QVector>
+
+#include "benchworker.h"
+#include "processsampler.h"
+
+class QThread;
+class QTimer;
+
+// the workers and their threads for one run: the warm-up, the measured part and the summary,
+// or the rounds of a connect storm
+class BenchRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    BenchRunner(const BenchConfig &benchConfig, int threadsCount, double warmupSec, double durationSec,
+                QObject *parent = 0);
+    ~BenchRunner();
+
+    void start();
+    // valid once finished() is emitted
+    QJsonObject getSummary() const {return this->summary;}
+    qint64 getRegistrations() const {return this->finalStats.registrations;}
+    // the rates and the latencies of a summary against the ones of an earlier run, e.g. of a server
+    // with the journal off: {"deliveredPerSec": {"baseline", "now", "changePercent"}, ...}
+    static QJsonObject compareSummaries(const QJsonObject &summary, const QJsonObject &baseline);
+
+signals:
+    void finished();
+
+private:
+    BenchConfig config;
+    double warmup;
+    double duration;
+    // one clock for every thread, the send times in the messages are compared across them
+    QElapsedTimer clock;
+    QVector<BenchWorker *> workers;
+    QVector<QThread *> threads;
+    QTimer *progressTimer;
+    qint64 lastDeliveries;
+    BenchStats finalStats;
+    QJsonObject summary;
+    ProcessSample serverAtStart;
+    ProcessSample serverAtEnd;
+    QTimer *stormTimer;
+    int stormRound;
+    quint64 stormStartUsec;
+    // the totals when the round started, the round gets the difference
+    BenchStats stormBase;
+    LatencyHistogram stormRoundTimes;
+    QJsonArray stormRounds;
+
+    BenchStats collectStats();
+    void makeSummary(double measuredSec);
+
+private slots:
+    void onMeasureStart();
+    void startStormRound();
+    void checkStormRound();
+    void onProgress();
+    void onFinish();
+};
+
+#endif // BENCHRUNNER_H
@@ -0,0 +1,372 @@
+#include <QTimer>
+#include <QMutexLocker>
+#include <QSet>
+#include <QtGlobal>
+
+#include "benchworker.h"
+#include "benchclient.h"
+
+// the pace of the connects and the sends
+static const int tickMsec = 10;
+// the stats are copied for the main thread that often
+static const quint64 publishIntervalUsec = 250 * 1000;
+// a client the server doesn't read from skips its turns instead of buffering without end
+static const qint64 maxBytesToWrite = 1024 * 1024;
+
+BenchStats::BenchStats()
+{
+    readyClients = 0;
+    registrations = 0;
+    connectFailures = 0;
+    disconnects = 0;
+    reconnects = 0;
+    serverErrors = 0;
+    messagesSent = 0;
+    bytesSent = 0;
+    sendsSkipped = 0;
+    deliveries = 0;
+    bytesReceived = 0;
+    slowDowns = 0;
+    floodSent = 0;
+    floodBytesSent = 0;
+    floodDeliveries = 0;
+    floodSlowDowns = 0;
+    stormRound = 0;
+    stormDoneUsec = 0;
+}
+
+void BenchStats::merge(const BenchStats &other)
+{
+    readyClients += other.readyClients;
+    registrations += other.registrations;
+    connectFailures += other.connectFailures;
+    disconnects += other.disconnects;
+    reconnects += other.reconnects;
+    serverErrors += other.serverErrors;
+    connectLatency.merge(other.connectLatency);
+    acceptLatency.merge(other.acceptLatency);
+    messagesSent += other.messagesSent;
+    bytesSent += other.bytesSent;
+    sendsSkipped += other.sendsSkipped;
+    deliveries += other.deliveries;
+    bytesReceived += other.bytesReceived;
+    slowDowns += other.slowDowns;
+    latency.merge(other.latency);
+    floodSent += other.floodSent;
+    floodBytesSent += other.floodBytesSent;
+    floodDeliveries += other.floodDeliveries;
+    floodSlowDowns += other.floodSlowDowns;
+    floodLatency.merge(other.floodLatency);
+}
+
+BenchWorker::BenchWorker(const BenchConfig &benchConfig, int firstIndex, int count, double rateShare,
+                         const QElapsedTimer *clockPtr, QObject *parent) :
+    QObject(parent), config(benchConfig), firstClientIndex(firstIndex), clientsCount(count),
+    share(rateShare), clock(clockPtr), measureFromUsec(Q_UINT64_C(0xffffffffffffffff))
+{
+    tickTimer = 0;
+    lastTickUsec = 0;
+    lastPublishUsec = 0;
+    nextConnectIndex = 0;
+    nextSenderIndex = 0;
+    nextFlooderIndex = 0;
+    connectBudget = 0;
+    messageBudget = 0;
+    churnBudget = 0;
+    floodBudget = 0;
+    stormRound = 0;
+    stormPending = 0;
+    textTemplate = QByteArray(config.messageSize, 'x');
+}
+
+BenchWorker::~BenchWorker()
+{
+    qDeleteAll(clients);
+}
+
+void BenchWorker::start()
+{
+    // everything is created in the thread of the worker, the sockets belong to it
+    qsrand(firstClientIndex + 1);
+    for (int i = 0; i < clientsCount; ++i)
+    {
+        BenchClient *client = new BenchClient(this, config.namePrefix + QString::number(firstClientIndex + i));
+        client->isFlooder = firstClientIndex + i < config.floodersCount;
+        clients.append(client);
+    }
+    // the storm rounds connect the clients, not the ticks
+    if (config.stormRounds > 0)
+        nextConnectIndex = clients.size();
+    tickTimer = new QTimer(this);
+    connect(tickTimer, SIGNAL(timeout()), this, SLOT(onTick()));
+    tickTimer->start(tickMsec);
+    lastTickUsec = nowUsec();
+    lastPublishUsec = lastTickUsec;
+    onTick();
+}
+
+void BenchWorker::stop()
+{
+    tickTimer->stop();
+    publish();
+    // the sockets go away in their own thread
+    foreach (BenchClient *client, clients)
+        client->abortConnection();
+    qDeleteAll(clients);
+    clients.clear();
+}
+
+BenchStats BenchWorker::getStats()
+{
+    QMutexLocker locker(&publishedMutex);
+    return published;
+}
+
+void BenchWorker::publish()
+{
+    stats.readyClients = readyClients.size();
+    QMutexLocker locker(&publishedMutex);
+    published = stats;
+}
+
+void BenchWorker::onTick()
+{
+    quint64 now = nowUsec();
+    double seconds = (now - lastTickUsec) / 1e6;
+    lastTickUsec = now;
+    startConnects(seconds);
+    churn(seconds);
+    sendMessages(now, seconds);
+    sendFlood(now, seconds);
+    if (now - lastPublishUsec >= publishIntervalUsec)
+    {
+        lastPublishUsec = now;
+        publish();
+    }
+}
+
+void BenchWorker::startConnects(double seconds)
+{
+    if (nextConnectIndex >= clients.size())
+        return;
+    int count = clients.size() - nextConnectIndex;
+    if (config.connectRate > 0)
+    {
+        connectBudget += config.connectRate * share * seconds;
+        count = qMin(count, (int)connectBudget);
+        connectBudget -= count;
+    }
+    for (int i = 0; i < count; ++i)
+        clients.at(nextConnectIndex++)->connectToServer();
+}
+
+void BenchWorker::startStormRound(int round)
+{
+    foreach (BenchClient *client, clients)
+        client->abortConnection();
+    // every client is pending before the first connect, so a quick failure doesn't end the round early
+    stormRound = round;
+    stormPending = clients.size();
+    foreach (BenchClient *client, clients)
+        client->isStormPending = true;
+    foreach (BenchClient *client, clients)
+        client->connectToServer();
+    if (stormPending == 0)
+        onStormSettled();
+}
+
+void BenchWorker::endStormRound()
+{
+    foreach (BenchClient *client, clients)
+        client->abortConnection();
+    publish();
+}
+
+void BenchWorker::onStormSettled()
+{
+    if (stormPending > 0)
+        stormPending--;
+    if (stormPending > 0)
+        return;
+    stats.stormRound = stormRound;
+    stats.stormDoneUsec = nowUsec();
+    // the runner waits for it
+    publish();
+}
+
+void BenchWorker::churn(double seconds)
+{
+    if (config.churnRate <= 0)
+        return;
+    churnBudget += config.churnRate * share * seconds;
+    // a reconnect storm: the dropped clients connect again at once
+    for (; churnBudget >= 1 && !readyClients.isEmpty(); churnBudget -= 1)
+    {
+        BenchClient *client = readyClients.at(qrand() % readyClients.size());
+        client->abortConnection();
+        client->connectToServer();
+        stats.reconnects++;
+    }
+    // no budget is saved up while nobody is connected
+    churnBudget = qMin(churnBudget, 1.0);
+}
+
+void BenchWorker::sendMessages(quint64 now, double seconds)
+{
+    // the flooders don't take the turns of the others
+    if (readyClients.size() == readyFlooders.size() || config.messageRate <= 0)
+        return;
+    messageBudget += config.messageRate * share * seconds;
+    // a stalled thread catches up a second's worth at most
+    messageBudget = qMin(messageBudget, qMax(1.0, config.messageRate * share));
+    bool measured = isMeasuring(now);
+    for (; messageBudget >= 1; messageBudget -= 1)
+    {
+        do
+            nextSenderIndex = (nextSenderIndex + 1) % readyClients.size();
+        while (readyClients.at(nextSenderIndex)->isFlooder);
+        sendOne(nextSenderIndex, false, measured);
+    }
+}
+
+void BenchWorker::sendFlood(quint64 now, double seconds)
+{
+    if (readyFlooders.isEmpty() || config.floodRate <= 0)
+        return;
+    double rate = config.floodRate * readyFlooders.size();
+    floodBudget += rate * seconds;
+    floodBudget = qMin(floodBudget, qMax(1.0, rate));
+    bool measured = isMeasuring(now);
+    for (; floodBudget >= 1; floodBudget -= 1)
+    {
+        nextFlooderIndex = (nextFlooderIndex + 1) % readyFlooders.size();
+        sendOne(readyFlooders.at(nextFlooderIndex)->readyIndex, true, measured);
+    }
+}
+
+void BenchWorker::sendOne(int senderIndex, bool isFlood, bool measured)
+{
+    BenchClient *sender = readyClients.at(senderIndex);
+    if (sender->bytesToWrite() > maxBytesToWrite)
+    {
+        if (measured)
+            stats.sendsSkipped++;
+        return;
+    }
+    QList<quint32> receiverIds;
+    if (config.fanout > 0)
+    {
+        if (config.fanout >= readyClients.size() - 1)
+        {
+            foreach (BenchClient *client, readyClients)
+                if (client != sender)
+                    receiverIds.append(client->getSessionId());
+        }
+        else
+        {
+            QSet<int> picked;
+            picked.insert(senderIndex);
+            while (receiverIds.size() < config.fanout)
+            {
+                int index = qrand() % readyClients.size();
+                if (picked.contains(index))
+                    continue;
+                picked.insert(index);
+                receiverIds.append(readyClients.at(index)->getSessionId());
+            }
+        }
+        // nobody else to send to yet
+        if (receiverIds.isEmpty())
+            return;
+    }
+    QByteArray stamp = QByteArray::number(nowUsec()) + (isFlood ? 'f' : ' ');
+    QByteArray text = textTemplate;
+    text.replace(0, qMin(stamp.size(), text.size()), stamp);
+    sender->sendMessage(receiverIds, text);
+    if (measured && isFlood)
+    {
+        stats.floodSent++;
+        stats.floodBytesSent += text.size();
+    }
+    else if (measured)
+    {
+        stats.messagesSent++;
+        stats.bytesSent += text.size();
+    }
+}
+
+void BenchWorker::onAccepted(quint64 connectUsec)
+{
+    stats.acceptLatency.add(connectUsec);
+}
+
+void BenchWorker::onRegistered(BenchClient *client, quint64 connectUsec)
+{
+    client->readyIndex = readyClients.size();
+    readyClients.append(client);
+    if (client->isFlooder)
+        readyFlooders.append(client);
+    stats.registrations++;
+    stats.connectLatency.add(connectUsec);
+}
+
+void BenchWorker::onNotReady(BenchClient *client)
+{
+    // the last one takes the place of the removed one
+    int index = client->readyIndex;
+    if (index < 0)
+        return;
+    BenchClient *last = readyClients.last();
+    readyClients[index] = last;
+    last->readyIndex = index;
+    readyClients.removeLast();
+    client->readyIndex = -1;
+    if (client->isFlooder)
+        readyFlooders.remove(readyFlooders.indexOf(client));
+}
+
+void BenchWorker::onConnectFailed()
+{
+    stats.connectFailures++;
+}
+
+void BenchWorker::onDisconnected()
+{
+    stats.disconnects++;
+}
+
+void BenchWorker::onServerError()
+{
+    stats.serverErrors++;
+}
+
+void BenchWorker::onBytesReceived(int size)
+{
+    if (isMeasuring(nowUsec()))
+        stats.bytesReceived += size;
+}
+
+void BenchWorker::onDelivered(quint64 sentUsec, bool isFlood)
+{
+    // the messages sent during the warm-up don't count
+    if (!isMeasuring(sentUsec))
+        return;
+    if (isFlood)
+    {
+        stats.floodDeliveries++;
+        stats.floodLatency.add(nowUsec() - sentUsec);
+        return;
+    }
+    stats.deliveries++;
+    stats.latency.add(nowUsec() - sentUsec);
+}
+
+void BenchWorker::onSlowDown(BenchClient *client)
+{
+    if (!isMeasuring(nowUsec()))
+        return;
+    if (client->isFlooder)
+        stats.floodSlowDowns++;
+    else
+        stats.slowDowns++;
+}
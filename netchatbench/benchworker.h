@@ -0,0 +1,160 @@
+#ifndef BENCHWORKER_H
+#define BENCHWORKER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QMutex>
+#include <QVector>
+#include <QAtomicInteger>
+
+#include "latencyhistogram.h"
+
+class QTimer;
+class BenchClient;
+
+struct BenchConfig
+{
+    QHostAddress address;
+    quint16 port;
+    int clientsCount;
+    // the rates are of all the clients together, 0 connects all the clients at once
+    double connectRate;
+    double messageRate;
+    // the receivers of every message, 0 - to all
+    int fanout;
+    int messageSize;
+    // the registered clients dropped and connected again per second
+    double churnRate;
+    QString namePrefix;
+    // the server process sampled at the start and the end of the measured part, 0 - none
+    qint64 serverPid;
+    // the rounds of the connect storm, 0 - the usual run: every round connects all the clients at once
+    // and drops them once they're all registered, nothing is sent
+    int stormRounds;
+    // the listeners of the server, only recorded in the summary to tell the storm runs apart, 0 - unknown
+    int listeners;
+    // the first clients send floodRate messages per second each on top of the message rate of the others,
+    // their messages are counted apart
+    int floodersCount;
+    double floodRate;
+};
+
+struct BenchStats
+{
+    // the connections are counted from the start
+    int readyClients;
+    qint64 registrations;
+    qint64 connectFailures;
+    qint64 disconnects;
+    qint64 reconnects;
+    qint64 serverErrors;
+    LatencyHistogram connectLatency;
+    // from the connect to the first frame of the server: the connection has been accepted and read
+    LatencyHistogram acceptLatency;
+    // the last storm round all the clients of the worker have been through and when, not merged
+    int stormRound;
+    quint64 stormDoneUsec;
+    // the messages are counted once the warm-up is over
+    qint64 messagesSent;
+    qint64 bytesSent;
+    qint64 sendsSkipped;
+    qint64 deliveries;
+    qint64 bytesReceived;
+    qint64 slowDowns;
+    LatencyHistogram latency;
+    // the same for the messages of the flooders, the ones above are of the others then
+    qint64 floodSent;
+    qint64 floodBytesSent;
+    qint64 floodDeliveries;
+    qint64 floodSlowDowns;
+    LatencyHistogram floodLatency;
+
+    BenchStats();
+    void merge(const BenchStats &other);
+};
+
+// the clients of one thread and the timer that paces their connects and messages
+class BenchWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    // the worker runs its share of the rates on clients firstIndex..firstIndex+count-1
+    BenchWorker(const BenchConfig &benchConfig, int firstIndex, int count, double rateShare,
+                const QElapsedTimer *clockPtr, QObject *parent = 0);
+    ~BenchWorker();
+
+    const BenchConfig &getConfig() const {return this->config;}
+    quint64 nowUsec() const {return this->clock->nsecsElapsed() / 1000;}
+    // the messages sent from then on are measured, may be called from any thread
+    void startMeasuring(quint64 fromUsec) {this->measureFromUsec.store(fromUsec);}
+    // a copy of the stats of the last tick, may be called from any thread
+    BenchStats getStats();
+
+    // called by the clients
+    void onAccepted(quint64 connectUsec);
+    void onRegistered(BenchClient *client, quint64 connectUsec);
+    void onNotReady(BenchClient *client);
+    void onConnectFailed();
+    void onDisconnected();
+    // an error frame or a server too old for the bench
+    void onServerError();
+    void onBytesReceived(int size);
+    void onDelivered(quint64 sentUsec, bool isFlood);
+    void onSlowDown(BenchClient *client);
+    // the client of the storm round is registered or has failed
+    void onStormSettled();
+
+public slots:
+    void start();
+    // the clients are dropped and connected again all at once
+    void startStormRound(int round);
+    void endStormRound();
+    // closes every connection and publishes the final stats
+    void stop();
+
+private slots:
+    void onTick();
+
+private:
+    BenchConfig config;
+    int firstClientIndex;
+    int clientsCount;
+    double share;
+    const QElapsedTimer *clock;
+    QAtomicInteger<quint64> measureFromUsec;
+    QTimer *tickTimer;
+    quint64 lastTickUsec;
+    quint64 lastPublishUsec;
+    QVector<BenchClient *> clients;
+    // the registered clients, the senders and the receivers are picked from them
+    QVector<BenchClient *> readyClients;
+    // the registered flooders, a part of the ready clients
+    QVector<BenchClient *> readyFlooders;
+    int nextConnectIndex;
+    int nextSenderIndex;
+    int nextFlooderIndex;
+    double connectBudget;
+    double messageBudget;
+    double churnBudget;
+    double floodBudget;
+    int stormRound;
+    int stormPending;
+    // the text every message is cut from, the send time goes in front
+    QByteArray textTemplate;
+    BenchStats stats;
+    QMutex publishedMutex;
+    BenchStats published;
+
+    bool isMeasuring(quint64 sentUsec) const {return sentUsec >= this->measureFromUsec.load();}
+    void startConnects(double seconds);
+    void sendMessages(quint64 now, double seconds);
+    void sendFlood(quint64 now, double seconds);
+    // skipped if the sender's socket is full or there's nobody to send to
+    void sendOne(int senderIndex, bool isFlood, bool measured);
+    void churn(double seconds);
+    void publish();
+};
+
+#endif // BENCHWORKER_H
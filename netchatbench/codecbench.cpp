@@ -0,0 +1,367 @@
+#include <QElapsedTimer>
+#include <QHash>
+#include <QUuid>
+
+#include "codecbench.h"
+#include "allocationcounter.h"
+#include "framecodec.h"
+#include "constants.h"
+
+// the fields a case builds its frame from, all made before the timing
+struct CodecInput
+{
+    int payloadSize;
+    QString text;
+    QByteArray utf8;
+    QString uuid;
+    QString name;
+    QList<quint32> receiverIds;
+};
+
+typedef QByteArray (*EncodeFunction)(const CodecInput &input);
+// returns something from the fields read, so nothing is optimized away
+typedef quint64 (*DecodeFunction)(FrameReader &in);
+
+struct CodecCase
+{
+    const char *name;
+    EncodeFunction encode;
+    DecodeFunction decode;
+    // the payload sizes don't matter for the fixed size commands
+    bool hasPayload;
+};
+
+static QByteArray encodeCommand(const CodecInput &input)
+{
+    Q_UNUSED(input);
+    return FrameBuilder(Constants::comHeartbeat).finish();
+}
+
+static quint64 decodeCommand(FrameReader &in)
+{
+    return in.readUInt8();
+}
+
+static QByteArray encodeRegisterRequest(const CodecInput &input)
+{
+    return FrameBuilder(Constants::comRegisterRequest).appendUtf8String(input.uuid)
+            .appendUtf8String(input.name).finish();
+}
+
+static quint64 decodeRegisterRequest(FrameReader &in)
+{
+    in.readUInt8();
+    return in.readUtf8String().size() + in.readUtf8String().size();
+}
+
+static QByteArray encodeRegistrationSuccess(const CodecInput &input)
+{
+    Q_UNUSED(input);
+    return FrameBuilder(Constants::comRegistrationSuccess).appendUInt32(42).finish();
+}
+
+static quint64 decodeUInt32Command(FrameReader &in)
+{
+    in.readUInt8();
+    return in.readUInt32();
+}
+
+static QByteArray encodeProtocolAccepted(const CodecInput &input)
+{
+    Q_UNUSED(input);
+    return FrameBuilder(Constants::comProtocolAccepted).appendUInt8(Constants::protocolVersion).finish();
+}
+
+static quint64 decodeProtocolAccepted(FrameReader &in)
+{
+    in.readUInt8();
+    return in.readUInt8();
+}
+
+static QByteArray encodeRegisteredClients(const CodecInput &input)
+{
+    // a roster page of payloadSize / 64 clients, about the size of an entry
+    FrameBuilder frame(Constants::comRegisteredClients);
+    quint32 count = qMax(1, input.payloadSize / 64);
+    frame.appendUInt32(count);
+    for (quint32 i = 0; i < count; ++i)
+        frame.appendUInt32(i + 1).appendUtf8String(input.uuid).appendUtf8String(input.name);
+    return frame.finish();
+}
+
+static quint64 decodeRegisteredClients(FrameReader &in)
+{
+    in.readUInt8();
+    quint32 count = in.readUInt32();
+    quint64 sum = 0;
+    for (quint32 i = 0; i < count && in.isOk(); ++i)
+    {
+        sum += in.readUInt32();
+        sum += in.readUtf8String().size() + in.readUtf8String().size();
+    }
+    return sum;
+}
+
+static QByteArray encodeClientJoined(const CodecInput &input)
+{
+    return FrameBuilder(Constants::comClientJoined).appendUInt32(42).appendUtf8String(input.uuid)
+            .appendUtf8String(input.name).finish();
+}
+
+static quint64 decodeClientJoined(FrameReader &in)
+{
+    in.readUInt8();
+    quint64 sum = in.readUInt32();
+    return sum + in.readUtf8String().size() + in.readUtf8String().size();
+}
+
+static QByteArray encodeClientLeft(const CodecInput &input)
+{
+    Q_UNUSED(input);
+    return FrameBuilder(Constants::comClientLeft).appendUInt32(42).finish();
+}
+
+static QByteArray encodeMessageToAllRequest(const CodecInput &input)
+{
+    // the client to the server: [text]
+    return FrameBuilder(Constants::comMessageToAll).appendUtf8String(input.text).finish();
+}
+
+static quint64 decodeMessageToAllRequest(FrameReader &in)
+{
+    // the server relays the UTF-8 bytes as they are
+    in.readUInt8();
+    return in.readUtf8().size();
+}
+
+static QByteArray encodeMessageToAllRelay(const CodecInput &input)
+{
+    // the server to the clients: [sender id][text], the bytes of the sender reused
+    return FrameBuilder(Constants::comMessageToAll, input.utf8.size() + 8).appendUInt32(42)
+            .appendUtf8(input.utf8).finish();
+}
+
+static quint64 decodeMessageToAllRelay(FrameReader &in)
+{
+    in.readUInt8();
+    quint64 sum = in.readUInt32();
+    return sum + in.readUtf8String().size();
+}
+
+static QByteArray encodeMessageToAllLegacy(const CodecInput &input)
+{
+    // protocol version 3: the UTF-16 of QDataStream
+    return FrameBuilder(Constants::comMessageToAll, input.text.size() * 2 + 8).appendUInt32(42)
+            .appendString(input.text).finish();
+}
+
+static quint64 decodeMessageToAllLegacy(FrameReader &in)
+{
+    in.readUInt8();
+    quint64 sum = in.readUInt32();
+    return sum + in.readString().size();
+}
+
+static QByteArray encodeMessageToClientsRelay(const CodecInput &input)
+{
+    return FrameBuilder(Constants::comMessageToClients, input.utf8.size() + input.receiverIds.size() * 4 + 12)
+            .appendUInt32(42).appendUInt32List(input.receiverIds).appendUtf8(input.utf8).finish();
+}
+
+static quint64 decodeMessageToClientsRelay(FrameReader &in)
+{
+    in.readUInt8();
+    quint64 sum = in.readUInt32();
+    sum += in.readUInt32List().size();
+    return sum + in.readUtf8String().size();
+}
+
+static QByteArray encodeMessageChunk(const CodecInput &input)
+{
+    // a first chunk to some clients
+    FrameBuilder frame(Constants::comMessageChunk, input.utf8.size() + input.receiverIds.size() * 4 + 20);
+    frame.appendUInt32(7).appendUInt8(Constants::chunkFirst).appendUInt32(42);
+    frame.appendUInt8(Constants::comMessageToClients).appendUInt32List(input.receiverIds);
+    return frame.appendUtf8(input.utf8).finish();
+}
+
+static quint64 decodeMessageChunk(FrameReader &in)
+{
+    in.readUInt8();
+    quint64 sum = in.readUInt32();
+    sum += in.readUInt8();
+    sum += in.readUInt32();
+    sum += in.readUInt8();
+    sum += in.readUInt32List().size();
+    return sum + in.readUtf8String().size();
+}
+
+static QByteArray encodeServerMessage(const CodecInput &input)
+{
+    return FrameBuilder(Constants::comPublicServerMessage).appendUtf8String(input.text).finish();
+}
+
+static quint64 decodeServerMessage(FrameReader &in)
+{
+    in.readUInt8();
+    return in.readUtf8String().size();
+}
+
+static QByteArray encodePing(const CodecInput &input)
+{
+    Q_UNUSED(input);
+    return FrameBuilder(Constants::comPingRequest).appendUInt32(7).appendUInt64(Q_UINT64_C(123456789)).finish();
+}
+
+static quint64 decodePing(FrameReader &in)
+{
+    in.readUInt8();
+    quint64 sum = in.readUInt32();
+    return sum + in.readUInt64();
+}
+
+static QByteArray encodeSlowDown(const CodecInput &input)
+{
+    Q_UNUSED(input);
+    return FrameBuilder(Constants::comSlowDown).appendUInt32(250).finish();
+}
+
+static const CodecCase codecCases[] = {
+    {"command", encodeCommand, decodeCommand, false},
+    {"registerRequest", encodeRegisterRequest, decodeRegisterRequest, false},
+    {"registrationSuccess", encodeRegistrationSuccess, decodeUInt32Command, false},
+    {"protocolAccepted", encodeProtocolAccepted, decodeProtocolAccepted, false},
+    {"registeredClients", encodeRegisteredClients, decodeRegisteredClients, true},
+    {"clientJoined", encodeClientJoined, decodeClientJoined, false},
+    {"clientLeft", encodeClientLeft, decodeUInt32Command, false},
+    {"messageToAllRequest", encodeMessageToAllRequest, decodeMessageToAllRequest, true},
+    {"messageToAllRelay", encodeMessageToAllRelay, decodeMessageToAllRelay, true},
+    {"messageToAllLegacy", encodeMessageToAllLegacy, decodeMessageToAllLegacy, true},
+    {"messageToClientsRelay", encodeMessageToClientsRelay, decodeMessageToClientsRelay, true},
+    {"messageChunk", encodeMessageChunk, decodeMessageChunk, true},
+    {"serverMessage", encodeServerMessage, decodeServerMessage, true},
+    {"pingRequest", encodePing, decodePing, false},
+    {"slowDown", encodeSlowDown, decodeUInt32Command, false}
+};
+
+// from a short line to the largest unchunked message and past the short size field
+static const int payloadSizes[] = {16, 256, 4096, 65536};
+
+// keeps the results of the timed loops alive
+static volatile quint64 sink;
+
+CodecBench::CodecBench(int minCaseMsec) : minCaseMsec(minCaseMsec)
+{
+}
+
+QJsonObject CodecBench::run()
+{
+    QJsonArray results;
+    QElapsedTimer timer;
+    for (size_t c = 0; c < sizeof(codecCases) / sizeof(codecCases[0]); ++c)
+    {
+        const CodecCase &codecCase = codecCases[c];
+        int sizesCount = codecCase.hasPayload ? sizeof(payloadSizes) / sizeof(payloadSizes[0]) : 1;
+        for (int s = 0; s < sizesCount; ++s)
+        {
+            CodecInput input;
+            input.payloadSize = codecCase.hasPayload ? payloadSizes[s] : 0;
+            input.text = QString(input.payloadSize, QChar('x'));
+            input.utf8 = input.text.toUtf8();
+            input.uuid = QUuid::createUuid().toString();
+            input.name = "bench_client";
+            for (quint32 i = 1; i <= 8; ++i)
+                input.receiverIds.append(i);
+
+            // encode: the frame is built from scratch every time, as the apps do
+            qint64 encodeCount = 0;
+            quint64 allocationsBefore = AllocationCounter::count();
+            timer.start();
+            do
+            {
+                for (int i = 0; i < 256; ++i)
+                    sink += codecCase.encode(input).size();
+                encodeCount += 256;
+            }
+            while (timer.elapsed() < minCaseMsec);
+            qint64 encodeNsec = timer.nsecsElapsed();
+            quint64 encodeAllocations = AllocationCounter::count() - allocationsBefore;
+
+            // decode: the bytes come into a decoder, get split and read field by field
+            QByteArray frame = codecCase.encode(input);
+            FrameDecoder decoder;
+            qint64 decodeCount = 0;
+            allocationsBefore = AllocationCounter::count();
+            timer.start();
+            do
+            {
+                for (int i = 0; i < 256; ++i)
+                {
+                    decoder.append(frame.constData(), frame.size());
+                    const char *data;
+                    int size;
+                    if (decoder.nextFrame(&data, &size))
+                    {
+                        FrameReader in(data, size);
+                        sink += codecCase.decode(in);
+                    }
+                }
+                decodeCount += 256;
+            }
+            while (timer.elapsed() < minCaseMsec);
+            qint64 decodeNsec = timer.nsecsElapsed();
+            quint64 decodeAllocations = AllocationCounter::count() - allocationsBefore;
+
+            QJsonObject result;
+            result["case"] = QString(codecCase.name);
+            result["payload"] = input.payloadSize;
+            result["frameBytes"] = frame.size();
+            result["encodeNs"] = (double)encodeNsec / encodeCount;
+            result["encodeAllocs"] = (double)encodeAllocations / encodeCount;
+            result["decodeNs"] = (double)decodeNsec / decodeCount;
+            result["decodeAllocs"] = (double)decodeAllocations / decodeCount;
+            results.append(result);
+        }
+    }
+    QJsonObject summary;
+    summary["allocationsCounted"] = AllocationCounter::isAvailable();
+    summary["codec"] = results;
+    return summary;
+}
+
+QStringList CodecBench::findRegressions(const QJsonObject &results, const QJsonObject &baseline,
+                                        double tolerancePercent)
+{
+    QHash<QString, QJsonObject> baselineCases;
+    foreach (const QJsonValue &value, baseline["codec"].toArray())
+    {
+        QJsonObject result = value.toObject();
+        baselineCases.insert(result["case"].toString() + "/" + QString::number(result["payload"].toInt()), result);
+    }
+    // the allocation counts are exact, the times are compared with the tolerance
+    bool compareAllocations = results["allocationsCounted"].toBool() && baseline["allocationsCounted"].toBool();
+    double factor = 1 + tolerancePercent / 100;
+    QStringList regressions;
+    foreach (const QJsonValue &value, results["codec"].toArray())
+    {
+        QJsonObject result = value.toObject();
+        QString key = result["case"].toString() + "/" + QString::number(result["payload"].toInt());
+        if (!baselineCases.contains(key))
+            continue;
+        const QJsonObject &old = baselineCases[key];
+        const char *fields[] = {"encodeNs", "decodeNs", "encodeAllocs", "decodeAllocs"};
+        for (int i = 0; i < 4; ++i)
+        {
+            bool isAllocations = i >= 2;
+            if (isAllocations && !compareAllocations)
+                continue;
+            double now = result[fields[i]].toDouble();
+            double before = old[fields[i]].toDouble();
+            // a fraction of an allocation is the amortized growth of the decoder buffer
+            if (isAllocations ? now > before + 0.05 : now > before * factor)
+                regressions.append(QString("%1 %2: %3 -> %4").arg(key).arg(fields[i])
+                                   .arg(before, 0, 'f', 2).arg(now, 0, 'f', 2));
+        }
+    }
+    return regressions;
+}
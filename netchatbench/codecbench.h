@@ -0,0 +1,26 @@
+#ifndef CODECBENCH_H
+#define CODECBENCH_H
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QStringList>
+
+// times the shared frame codec without any sockets: every command of the protocol is encoded
+// the way the apps build it and decoded the way the receivers read it, at several payload sizes
+class CodecBench
+{
+public:
+    // every case runs for at least that long
+    explicit CodecBench(int minCaseMsec);
+
+    // [{case, payload, frameBytes, encodeNs, encodeAllocs, decodeNs, decodeAllocs}...]
+    QJsonObject run();
+    // the cases slower than the baseline by more than tolerancePercent or allocating more
+    static QStringList findRegressions(const QJsonObject &results, const QJsonObject &baseline,
+                                       double tolerancePercent);
+
+private:
+    int minCaseMsec;
+};
+
+#endif // CODECBENCH_H
@@ -0,0 +1,86 @@
+#include <QtAlgorithms>
+#include <QtMath>
+
+#include "latencyhistogram.h"
+
+// 2^subBucketBits buckets per power of 2
+static const int subBucketBits = 5;
+static const int subBuckets = 1 << subBucketBits;
+
+LatencyHistogram::LatencyHistogram() : buckets(64 * subBuckets)
+{
+    clear();
+}
+
+int LatencyHistogram::bucketOf(quint64 usec)
+{
+    // the small values get a bucket each
+    if (usec < (quint64)subBuckets)
+        return (int)usec;
+    int shift = 63 - qCountLeadingZeroBits(usec) - subBucketBits;
+    return (shift + 1) * subBuckets + (int)(usec >> shift) - subBuckets;
+}
+
+quint64 LatencyHistogram::valueOf(int bucket)
+{
+    if (bucket < subBuckets)
+        return bucket;
+    int shift = bucket / subBuckets - 1;
+    quint64 low = (quint64)(bucket % subBuckets + subBuckets) << shift;
+    // the middle of the bucket
+    return low + (((quint64)1 << shift) >> 1);
+}
+
+void LatencyHistogram::add(quint64 usec)
+{
+    buckets[bucketOf(usec)]++;
+    if (count == 0 || usec < minValue)
+        minValue = usec;
+    if (usec > maxValue)
+        maxValue = usec;
+    sum += usec;
+    count++;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    if (other.count == 0)
+        return;
+    for (int i = 0; i < buckets.size(); ++i)
+        buckets[i] += other.buckets.at(i);
+    if (count == 0 || other.minValue < minValue)
+        minValue = other.minValue;
+    maxValue = qMax(maxValue, other.maxValue);
+    sum += other.sum;
+    count += other.count;
+}
+
+void LatencyHistogram::clear()
+{
+    buckets.fill(0);
+    count = 0;
+    minValue = 0;
+    maxValue = 0;
+    sum = 0;
+}
+
+double LatencyHistogram::getMean() const
+{
+    return count == 0 ? 0 : sum / count;
+}
+
+quint64 LatencyHistogram::percentile(double p) const
+{
+    if (count == 0)
+        return 0;
+    qint64 rank = qMax((qint64)1, (qint64)qCeil(p / 100 * count));
+    qint64 seen = 0;
+    for (int i = 0; i < buckets.size(); ++i)
+    {
+        seen += buckets.at(i);
+        if (seen >= rank)
+            // the exact extremes are known, the bucket middle may be past them
+            return qBound(getMin(), valueOf(i), maxValue);
+    }
+    return maxValue;
+}
@@ -0,0 +1,34 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QVector>
+
+// a log-linear histogram of microseconds: 32 buckets per power of 2, so any percentile
+// is within 3% of the exact one, the memory stays the same however many samples come
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void add(quint64 usec);
+    void merge(const LatencyHistogram &other);
+    void clear();
+    qint64 getCount() const {return this->count;}
+    quint64 getMin() const {return this->count == 0 ? 0 : this->minValue;}
+    quint64 getMax() const {return this->maxValue;}
+    double getMean() const;
+    // p from 0 to 100
+    quint64 percentile(double p) const;
+
+private:
+    QVector<qint64> buckets;
+    qint64 count;
+    quint64 minValue;
+    quint64 maxValue;
+    double sum;
+
+    static int bucketOf(quint64 usec);
+    static quint64 valueOf(int bucket);
+};
+
+#endif // LATENCYHISTOGRAM_H
@@ -0,0 +1,321 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QHostAddress>
+#include <QFile>
+#include <QJsonDocument>
+#include <QRegExp>
+#include <QTextStream>
+
+#include "benchrunner.h"
+#include "codecbench.h"
+#include "processsampler.h"
+
+// stdout unless a file is given
+static bool openOutput(QFile &output, const QString &fileName)
+{
+    if (fileName.isEmpty())
+        return output.open(stdout, QIODevice::WriteOnly);
+    output.setFileName(fileName);
+    if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qCritical("Cannot write to %s", qPrintable(fileName));
+        return false;
+    }
+    return true;
+}
+
+// the codec microbenchmark, no server needed
+static int runCodecBench(QFile &output, const QString &baselineFileName, double tolerance, int caseMsec)
+{
+    QJsonObject baseline;
+    if (!baselineFileName.isEmpty())
+    {
+        QFile baselineFile(baselineFileName);
+        if (!baselineFile.open(QIODevice::ReadOnly))
+        {
+            qCritical("Cannot read %s", qPrintable(baselineFileName));
+            return 1;
+        }
+        baseline = QJsonDocument::fromJson(baselineFile.readAll()).object();
+    }
+    QJsonObject results = CodecBench(caseMsec).run();
+    output.write(QJsonDocument(results).toJson());
+    output.close();
+    if (baselineFileName.isEmpty())
+        return 0;
+    QStringList regressions = CodecBench::findRegressions(results, baseline, tolerance);
+    foreach (const QString &regression, regressions)
+        qCritical("Regression: %s", qPrintable(regression));
+    return regressions.isEmpty() ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("netchatbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Load generator for the NetChat servers: simulated clients send "
+                                     "timestamped messages and measure the relay latency.");
+    parser.addHelpOption();
+    QCommandLineOption addressOption(QStringList() << "a" << "address",
+                                     "Server address.", "address", "127.0.0.1");
+    QCommandLineOption portOption(QStringList() << "p" << "port",
+                                  "Server port.", "port", "1616");
+    QCommandLineOption clientsOption(QStringList() << "c" << "clients",
+                                     "Number of simulated clients.", "count", "100");
+    QCommandLineOption threadsOption(QStringList() << "t" << "threads",
+                                     "Number of threads the clients are spread over.", "count", "1");
+    QCommandLineOption connectRateOption("connect-rate",
+                                         "New connections per second (0 - all at once).", "rate", "0");
+    QCommandLineOption messageRateOption(QStringList() << "r" << "rate",
+                                         "Messages per second of all the clients together.", "rate", "100");
+    QCommandLineOption fanoutOption(QStringList() << "f" << "fanout",
+                                    "Receivers of every message (0 - to all).", "count", "0");
+    QCommandLineOption sizeOption(QStringList() << "s" << "size",
+                                  "Message size in bytes.", "bytes", "100");
+    QCommandLineOption churnOption("churn",
+                                   "Registered clients dropped and connected again per second.", "rate", "0");
+    QCommandLineOption warmupOption("warmup",
+                                    "Seconds to connect and warm up before measuring.", "sec", "2");
+    QCommandLineOption durationOption(QStringList() << "d" << "duration",
+                                      "Seconds to measure.", "sec", "10");
+    QCommandLineOption namePrefixOption("name-prefix",
+                                        "The client names are the prefix and the client number.", "prefix", "bench");
+    QCommandLineOption serverPidOption("server-pid",
+                                       "Sample the memory and the CPU time of the server process "
+                                       "(Linux, the server on the same host).", "pid");
+    QCommandLineOption stormOption("storm",
+                                   "Connect storm: every round connects all the clients at once and drops them "
+                                   "once registered, the accept latency is measured, nothing is sent.", "rounds");
+    QCommandLineOption listenersOption("listeners",
+                                       "The listeners of the server, recorded in the summary of a storm.", "count");
+    QCommandLineOption floodersOption("flooders",
+                                      "The first clients flood the server at --flood-rate each, "
+                                      "their messages are counted apart from the others.", "count", "0");
+    QCommandLineOption floodRateOption("flood-rate",
+                                       "Messages per second of every flooder.", "rate", "1000");
+    QCommandLineOption outputOption(QStringList() << "o" << "output",
+                                    "Write the JSON summary to the file instead of stdout.", "file");
+    QCommandLineOption compareOption("compare",
+                                     "Compare the rates and the latencies with the summary of an earlier run.", "file");
+    QCommandLineOption codecOption("codec",
+                                   "Run the codec microbenchmark instead of the load test.");
+    QCommandLineOption codecBaselineOption("codec-baseline",
+                                           "Compare the codec results with an earlier output, "
+                                           "exit with 1 on a regression.", "file");
+    QCommandLineOption codecToleranceOption("codec-tolerance",
+                                            "Slowdown in percent not counted as a regression.", "pct", "25");
+    QCommandLineOption codecTimeOption("codec-time",
+                                       "Milliseconds to time every codec case for.", "msec", "200");
+    parser.addOption(addressOption);
+    parser.addOption(portOption);
+    parser.addOption(clientsOption);
+    parser.addOption(threadsOption);
+    parser.addOption(connectRateOption);
+    parser.addOption(messageRateOption);
+    parser.addOption(fanoutOption);
+    parser.addOption(sizeOption);
+    parser.addOption(churnOption);
+    parser.addOption(warmupOption);
+    parser.addOption(durationOption);
+    parser.addOption(namePrefixOption);
+    parser.addOption(serverPidOption);
+    parser.addOption(stormOption);
+    parser.addOption(listenersOption);
+    parser.addOption(floodersOption);
+    parser.addOption(floodRateOption);
+    parser.addOption(outputOption);
+    parser.addOption(compareOption);
+    parser.addOption(codecOption);
+    parser.addOption(codecBaselineOption);
+    parser.addOption(codecToleranceOption);
+    parser.addOption(codecTimeOption);
+    parser.process(app);
+
+    bool ok = false;
+    if (parser.isSet(codecOption))
+    {
+        double tolerance = parser.value(codecToleranceOption).toDouble(&ok);
+        if (!ok || tolerance < 0)
+        {
+            qCritical("Invalid tolerance: %s", qPrintable(parser.value(codecToleranceOption)));
+            return 1;
+        }
+        int caseMsec = parser.value(codecTimeOption).toInt(&ok);
+        if (!ok || caseMsec <= 0)
+        {
+            qCritical("Invalid case time: %s", qPrintable(parser.value(codecTimeOption)));
+            return 1;
+        }
+        QFile output;
+        if (!openOutput(output, parser.value(outputOption)))
+            return 1;
+        return runCodecBench(output, parser.value(codecBaselineOption), tolerance, caseMsec);
+    }
+
+    BenchConfig config;
+    if (!config.address.setAddress(parser.value(addressOption)))
+    {
+        qCritical("Invalid address: %s", qPrintable(parser.value(addressOption)));
+        return 1;
+    }
+    config.port = parser.value(portOption).toUShort(&ok);
+    if (!ok)
+    {
+        qCritical("Invalid port: %s", qPrintable(parser.value(portOption)));
+        return 1;
+    }
+    config.clientsCount = parser.value(clientsOption).toInt(&ok);
+    if (!ok || config.clientsCount <= 0)
+    {
+        qCritical("Invalid clients count: %s", qPrintable(parser.value(clientsOption)));
+        return 1;
+    }
+    int threadsCount = parser.value(threadsOption).toInt(&ok);
+    if (!ok || threadsCount <= 0)
+    {
+        qCritical("Invalid threads count: %s", qPrintable(parser.value(threadsOption)));
+        return 1;
+    }
+    config.connectRate = parser.value(connectRateOption).toDouble(&ok);
+    if (!ok || config.connectRate < 0)
+    {
+        qCritical("Invalid connection rate: %s", qPrintable(parser.value(connectRateOption)));
+        return 1;
+    }
+    config.messageRate = parser.value(messageRateOption).toDouble(&ok);
+    if (!ok || config.messageRate < 0)
+    {
+        qCritical("Invalid message rate: %s", qPrintable(parser.value(messageRateOption)));
+        return 1;
+    }
+    config.fanout = parser.value(fanoutOption).toInt(&ok);
+    if (!ok || config.fanout < 0)
+    {
+        qCritical("Invalid fan-out: %s", qPrintable(parser.value(fanoutOption)));
+        return 1;
+    }
+    config.messageSize = parser.value(sizeOption).toInt(&ok);
+    if (!ok || config.messageSize <= 0)
+    {
+        qCritical("Invalid message size: %s", qPrintable(parser.value(sizeOption)));
+        return 1;
+    }
+    config.churnRate = parser.value(churnOption).toDouble(&ok);
+    if (!ok || config.churnRate < 0)
+    {
+        qCritical("Invalid churn rate: %s", qPrintable(parser.value(churnOption)));
+        return 1;
+    }
+    double warmup = parser.value(warmupOption).toDouble(&ok);
+    if (!ok || warmup < 0)
+    {
+        qCritical("Invalid warm-up: %s", qPrintable(parser.value(warmupOption)));
+        return 1;
+    }
+    double duration = parser.value(durationOption).toDouble(&ok);
+    if (!ok || duration <= 0)
+    {
+        qCritical("Invalid duration: %s", qPrintable(parser.value(durationOption)));
+        return 1;
+    }
+    // the names must pass the checks of the server: 5 to 20 letters, digits or underscores
+    config.namePrefix = parser.value(namePrefixOption);
+    QString longestName = config.namePrefix + QString::number(config.clientsCount - 1);
+    if (!QRegExp("[A-Za-z0-9_]{5,20}").exactMatch(config.namePrefix + "0") ||
+            longestName.length() > 20)
+    {
+        qCritical("Invalid name prefix: %s", qPrintable(config.namePrefix));
+        return 1;
+    }
+    config.serverPid = 0;
+    if (parser.isSet(serverPidOption))
+    {
+        config.serverPid = parser.value(serverPidOption).toLongLong(&ok);
+        if (!ok || config.serverPid <= 0 || !ProcessSample::take(config.serverPid).isValid)
+        {
+            qCritical("Cannot sample the process: %s", qPrintable(parser.value(serverPidOption)));
+            return 1;
+        }
+    }
+    config.floodersCount = parser.value(floodersOption).toInt(&ok);
+    if (!ok || config.floodersCount < 0 || config.floodersCount >= config.clientsCount)
+    {
+        qCritical("Invalid flooders count: %s", qPrintable(parser.value(floodersOption)));
+        return 1;
+    }
+    config.floodRate = parser.value(floodRateOption).toDouble(&ok);
+    if (!ok || config.floodRate <= 0)
+    {
+        qCritical("Invalid flood rate: %s", qPrintable(parser.value(floodRateOption)));
+        return 1;
+    }
+    config.stormRounds = 0;
+    if (parser.isSet(stormOption))
+    {
+        config.stormRounds = parser.value(stormOption).toInt(&ok);
+        if (!ok || config.stormRounds <= 0)
+        {
+            qCritical("Invalid storm rounds: %s", qPrintable(parser.value(stormOption)));
+            return 1;
+        }
+        // only the connects are measured
+        config.messageRate = 0;
+        config.churnRate = 0;
+        config.floodersCount = 0;
+    }
+    config.listeners = 0;
+    if (parser.isSet(listenersOption))
+    {
+        config.listeners = parser.value(listenersOption).toInt(&ok);
+        if (!ok || config.listeners <= 0)
+        {
+            qCritical("Invalid listeners count: %s", qPrintable(parser.value(listenersOption)));
+            return 1;
+        }
+    }
+    QJsonObject baseline;
+    if (parser.isSet(compareOption))
+    {
+        QFile baselineFile(parser.value(compareOption));
+        if (!baselineFile.open(QIODevice::ReadOnly))
+        {
+            qCritical("Cannot read %s", qPrintable(parser.value(compareOption)));
+            return 1;
+        }
+        baseline = QJsonDocument::fromJson(baselineFile.readAll()).object();
+    }
+    QFile output;
+    if (!openOutput(output, parser.value(outputOption)))
+        return 1;
+
+    BenchRunner runner(config, threadsCount, warmup, duration);
+    QObject::connect(&runner, SIGNAL(finished()), &app, SLOT(quit()));
+    runner.start();
+    app.exec();
+
+    QJsonObject summary = runner.getSummary();
+    if (!baseline.isEmpty())
+    {
+        QJsonObject comparison = BenchRunner::compareSummaries(summary, baseline);
+        summary["comparison"] = comparison;
+        QTextStream err(stderr);
+        if (comparison.contains("acceptP99Usec"))
+        {
+            QJsonObject accept = comparison["acceptP99Usec"].toObject();
+            err << QString("Accept latency p99 %1 us against %2 us of the baseline (%3%)")
+                   .arg(accept["now"].toDouble(), 0, 'f', 0).arg(accept["baseline"].toDouble(), 0, 'f', 0)
+                   .arg(accept["changePercent"].toDouble(), 0, 'f', 1) << endl;
+        }
+        QJsonObject delivered = comparison["deliveredPerSec"].toObject();
+        if (!delivered.isEmpty())
+            err << QString("Delivered %1 msgs/sec against %2 of the baseline (%3%)")
+                   .arg(delivered["now"].toDouble(), 0, 'f', 0).arg(delivered["baseline"].toDouble(), 0, 'f', 0)
+                   .arg(delivered["changePercent"].toDouble(), 0, 'f', 1) << endl;
+    }
+    output.write(QJsonDocument(summary).toJson());
+    output.close();
+    // nobody got through, the server is down or refused everyone
+    return runner.getRegistrations() > 0 ? 0 : 1;
+}
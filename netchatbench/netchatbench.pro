@@ -0,0 +1,34 @@
+TEMPLATE = app
+
+TARGET = netchatbench
+
+CONFIG += console
+CONFIG -= app_bundle
+
+QT = core network
+
+# the protocol constants of the GUI client
+CLIENTDIR = ../netchatclient
+INCLUDEPATH += $$CLIENTDIR
+
+HEADERS += \
+    benchclient.h \
+    benchworker.h \
+    benchrunner.h \
+    latencyhistogram.h \
+    codecbench.h \
+    allocationcounter.h \
+    processsampler.h \
+    $$CLIENTDIR/constants.h
+
+SOURCES += \
+    main.cpp \
+    benchclient.cpp \
+    benchworker.cpp \
+    benchrunner.cpp \
+    latencyhistogram.cpp \
+    codecbench.cpp \
+    allocationcounter.cpp \
+    processsampler.cpp
+
+include(../common/common.pri)
@@ -0,0 +1,63 @@
+#include <QFile>
+#include <QList>
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+#include "processsampler.h"
+
+#ifdef Q_OS_LINUX
+
+// "VmRSS:	   12345 kB" and the like
+static qint64 statusValue(const QByteArray &status, const char *key)
+{
+    int pos = status.indexOf(QByteArray("\n") + key);
+    if (pos < 0)
+        return 0;
+    pos += qstrlen(key) + 1;
+    int end = status.indexOf('\n', pos);
+    QByteArray value = status.mid(pos, end - pos).trimmed();
+    int space = value.indexOf(' ');
+    return (space < 0 ? value : value.left(space)).toLongLong();
+}
+
+ProcessSample ProcessSample::take(qint64 pid)
+{
+    ProcessSample sample;
+    QFile statusFile(QString("/proc/%1/status").arg(pid));
+    QFile statFile(QString("/proc/%1/stat").arg(pid));
+    if (!statusFile.open(QIODevice::ReadOnly) || !statFile.open(QIODevice::ReadOnly))
+        return sample;
+    QByteArray status = "\n" + statusFile.readAll();
+    sample.rssKb = statusValue(status, "VmRSS:");
+    sample.peakRssKb = statusValue(status, "VmHWM:");
+    sample.voluntarySwitches = statusValue(status, "voluntary_ctxt_switches:");
+    sample.involuntarySwitches = statusValue(status, "nonvoluntary_ctxt_switches:");
+
+    // the name in parentheses may have spaces, the fields are counted after it:
+    // the state is field 3, utime and stime (in clock ticks) are 14 and 15
+    QByteArray stat = statFile.readAll();
+    int nameEnd = stat.lastIndexOf(')');
+    if (nameEnd < 0)
+        return sample;
+    QList<QByteArray> fields = stat.mid(nameEnd + 2).split(' ');
+    if (fields.size() < 13)
+        return sample;
+    long ticksPerSecond = sysconf(_SC_CLK_TCK);
+    if (ticksPerSecond <= 0)
+        return sample;
+    sample.userCpuMsec = fields.at(11).toLongLong() * 1000 / ticksPerSecond;
+    sample.systemCpuMsec = fields.at(12).toLongLong() * 1000 / ticksPerSecond;
+    sample.isValid = true;
+    return sample;
+}
+
+#else
+
+ProcessSample ProcessSample::take(qint64 pid)
+{
+    Q_UNUSED(pid);
+    return ProcessSample();
+}
+
+#endif
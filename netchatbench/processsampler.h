@@ -0,0 +1,25 @@
+#ifndef PROCESSSAMPLER_H
+#define PROCESSSAMPLER_H
+
+#include <QtGlobal>
+
+// the memory and the CPU time of another process (the server under the bench) as /proc shows them,
+// so runs against different server backends can be compared by more than the rates.
+// Linux only, elsewhere a sample is never valid
+struct ProcessSample
+{
+    ProcessSample() : isValid(false), rssKb(0), peakRssKb(0), userCpuMsec(0), systemCpuMsec(0),
+        voluntarySwitches(0), involuntarySwitches(0) {}
+
+    bool isValid;
+    qint64 rssKb;
+    qint64 peakRssKb;
+    qint64 userCpuMsec;
+    qint64 systemCpuMsec;
+    qint64 voluntarySwitches;
+    qint64 involuntarySwitches;
+
+    static ProcessSample take(qint64 pid);
+};
+
+#endif // PROCESSSAMPLER_H
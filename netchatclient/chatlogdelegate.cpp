@@ -0,0 +1,66 @@
+#include <QPainter>
+#include <QAbstractTextDocumentLayout>
+#include <qmath.h>
+
+#include "chatlogdelegate.h"
+#include "chatlogmodel.h"
+#include "constants.h"
+
+ChatLogDelegate::ChatLogDelegate(QObject *parent) :
+    QStyledItemDelegate(parent), documents(Constants::logCachedRows), textWidth(-1)
+{
+}
+
+QTextDocument *ChatLogDelegate::document(const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    // a new width changes the layout of all of them, the visible ones are laid out again as they're asked
+    if (option.rect.width() != textWidth)
+    {
+        documents.clear();
+        textWidth = option.rect.width();
+    }
+    quint64 serial = index.data(ChatLogModel::SerialRole).toULongLong();
+    QTextDocument *doc = documents.object(serial);
+    if (doc == 0)
+    {
+        doc = new QTextDocument();
+        doc->setDefaultFont(option.font);
+        doc->setDocumentMargin(2);
+        doc->setHtml(index.data(Qt::DisplayRole).toString());
+        doc->setTextWidth(textWidth);
+        documents.insert(serial, doc);
+    }
+    return doc;
+}
+
+QSize ChatLogDelegate::sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    // an empty line after every record, as the log always had
+    QTextDocument *doc = this->document(option, index);
+    return QSize(textWidth, qCeil(doc->size().height()) + option.fontMetrics.lineSpacing());
+}
+
+void ChatLogDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    QTextDocument *doc = this->document(option, index);
+    painter->save();
+    if (option.state & QStyle::State_Selected)
+    {
+        // the text keeps its colors, the selection only tints the row
+        QColor color = option.palette.color(QPalette::Highlight);
+        color.setAlpha(60);
+        painter->fillRect(option.rect, color);
+    }
+    painter->translate(option.rect.topLeft());
+    QAbstractTextDocumentLayout::PaintContext context;
+    context.palette = option.palette;
+    context.clip = QRectF(0, 0, option.rect.width(), option.rect.height());
+    painter->setClipRect(context.clip);
+    doc->documentLayout()->draw(painter, context);
+    painter->restore();
+}
+
+QString ChatLogDelegate::anchorAt(const QStyleOptionViewItem &option, const QModelIndex &index, const QPoint &pos) const
+{
+    return this->document(option, index)->documentLayout()->anchorAt(pos);
+}
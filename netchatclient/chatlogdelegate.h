@@ -0,0 +1,30 @@
+#ifndef CHATLOGDELEGATE_H
+#define CHATLOGDELEGATE_H
+
+#include <QStyledItemDelegate>
+#include <QTextDocument>
+#include <QCache>
+
+// draws a record of the log as rich text. The laid out documents of the rows last shown are cached
+// by the serial of the record, so scrolling and the new records don't lay out the visible ones again;
+// they are laid out anew only when the width changes
+class ChatLogDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    explicit ChatLogDelegate(QObject *parent = 0);
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const;
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const;
+    // the link at the point of the row (in the coordinates of the row), empty if there's none
+    QString anchorAt(const QStyleOptionViewItem &option, const QModelIndex &index, const QPoint &pos) const;
+
+private:
+    mutable QCache<quint64, QTextDocument> documents;
+    mutable int textWidth;
+
+    QTextDocument *document(const QStyleOptionViewItem &option, const QModelIndex &index) const;
+};
+
+#endif // CHATLOGDELEGATE_H
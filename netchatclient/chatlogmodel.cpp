@@ -0,0 +1,73 @@
+#include "chatlogmodel.h"
+#include "constants.h"
+
+ChatLogModel::ChatLogModel(int capacity, QObject *parent) :
+    QAbstractListModel(parent), capacity(qMax(1, capacity)), head(0), count(0), dropped(0)
+{
+    flushTimer.setSingleShot(true);
+    flushTimer.setInterval(Constants::logFlushMsec);
+    connect(&flushTimer, SIGNAL(timeout()), this, SLOT(flushPending()));
+}
+
+int ChatLogModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : count;
+}
+
+QVariant ChatLogModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= count)
+        return QVariant();
+    switch (role)
+    {
+    case Qt::DisplayRole:
+        return this->record(index.row()).html();
+    case SerialRole:
+        return this->serial(index.row());
+    case RecordRole:
+        return QVariant::fromValue(this->record(index.row()));
+    }
+    return QVariant();
+}
+
+void ChatLogModel::append(const ChatRecord &record)
+{
+    pending.append(record);
+    if (!flushTimer.isActive())
+        flushTimer.start();
+}
+
+// slot
+void ChatLogModel::flushPending()
+{
+    if (pending.isEmpty())
+        return;
+    // only the last ones of a batch longer than the log can stay
+    int skipped = qMax(0, pending.size() - capacity);
+    int incoming = pending.size() - skipped;
+    dropped += skipped;
+
+    int overflow = count + incoming - capacity;
+    if (overflow > 0)
+    {
+        this->beginRemoveRows(QModelIndex(), 0, overflow - 1);
+        head = (head + overflow) % capacity;
+        count -= overflow;
+        dropped += overflow;
+        this->endRemoveRows();
+    }
+
+    this->beginInsertRows(QModelIndex(), count, count + incoming - 1);
+    for (int i = skipped; i < pending.size(); ++i)
+    {
+        // the ring grows up to the capacity, then the places of the dropped records are reused
+        int pos = (head + count) % capacity;
+        if (pos == ring.size())
+            ring.append(pending.at(i));
+        else
+            ring[pos] = pending.at(i);
+        ++count;
+    }
+    pending.clear();
+    this->endInsertRows();
+}
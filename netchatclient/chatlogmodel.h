@@ -0,0 +1,49 @@
+#ifndef CHATLOGMODEL_H
+#define CHATLOGMODEL_H
+
+#include <QAbstractListModel>
+#include <QVector>
+#include <QTimer>
+
+#include "chatrecord.h"
+
+// the records of the log window in a ring buffer of a fixed capacity, the oldest ones are
+// dropped when it's full. The records are added in batches by a timer, so a burst of messages
+// costs the views one insertion instead of one per message
+class ChatLogModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    enum Roles
+    {
+        // the number of the record since the start, stays the same when the older ones are dropped
+        SerialRole = Qt::UserRole + 1,
+        RecordRole
+    };
+
+    explicit ChatLogModel(int capacity, QObject *parent = 0);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    // Qt::DisplayRole - the HTML of the record
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+
+    const ChatRecord &record(int row) const {return ring.at((head + row) % capacity);}
+    quint64 serial(int row) const {return dropped + row;}
+    void append(const ChatRecord &record);
+
+private:
+    QVector<ChatRecord> ring;
+    int capacity;
+    // the row 0 in the ring
+    int head;
+    int count;
+    quint64 dropped;
+    QVector<ChatRecord> pending;
+    QTimer flushTimer;
+
+private slots:
+    void flushPending();
+};
+
+#endif // CHATLOGMODEL_H
@@ -0,0 +1,349 @@
+#include <QPainter>
+#include <QScrollBar>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QApplication>
+#include <QClipboard>
+#include <QDesktopServices>
+#include <QTextDocumentFragment>
+#include <QUrl>
+#include <algorithm>
+
+#include "chatlogview.h"
+#include "chatlogdelegate.h"
+
+ChatLogView::ChatLogView(QWidget *parent) :
+    QAbstractItemView(parent), isFollowing(true)
+{
+    delegate = new ChatLogDelegate(this);
+    this->setItemDelegate(delegate);
+    this->setSelectionMode(QAbstractItemView::ExtendedSelection);
+    this->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    this->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    this->setMouseTracking(true);
+    this->verticalScrollBar()->setSingleStep(1);
+}
+
+void ChatLogView::setModel(QAbstractItemModel *model)
+{
+    QAbstractItemView::setModel(model);
+    if (model)
+    {
+        connect(model, SIGNAL(rowsRemoved(QModelIndex,int,int)), this, SLOT(onRowsChanged()));
+        connect(model, SIGNAL(modelReset()), this, SLOT(onRowsChanged()));
+    }
+    this->updateGeometries();
+}
+
+int ChatLogView::rowHeight(int row) const
+{
+    QModelIndex index = this->model()->index(row, 0, this->rootIndex());
+    return delegate->sizeHint(this->rowOption(row, QRect(0, 0, this->viewport()->width(), 0)), index).height();
+}
+
+int ChatLogView::bottomRowFrom(int row) const
+{
+    int count = this->model()->rowCount(this->rootIndex());
+    int height = this->viewport()->height();
+    int bottom = 0;
+    while (row < count && bottom < height)
+        bottom += this->rowHeight(row++);
+    return row - 1;
+}
+
+QVector<QPair<int, QRect> > ChatLogView::layoutRows() const
+{
+    QVector<QPair<int, QRect> > rows;
+    int count = this->model() ? this->model()->rowCount(this->rootIndex()) : 0;
+    if (count == 0)
+        return rows;
+    int width = this->viewport()->width();
+    int height = this->viewport()->height();
+
+    // from the row of the scroll bar up to the top of the viewport
+    int anchor = qBound(0, this->verticalScrollBar()->value(), count - 1);
+    int top = height;
+    for (int row = anchor; row >= 0 && top > 0; --row)
+    {
+        int rowHeight = this->rowHeight(row);
+        top -= rowHeight;
+        rows.prepend(qMakePair(row, QRect(0, top, width, rowHeight)));
+    }
+    // the rows up to it don't fill the viewport: they start at the top and the next ones fill the rest
+    if (top > 0)
+    {
+        for (int i = 0; i < rows.size(); ++i)
+            rows[i].second.translate(0, -top);
+        int bottom = height - top;
+        for (int row = anchor + 1; row < count && bottom < height; ++row)
+        {
+            int rowHeight = this->rowHeight(row);
+            rows.append(qMakePair(row, QRect(0, bottom, width, rowHeight)));
+            bottom += rowHeight;
+        }
+    }
+    return rows;
+}
+
+QStyleOptionViewItem ChatLogView::rowOption(int row, const QRect &rect) const
+{
+    QStyleOptionViewItem option = this->viewOptions();
+    option.rect = rect;
+    QModelIndex index = this->model()->index(row, 0, this->rootIndex());
+    if (this->selectionModel() && this->selectionModel()->isSelected(index))
+        option.state |= QStyle::State_Selected;
+    return option;
+}
+
+void ChatLogView::updateGeometries()
+{
+    int count = this->model() ? this->model()->rowCount(this->rootIndex()) : 0;
+    QScrollBar *bar = this->verticalScrollBar();
+    // the scroll bar goes by the bottom row, the ones before the first full viewport aren't positions
+    bar->setRange(count > 0 ? this->bottomRowFrom(0) : 0, qMax(0, count - 1));
+    bar->setPageStep(qMax(1, this->layoutRows().size() - 1));
+    if (isFollowing)
+        bar->setValue(bar->maximum());
+    QAbstractItemView::updateGeometries();
+}
+
+// slot
+void ChatLogView::verticalScrollbarValueChanged(int value)
+{
+    isFollowing = value >= this->verticalScrollBar()->maximum();
+    QAbstractItemView::verticalScrollbarValueChanged(value);
+}
+
+// slot
+void ChatLogView::rowsInserted(const QModelIndex &parent, int start, int end)
+{
+    QAbstractItemView::rowsInserted(parent, start, end);
+    this->updateGeometries();
+    this->viewport()->update();
+}
+
+// slot
+void ChatLogView::rowsAboutToBeRemoved(const QModelIndex &parent, int start, int end)
+{
+    QAbstractItemView::rowsAboutToBeRemoved(parent, start, end);
+    // the rows shown stay on the screen when the older ones are dropped
+    QScrollBar *bar = this->verticalScrollBar();
+    if (!isFollowing && start <= bar->value())
+    {
+        int removed = qMin(end, bar->value()) - start + 1;
+        bar->setValue(bar->value() - removed);
+    }
+}
+
+// slot
+void ChatLogView::onRowsChanged()
+{
+    this->updateGeometries();
+    this->viewport()->update();
+}
+
+void ChatLogView::scrollContentsBy(int dx, int dy)
+{
+    Q_UNUSED(dx);
+    Q_UNUSED(dy);
+    // the scroll bar holds a row, not pixels: the rows are laid out again
+    this->viewport()->update();
+}
+
+void ChatLogView::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    QPainter painter(this->viewport());
+    QVector<QPair<int, QRect> > rows = this->layoutRows();
+    for (int i = 0; i < rows.size(); ++i)
+    {
+        QModelIndex index = this->model()->index(rows.at(i).first, 0, this->rootIndex());
+        delegate->paint(&painter, this->rowOption(rows.at(i).first, rows.at(i).second), index);
+    }
+}
+
+QRect ChatLogView::visualRect(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return QRect();
+    QVector<QPair<int, QRect> > rows = this->layoutRows();
+    for (int i = 0; i < rows.size(); ++i)
+    {
+        if (rows.at(i).first == index.row())
+            return rows.at(i).second;
+    }
+    return QRect();
+}
+
+QModelIndex ChatLogView::indexAt(const QPoint &point) const
+{
+    QVector<QPair<int, QRect> > rows = this->layoutRows();
+    for (int i = 0; i < rows.size(); ++i)
+    {
+        if (rows.at(i).second.contains(point))
+            return this->model()->index(rows.at(i).first, 0, this->rootIndex());
+    }
+    return QModelIndex();
+}
+
+void ChatLogView::scrollTo(const QModelIndex &index, ScrollHint hint)
+{
+    if (!index.isValid())
+        return;
+    QVector<QPair<int, QRect> > rows = this->layoutRows();
+    for (int i = 0; i < rows.size() && hint == EnsureVisible; ++i)
+    {
+        if (rows.at(i).first == index.row() && this->viewport()->rect().contains(rows.at(i).second))
+            return;
+    }
+    // above the viewport the row goes to the top, below it to the bottom
+    bool isAbove = !rows.isEmpty() && index.row() <= rows.first().first;
+    if (hint == PositionAtTop || (hint == EnsureVisible && isAbove))
+        this->verticalScrollBar()->setValue(this->bottomRowFrom(index.row()));
+    else
+        this->verticalScrollBar()->setValue(index.row());
+}
+
+QModelIndex ChatLogView::moveCursor(CursorAction cursorAction, Qt::KeyboardModifiers modifiers)
+{
+    Q_UNUSED(modifiers);
+    int count = this->model() ? this->model()->rowCount(this->rootIndex()) : 0;
+    if (count == 0)
+        return QModelIndex();
+    QModelIndex current = this->currentIndex();
+    int row = current.isValid() ? current.row() : this->verticalScrollBar()->value();
+    int page = qMax(1, this->layoutRows().size() - 1);
+    switch (cursorAction)
+    {
+    case MoveUp:
+    case MovePrevious:
+        --row;
+        break;
+    case MoveDown:
+    case MoveNext:
+        ++row;
+        break;
+    case MovePageUp:
+        row -= page;
+        break;
+    case MovePageDown:
+        row += page;
+        break;
+    case MoveHome:
+        row = 0;
+        break;
+    case MoveEnd:
+        row = count - 1;
+        break;
+    default:
+        break;
+    }
+    return this->model()->index(qBound(0, row, count - 1), 0, this->rootIndex());
+}
+
+int ChatLogView::horizontalOffset() const
+{
+    return 0;
+}
+
+int ChatLogView::verticalOffset() const
+{
+    // the rows are laid out in the coordinates of the viewport
+    return 0;
+}
+
+bool ChatLogView::isIndexHidden(const QModelIndex &index) const
+{
+    Q_UNUSED(index);
+    return false;
+}
+
+void ChatLogView::setSelection(const QRect &rect, QItemSelectionModel::SelectionFlags command)
+{
+    QRect area = rect.normalized();
+    QVector<QPair<int, QRect> > rows = this->layoutRows();
+    int first = -1;
+    int last = -1;
+    for (int i = 0; i < rows.size(); ++i)
+    {
+        if (rows.at(i).second.intersects(area))
+        {
+            if (first < 0)
+                first = rows.at(i).first;
+            last = rows.at(i).first;
+        }
+    }
+    QItemSelection selection;
+    if (first >= 0)
+        selection.select(this->model()->index(first, 0, this->rootIndex()), this->model()->index(last, 0, this->rootIndex()));
+    this->selectionModel()->select(selection, command);
+}
+
+QRegion ChatLogView::visualRegionForSelection(const QItemSelection &selection) const
+{
+    QRegion region;
+    QVector<QPair<int, QRect> > rows = this->layoutRows();
+    for (int i = 0; i < rows.size(); ++i)
+    {
+        if (selection.contains(this->model()->index(rows.at(i).first, 0, this->rootIndex())))
+            region += rows.at(i).second;
+    }
+    return region;
+}
+
+void ChatLogView::copySelection()
+{
+    QModelIndexList indexes = this->selectionModel()->selectedRows();
+    std::sort(indexes.begin(), indexes.end());
+    QStringList lines;
+    foreach (const QModelIndex &index, indexes)
+        lines.append(QTextDocumentFragment::fromHtml(index.data(Qt::DisplayRole).toString()).toPlainText());
+    if (!lines.isEmpty())
+        QApplication::clipboard()->setText(lines.join("\n\n"));
+}
+
+void ChatLogView::keyPressEvent(QKeyEvent *event)
+{
+    if (event->matches(QKeySequence::Copy))
+    {
+        this->copySelection();
+        return;
+    }
+    QAbstractItemView::keyPressEvent(event);
+}
+
+QString ChatLogView::anchorAt(const QPoint &point) const
+{
+    QVector<QPair<int, QRect> > rows = this->layoutRows();
+    for (int i = 0; i < rows.size(); ++i)
+    {
+        const QRect &rect = rows.at(i).second;
+        if (rect.contains(point))
+        {
+            QModelIndex index = this->model()->index(rows.at(i).first, 0, this->rootIndex());
+            return delegate->anchorAt(this->rowOption(rows.at(i).first, rect), index, point - rect.topLeft());
+        }
+    }
+    return QString();
+}
+
+void ChatLogView::mousePressEvent(QMouseEvent *event)
+{
+    pressedAnchor = this->anchorAt(event->pos());
+    QAbstractItemView::mousePressEvent(event);
+}
+
+void ChatLogView::mouseMoveEvent(QMouseEvent *event)
+{
+    this->viewport()->setCursor(this->anchorAt(event->pos()).isEmpty() ? Qt::ArrowCursor : Qt::PointingHandCursor);
+    QAbstractItemView::mouseMoveEvent(event);
+}
+
+void ChatLogView::mouseReleaseEvent(QMouseEvent *event)
+{
+    QAbstractItemView::mouseReleaseEvent(event);
+    // the links open outside, as they did in the text browser
+    if (event->button() == Qt::LeftButton && !pressedAnchor.isEmpty() && this->anchorAt(event->pos()) == pressedAnchor)
+        QDesktopServices::openUrl(QUrl(pressedAnchor));
+    pressedAnchor.clear();
+}
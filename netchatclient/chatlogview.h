@@ -0,0 +1,68 @@
+#ifndef CHATLOGVIEW_H
+#define CHATLOGVIEW_H
+
+#include <QAbstractItemView>
+#include <QVector>
+#include <QPair>
+
+class ChatLogDelegate;
+
+// the log of the window: a list of rows of different heights that scrolls by rows. The scroll bar
+// holds the row shown at the bottom and the rows are laid out from it upwards only as far as the
+// viewport goes, so only the visible rows are ever measured and painted, whatever the count
+// (a QListView lays out all of them once the heights differ).
+// While scrolled to the bottom the view follows the new rows, otherwise it stays where it is
+class ChatLogView : public QAbstractItemView
+{
+    Q_OBJECT
+
+public:
+    explicit ChatLogView(QWidget *parent = 0);
+
+    void setModel(QAbstractItemModel *model);
+    QRect visualRect(const QModelIndex &index) const;
+    void scrollTo(const QModelIndex &index, ScrollHint hint = EnsureVisible);
+    QModelIndex indexAt(const QPoint &point) const;
+
+protected:
+    QModelIndex moveCursor(CursorAction cursorAction, Qt::KeyboardModifiers modifiers);
+    int horizontalOffset() const;
+    int verticalOffset() const;
+    bool isIndexHidden(const QModelIndex &index) const;
+    void setSelection(const QRect &rect, QItemSelectionModel::SelectionFlags command);
+    QRegion visualRegionForSelection(const QItemSelection &selection) const;
+    void scrollContentsBy(int dx, int dy);
+    void updateGeometries();
+
+    void paintEvent(QPaintEvent *event);
+    void keyPressEvent(QKeyEvent *event);
+    void mousePressEvent(QMouseEvent *event);
+    void mouseMoveEvent(QMouseEvent *event);
+    void mouseReleaseEvent(QMouseEvent *event);
+
+protected slots:
+    void rowsInserted(const QModelIndex &parent, int start, int end);
+    void rowsAboutToBeRemoved(const QModelIndex &parent, int start, int end);
+    void verticalScrollbarValueChanged(int value);
+
+private:
+    ChatLogDelegate *delegate;
+    // the scroll bar is at the last row
+    bool isFollowing;
+    // the link the press was on, opened if the release is on it too
+    QString pressedAnchor;
+
+    // the visible rows from the top and their rectangles
+    QVector<QPair<int, QRect> > layoutRows() const;
+    int rowHeight(int row) const;
+    // the last row of the ones from the row that fill the viewport
+    int bottomRowFrom(int row) const;
+    QStyleOptionViewItem rowOption(int row, const QRect &rect) const;
+    QString anchorAt(const QPoint &point) const;
+    void copySelection();
+
+private slots:
+    void onRowsChanged();
+};
+
+#endif // CHATLOGVIEW_H
@@ -0,0 +1,39 @@
+#include <QDateTime>
+
+#include "chatrecord.h"
+#include "utils.h"
+
+QString ChatRecord::headerHtml() const
+{
+    QString time = QDateTime::fromMSecsSinceEpoch(timestampMsec).toString("MM/dd/yy h:mm:ss AP");
+    if (flags & flagServerHistory)
+        return "<div style='color:gray'>[" + time + "] #" + QString::number(messageId) + " <b>" +
+                (flags & flagFromMe ? QString("Me") : sender) + "</b>:</div>";
+    switch (kind)
+    {
+    case kindToAll:
+        if (flags & flagFromMe)
+            return "<div style='color:blue'>[" + time + "] From <b>Me</b> to all:</div>";
+        return "<div style='color:navy'>[" + time + "] <b>" + sender + "</b> to all:</div>";
+    case kindPrivate:
+        if (flags & flagFromMe)
+            return "<div style='color:orange'>[" + time + "] From <b>Me</b> to <b>" + receivers.join(", ") + "</b>:</div>";
+        if (flags & flagWhileAway)
+            return "<div style='color:green'>[" + time + "] <b>" + sender + "</b> (while you were away):</div>";
+        return "<div style='color:green'>[" + time + "] <b>" + sender + "</b>:</div>";
+    case kindServerBroadcast:
+        return "<div style='color:black'><b>ChatServer</b> (broadcast):</div>";
+    case kindServerPrivate:
+        return "<div style='color:blue'><b>ChatServer</b> (private):</div>";
+    }
+    return QString();
+}
+
+QString ChatRecord::bodyHtml() const
+{
+    if (kind == kindNotice)
+        return text;
+    Utils utils;
+    QString color = flags & flagServerHistory ? "dimgray" : "black";
+    return "<div style='color: " + color + "; white-space: pre-wrap;'>" + utils.replaceWebLinksInText(text) + "</div>";
+}
@@ -0,0 +1,45 @@
+#ifndef CHATRECORD_H
+#define CHATRECORD_H
+
+#include <QString>
+#include <QStringList>
+#include <QMetaType>
+
+// one message of the chat log as the client keeps it: the fields, the HTML is made only to show it
+struct ChatRecord
+{
+    ChatRecord() : timestampMsec(0), kind(0), flags(0), messageId(0) {}
+
+    qint64 timestampMsec;
+    quint8 kind;
+    quint8 flags;
+    QString sender;
+    // the names the private message was sent to (the ones we sent)
+    QStringList receivers;
+    // as it has come, the messages of ChatServer are HTML
+    QString text;
+    // the id in the history of the server (flagServerHistory)
+    quint64 messageId;
+
+    static const quint8 kindToAll = 1;
+    static const quint8 kindPrivate = 2;
+    static const quint8 kindServerBroadcast = 3;
+    static const quint8 kindServerPrivate = 4;
+    // a notice of the client itself, the text is HTML; shown only, never saved
+    static const quint8 kindNotice = 5;
+
+    static const quint8 flagFromMe = 0x01;
+    // kept by the server while we were away
+    static const quint8 flagWhileAway = 0x02;
+    // asked with #history, not a part of the local history
+    static const quint8 flagServerHistory = 0x04;
+
+    QString headerHtml() const;
+    QString bodyHtml() const;
+    // the whole record as the log shows it
+    QString html() const {return this->headerHtml() + this->bodyHtml();}
+};
+
+Q_DECLARE_METATYPE(ChatRecord)
+
+#endif // CHATRECORD_H
@@ -1,392 +1,880 @@
-#include <QtNetwork>
-#include <QApplication>
-#include <QMessageBox>
-#include <QUuid>
-#include <QMediaPlayer>
-#include <QSound>
-#include <QSoundEffect>
-#include <ctime>
-#include <algorithm>
-
-#include "constants.h"
-#include "utils.h"
-#include "client.h"
-
-Client::Client(QMainWindow *widget, QObject *parent) :
-    QObject(parent), mainWindow(widget)
-{
-    uuid = generateUUID();
-
-    socket = new QTcpSocket();
-
-    connect(this, SIGNAL(addToLogArea(QString,bool)), mainWindow, SLOT(onAddToLogArea(QString,bool)));
-    connect(this, SIGNAL(clearMessageArea()), mainWindow, SLOT(onClearMessageArea()));
-    connect(this, SIGNAL(setWindowTitleWithClientName()), mainWindow, SLOT(onSetWindowTitleWithClientName()));
-    connect(this, SIGNAL(adjustGUIOnDeregister()), mainWindow, SLOT(onAdjustGUIOnDeregister()));
-
-    connect(this->getSocket(), SIGNAL(readyRead()), this, SLOT(onSocketReadyRead()));
-    connect(this->getSocket(), SIGNAL(connected()), this, SLOT(onSocketConnected()));
-    connect(this->getSocket(), SIGNAL(disconnected()), this, SLOT(onSocketDisconnected()));
-    connect(this->getSocket(), SIGNAL(error(QAbstractSocket::SocketError)),
-            this, SLOT(onSocketDisplayError(QAbstractSocket::SocketError)));
-    connect(this, SIGNAL(showMessageInTray(QString,QString,QSystemTrayIcon::MessageIcon,int,bool)),
-            mainWindow, SLOT(onShowMessageInTray(QString,QString,QSystemTrayIcon::MessageIcon,int,bool)));
-
-    msgSound = new QMediaPlayer;
-    msgSound->setMedia(QUrl("qrc:/data/msg.wav"));
-    msgSound->setVolume(100);
-
-    utils = new Utils();
-
-}
-
-QString Client::generateUUID()
-{
-    QUuid uuid = QUuid::createUuid();
-    return uuid.toString();
-}
-
-QString Client::retrieveNameFromStr(QString str)
-{
-    return str.left(str.indexOf(" "));
-}
-
-void Client::onSocketDisplayError(QAbstractSocket::SocketError socketError)
-{
-    QApplication::alert(mainWindow);
-    QString title = "Cannot connect to ChatServer";
-    QString body = "An error occured while connecting.\nClick the message for details.";
-    emit showMessageInTray(title, body, QSystemTrayIcon::Critical, 10000, false);
-
-    switch (socketError) {
-    case QAbstractSocket::RemoteHostClosedError:
-        break;
-    case QAbstractSocket::HostNotFoundError:
-        QMessageBox::information(mainWindow, "Connection Error - " + Constants::programName, "The host was not found");
-        break;
-    case QAbstractSocket::ConnectionRefusedError:
-        QMessageBox::information(mainWindow, "Connection Error - " + Constants::programName, "The connection was refused by the peer.");
-        break;
-    default:
-        QMessageBox::information(mainWindow, "Connection Error - " + Constants::programName, "The following error occurred: " + this->getSocket()->errorString());
-    }
-}
-
-void Client::sendMessageToAll(QString message)
-{
-    QByteArray block;
-    QDataStream out(&block, QIODevice::WriteOnly);
-    out << (quint16)0;
-    out << (quint8)Constants::comMessageToAll << message;
-    out.device()->seek(0);
-    out << (quint16)(block.size() - sizeof(quint16));
-    this->writeToSocket(block);
-}
-
-void Client::sendMessageToSelected(QString message, QString selectedClients)
-{
-    QByteArray block;
-    QDataStream out(&block, QIODevice::WriteOnly);
-    out << (quint16)0;
-    out << (quint8)Constants::comMessageToClients << selectedClients << message;
-    out.device()->seek(0);
-    out << (quint16)(block.size() - sizeof(quint16));
-    this->writeToSocket(block);
-}
-
-void Client::onSocketReadyRead()
-{
-    QDataStream in(this->getSocket());
-    // if read a new block so the first 2 bytes are its size
-    if (blockSize == 0) {
-        // if came less than 2 bytes, wait until 2 bytes come
-        if (this->getSocket()->bytesAvailable() < (int)sizeof(quint16))
-            return;
-        // read size (2 bytes)
-        in >> blockSize;
-    }
-    // wait until block comes completely
-    if (this->getSocket()->bytesAvailable() < blockSize)
-        return;
-    else
-        // one can accept a new block
-        blockSize = 0;
-    // the 3rd byte is a command to server
-    quint8 command;
-    in >> command;
-
-    switch (command)
-    {
-    case Constants::comRegistrationSuccess:
-    {
-        emit addToLogArea("<div style='color:gray'>* Signed in as <b>" +
-                          this->getName() + "</b></div>");
-    }
-        break;
-    case Constants::comRegisteredClients:
-    {
-        QString clientsUUIDs;
-        in >> clientsUUIDs;
-        if (clientsUUIDs.isEmpty())
-            return;
-        QStringList clientsList = clientsUUIDs.split(",");
-        emit addClientsToGUI(clientsList);
-    }
-        break;
-    case Constants::comMessageToAll:
-    {
-        QString clientUUID;
-        in >> clientUUID;
-        QString clientName;
-        in >> clientName;
-        QString message;
-        in >> message;
-        QString strToLogArea;
-        if (clientUUID == this->getUUID())
-            strToLogArea = "<div style='color:blue'>[" +
-                    QDateTime::currentDateTime().toString("MM/dd/yy h:mm:ss AP") +
-                    "] From <b>Me</b> to all:</div>";
-        else
-        {
-            strToLogArea = "<div style='color:navy'>[" +
-                    QDateTime::currentDateTime().toString("MM/dd/yy h:mm:ss AP") +
-                    "] <b>" + clientName + "</b> to all:</div>";
-            QString title = Constants::programName;
-            QString body = "[" + clientName + "] to all:\n" + utils->shortenForMessageInTray(message);
-            emit showMessageInTray(title, body, QSystemTrayIcon::NoIcon, 5000);
-            msgSound->play();
-            QApplication::alert(mainWindow);
-        }
-        emit addToLogArea(strToLogArea, false);
-        emit addToLogArea("<div style='color: black; white-space: pre-wrap;'>" + utils->replaceWebLinksInText(message) + "</div>");
-    }
-        break;
-    case Constants::comMessageToClients:
-    {
-        QStringList receivers;
-        in >> receivers;
-        QString senderUUID;
-        in >> senderUUID;
-        QString senderName;
-        in >> senderName;
-        QString message;
-        in >> message;
-
-        QString strToLogArea;
-        if (senderUUID == this->getUUID())
-        {
-            QStringList receiversNamesList;
-            foreach (QString item, receivers) {
-                receiversNamesList.append(this->retrieveNameFromStr(item));
-            }
-            strToLogArea = "<div style='color:orange'>[" +
-                    QDateTime::currentDateTime().toString("MM/dd/yy h:mm:ss AP") +
-                    "] From <b>Me</b> to <b>" + receiversNamesList.join(", ") + "</b>:</div>";
-        }
-        else
-        {
-            strToLogArea = "<div style='color:green'>[" +
-                    QDateTime::currentDateTime().toString("MM/dd/yy h:mm:ss AP") +
-                    "] <b>" + senderName + "</b>:</div>";
-            QString title = Constants::programName;
-            QString body = "[" + senderName + "]:\n" + utils->shortenForMessageInTray(message);
-            emit showMessageInTray(title, body, QSystemTrayIcon::NoIcon, 5000);
-            msgSound->play();
-            QApplication::alert(mainWindow);
-        }
-        emit addToLogArea(strToLogArea, false);
-        emit addToLogArea("<div style='color: black; white-space: pre-wrap;'>" + utils->replaceWebLinksInText(message) + "</div>");
-    }
-        break;
-    case Constants::comPublicServerMessage:
-    {
-        QString message;
-        in >> message;
-        QString strToLogArea;
-        QString title = Constants::programName;
-        QString body = "ChatServer (broadcast):\n" + utils->shortenForMessageInTray(message);
-        emit showMessageInTray(title, body, QSystemTrayIcon::NoIcon, 5000);
-        msgSound->play();
-        QApplication::alert(mainWindow);
-        strToLogArea = "<div style='color:black'><b>ChatServer</b> (broadcast):</div>";
-        emit addToLogArea(strToLogArea, false);
-        emit addToLogArea("<div style='color: black; white-space: pre-wrap;'>" + utils->replaceWebLinksInText(message) + "</div>");
-    }
-        break;
-    case Constants::comPrivateServerMessage:
-    {
-        QString message;
-        in >> message;
-        QString strToLogArea;
-        QString title = Constants::programName;
-        QString body = "ChatServer (private):\n" + utils->shortenForMessageInTray(message);
-        emit showMessageInTray(title, body, QSystemTrayIcon::NoIcon, 5000);
-        msgSound->play();
-        QApplication::alert(mainWindow);
-        strToLogArea = "<div style='color:blue'><b>ChatServer</b> (private):</div>";
-        emit addToLogArea(strToLogArea, false);
-        emit addToLogArea("<div style='color: black; white-space: pre-wrap;'>" + utils->replaceWebLinksInText(message) + "</div>");
-    }
-        break;
-    case Constants::comClientJoined:
-    {
-        QString uuid;
-        in >> uuid;
-        QString name;
-        in >> name;
-        emit addClientToGUI(uuid, name);
-    }
-        break;
-    case Constants::comClientLeft:
-    {
-        QString uuid;
-        in >> uuid;
-        QString name;
-        in >> name;
-        emit removeClientFromGUI(uuid, name);
-    }
-        break;
-    case Constants::comDisconnectClient:
-    {
-        this->disconnectFromChatServer();
-        QString title = "Disconnected from ChatServer";
-        QString body = "Server has been stopped.";
-        emit showMessageInTray(title, body, QSystemTrayIcon::Information, 10000, false);
-        QApplication::alert(mainWindow);
-        QMessageBox::information(mainWindow, Constants::programName, "You have been disconnected.\nChatServer has been stopped.");
-    }
-        break;
-    case Constants::comDeregisterClient:
-    {
-        emit adjustGUIOnDeregister();
-    }
-        break;
-    case Constants::comErrClientExists:
-    {
-        QApplication::alert(mainWindow);
-        QMessageBox::warning(mainWindow, "Authorization Error - " + Constants::programName, "You are already authorized.\\nBut now you are not :) Bye.");
-        this->disconnectFromChatServer();
-    }
-        break;
-    case Constants::comErrNameInvalid:
-    {
-        QApplication::alert(mainWindow);
-        QMessageBox::warning(mainWindow, "Authorization Error - " + Constants::programName, "Client name is invalid.");
-        this->disconnectFromChatServer();
-    }
-        break;
-    case Constants::comErrNameUsed:
-    {
-        QApplication::alert(mainWindow);
-        QMessageBox::warning(mainWindow, "Authorization Error - " + Constants::programName, "Client name is already used.");
-        this->disconnectFromChatServer();
-    }
-        break;
-    case Constants::comErrNameIllegal:
-    {
-        QApplication::alert(mainWindow);
-        QMessageBox::warning(mainWindow, "Authorization Error - " + Constants::programName, "Client name is illegal.");
-        this->disconnectFromChatServer();
-    }
-        break;
-    }
-}
-
-bool Client::isCommandExpected(QString text)
-{
-    if (text[0] == '#')
-        return true;
-    return false;
-}
-
-void Client::processCommand(QString text)
-{
-    QRegExp pingCommandRegExp("^ping$");
-    pingCommandRegExp.setCaseSensitivity(Qt::CaseInsensitive);
-    if (pingCommandRegExp.indexIn(text) != -1)
-    {
-        // ping command
-        this->sendCommand(Constants::comPing);
-        emit clearMessageArea();
-    }
-    else
-    {
-        addToLogArea(tr("<div style='color:red'>Unknown command: \"%1\" </div>").arg(text.left(text.indexOf(' '))));
-    }
-}
-
-bool Client::isConnected()
-{
-    if (this->getSocket()->state() == QAbstractSocket::ConnectedState)
-        return true;
-    else
-        return false;
-}
-
-bool Client::connectToChatServer(QHostAddress ipAddress, quint16 port)
-{
-    this->getSocket()->connectToHost(ipAddress, port);
-    if (!this->getSocket()->waitForConnected(3000))
-        return false;
-    else
-        return true;
-}
-
-void Client::disconnectFromChatServer()
-{
-    this->getSocket()->disconnectFromHost();
-}
-
-void Client::tryToRegister(QString name)
-{
-    blockSize = 0;
-    QByteArray block;
-    QDataStream out(&block, QIODevice::WriteOnly);
-    out << (quint16)0;
-    out << (quint8)Constants::comRegisterRequest;
-    out << this->getUUID();
-    out << name;
-    out.device()->seek(0);
-    out << (quint16)(block.size() - sizeof(quint16));
-    this->writeToSocket(block);
-}
-
-void Client::sendCommand(quint8 command)
-{
-    blockSize = 0;
-    QByteArray block;
-    QDataStream out(&block, QIODevice::WriteOnly);
-    out << (quint16)0;
-    out << (quint8)command;
-    out.device()->seek(0);
-    out << (quint16)(block.size() - sizeof(quint16));
-    this->writeToSocket(block);
-}
-
-void Client::sendClientConnected()
-{
-    blockSize = 0;
-    QByteArray block;
-    QDataStream out(&block, QIODevice::WriteOnly);
-    out << (quint16)0;
-    out << (quint8)Constants::comClientConnected;
-    out << this->getUUID();
-    out.device()->seek(0);
-    out << (quint16)(block.size() - sizeof(quint16));
-    this->writeToSocket(block);
-}
-
-void Client::writeToSocket(QByteArray block)
-{
-    this->getSocket()->write(block);
-}
-
-void Client::onSocketConnected()
-{
-    this->sendClientConnected();
-}
-
-void Client::onSocketDisconnected()
-{
-    emit clientDisconnected();
-}
+#include <QtNetwork>
+#include <QApplication>
+#include <QMessageBox>
+#include <QUuid>
+#include <QMediaPlayer>
+#include <QSound>
+#include <QSoundEffect>
+#include <ctime>
+#include <algorithm>
+
+#include "constants.h"
+#include "utils.h"
+#include "client.h"
+
+Client::Client(QMainWindow *widget, QObject *parent) :
+    QObject(parent), rttHistogram(Constants::rttWindowSamples), mainWindow(widget)
+{
+    uuid = generateUUID();
+    serverProtocolVersion = 1;
+    nextStreamId = 0;
+    sessionId = 0;
+    nextPingSeq = 1;
+    reportPingSeq = 0;
+    historyRequestId = 0;
+    historyMessagesShown = 0;
+    rttClock.start();
+    pingTimer = new QTimer(this);
+    pingTimer->setInterval(Constants::pingIntervalMsec);
+    connect(pingTimer, SIGNAL(timeout()), this, SLOT(sendPingRequest()));
+
+    socket = new QTcpSocket();
+
+    connect(this, SIGNAL(addToLogArea(QString)), mainWindow, SLOT(onAddToLogArea(QString)));
+    connect(this, SIGNAL(clearMessageArea()), mainWindow, SLOT(onClearMessageArea()));
+    connect(this, SIGNAL(setWindowTitleWithClientName()), mainWindow, SLOT(onSetWindowTitleWithClientName()));
+    connect(this, SIGNAL(adjustGUIOnDeregister()), mainWindow, SLOT(onAdjustGUIOnDeregister()));
+    connect(this, SIGNAL(rttUpdated(QString)), mainWindow, SLOT(onRttUpdated(QString)));
+
+    connect(this->getSocket(), SIGNAL(readyRead()), this, SLOT(onSocketReadyRead()));
+    connect(this->getSocket(), SIGNAL(connected()), this, SLOT(onSocketConnected()));
+    connect(this->getSocket(), SIGNAL(disconnected()), this, SLOT(onSocketDisconnected()));
+    connect(this->getSocket(), SIGNAL(error(QAbstractSocket::SocketError)),
+            this, SLOT(onSocketDisplayError(QAbstractSocket::SocketError)));
+    connect(this, SIGNAL(showMessageInTray(QString,QString,QSystemTrayIcon::MessageIcon,int,bool)),
+            mainWindow, SLOT(onShowMessageInTray(QString,QString,QSystemTrayIcon::MessageIcon,int,bool)));
+
+    msgSound = new QMediaPlayer;
+    msgSound->setMedia(QUrl("qrc:/data/msg.wav"));
+    msgSound->setVolume(100);
+
+    utils = new Utils();
+
+}
+
+QString Client::generateUUID()
+{
+    QUuid uuid = QUuid::createUuid();
+    return uuid.toString();
+}
+
+QString Client::retrieveNameFromStr(QString str)
+{
+    return str.left(str.indexOf(" "));
+}
+
+void Client::onSocketDisplayError(QAbstractSocket::SocketError socketError)
+{
+    QApplication::alert(mainWindow);
+    QString title = "Cannot connect to ChatServer";
+    QString body = "An error occured while connecting.\nClick the message for details.";
+    emit showMessageInTray(title, body, QSystemTrayIcon::Critical, 10000, false);
+
+    switch (socketError) {
+    case QAbstractSocket::RemoteHostClosedError:
+        break;
+    case QAbstractSocket::HostNotFoundError:
+        QMessageBox::information(mainWindow, "Connection Error - " + Constants::programName, "The host was not found");
+        break;
+    case QAbstractSocket::ConnectionRefusedError:
+        QMessageBox::information(mainWindow, "Connection Error - " + Constants::programName, "The connection was refused by the peer.");
+        break;
+    default:
+        QMessageBox::information(mainWindow, "Connection Error - " + Constants::programName, "The following error occurred: " + this->getSocket()->errorString());
+    }
+}
+
+void Client::sendMessageToAll(QString message)
+{
+    if (message.length() > Constants::messageChunkLength && serverProtocolVersion >= 2)
+    {
+        this->sendMessageStream(Constants::comMessageToAll, QString(), message);
+        return;
+    }
+    FrameBuilder frame(Constants::comMessageToAll);
+    this->writeString(frame, message);
+    this->writeToSocket(this->finishFrame(frame));
+}
+
+void Client::sendMessageToSelected(QString message, QString selectedClients)
+{
+    if (message.length() > Constants::messageChunkLength && serverProtocolVersion >= 2)
+    {
+        this->sendMessageStream(Constants::comMessageToClients, selectedClients, message);
+        return;
+    }
+    FrameBuilder frame(Constants::comMessageToClients);
+    this->writeReceivers(frame, selectedClients);
+    this->writeString(frame, message);
+    this->writeToSocket(this->finishFrame(frame));
+}
+
+void Client::writeReceivers(FrameBuilder &frame, const QString &selectedClients)
+{
+    if (serverProtocolVersion < 3)
+    {
+        frame.appendString(selectedClients);
+        return;
+    }
+    // "name {uuid},..." to the session ids, the clients who have left are skipped
+    QList<quint32> ids;
+    foreach (const QString &item, selectedClients.split(","))
+    {
+        quint32 id = peerIdsByUUID.value(item.mid(item.indexOf('{')), 0);
+        if (id != 0)
+            ids.append(id);
+    }
+    frame.appendUInt32List(ids);
+}
+
+void Client::sendMessageStream(quint8 kind, const QString &selectedClients, const QString &message)
+{
+    // the server relays every chunk as it comes and never holds the whole message
+    quint32 streamId = nextStreamId++;
+    int length;
+    for (int pos = 0; pos < message.length(); pos += length)
+    {
+        // a surrogate pair is never split, every chunk has to be valid UTF-8 on its own
+        length = MessageText::chunkLength(message, pos, Constants::messageChunkLength);
+        quint8 flags = 0;
+        if (pos == 0)
+            flags |= Constants::chunkFirst;
+        if (pos + length >= message.length())
+            flags |= Constants::chunkLast;
+        FrameBuilder frame(Constants::comMessageChunk);
+        frame.appendUInt32(streamId).appendUInt8(flags);
+        if (flags & Constants::chunkFirst)
+        {
+            frame.appendUInt8(kind);
+            if (kind == Constants::comMessageToClients)
+                this->writeReceivers(frame, selectedClients);
+        }
+        this->writeString(frame, message.mid(pos, length));
+        this->writeToSocket(this->finishFrame(frame));
+    }
+}
+
+QByteArray Client::finishFrame(FrameBuilder &frame)
+{
+    QByteArray block = frame.finish();
+    // the original protocol can't carry it, the server would read garbage
+    if (serverProtocolVersion < 2 && FrameBuilder::isExtendedFrame(block))
+    {
+        emit addToLogArea("<div style='color:red'>The message is too long for this ChatServer.</div>");
+        return QByteArray();
+    }
+    return block;
+}
+
+void Client::onSocketReadyRead()
+{
+    receiveDecoder.readFrom(this->getSocket());
+    // handle every complete block, several of them may come at once
+    const char *frame;
+    int frameSize;
+    while (receiveDecoder.nextFrame(&frame, &frameSize))
+    {
+        // a copy, message boxes may spin the event loop and read more into the decoder
+        processBlock(QByteArray(frame, frameSize));
+    }
+    if (receiveDecoder.hasError())
+        this->disconnectFromChatServer();
+}
+
+void Client::processBlock(const QByteArray &block)
+{
+    FrameReader in(block.constData(), block.size());
+    // the 1st byte is a command to client
+    quint8 command = in.readUInt8();
+
+    switch (command)
+    {
+    case Constants::comRegistrationSuccess:
+    {
+        if (serverProtocolVersion >= 3)
+            sessionId = in.readUInt32();
+        emit addToLogArea("<div style='color:gray'>* Signed in as <b>" +
+                          this->getName() + "</b></div>");
+    }
+        break;
+    case Constants::comRegisteredClients:
+    {
+        if (serverProtocolVersion >= 3)
+        {
+            // [count][session id, uuid, name]...
+            quint32 count = in.readUInt32();
+            QStringList clientsList;
+            for (quint32 i = 0; i < count && in.isOk(); ++i)
+            {
+                quint32 id = in.readUInt32();
+                QString uuid = this->readString(in);
+                QString name = this->readString(in);
+                if (!in.isOk())
+                    break;
+                this->addPeer(id, uuid, name);
+                clientsList.append(name + " " + uuid);
+            }
+            if (!clientsList.isEmpty())
+                emit addClientsToGUI(clientsList);
+            return;
+        }
+        QString clientsUUIDs = in.readString();
+        if (clientsUUIDs.isEmpty())
+            return;
+        QStringList clientsList = clientsUUIDs.split(",");
+        emit addClientsToGUI(clientsList);
+    }
+        break;
+    case Constants::comMessageToAll:
+    {
+        if (serverProtocolVersion >= 3)
+        {
+            quint32 senderId = in.readUInt32();
+            QString message = this->readString(in);
+            QString senderUUID;
+            QString senderName;
+            this->findPeer(senderId, &senderUUID, &senderName);
+            showMessageToAll(senderUUID, senderName, message);
+            return;
+        }
+        QString clientUUID = in.readString();
+        QString clientName = in.readString();
+        QString message = in.readString();
+        showMessageToAll(clientUUID, clientName, message);
+    }
+        break;
+    case Constants::comMessageToClients:
+    {
+        if (serverProtocolVersion >= 3)
+        {
+            quint32 senderId = in.readUInt32();
+            QList<quint32> receiverIds = in.readUInt32List();
+            QString message = this->readString(in);
+            QString senderUUID;
+            QString senderName;
+            this->findPeer(senderId, &senderUUID, &senderName);
+            showMessageToClients(describePeers(receiverIds), senderUUID, senderName, message);
+            return;
+        }
+        QStringList receivers = in.readStringList();
+        QString senderUUID = in.readString();
+        QString senderName = in.readString();
+        QString message = in.readString();
+        showMessageToClients(receivers, senderUUID, senderName, message);
+    }
+        break;
+    case Constants::comMessageChunk:
+    {
+        this->processMessageChunk(in);
+    }
+        break;
+    case Constants::comProtocolAccepted:
+    {
+        quint8 version = in.readUInt8();
+        // use the newest version both sides speak and let the server know it
+        serverProtocolVersion = qMax((quint8)1, qMin(version, Constants::protocolVersion));
+        FrameBuilder frame(Constants::comProtocolVersion);
+        frame.appendUInt8(serverProtocolVersion);
+        this->writeToSocket(this->finishFrame(frame));
+        // the round trip readout is kept fresh from now on
+        if (serverProtocolVersion >= 6)
+        {
+            this->sendPingRequest();
+            pingTimer->start();
+        }
+    }
+        break;
+    case Constants::comPublicServerMessage:
+    {
+        QString message = this->readString(in);
+        QString title = Constants::programName;
+        QString body = "ChatServer (broadcast):\n" + utils->shortenForMessageInTray(message);
+        emit showMessageInTray(title, body, QSystemTrayIcon::NoIcon, 5000);
+        msgSound->play();
+        QApplication::alert(mainWindow);
+        emit addRecordToLogArea(this->makeRecord(ChatRecord::kindServerBroadcast, 0, QString(), message));
+    }
+        break;
+    case Constants::comPrivateServerMessage:
+    {
+        QString message = this->readString(in);
+        QString title = Constants::programName;
+        QString body = "ChatServer (private):\n" + utils->shortenForMessageInTray(message);
+        emit showMessageInTray(title, body, QSystemTrayIcon::NoIcon, 5000);
+        msgSound->play();
+        QApplication::alert(mainWindow);
+        emit addRecordToLogArea(this->makeRecord(ChatRecord::kindServerPrivate, 0, QString(), message));
+    }
+        break;
+    case Constants::comClientJoined:
+    {
+        quint32 id = 0;
+        if (serverProtocolVersion >= 3)
+            id = in.readUInt32();
+        QString uuid = this->readString(in);
+        QString name = this->readString(in);
+        if (id != 0)
+        {
+            this->removeAwayPeer(name);
+            this->addPeer(id, uuid, name);
+        }
+        emit addClientToGUI(uuid, name);
+    }
+        break;
+    case Constants::comClientLeft:
+    {
+        QString uuid;
+        QString name;
+        if (serverProtocolVersion >= 3)
+        {
+            // just the session id, we know the rest
+            quint32 id = in.readUInt32();
+            if (!this->findPeer(id, &uuid, &name))
+                return;
+            if (serverProtocolVersion >= 7)
+            {
+                // the messages to the peer wait for it on the server
+                this->removeAwayPeer(name);
+                awayPeerIds.insert(name.toCaseFolded(), id);
+                emit markClientAwayInGUI(uuid, name);
+                return;
+            }
+            peerIdsByUUID.remove(uuid);
+            peers.remove(id);
+        }
+        else
+        {
+            uuid = in.readString();
+            name = in.readString();
+        }
+        emit removeClientFromGUI(uuid, name);
+    }
+        break;
+    case Constants::comOfflineMessages:
+    {
+        this->showOfflineMessages(in);
+    }
+        break;
+    case Constants::comHistoryPage:
+    {
+        this->showHistoryPage(in);
+    }
+        break;
+    case Constants::comDisconnectClient:
+    {
+        this->disconnectFromChatServer();
+        QString title = "Disconnected from ChatServer";
+        QString body = "Server has been stopped.";
+        emit showMessageInTray(title, body, QSystemTrayIcon::Information, 10000, false);
+        QApplication::alert(mainWindow);
+        QMessageBox::information(mainWindow, Constants::programName, "You have been disconnected.\nChatServer has been stopped.");
+    }
+        break;
+    case Constants::comPingRequest:
+    {
+        // the server measures the round trip, its timestamp goes back as it is
+        quint32 seq = in.readUInt32();
+        quint64 sentUsec = in.readUInt64();
+        this->sendPingReply(seq, sentUsec);
+    }
+        break;
+    case Constants::comPingReply:
+    {
+        quint32 seq = in.readUInt32();
+        quint64 sentUsec = in.readUInt64();
+        if (in.isOk())
+            this->onPingReply(seq, sentUsec);
+    }
+        break;
+    case Constants::comHeartbeat:
+    {
+        // the server checks that we're still here
+        this->sendCommand(Constants::comHeartbeat);
+    }
+        break;
+    case Constants::comSlowDown:
+    {
+        // the server has dropped some of our messages, it says when it takes them again
+        quint32 waitMsec = in.readUInt32();
+        emit addToLogArea(tr("<div style='color:red'>* You are sending too fast, ChatServer has dropped your last messages. "
+                             "Wait %1 s before sending more.</div>").arg(qMax(waitMsec, (quint32)1) / 1000.0, 0, 'f', 1));
+    }
+        break;
+    case Constants::comDeregisterClient:
+    {
+        this->clearPeers();
+        emit adjustGUIOnDeregister();
+    }
+        break;
+    case Constants::comErrClientExists:
+    {
+        QApplication::alert(mainWindow);
+        QMessageBox::warning(mainWindow, "Authorization Error - " + Constants::programName, "You are already authorized.\\nBut now you are not :) Bye.");
+        this->disconnectFromChatServer();
+    }
+        break;
+    case Constants::comErrNameInvalid:
+    {
+        QApplication::alert(mainWindow);
+        QMessageBox::warning(mainWindow, "Authorization Error - " + Constants::programName, "Client name is invalid.");
+        this->disconnectFromChatServer();
+    }
+        break;
+    case Constants::comErrNameUsed:
+    {
+        QApplication::alert(mainWindow);
+        QMessageBox::warning(mainWindow, "Authorization Error - " + Constants::programName, "Client name is already used.");
+        this->disconnectFromChatServer();
+    }
+        break;
+    case Constants::comErrSlowConsumer:
+    {
+        QApplication::alert(mainWindow);
+        QMessageBox::warning(mainWindow, "Connection Error - " + Constants::programName, "You have been disconnected.\nThe connection is too slow for ChatServer.");
+        this->disconnectFromChatServer();
+    }
+        break;
+    case Constants::comErrTooManyRequests:
+    {
+        QApplication::alert(mainWindow);
+        QMessageBox::warning(mainWindow, "Authorization Error - " + Constants::programName, "Too many sign-ins from your address.\nPlease try again later.");
+        this->disconnectFromChatServer();
+    }
+        break;
+    case Constants::comErrNameIllegal:
+    {
+        QApplication::alert(mainWindow);
+        QMessageBox::warning(mainWindow, "Authorization Error - " + Constants::programName, "Client name is illegal.");
+        this->disconnectFromChatServer();
+    }
+        break;
+    }
+}
+
+void Client::showMessageToAll(const QString &senderUUID, const QString &senderName, const QString &message)
+{
+    quint8 flags = 0;
+    if (senderUUID == this->getUUID())
+        flags = ChatRecord::flagFromMe;
+    else
+    {
+        QString title = Constants::programName;
+        QString body = "[" + senderName + "] to all:\n" + utils->shortenForMessageInTray(message);
+        emit showMessageInTray(title, body, QSystemTrayIcon::NoIcon, 5000);
+        msgSound->play();
+        QApplication::alert(mainWindow);
+    }
+    emit addRecordToLogArea(this->makeRecord(ChatRecord::kindToAll, flags, senderName, message));
+}
+
+void Client::showMessageToClients(const QStringList &receivers, const QString &senderUUID,
+                                  const QString &senderName, const QString &message)
+{
+    ChatRecord record = this->makeRecord(ChatRecord::kindPrivate, 0, senderName, message);
+    if (senderUUID == this->getUUID())
+    {
+        record.flags = ChatRecord::flagFromMe;
+        foreach (QString item, receivers) {
+            record.receivers.append(this->retrieveNameFromStr(item));
+        }
+    }
+    else
+    {
+        QString title = Constants::programName;
+        QString body = "[" + senderName + "]:\n" + utils->shortenForMessageInTray(message);
+        emit showMessageInTray(title, body, QSystemTrayIcon::NoIcon, 5000);
+        msgSound->play();
+        QApplication::alert(mainWindow);
+    }
+    emit addRecordToLogArea(record);
+}
+
+ChatRecord Client::makeRecord(quint8 kind, quint8 flags, const QString &sender, const QString &text)
+{
+    ChatRecord record;
+    record.timestampMsec = QDateTime::currentMSecsSinceEpoch();
+    record.kind = kind;
+    record.flags = flags;
+    record.sender = sender;
+    record.text = text;
+    return record;
+}
+
+void Client::showOfflineMessages(FrameReader &in)
+{
+    quint32 count = in.readUInt32();
+    QStringList senders;
+    QString lastMessage;
+    for (quint32 i = 0; i < count && in.isOk(); ++i)
+    {
+        qint64 sentMsec = in.readUInt64();
+        in.readUtf8String();
+        QString senderName = in.readUtf8String();
+        QString message = QString::fromUtf8(in.readUtf8());
+        if (!in.isOk())
+            break;
+        if (!senders.contains(senderName))
+            senders.append(senderName);
+        lastMessage = message;
+        ChatRecord record = this->makeRecord(ChatRecord::kindPrivate, ChatRecord::flagWhileAway, senderName, message);
+        // the time it was sent, not the time it has come
+        record.timestampMsec = sentMsec;
+        emit addRecordToLogArea(record);
+    }
+    quint32 left = in.readUInt32();
+    if (senders.isEmpty())
+        return;
+    if (in.isOk() && left == 0)
+        emit addToLogArea("<div style='color:gray'>* All the messages sent while you were away are delivered</div>");
+    // one alert for the page, not one per message
+    QString title = Constants::programName;
+    QString body = "[" + senders.join(", ") + "] while you were away:\n" + utils->shortenForMessageInTray(lastMessage);
+    emit showMessageInTray(title, body, QSystemTrayIcon::NoIcon, 5000);
+    msgSound->play();
+    QApplication::alert(mainWindow);
+}
+
+void Client::requestHistory(quint8 mode, quint64 first, quint64 second, int limit, const QStringList &peerNames)
+{
+    historyRequestId++;
+    historyMessagesShown = 0;
+    FrameBuilder frame(Constants::comHistoryRequest);
+    frame.appendUInt32(historyRequestId).appendUInt8(mode).appendUInt64(first).appendUInt64(second)
+            .appendUInt32(limit).appendUInt32(peerNames.size());
+    foreach (const QString &name, peerNames)
+        frame.appendUtf8String(name);
+    this->writeToSocket(this->finishFrame(frame));
+}
+
+void Client::showHistoryPage(FrameReader &in)
+{
+    quint32 requestId = in.readUInt32();
+    quint8 flags = in.readUInt8();
+    quint32 count = in.readUInt32();
+    if (!in.isOk() || requestId != historyRequestId)
+        return;
+    if (flags & Constants::historyUnavailable)
+    {
+        emit addToLogArea("<div style='color:red'>* ChatServer keeps no history</div>");
+        return;
+    }
+    for (quint32 i = 0; i < count && in.isOk(); ++i)
+    {
+        quint64 messageId = in.readUInt64();
+        qint64 sentMsec = in.readUInt64();
+        QString senderName = in.readUtf8String();
+        in.readUInt8();
+        QString message = QString::fromUtf8(in.readUtf8());
+        if (!in.isOk())
+            break;
+        // the id lets the user go on with "#history before <id>"
+        quint8 flags = ChatRecord::flagServerHistory;
+        if (senderName.compare(this->getName(), Qt::CaseInsensitive) == 0)
+            flags |= ChatRecord::flagFromMe;
+        ChatRecord record = this->makeRecord(ChatRecord::kindToAll, flags, senderName, message);
+        record.timestampMsec = sentMsec;
+        record.messageId = messageId;
+        emit addRecordToLogArea(record);
+        historyMessagesShown++;
+    }
+    if (flags & Constants::historyLast)
+        emit addToLogArea(tr("<div style='color:gray'>* %1 messages of the history</div>").arg(historyMessagesShown));
+}
+
+void Client::processMessageChunk(FrameReader &in)
+{
+    quint32 streamId = in.readUInt32();
+    quint8 flags = in.readUInt8();
+    QString senderKey;
+    quint32 senderId = 0;
+    if (serverProtocolVersion >= 3)
+    {
+        senderId = in.readUInt32();
+        senderKey = QString::number(senderId);
+    }
+    else
+        senderKey = in.readString();
+    // the streams ids are chosen by the senders, so they are unique per sender only
+    QString streamKey = senderKey + ":" + QString::number(streamId);
+    if (flags & Constants::chunkFirst)
+    {
+        IncomingStream stream;
+        if (serverProtocolVersion >= 3)
+        {
+            stream.kind = in.readUInt8();
+            this->findPeer(senderId, &stream.senderUUID, &stream.senderName);
+            if (stream.kind == Constants::comMessageToClients)
+                stream.receivers = describePeers(in.readUInt32List());
+        }
+        else
+        {
+            stream.senderUUID = senderKey;
+            stream.kind = in.readUInt8();
+            stream.senderName = in.readString();
+            if (stream.kind == Constants::comMessageToClients)
+                stream.receivers = in.readStringList();
+        }
+        incomingStreams.insert(streamKey, stream);
+    }
+    QString piece = this->readString(in);
+    if (!in.isOk())
+        return;
+    QHash<QString, IncomingStream>::iterator it = incomingStreams.find(streamKey);
+    if (it == incomingStreams.end())
+        return;
+    it->text += piece;
+    if (it->text.length() > maxIncomingMessageLength)
+    {
+        incomingStreams.erase(it);
+        return;
+    }
+    if (flags & Constants::chunkLast)
+    {
+        IncomingStream stream = it.value();
+        incomingStreams.erase(it);
+        if (stream.kind == Constants::comMessageToAll)
+            showMessageToAll(stream.senderUUID, stream.senderName, stream.text);
+        else
+            showMessageToClients(stream.receivers, stream.senderUUID, stream.senderName, stream.text);
+    }
+}
+
+QString Client::readString(FrameReader &in)
+{
+    // [quint32 size][UTF-8] since protocol version 4
+    if (serverProtocolVersion < 4)
+        return in.readString();
+    return in.readUtf8String();
+}
+
+void Client::writeString(FrameBuilder &frame, const QString &str)
+{
+    if (serverProtocolVersion < 4)
+        frame.appendString(str);
+    else
+        frame.appendUtf8String(str);
+}
+
+bool Client::findPeer(quint32 id, QString *uuid, QString *name)
+{
+    if (id == sessionId)
+    {
+        *uuid = this->getUUID();
+        *name = this->getName();
+        return true;
+    }
+    QHash<quint32, Peer>::const_iterator it = peers.constFind(id);
+    if (it == peers.constEnd())
+    {
+        *uuid = QString();
+        *name = Constants::constNameUnknown;
+        return false;
+    }
+    *uuid = it->uuid;
+    *name = it->name;
+    return true;
+}
+
+QStringList Client::describePeers(const QList<quint32> &ids)
+{
+    // "name {uuid}" as the original protocol sends the receivers
+    QStringList clientsList;
+    QString uuid;
+    QString name;
+    foreach (quint32 id, ids)
+        if (this->findPeer(id, &uuid, &name))
+            clientsList.append(name + " " + uuid);
+    return clientsList;
+}
+
+void Client::addPeer(quint32 id, const QString &uuid, const QString &name)
+{
+    Peer peer;
+    peer.uuid = uuid;
+    peer.name = name;
+    peers.insert(id, peer);
+    peerIdsByUUID.insert(uuid, id);
+}
+
+void Client::removeAwayPeer(const QString &name)
+{
+    // back under a new session id, the old one is of no use any more
+    quint32 id = awayPeerIds.take(name.toCaseFolded());
+    if (id == 0)
+        return;
+    QHash<quint32, Peer>::iterator it = peers.find(id);
+    if (it == peers.end())
+        return;
+    peerIdsByUUID.remove(it->uuid);
+    peers.erase(it);
+}
+
+void Client::clearPeers()
+{
+    peers.clear();
+    peerIdsByUUID.clear();
+    awayPeerIds.clear();
+    sessionId = 0;
+}
+
+bool Client::isCommandExpected(QString text)
+{
+    if (text[0] == '#')
+        return true;
+    return false;
+}
+
+void Client::processCommand(QString text)
+{
+    QRegExp pingCommandRegExp("^ping$");
+    pingCommandRegExp.setCaseSensitivity(Qt::CaseInsensitive);
+    QRegExp historyCommandRegExp("^history(?:\\s+(last|before|after|since)\\s+(\\d+))?(?:\\s+with\\s+(\\w+(?:[\\s,]+\\w+)*))?\\s*$");
+    historyCommandRegExp.setCaseSensitivity(Qt::CaseInsensitive);
+    if (pingCommandRegExp.indexIn(text) != -1)
+    {
+        // ping command, a timed one if the server knows it
+        if (serverProtocolVersion >= 6)
+        {
+            reportPingSeq = nextPingSeq;
+            this->sendPingRequest();
+        }
+        else
+            this->sendCommand(Constants::comPing);
+        emit clearMessageArea();
+    }
+    else if (historyCommandRegExp.indexIn(text) != -1)
+    {
+        // history [last N | before ID | after ID | since HOURS] [with NAME, ...]
+        if (serverProtocolVersion < 8)
+        {
+            addToLogArea("<div style='color:red'>This ChatServer doesn't keep the history.</div>");
+            return;
+        }
+        QString range = historyCommandRegExp.cap(1).toLower();
+        quint64 value = historyCommandRegExp.cap(2).toULongLong();
+        QStringList peerNames = historyCommandRegExp.cap(3).split(QRegExp("[\\s,]+"), QString::SkipEmptyParts);
+        int limit = Constants::historyDefaultMessages;
+        if (range == "last")
+            this->requestHistory(Constants::historyBefore, 0, 0, qMax(1, (int)qMin(value, (quint64)Constants::historyMaxMessages)), peerNames);
+        else if (range == "before")
+            this->requestHistory(Constants::historyBefore, value, 0, limit, peerNames);
+        else if (range == "after")
+            this->requestHistory(Constants::historyAfter, value, 0, limit, peerNames);
+        else if (range == "since")
+        {
+            qint64 nowMsec = QDateTime::currentMSecsSinceEpoch();
+            this->requestHistory(Constants::historyByTime, nowMsec - qint64(value) * 3600 * 1000, nowMsec,
+                                 Constants::historyMaxMessages, peerNames);
+        }
+        else
+            this->requestHistory(Constants::historyBefore, 0, 0, limit, peerNames);
+        emit clearMessageArea();
+    }
+    else
+    {
+        addToLogArea(tr("<div style='color:red'>Unknown command: \"%1\" </div>").arg(text.left(text.indexOf(' '))));
+    }
+}
+
+bool Client::isConnected()
+{
+    if (this->getSocket()->state() == QAbstractSocket::ConnectedState)
+        return true;
+    else
+        return false;
+}
+
+bool Client::connectToChatServer(QHostAddress ipAddress, quint16 port)
+{
+    this->getSocket()->connectToHost(ipAddress, port);
+    if (!this->getSocket()->waitForConnected(3000))
+        return false;
+    else
+        return true;
+}
+
+void Client::disconnectFromChatServer()
+{
+    this->getSocket()->disconnectFromHost();
+}
+
+void Client::tryToRegister(QString name)
+{
+    FrameBuilder frame(Constants::comRegisterRequest);
+    this->writeString(frame, this->getUUID());
+    this->writeString(frame, name);
+    this->writeToSocket(this->finishFrame(frame));
+}
+
+void Client::sendCommand(quint8 command)
+{
+    this->writeToSocket(FrameBuilder(command).finish());
+}
+
+void Client::sendClientConnected()
+{
+    // the original protocol's UTF-16, the version isn't known yet
+    this->writeToSocket(FrameBuilder(Constants::comClientConnected).appendString(this->getUUID()).finish());
+}
+
+void Client::writeToSocket(QByteArray block)
+{
+    if (block.isEmpty())
+        return;
+    this->getSocket()->write(block);
+}
+
+void Client::onSocketConnected()
+{
+    receiveDecoder.clear();
+    incomingStreams.clear();
+    this->clearPeers();
+    serverProtocolVersion = 1;
+    this->sendClientConnected();
+    // an empty hello is safely skipped by the servers of the original protocol
+    this->sendCommand(Constants::comProtocolHello);
+}
+
+void Client::onSocketDisconnected()
+{
+    pingTimer->stop();
+    rttHistogram.clear();
+    reportPingSeq = 0;
+    emit rttUpdated(QString());
+    emit clientDisconnected();
+}
+
+void Client::sendPingRequest()
+{
+    this->writeToSocket(FrameBuilder(Constants::comPingRequest).appendUInt32(nextPingSeq++)
+                        .appendUInt64(rttClock.nsecsElapsed() / 1000).finish());
+}
+
+void Client::sendPingReply(quint32 seq, quint64 sentUsec)
+{
+    this->writeToSocket(FrameBuilder(Constants::comPingReply).appendUInt32(seq).appendUInt64(sentUsec).finish());
+}
+
+void Client::onPingReply(quint32 seq, quint64 sentUsec)
+{
+    quint64 nowUsec = rttClock.nsecsElapsed() / 1000;
+    if (sentUsec > nowUsec)
+        return;
+    rttHistogram.addSample(nowUsec - sentUsec);
+    emit rttUpdated(this->describeRtt());
+    if (seq == reportPingSeq)
+    {
+        reportPingSeq = 0;
+        emit addToLogArea(tr("<div style='color:gray'>Pong: %1 ms (%2 over the last %3 pings)</div>")
+                          .arg((nowUsec - sentUsec) / 1000.0, 0, 'f', 1).arg(this->describeRtt())
+                          .arg(rttHistogram.getSamplesCount()));
+    }
+}
+
+QString Client::describeRtt()
+{
+    return tr("RTT p50 %1 ms, p99 %2 ms, max %3 ms")
+            .arg(rttHistogram.percentile(50) / 1000.0, 0, 'f', 1)
+            .arg(rttHistogram.percentile(99) / 1000.0, 0, 'f', 1)
+            .arg(rttHistogram.getMax() / 1000.0, 0, 'f', 1);
+}
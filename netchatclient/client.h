@@ -1,71 +1,146 @@
-#ifndef CLIENT_H
-#define CLIENT_H
-
-#include <QObject>
-#include <QMainWindow>
-#include <QTcpSocket>
-#include <QSystemTrayIcon>
-#include <QMediaPlayer>
-
-class Utils;
-
-class Client : public QObject
-{
-    Q_OBJECT
-public:
-    explicit Client(QMainWindow *widget = 0, QObject *parent = 0);
-
-private:
-    QString uuid;
-    QString clientName;
-    QTcpSocket *socket;
-    quint16 blockSize;
-
-    QMainWindow* mainWindow;
-    QMediaPlayer *msgSound;
-    Utils *utils;
-
-public:
-    void setName(const QString &name) {this->clientName = name;}
-    void setUUID(const QString &uuid) {this->uuid = uuid;}
-    void setSocket(QTcpSocket *socket) {this->socket = socket;}
-    QString getName() {return clientName;}
-    QString getUUID() {return uuid;}
-    QTcpSocket* getSocket() {return socket;}
-
-    bool connectToChatServer(QHostAddress ipAddress, quint16 port);
-    void disconnectFromChatServer();
-    void sendMessageToAll(QString message);
-    void sendMessageToSelected(QString message, QString selectedClients);
-    bool isConnected();
-    bool isCommandExpected(QString text);
-    void processCommand(QString text);
-    void tryToRegister(QString name);
-    void sendCommand(quint8 command);
-
-private:
-    QString generateUUID();
-    QString retrieveNameFromStr(QString str);
-    void writeToSocket(QByteArray block);
-
-signals:
-    void addToLogArea(const QString &, bool = true);
-    void addClientsToGUI(const QStringList &);
-    void addClientToGUI(const QString &, const QString &);
-    void removeClientFromGUI(const QString &, const QString &);
-    void clientDisconnected();
-    void clearMessageArea();
-    void setWindowTitleWithClientName();
-    void adjustGUIOnDeregister();
-    void showMessageInTray(const QString &title, const QString &msg,
-                           QSystemTrayIcon::MessageIcon icon, int msecs, bool isMsg = true);
-
-private slots:
-    void onSocketDisplayError(QAbstractSocket::SocketError);
-    void onSocketConnected();
-    void onSocketDisconnected();
-    void onSocketReadyRead();
-    void sendClientConnected();
-};
-
-#endif // CLIENT_H
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include <QObject>
+#include <QMainWindow>
+#include <QTcpSocket>
+#include <QSystemTrayIcon>
+#include <QMediaPlayer>
+#include <QHash>
+#include <QStringList>
+#include <QElapsedTimer>
+
+#include "rtthistogram.h"
+#include "framecodec.h"
+#include "chatrecord.h"
+
+class Utils;
+class QTimer;
+
+class Client : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Client(QMainWindow *widget = 0, QObject *parent = 0);
+
+private:
+    QString uuid;
+    QString clientName;
+    QTcpSocket *socket;
+    FrameDecoder receiveDecoder;
+    quint8 serverProtocolVersion;
+    quint32 nextStreamId;
+    // the session id the server has assigned to us (protocol version 3)
+    quint32 sessionId;
+
+    // the other registered clients by their session ids (protocol version 3)
+    struct Peer
+    {
+        QString uuid;
+        QString name;
+    };
+    QHash<quint32, Peer> peers;
+    QHash<QString, quint32> peerIdsByUUID;
+    // the peers who have left stay selectable, the server keeps the messages to them
+    // (protocol version 7); by the case-folded name, until they come back
+    QHash<QString, quint32> awayPeerIds;
+
+    // a long message coming in chunks
+    struct IncomingStream
+    {
+        quint8 kind;
+        QString senderUUID;
+        QString senderName;
+        QStringList receivers;
+        QString text;
+    };
+    QHash<QString, IncomingStream> incomingStreams;
+    static const int maxIncomingMessageLength = 8 * 1024 * 1024;
+
+    // the timed pings (protocol version 6): the send times are of our monotonic clock
+    QElapsedTimer rttClock;
+    quint32 nextPingSeq;
+    // the ping asked for with #ping, its reply is shown in the log
+    quint32 reportPingSeq;
+    RttHistogram rttHistogram;
+    QTimer *pingTimer;
+
+    // the #history request being answered, the pages of an older one are skipped
+    quint32 historyRequestId;
+    int historyMessagesShown;
+
+    QMainWindow* mainWindow;
+    QMediaPlayer *msgSound;
+    Utils *utils;
+
+public:
+    void setName(const QString &name) {this->clientName = name;}
+    void setUUID(const QString &uuid) {this->uuid = uuid;}
+    void setSocket(QTcpSocket *socket) {this->socket = socket;}
+    QString getName() {return clientName;}
+    QString getUUID() {return uuid;}
+    QTcpSocket* getSocket() {return socket;}
+
+    bool connectToChatServer(QHostAddress ipAddress, quint16 port);
+    void disconnectFromChatServer();
+    void sendMessageToAll(QString message);
+    void sendMessageToSelected(QString message, QString selectedClients);
+    bool isConnected();
+    bool isCommandExpected(QString text);
+    void processCommand(QString text);
+    void tryToRegister(QString name);
+    void sendCommand(quint8 command);
+
+private:
+    QString generateUUID();
+    QString retrieveNameFromStr(QString str);
+    void writeToSocket(QByteArray block);
+    QByteArray finishFrame(FrameBuilder &frame);
+    void sendMessageStream(quint8 kind, const QString &selectedClients, const QString &message);
+    void processBlock(const QByteArray &block);
+    void processMessageChunk(FrameReader &in);
+    void writeReceivers(FrameBuilder &frame, const QString &selectedClients);
+    QString readString(FrameReader &in);
+    void writeString(FrameBuilder &frame, const QString &str);
+    bool findPeer(quint32 id, QString *uuid, QString *name);
+    QStringList describePeers(const QList<quint32> &ids);
+    void addPeer(quint32 id, const QString &uuid, const QString &name);
+    void clearPeers();
+    void removeAwayPeer(const QString &name);
+    void showOfflineMessages(FrameReader &in);
+    ChatRecord makeRecord(quint8 kind, quint8 flags, const QString &sender, const QString &text);
+    void requestHistory(quint8 mode, quint64 first, quint64 second, int limit, const QStringList &peerNames);
+    void showHistoryPage(FrameReader &in);
+    void sendPingReply(quint32 seq, quint64 sentUsec);
+    void onPingReply(quint32 seq, quint64 sentUsec);
+    QString describeRtt();
+    void showMessageToAll(const QString &senderUUID, const QString &senderName, const QString &message);
+    void showMessageToClients(const QStringList &receivers, const QString &senderUUID,
+                              const QString &senderName, const QString &message);
+
+signals:
+    void addToLogArea(const QString &);
+    // a message, the notices go to addToLogArea
+    void addRecordToLogArea(const ChatRecord &);
+    void addClientsToGUI(const QStringList &);
+    void addClientToGUI(const QString &, const QString &);
+    void removeClientFromGUI(const QString &, const QString &);
+    void markClientAwayInGUI(const QString &, const QString &);
+    void clientDisconnected();
+    void clearMessageArea();
+    void setWindowTitleWithClientName();
+    void rttUpdated(const QString &text);
+    void adjustGUIOnDeregister();
+    void showMessageInTray(const QString &title, const QString &msg,
+                           QSystemTrayIcon::MessageIcon icon, int msecs, bool isMsg = true);
+
+private slots:
+    void onSocketDisplayError(QAbstractSocket::SocketError);
+    void onSocketConnected();
+    void onSocketDisconnected();
+    void onSocketReadyRead();
+    void sendClientConnected();
+    void sendPingRequest();
+};
+
+#endif // CLIENT_H
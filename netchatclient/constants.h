@@ -1,32 +1,96 @@
-#ifndef CONSTANTS_H
-#define CONSTANTS_H
-
-#include <QString>
-
-namespace Constants {
-
-static const QString constNameUnknown = ".Unknown";
-static const quint8 comRegisterRequest = 1;
-static const quint8 comRegisteredClients = 2;
-static const quint8 comClientJoined = 3;
-static const quint8 comClientLeft = 4;
-static const quint8 comMessageToAll = 5;
-static const quint8 comMessageToClients = 6;
-static const quint8 comPublicServerMessage = 7;
-static const quint8 comPrivateServerMessage = 8;
-static const quint8 comRegistrationSuccess = 9;
-static const quint8 comDisconnectClient = 10;
-static const quint8 comDeregisterRequest = 11;
-static const quint8 comDeregisterClient = 14;
-static const quint8 comPing = 15;
-static const quint8 comClientConnected = 16;
-
-static const quint8 comErrClientExists = 201;
-static const quint8 comErrNameInvalid = 202;
-static const quint8 comErrNameUsed = 203;
-static const quint8 comErrNameIllegal = 204;
-
-static const QString programName = "NetChatClient";
-}
-
-#endif // CONSTANTS_H
+#ifndef CONSTANTS_H
+#define CONSTANTS_H
+
+#include <QString>
+
+namespace Constants {
+
+static const QString constNameUnknown = ".Unknown";
+static const quint8 comRegisterRequest = 1;
+static const quint8 comRegisteredClients = 2;
+static const quint8 comClientJoined = 3;
+static const quint8 comClientLeft = 4;
+static const quint8 comMessageToAll = 5;
+static const quint8 comMessageToClients = 6;
+static const quint8 comPublicServerMessage = 7;
+static const quint8 comPrivateServerMessage = 8;
+static const quint8 comRegistrationSuccess = 9;
+static const quint8 comDisconnectClient = 10;
+static const quint8 comDeregisterRequest = 11;
+static const quint8 comDeregisterClient = 14;
+static const quint8 comPing = 15;
+static const quint8 comClientConnected = 16;
+// protocol negotiation: an empty hello from the client, the server answers with its version,
+// the client confirms the version both sides use from now on
+static const quint8 comProtocolHello = 17;
+static const quint8 comProtocolAccepted = 18;
+static const quint8 comProtocolVersion = 19;
+// a part of a long message (protocol version 2)
+static const quint8 comMessageChunk = 20;
+// the server drops the messages sent faster than it lets: [quint32 msec to wait]
+static const quint8 comSlowDown = 21;
+// the server asks an idle client whether it's still there, the client answers with the same (protocol version 5)
+static const quint8 comHeartbeat = 22;
+// [quint32 sequence number][quint64 monotonic send time, usec of the sender's clock],
+// the receiver sends the same back as a reply at once (protocol version 6)
+static const quint8 comPingRequest = 23;
+static const quint8 comPingReply = 24;
+// the private messages sent while the client was away, a page of them after the registration:
+// [quint32 count][quint64 msec since epoch][sender UUID][sender name][text]...[quint32 messages left]
+// (protocol version 7)
+static const quint8 comOfflineMessages = 25;
+// the history kept by the server (protocol version 8): the client asks
+// [quint32 request id][quint8 mode][quint64 a][quint64 b][quint32 limit][quint32 count][peer name]...
+// (no peers - the messages to all), the server answers with pages of
+// [quint32 request id][quint8 flags][quint32 count][quint64 message id][quint64 msec][sender name]
+// [quint8 record flags][text]...
+static const quint8 comHistoryRequest = 26;
+static const quint8 comHistoryPage = 27;
+static const quint8 historyByTime = 1;
+static const quint8 historyBefore = 2;
+static const quint8 historyAfter = 3;
+static const quint8 historyLast = 0x01;
+static const quint8 historyUnavailable = 0x02;
+
+static const quint8 comErrClientExists = 201;
+static const quint8 comErrNameInvalid = 202;
+static const quint8 comErrNameUsed = 203;
+static const quint8 comErrNameIllegal = 204;
+// the client doesn't read fast enough and is disconnected
+static const quint8 comErrSlowConsumer = 205;
+// too many registrations from the client's address, it's disconnected
+static const quint8 comErrTooManyRequests = 206;
+
+// 1 - the original protocol, 2 - extended frame sizes, paged roster, chunked messages,
+// 3 - the clients are referenced by the 32-bit session ids the server assigns on registration,
+// 4 - the strings are [quint32 size][UTF-8] instead of the UTF-16 of QDataStream,
+// 5 - the server checks the idle connections with heartbeats,
+// 6 - timestamped ping/pong in both directions,
+// 7 - the private messages to the clients who have left are kept and delivered on their return,
+// 8 - the history requests
+static const quint8 protocolVersion = 8;
+static const quint8 chunkFirst = 0x01;
+static const quint8 chunkLast = 0x02;
+// messages longer than that are sent in chunks of that length
+static const int messageChunkLength = 8192;
+
+// the client pings the server that often to keep the round trip readout fresh
+static const int pingIntervalMsec = 5000;
+// the round trip percentiles are taken over that many last pings
+static const int rttWindowSamples = 256;
+// #history asks for that many messages unless told otherwise, the server returns not more than the max
+static const int historyDefaultMessages = 50;
+static const int historyMaxMessages = 1000;
+// the local history: that many last messages of the day are shown on the start
+static const int historyTailRecords = 500;
+// the log of the window keeps that many last records (the "logCapacity" setting), the older ones are dropped
+static const int logCapacity = 1000000;
+// the records coming in are added to the log in batches, once in that time
+static const int logFlushMsec = 40;
+// the laid out rows kept, the ones around the visible part of the log
+static const int logCachedRows = 2000;
+
+static const QString programName = "NetChatClient";
+}
+
+#endif // CONSTANTS_H
@@ -0,0 +1,149 @@
+#include <QDir>
+#include <QtEndian>
+
+#include "historyfile.h"
+#include "framecodec.h"
+
+HistoryFile::HistoryFile(const QString &directory) : directory(directory)
+{
+}
+
+QString HistoryFile::fileName(const QDate &date) const
+{
+    return QDir(directory).filePath("msg" + date.toString("MMddyy") + ".rec");
+}
+
+bool HistoryFile::openFor(const QDate &date)
+{
+    file.close();
+    if (!QDir().mkpath(directory))
+        return false;
+    file.setFileName(fileName(date));
+    // every record goes to the file at once, nothing is left in a buffer on a crash
+    if (!file.open(QIODevice::Append | QIODevice::Unbuffered))
+        return false;
+    fileDate = date;
+    if (file.size() == 0)
+    {
+        uchar magic[sizeof(quint32)];
+        qToBigEndian<quint32>(fileMagic, magic);
+        file.write(reinterpret_cast<const char *>(magic), sizeof(magic));
+    }
+    return true;
+}
+
+bool HistoryFile::append(const ChatRecord &record)
+{
+    // a new file every day, as the log of the window starts empty every day
+    QDate today = QDate::currentDate();
+    if ((!file.isOpen() || fileDate != today) && !openFor(today))
+        return false;
+    QByteArray bytes = encode(record);
+    return file.write(bytes) == bytes.size();
+}
+
+QByteArray HistoryFile::encode(const ChatRecord &record)
+{
+    // [timestamp][flags][sender][receivers][text], then [checksum][length]
+    FrameBuilder frame(record.kind, record.text.size() * 3 + record.receivers.size() * 32 + 64);
+    frame.appendUInt64(record.timestampMsec).appendUInt8(record.flags).appendUtf8String(record.sender)
+            .appendUInt32(record.receivers.size());
+    foreach (const QString &name, record.receivers)
+        frame.appendUtf8String(name);
+    frame.appendUtf8String(record.text);
+    QByteArray bytes = frame.finish();
+    uchar trailer[sizeof(quint16) + sizeof(quint32)];
+    qToBigEndian<quint16>(qChecksum(bytes.constData(), bytes.size()), trailer);
+    qToBigEndian<quint32>(bytes.size(), trailer + sizeof(quint16));
+    bytes.append(reinterpret_cast<const char *>(trailer), sizeof(trailer));
+    return bytes;
+}
+
+int HistoryFile::readBackward(const char *data, qint64 end, qint64 begin, ChatRecord *record)
+{
+    const int trailerSize = sizeof(quint16) + sizeof(quint32);
+    const uchar *ptr = reinterpret_cast<const uchar *>(data);
+    if (end - begin < trailerSize + 3)
+        return 0;
+    quint32 length = qFromBigEndian<quint32>(ptr + end - sizeof(quint32));
+    if (length < 3 || length > end - begin - trailerSize)
+        return 0;
+    qint64 start = end - trailerSize - length;
+    if (qChecksum(data + start, length) != qFromBigEndian<quint16>(ptr + end - trailerSize))
+        return 0;
+    // the size of the frame agrees with the length
+    int headerSize = sizeof(quint16);
+    quint32 frameSize = qFromBigEndian<quint16>(ptr + start);
+    if (frameSize == 0xffff)
+    {
+        if (length < sizeof(quint16) + sizeof(quint32) + 1)
+            return 0;
+        headerSize += sizeof(quint32);
+        frameSize = qFromBigEndian<quint32>(ptr + start + sizeof(quint16));
+    }
+    if (headerSize + frameSize != length)
+        return 0;
+    FrameReader in(data + start + headerSize, frameSize);
+    record->kind = in.readUInt8();
+    record->timestampMsec = in.readUInt64();
+    record->flags = in.readUInt8();
+    record->sender = in.readUtf8String();
+    quint32 count = in.readUInt32();
+    record->receivers.clear();
+    for (quint32 i = 0; i < count && in.isOk(); ++i)
+        record->receivers.append(in.readUtf8String());
+    record->text = in.readUtf8String();
+    return in.isOk() ? length + trailerSize : 0;
+}
+
+qint64 HistoryFile::validSize(const char *data, qint64 size)
+{
+    // the records from the start, each by the size of its frame, up to the first damaged one
+    const uchar *ptr = reinterpret_cast<const uchar *>(data);
+    qint64 pos = sizeof(quint32);
+    ChatRecord record;
+    while (size - pos >= (qint64)sizeof(quint16))
+    {
+        qint64 frameSize = qFromBigEndian<quint16>(ptr + pos) + sizeof(quint16);
+        if (frameSize == 0xffff + sizeof(quint16))
+        {
+            if (size - pos < (qint64)(sizeof(quint16) + sizeof(quint32)))
+                break;
+            frameSize = qFromBigEndian<quint32>(ptr + pos + sizeof(quint16)) + sizeof(quint16) + sizeof(quint32);
+        }
+        qint64 end = pos + frameSize + sizeof(quint16) + sizeof(quint32);
+        if (end > size || readBackward(data, end, pos, &record) != end - pos)
+            break;
+        pos = end;
+    }
+    return pos;
+}
+
+QList<ChatRecord> HistoryFile::loadTail(int maxRecords)
+{
+    QList<ChatRecord> records;
+    QFile in(fileName(QDate::currentDate()));
+    if (!in.open(QIODevice::ReadWrite))
+        return records;
+    qint64 size = in.size();
+    const char *data = size > (qint64)sizeof(quint32) ? reinterpret_cast<const char *>(in.map(0, size)) : 0;
+    if (data == 0 || qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(data)) != fileMagic)
+        return records;
+    ChatRecord record;
+    qint64 end = size;
+    // the last write didn't complete, where the good records end is found from the start
+    if (readBackward(data, end, sizeof(quint32), &record) == 0)
+        end = validSize(data, size);
+    // from the end back, the records before the tail are never touched
+    qint64 pos = end;
+    int length;
+    while (records.size() < maxRecords && (length = readBackward(data, pos, sizeof(quint32), &record)) > 0)
+    {
+        records.prepend(record);
+        pos -= length;
+    }
+    in.unmap(reinterpret_cast<uchar *>(const_cast<char *>(data)));
+    if (end < size)
+        in.resize(end);
+    return records;
+}
@@ -0,0 +1,40 @@
+#ifndef HISTORYFILE_H
+#define HISTORYFILE_H
+
+#include <QFile>
+#include <QDate>
+#include <QList>
+
+#include "chatrecord.h"
+
+// the local history: a file per day of append-only records, each written as it comes.
+// A record is a frame of the chat protocol (the kind is the command) carrying the fields,
+// followed by [quint16 checksum][quint32 frame length], so the file can be read from the end
+// and only the tail of a long day is ever read
+class HistoryFile
+{
+public:
+    explicit HistoryFile(const QString &directory);
+
+    // the last records of today, read through a mapping of the file; a torn tail is cut off
+    QList<ChatRecord> loadTail(int maxRecords);
+    bool append(const ChatRecord &record);
+
+    static QByteArray encode(const ChatRecord &record);
+    // the record ending at the end: its length, or 0 if it's incomplete or damaged
+    static int readBackward(const char *data, qint64 end, qint64 begin, ChatRecord *record);
+    // where the good records of a file end, read from the start: the size to cut a torn tail at
+    static qint64 validSize(const char *data, qint64 size);
+
+    static const quint32 fileMagic = 0x4e434831; // "NCH1"
+
+private:
+    QString directory;
+    QFile file;
+    QDate fileDate;
+
+    QString fileName(const QDate &date) const;
+    bool openFor(const QDate &date);
+};
+
+#endif // HISTORYFILE_H
@@ -1,27 +1,41 @@
-TEMPLATE = app
-
-TARGET = netchatclient
-
-QT += network widgets multimedia gui
-
-HEADERS += \
-    client.h \
-    mainwindow.h \
-    utils.h \
-    constants.h \
-    utils.h
-
-SOURCES += \
-    client.cpp \
-    main.cpp \
-    mainwindow.cpp \
-    utils.cpp \
-    utils.cpp
-
-FORMS += \
-    mainwindow.ui
-
-RESOURCES += \
-    netchatclient.qrc
-
-win32:RC_ICONS += "data\\icon.ico"
+TEMPLATE = app
+
+TARGET = netchatclient
+
+QT += network widgets multimedia gui
+
+HEADERS += \
+    client.h \
+    mainwindow.h \
+    utils.h \
+    constants.h \
+    utils.h \
+    rtthistogram.h \
+    chatrecord.h \
+    historyfile.h \
+    chatlogmodel.h \
+    chatlogdelegate.h \
+    chatlogview.h
+
+SOURCES += \
+    client.cpp \
+    main.cpp \
+    mainwindow.cpp \
+    utils.cpp \
+    utils.cpp \
+    rtthistogram.cpp \
+    chatrecord.cpp \
+    historyfile.cpp \
+    chatlogmodel.cpp \
+    chatlogdelegate.cpp \
+    chatlogview.cpp
+
+include(../common/common.pri)
+
+FORMS += \
+    mainwindow.ui
+
+RESOURCES += \
+    netchatclient.qrc
+
+win32:RC_ICONS += "data\\icon.ico"
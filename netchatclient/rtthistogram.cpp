@@ -0,0 +1,43 @@
+#include <algorithm>
+#include <QtMath>
+
+#include "rtthistogram.h"
+
+RttHistogram::RttHistogram(int windowSize) : samples(windowSize)
+{
+    clear();
+}
+
+void RttHistogram::addSample(qint64 usec)
+{
+    // the oldest sample makes room
+    samples[nextIndex] = usec;
+    nextIndex = (nextIndex + 1) % samples.size();
+    count = qMin(count + 1, samples.size());
+    last = usec;
+}
+
+void RttHistogram::clear()
+{
+    nextIndex = 0;
+    count = 0;
+    last = 0;
+}
+
+qint64 RttHistogram::percentile(double p) const
+{
+    if (count == 0)
+        return 0;
+    // the window is small, a partial sort of a copy is cheap enough
+    QVector<qint64> window = samples.mid(0, count);
+    int index = qBound(0, qCeil(p / 100 * count) - 1, count - 1);
+    std::nth_element(window.begin(), window.begin() + index, window.end());
+    return window.at(index);
+}
+
+qint64 RttHistogram::getMax() const
+{
+    if (count == 0)
+        return 0;
+    return *std::max_element(samples.constBegin(), samples.constBegin() + count);
+}
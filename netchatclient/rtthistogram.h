@@ -0,0 +1,27 @@
+#ifndef RTTHISTOGRAM_H
+#define RTTHISTOGRAM_H
+
+#include <QVector>
+
+// the round trips of the last N pings, the percentiles are taken over that window
+class RttHistogram
+{
+public:
+    explicit RttHistogram(int windowSize);
+
+    void addSample(qint64 usec);
+    void clear();
+    int getSamplesCount() const {return this->count;}
+    qint64 getLast() const {return this->last;}
+    // p from 0 to 100, 0 if there are no samples
+    qint64 percentile(double p) const;
+    qint64 getMax() const;
+
+private:
+    QVector<qint64> samples;
+    int nextIndex;
+    int count;
+    qint64 last;
+};
+
+#endif // RTTHISTOGRAM_H
@@ -0,0 +1,168 @@
+#include <QtTest>
+#include <QSignalSpy>
+
+#include "chatlogmodel.h"
+
+class TestChatLogModel : public QObject
+{
+    Q_OBJECT
+
+private:
+    // the record number n of a test, its text tells it
+    static ChatRecord makeRecord(int n);
+    static void append(ChatLogModel *model, int from, int count);
+    // the batch goes in at once instead of on the timer
+    static void flush(ChatLogModel *model);
+    // the rows are the last records appended, each with its number as the serial
+    static void checkRows(const ChatLogModel &model, int appended, int capacity);
+
+private slots:
+    void appendIsBatched();
+    void roles();
+    void ringOverflow();
+    void batchLongerThanCapacity();
+    void ringWraps_data();
+    void ringWraps();
+    void capacityOfOne();
+};
+
+ChatRecord TestChatLogModel::makeRecord(int n)
+{
+    ChatRecord record;
+    record.timestampMsec = Q_INT64_C(1700000000000) + n;
+    record.kind = ChatRecord::kindToAll;
+    record.sender = "sender";
+    record.text = QString::number(n);
+    return record;
+}
+
+void TestChatLogModel::append(ChatLogModel *model, int from, int count)
+{
+    for (int n = from; n < from + count; ++n)
+        model->append(makeRecord(n));
+}
+
+void TestChatLogModel::flush(ChatLogModel *model)
+{
+    QVERIFY(QMetaObject::invokeMethod(model, "flushPending"));
+}
+
+void TestChatLogModel::checkRows(const ChatLogModel &model, int appended, int capacity)
+{
+    int rows = qMin(appended, capacity);
+    QCOMPARE(model.rowCount(), rows);
+    for (int row = 0; row < rows; ++row)
+    {
+        int n = appended - rows + row;
+        QCOMPARE(model.record(row).text, QString::number(n));
+        QCOMPARE(model.serial(row), (quint64)n);
+    }
+}
+
+void TestChatLogModel::appendIsBatched()
+{
+    ChatLogModel model(1000);
+    QSignalSpy inserted(&model, SIGNAL(rowsInserted(QModelIndex,int,int)));
+    append(&model, 0, 100);
+    // nothing until the timer flushes the batch, then one insertion for all of it
+    QCOMPARE(model.rowCount(), 0);
+    QTRY_COMPARE(model.rowCount(), 100);
+    QCOMPARE(inserted.count(), 1);
+    QCOMPARE(inserted.first().at(1).toInt(), 0);
+    QCOMPARE(inserted.first().at(2).toInt(), 99);
+    checkRows(model, 100, 1000);
+}
+
+void TestChatLogModel::roles()
+{
+    ChatLogModel model(10);
+    append(&model, 0, 3);
+    flush(&model);
+    QModelIndex index = model.index(2, 0);
+    QVERIFY(index.data(Qt::DisplayRole).toString().contains("2"));
+    QCOMPARE(index.data(ChatLogModel::SerialRole).toULongLong(), Q_UINT64_C(2));
+    QCOMPARE(index.data(ChatLogModel::RecordRole).value<ChatRecord>().text, QString("2"));
+    QVERIFY(!model.index(3, 0).data(Qt::DisplayRole).isValid());
+    // a list, the rows have no children
+    QCOMPARE(model.rowCount(index), 0);
+}
+
+void TestChatLogModel::ringOverflow()
+{
+    ChatLogModel model(5);
+    append(&model, 0, 3);
+    flush(&model);
+    QSignalSpy removed(&model, SIGNAL(rowsRemoved(QModelIndex,int,int)));
+    QSignalSpy inserted(&model, SIGNAL(rowsInserted(QModelIndex,int,int)));
+    append(&model, 3, 4);
+    flush(&model);
+    // the two oldest rows go first, the four new ones go after the rest
+    QCOMPARE(removed.count(), 1);
+    QCOMPARE(removed.first().at(1).toInt(), 0);
+    QCOMPARE(removed.first().at(2).toInt(), 1);
+    QCOMPARE(inserted.count(), 1);
+    QCOMPARE(inserted.first().at(1).toInt(), 1);
+    QCOMPARE(inserted.first().at(2).toInt(), 4);
+    checkRows(model, 7, 5);
+}
+
+void TestChatLogModel::batchLongerThanCapacity()
+{
+    ChatLogModel model(5);
+    append(&model, 0, 3);
+    flush(&model);
+    QSignalSpy removed(&model, SIGNAL(rowsRemoved(QModelIndex,int,int)));
+    QSignalSpy inserted(&model, SIGNAL(rowsInserted(QModelIndex,int,int)));
+    // only the last 5 of the 12 can stay, the old rows all go
+    append(&model, 3, 12);
+    flush(&model);
+    QCOMPARE(removed.count(), 1);
+    QCOMPARE(removed.first().at(2).toInt(), 2);
+    QCOMPARE(inserted.count(), 1);
+    QCOMPARE(inserted.first().at(1).toInt(), 0);
+    QCOMPARE(inserted.first().at(2).toInt(), 4);
+    checkRows(model, 15, 5);
+}
+
+void TestChatLogModel::ringWraps_data()
+{
+    QTest::addColumn<int>("capacity");
+
+    QTest::newRow("capacity 7") << 7;
+    QTest::newRow("capacity 16") << 16;
+    QTest::newRow("capacity 100") << 100;
+}
+
+void TestChatLogModel::ringWraps()
+{
+    QFETCH(int, capacity);
+
+    ChatLogModel model(capacity);
+    int appended = 0;
+    // batches of every size around the capacity, so the head goes round the ring many times
+    for (int batch = 1; batch <= capacity + 3; ++batch)
+    {
+        append(&model, appended, batch);
+        appended += batch;
+        flush(&model);
+        checkRows(model, appended, capacity);
+        if (QTest::currentTestFailed())
+            return;
+    }
+}
+
+void TestChatLogModel::capacityOfOne()
+{
+    // a capacity below one is taken as one
+    ChatLogModel model(0);
+    append(&model, 0, 3);
+    flush(&model);
+    checkRows(model, 3, 1);
+    append(&model, 3, 1);
+    flush(&model);
+    checkRows(model, 4, 1);
+}
+
+QTEST_GUILESS_MAIN(TestChatLogModel)
+
+#include "tst_chatlogmodel.moc"
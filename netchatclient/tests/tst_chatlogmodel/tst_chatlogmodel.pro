@@ -0,0 +1,23 @@
+TEMPLATE = app
+
+TARGET = tst_chatlogmodel
+
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+QT = core testlib
+
+CLIENTDIR = ../..
+INCLUDEPATH += $$CLIENTDIR
+
+HEADERS += \
+    $$CLIENTDIR/chatlogmodel.h \
+    $$CLIENTDIR/chatrecord.h \
+    $$CLIENTDIR/constants.h \
+    $$CLIENTDIR/utils.h
+
+SOURCES += \
+    tst_chatlogmodel.cpp \
+    $$CLIENTDIR/chatlogmodel.cpp \
+    $$CLIENTDIR/chatrecord.cpp \
+    $$CLIENTDIR/utils.cpp
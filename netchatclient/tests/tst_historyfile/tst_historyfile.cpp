@@ -0,0 +1,224 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QtEndian>
+
+#include "historyfile.h"
+#include "framecodec.h"
+
+class TestHistoryFile : public QObject
+{
+    Q_OBJECT
+
+private:
+    static ChatRecord makeRecord(int n);
+    // [magic][records] as a file of the day holds them
+    static QByteArray makeFile(int count);
+    static void compareRecords(const ChatRecord &actual, const ChatRecord &expected);
+    static QString dayFile(const QString &directory);
+
+private slots:
+    void roundTrip();
+    void longRecord();
+    void readBackwardWalk();
+    void damagedRecord();
+    void lengthPastBegin();
+    void validSize_data();
+    void validSize();
+    void loadTail();
+    void loadTailCutsTornTail();
+};
+
+ChatRecord TestHistoryFile::makeRecord(int n)
+{
+    ChatRecord record;
+    record.timestampMsec = Q_INT64_C(1700000000000) + n * 1000;
+    record.kind = n % 2 == 0 ? ChatRecord::kindPrivate : ChatRecord::kindToAll;
+    record.flags = n % 3 == 0 ? ChatRecord::flagFromMe : 0;
+    record.sender = QString("sender%1").arg(n);
+    if (record.kind == ChatRecord::kindPrivate)
+        record.receivers << "first" << QString::fromUtf8("second \xc3\xa9");
+    record.text = QString::fromUtf8("message %1 \xf0\x9f\x98\x80").arg(n);
+    return record;
+}
+
+QByteArray TestHistoryFile::makeFile(int count)
+{
+    QByteArray data(sizeof(quint32), '\0');
+    qToBigEndian<quint32>(HistoryFile::fileMagic, reinterpret_cast<uchar *>(data.data()));
+    for (int n = 1; n <= count; ++n)
+        data += HistoryFile::encode(makeRecord(n));
+    return data;
+}
+
+void TestHistoryFile::compareRecords(const ChatRecord &actual, const ChatRecord &expected)
+{
+    QCOMPARE(actual.timestampMsec, expected.timestampMsec);
+    QCOMPARE(actual.kind, expected.kind);
+    QCOMPARE(actual.flags, expected.flags);
+    QCOMPARE(actual.sender, expected.sender);
+    QCOMPARE(actual.receivers, expected.receivers);
+    QCOMPARE(actual.text, expected.text);
+}
+
+QString TestHistoryFile::dayFile(const QString &directory)
+{
+    QStringList files = QDir(directory).entryList(QStringList("*.rec"), QDir::Files);
+    return files.size() == 1 ? QDir(directory).filePath(files.first()) : QString();
+}
+
+void TestHistoryFile::roundTrip()
+{
+    for (int n = 1; n <= 4; ++n)
+    {
+        QByteArray bytes = HistoryFile::encode(makeRecord(n));
+        ChatRecord record;
+        QCOMPARE(HistoryFile::readBackward(bytes.constData(), bytes.size(), 0, &record), bytes.size());
+        compareRecords(record, makeRecord(n));
+    }
+}
+
+void TestHistoryFile::longRecord()
+{
+    // the frame gets the extended size field, the trailer stays the same
+    ChatRecord expected = makeRecord(1);
+    expected.text = QString(100000, QChar('x'));
+    QByteArray bytes = HistoryFile::encode(expected);
+    QVERIFY(FrameBuilder::isExtendedFrame(bytes));
+    ChatRecord record;
+    QCOMPARE(HistoryFile::readBackward(bytes.constData(), bytes.size(), 0, &record), bytes.size());
+    compareRecords(record, expected);
+}
+
+void TestHistoryFile::readBackwardWalk()
+{
+    QByteArray data = makeFile(5);
+    // from the end back to the magic, one record at a time
+    qint64 pos = data.size();
+    ChatRecord record;
+    int length;
+    for (int n = 5; n >= 1; --n)
+    {
+        length = HistoryFile::readBackward(data.constData(), pos, sizeof(quint32), &record);
+        QVERIFY(length > 0);
+        compareRecords(record, makeRecord(n));
+        pos -= length;
+    }
+    QCOMPARE(pos, (qint64)sizeof(quint32));
+    QCOMPARE(HistoryFile::readBackward(data.constData(), pos, sizeof(quint32), &record), 0);
+}
+
+void TestHistoryFile::damagedRecord()
+{
+    QByteArray bytes = HistoryFile::encode(makeRecord(2));
+    // the frame and the checksum, any bit of them; the length is checked against the frame
+    int checked = bytes.size() - sizeof(quint32);
+    for (int i = 0; i < checked; ++i)
+    {
+        for (int bit = 0; bit < 8; ++bit)
+        {
+            QByteArray damaged = bytes;
+            damaged[i] = damaged.at(i) ^ (char)(1 << bit);
+            ChatRecord record;
+            QVERIFY2(HistoryFile::readBackward(damaged.constData(), damaged.size(), 0, &record) == 0,
+                     qPrintable(QString("byte %1, bit %2").arg(i).arg(bit)));
+        }
+    }
+}
+
+void TestHistoryFile::lengthPastBegin()
+{
+    QByteArray data = makeFile(2);
+    QByteArray last = HistoryFile::encode(makeRecord(2));
+    ChatRecord record;
+    // the last record doesn't fit after a begin inside it
+    qint64 begin = data.size() - last.size() + 1;
+    QCOMPARE(HistoryFile::readBackward(data.constData(), data.size(), begin, &record), 0);
+    // a length larger than the file
+    QByteArray bogus = data;
+    qToBigEndian<quint32>(0x7fffffff, reinterpret_cast<uchar *>(bogus.data()) + bogus.size() - sizeof(quint32));
+    QCOMPARE(HistoryFile::readBackward(bogus.constData(), bogus.size(), sizeof(quint32), &record), 0);
+}
+
+void TestHistoryFile::validSize_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<qint64>("size");
+
+    QByteArray three = makeFile(3);
+    QByteArray fourth = HistoryFile::encode(makeRecord(4));
+    QTest::newRow("complete") << three << (qint64)three.size();
+    QTest::newRow("empty") << makeFile(0) << (qint64)sizeof(quint32);
+    // the write of the last record didn't complete
+    QTest::newRow("a byte of the next") << three + fourth.left(1) << (qint64)three.size();
+    QTest::newRow("the next but its trailer") << three + fourth.left(fourth.size() - 6) << (qint64)three.size();
+    QTest::newRow("the next but a byte") << three + fourth.left(fourth.size() - 1) << (qint64)three.size();
+    QTest::newRow("zeros") << three + QByteArray(100, '\0') << (qint64)three.size();
+
+    // the good records end at a damaged one, whatever comes after it
+    QByteArray damaged = makeFile(3);
+    int second = sizeof(quint32) + HistoryFile::encode(makeRecord(1)).size();
+    damaged[second + 10] = (char)(damaged.at(second + 10) ^ 0x20);
+    QTest::newRow("damaged in the middle") << damaged << (qint64)second;
+}
+
+void TestHistoryFile::validSize()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(qint64, size);
+
+    QCOMPARE(HistoryFile::validSize(data.constData(), data.size()), size);
+}
+
+void TestHistoryFile::loadTail()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    HistoryFile history(dir.path());
+    QVERIFY(history.loadTail(10).isEmpty());
+    for (int n = 1; n <= 5; ++n)
+        QVERIFY(history.append(makeRecord(n)));
+
+    // the last ones, oldest first
+    QList<ChatRecord> records = history.loadTail(3);
+    QCOMPARE(records.size(), 3);
+    for (int i = 0; i < 3; ++i)
+        compareRecords(records.at(i), makeRecord(i + 3));
+    QCOMPARE(history.loadTail(100).size(), 5);
+}
+
+void TestHistoryFile::loadTailCutsTornTail()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    qint64 goodSize;
+    {
+        HistoryFile history(dir.path());
+        for (int n = 1; n <= 4; ++n)
+            QVERIFY(history.append(makeRecord(n)));
+    }
+    QString fileName = dayFile(dir.path());
+    QVERIFY(!fileName.isEmpty());
+    {
+        QFile file(fileName);
+        goodSize = file.size();
+        QVERIFY(file.open(QIODevice::Append));
+        QByteArray torn = HistoryFile::encode(makeRecord(5));
+        torn.chop(3);
+        file.write(torn);
+    }
+
+    HistoryFile history(dir.path());
+    QList<ChatRecord> records = history.loadTail(100);
+    QCOMPARE(records.size(), 4);
+    compareRecords(records.last(), makeRecord(4));
+    QCOMPARE(QFileInfo(fileName).size(), goodSize);
+    // the next record follows the good ones
+    QVERIFY(history.append(makeRecord(6)));
+    records = history.loadTail(100);
+    QCOMPARE(records.size(), 5);
+    compareRecords(records.last(), makeRecord(6));
+}
+
+QTEST_GUILESS_MAIN(TestHistoryFile)
+
+#include "tst_historyfile.moc"
@@ -0,0 +1,24 @@
+TEMPLATE = app
+
+TARGET = tst_historyfile
+
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+QT = core testlib
+
+CLIENTDIR = ../..
+INCLUDEPATH += $$CLIENTDIR
+
+HEADERS += \
+    $$CLIENTDIR/historyfile.h \
+    $$CLIENTDIR/chatrecord.h \
+    $$CLIENTDIR/utils.h
+
+SOURCES += \
+    tst_historyfile.cpp \
+    $$CLIENTDIR/historyfile.cpp \
+    $$CLIENTDIR/chatrecord.cpp \
+    $$CLIENTDIR/utils.cpp
+
+include(../../../common/common.pri)
@@ -0,0 +1,133 @@
+#include "admissioncontrol.h"
+#include "constants.h"
+
+void TokenBucket::refill(double rate, double burst, qint64 nowMsec)
+{
+    // a new bucket starts full
+    if (lastRefillMsec <= 0)
+        tokens = burst;
+    else
+        tokens = qMin(burst, tokens + (nowMsec - lastRefillMsec) * rate / 1000);
+    lastRefillMsec = nowMsec;
+}
+
+bool TokenBucket::take(double rate, double burst, qint64 nowMsec)
+{
+    refill(rate, burst, nowMsec);
+    if (tokens < 1)
+        return false;
+    tokens -= 1;
+    return true;
+}
+
+bool TokenBucket::isFull(double rate, double burst, qint64 nowMsec) const
+{
+    return lastRefillMsec <= 0 || tokens + (nowMsec - lastRefillMsec) * rate / 1000 >= burst;
+}
+
+// the bursts allowed on top of the rates
+static inline double burstOf(double rate)
+{
+    return qMax(rate * Constants::admissionBurstSeconds, 1.0);
+}
+
+AdmissionControl::AdmissionControl()
+{
+    connectionRate = Constants::admissionConnectionsPerSecond;
+    registrationRate = Constants::admissionRegistrationsPerSecond;
+    maxPending = Constants::admissionMaxPending;
+    lastPruneMsec = 0;
+    // the buckets take 0 for a new one, so the clock never reads 0
+    clock.start();
+}
+
+void AdmissionControl::setLimits(double connectionsPerSecond, double registrationsPerSecond, int maxPending)
+{
+    QMutexLocker locker(&mutex);
+    this->connectionRate = connectionsPerSecond;
+    this->registrationRate = registrationsPerSecond;
+    this->maxPending = maxPending;
+    addressStates.clear();
+}
+
+AdmissionControl::AddressState &AdmissionControl::stateOf(const QHostAddress &address, qint64 nowMsec)
+{
+    if (nowMsec - lastPruneMsec >= Constants::admissionPruneMsec)
+        prune(nowMsec);
+    // an IPv4 client of a dual-stack listener comes as ::ffff:a.b.c.d
+    bool isIPv4 = false;
+    quint32 ipv4 = address.toIPv4Address(&isIPv4);
+    if (isIPv4)
+        return addressStates[QHostAddress(ipv4)];
+    return addressStates[address];
+}
+
+void AdmissionControl::prune(qint64 nowMsec)
+{
+    // the addresses with full buckets are like the ones never seen, the table stays bounded
+    lastPruneMsec = nowMsec;
+    QHash<QHostAddress, AddressState>::iterator it = addressStates.begin();
+    while (it != addressStates.end())
+    {
+        if (it->connections.isFull(connectionRate, burstOf(connectionRate), nowMsec) &&
+                it->registrations.isFull(registrationRate, burstOf(registrationRate), nowMsec))
+            it = addressStates.erase(it);
+        else
+            ++it;
+    }
+}
+
+bool AdmissionControl::admitConnection(const QHostAddress &address)
+{
+    QMutexLocker locker(&mutex);
+    if (maxPending > 0 && pendingConnections.load() >= maxPending)
+    {
+        refusedConnections.fetchAndAddRelaxed(1);
+        return false;
+    }
+    if (connectionRate > 0)
+    {
+        qint64 nowMsec = clock.elapsed() + 1;
+        if (!stateOf(address, nowMsec).connections.take(connectionRate, burstOf(connectionRate), nowMsec))
+        {
+            refusedConnections.fetchAndAddRelaxed(1);
+            return false;
+        }
+    }
+    pendingConnections.fetchAndAddRelaxed(1);
+    return true;
+}
+
+bool AdmissionControl::admitRegistration(const QHostAddress &address)
+{
+    if (registrationRate <= 0)
+        return true;
+    QMutexLocker locker(&mutex);
+    qint64 nowMsec = clock.elapsed() + 1;
+    if (!stateOf(address, nowMsec).registrations.take(registrationRate, burstOf(registrationRate), nowMsec))
+    {
+        refusedRegistrations.fetchAndAddRelaxed(1);
+        return false;
+    }
+    return true;
+}
+
+void AdmissionControl::releasePending()
+{
+    pendingConnections.fetchAndAddRelaxed(-1);
+}
+
+void AdmissionControl::acquirePending()
+{
+    pendingConnections.fetchAndAddRelaxed(1);
+}
+
+AdmissionStats AdmissionControl::getStats() const
+{
+    AdmissionStats stats;
+    stats.pendingConnections = pendingConnections.load();
+    stats.refusedConnections = refusedConnections.load();
+    stats.refusedRegistrations = refusedRegistrations.load();
+    stats.handshakeTimeouts = handshakeTimeouts.load();
+    return stats;
+}
@@ -0,0 +1,83 @@
+#ifndef ADMISSIONCONTROL_H
+#define ADMISSIONCONTROL_H
+
+#include <QHash>
+#include <QHostAddress>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QAtomicInteger>
+
+// a token bucket: takes one token per event, refills at rate tokens per second up to burst
+struct TokenBucket
+{
+    TokenBucket() : tokens(0), lastRefillMsec(0) {}
+
+    // may go below 0 when a large amount is charged
+    double tokens;
+    // 0 - a new bucket
+    qint64 lastRefillMsec;
+
+    void refill(double rate, double burst, qint64 nowMsec);
+    bool take(double rate, double burst, qint64 nowMsec);
+    bool isFull(double rate, double burst, qint64 nowMsec) const;
+};
+
+struct AdmissionStats
+{
+    AdmissionStats() : pendingConnections(0), refusedConnections(0), refusedRegistrations(0),
+        handshakeTimeouts(0) {}
+
+    qint64 pendingConnections;
+    qint64 refusedConnections;
+    qint64 refusedRegistrations;
+    qint64 handshakeTimeouts;
+};
+
+// decides whether a new connection or a registration is let in: per-IP token buckets
+// for both and a cap on the connections that haven't registered yet; thread-safe,
+// the accepts and the registrations come from all the worker threads
+class AdmissionControl
+{
+public:
+    AdmissionControl();
+
+    // a rate of 0 turns the limit off, so does a pending cap of 0
+    void setLimits(double connectionsPerSecond, double registrationsPerSecond, int maxPending);
+    double getConnectionRate() const {return this->connectionRate;}
+    double getRegistrationRate() const {return this->registrationRate;}
+    int getMaxPending() const {return this->maxPending;}
+
+    // true - the connection is admitted and counts as pending until it registers or goes away
+    bool admitConnection(const QHostAddress &address);
+    bool admitRegistration(const QHostAddress &address);
+    // a connection that registered or went away
+    void releasePending();
+    // a client that deregistered is pending again, it isn't refused though
+    void acquirePending();
+    void countHandshakeTimeout() {handshakeTimeouts.fetchAndAddRelaxed(1);}
+    AdmissionStats getStats() const;
+
+private:
+    struct AddressState
+    {
+        TokenBucket connections;
+        TokenBucket registrations;
+    };
+
+    mutable QMutex mutex;
+    QHash<QHostAddress, AddressState> addressStates;
+    QElapsedTimer clock;
+    qint64 lastPruneMsec;
+    double connectionRate;
+    double registrationRate;
+    int maxPending;
+    QAtomicInteger<qint64> pendingConnections;
+    QAtomicInteger<qint64> refusedConnections;
+    QAtomicInteger<qint64> refusedRegistrations;
+    QAtomicInteger<qint64> handshakeTimeouts;
+
+    AddressState &stateOf(const QHostAddress &address, qint64 nowMsec);
+    void prune(qint64 nowMsec);
+};
+
+#endif // ADMISSIONCONTROL_H
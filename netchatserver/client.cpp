@@ -1,250 +1,843 @@
-#include <QWidget>
-#include <QMessageBox>
-
-#include "client.h"
-#include "constants.h"
-
-Client::Client(qintptr socketDesc, ChatServer *chatServerPtr, QObject *parent) : QObject(parent), socketDescriptor(socketDesc)
-{
-    qRegisterMetaType<QAbstractSocket::SocketError>();
-    // holds a pointer on blackboard-object
-    chatServer = chatServerPtr;
-    // a client didn't pass registration
-    this->setName(Constants::constNameUnknown);
-    this->setUUID("{00000000-0000-0000-0000-000000000000}");
-    this->setRegistered(false);
-    // receivable block size = 0
-    blockSize = 0;
-    // create a socket
-    socket = new QTcpSocket(this);
-    // set the descriptor from incomingConnection()
-    socket->setSocketDescriptor(socketDescriptor);
-
-    utils = new Utils();
-
-    // connect signals
-    connect(socket, SIGNAL(connected()), this, SLOT(onConnect()));
-    connect(socket, SIGNAL(disconnected()), this, SLOT(onDisconnect()));
-    connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
-    connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(onError(QAbstractSocket::SocketError)));
-}
-
-Client::~Client()
-{
-}
-
-void Client::onConnect()
-{
-    // never calls, socket is already connected to the tcpserver
-    // we are just binding to this socket here: socket->setSocketDescriptor(socketDesciptor);
-}
-
-void Client::onDisconnect()
-{
-    // if an client is registered
-    if (isRegistered())
-    {
-        // remove from GUI
-        emit removeClientFromGui(this->getUUID(), this->getName());
-        // tell everyone that an client has left
-        chatServer->sendToAllHasLeft(this->getUUID(), this->getName());
-        // remove from clients list
-        emit removeClient(this);
-    }
-    else
-    {
-        // remove from clients list
-        emit removeClient(this);
-    }
-    emit addToLogArea("<div style='color:gray'>* User <b>" + this->getUUID() + "</b> has disconnected</div>");
-
-    socket->close();
-    socket->deleteLater();
-    this->deleteLater();
-}
-
-void Client::onError(QAbstractSocket::SocketError socketError) const
-{
-    // w is needed for memory deallocation from QMessageBox (with the help of *parent = &w)
-    QWidget w;
-    switch (socketError) {
-    case QAbstractSocket::RemoteHostClosedError:
-        break;
-    case QAbstractSocket::HostNotFoundError:
-        QMessageBox::information(&w, "Error", "The host was not found");
-        break;
-    case QAbstractSocket::ConnectionRefusedError:
-        QMessageBox::information(&w, "Error", "The connection was refused by the peer.");
-        break;
-    default:
-        QMessageBox::information(&w, "Error", "The following error occurred: " + socket->errorString());
-    }
-    // here will be called desctructor for w and accordingly QMessageBox (according to C++ rules)
-}
-
-void Client::onReadyRead()
-{
-    QDataStream in(socket);
-    // if read a new block so the first 2 bytes are its size
-    if (blockSize == 0) {
-        // if came less than 2 bytes, wait until 2 bytes come
-        if (socket->bytesAvailable() < (int)sizeof(quint16))
-            return;
-        // read size (2 bytes)
-        in >> blockSize;
-    }
-    // wait until block comes completely
-    if (socket->bytesAvailable() < blockSize)
-        return;
-    else
-        // one can accept a new block
-        blockSize = 0;
-    // the 3rd byte is a command to server
-    quint8 command;
-    in >> command;
-    // for unregistered clients accepts command "registration request" only
-    if (!this->isRegistered() && command != Constants::comRegisterRequest
-            && command != Constants::comClientConnected
-            && command != Constants::comPing)
-        return;
-
-    switch(command)
-    {
-    // request for registration
-    case Constants::comRegisterRequest:
-    {
-        // read client data
-        QString uuidFromStream;
-        in >> uuidFromStream;
-        QString nameFromStream;
-        in >> nameFromStream;
-
-        // check whether client exists already
-        if (chatServer->clientExists(uuidFromStream))
-        {
-            // send an error
-            chatServer->sendCommand(Constants::comErrClientExists, this->getUUID());
-            emit removeClient(this);
-            return;
-        }
-        // check whether name is valid
-        if (!utils->isNameValid(nameFromStream))
-        {
-            // send an error
-            chatServer->sendCommand(Constants::comErrNameInvalid, this->getUUID());
-            emit removeClient(this);
-            return;
-        }
-        // check whether name is illegal
-        if (chatServer->isNameIllegal(nameFromStream))
-        {
-            // send an error
-            chatServer->sendCommand(Constants::comErrNameIllegal, this->getUUID());
-            emit removeClient(this);
-            return;
-        }
-        // check whether name is used already
-        if (chatServer->isNameUsed(nameFromStream))
-        {
-            // send an error
-            chatServer->sendCommand(Constants::comErrNameUsed, this->getUUID());
-            emit removeClient(this);
-            return;
-        }
-
-        // registration success
-        this->setUUID(uuidFromStream);
-        this->setName(nameFromStream);
-        this->setRegistered(true);
-
-        // send to the new client a list of active clients
-        sendRegisteredClients();
-        // add to GUI
-        emit addClientToGui(this->getUUID(), this->getName());
-        // inform everyone about new client
-        chatServer->sendToAllHasJoined(this->getUUID(), this->getName());
-        // inform the client about success
-        //if (socket->waitForBytesWritten())
-        //    sendCommand(comRegistrationSuccess);
-    }
-        break;
-        // request for deregistration
-    case Constants::comDeregisterRequest:
-    {
-        this->setRegistered(false);
-        emit removeClientFromGui(this->getUUID(), this->getName());
-        chatServer->sendToAllHasLeft(this->getUUID(), this->getName());
-        this->setName("");
-    }
-        break;
-    case Constants::comClientConnected:
-    {
-        QString uuidFromStream;
-        in >> uuidFromStream;
-        this->setUUID(uuidFromStream);
-        emit addToLogArea("<div style='color:gray'>* User <b>" + this->getUUID() + "</b> has connected</div>");
-    }
-        break;
-        // a message to all has come from current client
-    case Constants::comMessageToAll:
-    {
-        QString message;
-        in >> message;
-        // send this message to all clients
-        chatServer->sendToAllMessage(message, this->getUUID(), this->getName());
-        // update log area of the server
-        emit messageToGui(message, this->getName(), QStringList());
-    }
-        break;
-        // a message for several clients has come from current client
-    case Constants::comMessageToClients:
-    {
-        QString clientsReceivers;
-        in >> clientsReceivers;
-        QString message;
-        in >> message;
-        // split a string on the names with UUIDs
-        QStringList clients = clientsReceivers.split(",");
-        // send this message to necessary clients
-        chatServer->sendMessageToClients(message, clients, this->getUUID(), this->getName());
-        // update log area
-        emit messageToGui(message, this->getName(), clients);
-    }
-        break;
-    case Constants::comPing:
-    {
-        chatServer->sendServerMessageToClients("<div style='color:gray;'>pong</b>", QStringList(this->getUUID()));
-    }
-        break;
-    }
-}
-
-void Client::sendCommand(quint8 comm) const
-{
-    QByteArray block;
-    QDataStream out(&block, QIODevice::WriteOnly);
-    out << (quint16)0;
-    out << comm;
-    out.device()->seek(0);
-    out << (quint16)(block.size() - sizeof(quint16));
-    socket->write(block);
-}
-
-void Client::sendRegisteredClients() const
-{
-    QByteArray block;
-    QDataStream out(&block, QIODevice::WriteOnly);
-    out << (quint16)0;
-    out << Constants::comRegisteredClients;
-    QStringList clientsList = chatServer->getRegisteredClients();
-    QString clientsStr;
-    quint16 clientsQuantity = clientsList.length();
-    for (int i = 0; i < clientsQuantity; ++i)
-        if (clientsList.at(i) != (this->getName() + " " + this->getUUID()))
-            clientsStr += clientsList.at(i) + (QString)",";
-    clientsStr.remove(clientsStr.length()-1, 1);
-    out << clientsStr;
-    out.device()->seek(0);
-    out << (quint16)(block.size() - sizeof(quint32));
-    socket->write(block);
-}
+#include <QThread>
+#include <QDateTime>
+#include <QtEndian>
+#include <QtMath>
+#ifdef Q_OS_UNIX
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <string.h>
+#include <errno.h>
+#endif
+
+#include "client.h"
+#include "serverworker.h"
+#include "constants.h"
+
+Client::Client(ServerWorker *workerPtr, quint64 connectionId, qintptr socketDesc, ChatServer *chatServerPtr) :
+    worker(workerPtr), connectionId(connectionId), connection(0), socketDescriptor(socketDesc)
+{
+    // holds a pointer on blackboard-object
+    chatServer = chatServerPtr;
+    // a client didn't pass registration
+    this->setName(Constants::constNameUnknown);
+    this->setUUID("{00000000-0000-0000-0000-000000000000}");
+    this->setRegistered(false);
+    // a client speaks the original protocol until it negotiates a newer one
+    this->setProtocolVersion(1);
+    this->setSessionId(0);
+    isClosed = false;
+    queuedBytes = 0;
+    coalescedDrops = 0;
+    isDropNoticeQueued = false;
+    isClosingSlowConsumer = false;
+    isFlushScheduled = false;
+    // the connection has been admitted as pending already
+    isHandshakePending = true;
+    handshakeDeadline = 0;
+    throttledMessages = 0;
+    throttledBytes = 0;
+    lastSlowDownMsec = 0;
+    heartbeatNode.owner = this;
+    lastReceivedMsec = worker->nowMsec();
+    nextPingSeq = 1;
+    isOfflineDeliveryPending = false;
+    isHistoryPending = false;
+    isHistoryReading = false;
+    historyRequestId = 0;
+    decoder.setFrameSizeLimit(Constants::handshakeFrameSize);
+
+    utils = new Utils();
+}
+
+Client::~Client()
+{
+    // closing the connection here mustn't call back
+    isClosed = true;
+    worker->cancelHeartbeat(this);
+    delete connection;
+    delete utils;
+    chatServer->addOutboundBytes(-queuedBytes);
+    if (isHandshakePending)
+        chatServer->getAdmission().releasePending();
+}
+
+void Client::onDisconnect()
+{
+    if (isClosed)
+        return;
+    isClosed = true;
+    // if an client is registered
+    if (isRegistered())
+    {
+        // remove from GUI
+        emit chatServer->removeClientFromGui(this->getUUID(), this->getName());
+        // tell everyone that an client has left
+        chatServer->sendToAllHasLeft(this, this->getName());
+    }
+    // remove from clients list
+    chatServer->onRemoveClient(this);
+    emit chatServer->addToLogArea("<div style='color:gray'>* User <b>" + this->getUUID() + "</b> has disconnected</div>");
+
+    clearQueue();
+    // the worker deletes the client when the current events are handled
+    worker->closeClient(this);
+}
+
+void Client::onError(const QString &errorString)
+{
+    // the client may live in a worker thread, so no message boxes here - just log the error
+    emit chatServer->addToLogArea("<div style='color:red'>* Error: " + errorString + "</div>");
+}
+
+void Client::onReadyRead()
+{
+    // any traffic proves that the client is alive, the heartbeat timer looks at it when it fires
+    lastReceivedMsec = worker->nowMsec();
+    connection->readInto(decoder);
+    // handle every complete block, several of them may come in one segment
+    const char *frame;
+    int frameSize;
+    while (!isClosed && decoder.nextFrame(&frame, &frameSize))
+    {
+        FrameReader in(frame, frameSize);
+        processFrame(in);
+    }
+    // the peer doesn't speak our protocol
+    if (!isClosed && decoder.hasError())
+        connection->abort();
+}
+
+void Client::processFrame(FrameReader &in)
+{
+    // the 1st byte of a block is a command to server
+    quint8 command = in.readUInt8();
+    if (!in.isOk())
+        return;
+    // for unregistered clients accepts command "registration request" only
+    if (!this->isRegistered() && command != Constants::comRegisterRequest
+            && command != Constants::comClientConnected
+            && command != Constants::comProtocolHello
+            && command != Constants::comProtocolVersion
+            && command != Constants::comPing
+            && command != Constants::comHeartbeat
+            && command != Constants::comPingRequest
+            && command != Constants::comPingReply)
+        return;
+
+    switch(command)
+    {
+    // request for registration
+    case Constants::comRegisterRequest:
+    {
+        // read client data
+        QString uuidFromStream;
+        QString nameFromStream;
+        if (this->getProtocolVersion() >= 4)
+        {
+            uuidFromStream = in.readUtf8String();
+            nameFromStream = in.readUtf8String();
+        }
+        else
+        {
+            uuidFromStream = in.readString();
+            nameFromStream = in.readString();
+        }
+        if (!in.isOk())
+            return;
+
+        // an address that registers too often is turned away
+        if (!chatServer->getAdmission().admitRegistration(peerAddress))
+        {
+            closeWithError(Constants::comErrTooManyRequests);
+            return;
+        }
+        // check whether name is valid
+        if (!utils->isNameValid(nameFromStream))
+        {
+            // send an error
+            closeWithError(Constants::comErrNameInvalid);
+            return;
+        }
+        // check whether client exists already, whether name is illegal or used already
+        // and register the client if everything is fine
+        quint8 error = chatServer->registerClient(this, uuidFromStream, nameFromStream);
+        if (error != 0)
+        {
+            // send an error
+            closeWithError(error);
+            return;
+        }
+        setHandshakePending(false);
+
+        // since protocol version 3 the client learns its session id first
+        if (this->getProtocolVersion() >= 3)
+        {
+            sendBlock(FrameBuilder(Constants::comRegistrationSuccess).appendUInt32(this->getSessionId()).finish());
+        }
+        // send to the new client a list of active clients
+        sendRegisteredClients();
+        // add to GUI
+        emit chatServer->addClientToGui(this->getUUID(), this->getName());
+        // inform everyone about new client
+        chatServer->sendToAllHasJoined(this);
+        // the private messages kept while the client was away follow, a page per flush
+        if (chatServer->getOfflineStore().hasMessages(this->getName(), this->getUUID()))
+        {
+            isOfflineDeliveryPending = true;
+            sendOfflinePage();
+        }
+    }
+        break;
+        // request for deregistration
+    case Constants::comDeregisterRequest:
+    {
+        QString name = this->getName();
+        isOfflineDeliveryPending = false;
+        isHistoryPending = false;
+        isHistoryReading = false;
+        chatServer->deregisterClient(this);
+        setHandshakePending(true);
+        emit chatServer->removeClientFromGui(this->getUUID(), name);
+        chatServer->sendToAllHasLeft(this, name);
+    }
+        break;
+    case Constants::comClientConnected:
+    {
+        QString uuidFromStream = in.readString();
+        // the registered clients are indexed by UUID, it can't change anymore
+        if (!in.isOk() || this->isRegistered())
+            return;
+        chatServer->setClientUUID(this, uuidFromStream);
+        emit chatServer->addToLogArea("<div style='color:gray'>* User <b>" + this->getUUID() + "</b> has connected</div>");
+    }
+        break;
+    case Constants::comProtocolHello:
+    {
+        // tell the client the newest protocol version we speak
+        sendBlock(FrameBuilder(Constants::comProtocolAccepted).appendUInt8(Constants::protocolVersion).finish());
+    }
+        break;
+    case Constants::comProtocolVersion:
+    {
+        quint8 version = in.readUInt8();
+        // the registered clients are counted by version, it can't change anymore
+        if (!in.isOk() || version < 1 || this->isRegistered())
+            return;
+        chatServer->setClientProtocolVersion(this, qMin(version, Constants::protocolVersion));
+    }
+        break;
+    case Constants::comHeartbeat:
+        // the client is alive, that's all
+        break;
+    case Constants::comPingRequest:
+    {
+        // the timestamp is the client's, it goes back as it is
+        quint32 seq = in.readUInt32();
+        quint64 sentUsec = in.readUInt64();
+        if (in.isOk())
+            sendPingReply(seq, sentUsec);
+    }
+        break;
+    case Constants::comPingReply:
+    {
+        in.readUInt32();
+        quint64 sentUsec = in.readUInt64();
+        if (in.isOk())
+            onPingReply(sentUsec);
+    }
+        break;
+    case Constants::comMessageChunk:
+    {
+        if (this->getProtocolVersion() >= 2)
+            processMessageChunk(in);
+    }
+        break;
+        // a message to all has come from current client
+    case Constants::comMessageToAll:
+    {
+        if (!admitMessage(in.bytesLeft(), false))
+            return;
+        MessageText message = readMessageText(in);
+        if (!in.isOk())
+            return;
+        // send this message to all clients
+        chatServer->sendToAllMessage(this, message);
+        // update log area of the server, the message is decoded for that only
+        if (chatServer->isMirrorSample())
+            emit chatServer->messageToGui(message.text(), this->getName(), QStringList());
+    }
+        break;
+        // a message for several clients has come from current client
+    case Constants::comMessageToClients:
+    {
+        if (!admitMessage(in.bytesLeft(), false))
+            return;
+        bool isMirrored = chatServer->isMirrorSample();
+        QStringList clients;
+        if (this->getProtocolVersion() >= 3)
+        {
+            // the receivers come as session ids
+            QList<quint32> receiverIds = in.readUInt32List();
+            MessageText message = readMessageText(in);
+            if (!in.isOk())
+                return;
+            chatServer->sendMessageToClients(this, message, receiverIds, isMirrored ? &clients : 0);
+            if (isMirrored)
+                emit chatServer->messageToGui(message.text(), this->getName(), clients);
+            return;
+        }
+        QString clientsReceivers = in.readString();
+        QString message = in.readString();
+        if (!in.isOk())
+            return;
+        // send this message to necessary clients, a string is split on the names with UUIDs
+        chatServer->sendMessageToClients(this, MessageText::fromString(message),
+                                         clientsReceivers.split(","), isMirrored ? &clients : 0);
+        // update log area
+        if (isMirrored)
+            emit chatServer->messageToGui(message, this->getName(), clients);
+    }
+        break;
+    case Constants::comHistoryRequest:
+    {
+        // the requests read the disk, so they count against the flood limits as the messages do
+        if (this->getProtocolVersion() < 8 || !admitMessage(in.bytesLeft(), false))
+            return;
+        quint32 requestId = in.readUInt32();
+        quint8 mode = in.readUInt8();
+        quint64 first = in.readUInt64();
+        quint64 second = in.readUInt64();
+        int limit = qMin(in.readUInt32(), (quint32)Constants::historyMaxMessages);
+        quint32 count = in.readUInt32();
+        QStringList peerNames;
+        for (quint32 i = 0; i < count && in.isOk(); ++i)
+        {
+            QString name = in.readUtf8String();
+            if (utils->isNameValid(name))
+                peerNames.append(name);
+        }
+        if (!in.isOk())
+            return;
+        chatServer->countHistoryRequest();
+        startHistory(requestId, mode, first, second, limit, peerNames);
+    }
+        break;
+    case Constants::comPing:
+    {
+        chatServer->sendServerMessageToClients("<div style='color:gray;'>pong</b>", QStringList(this->getUUID()));
+    }
+        break;
+    }
+}
+
+void Client::processMessageChunk(FrameReader &in)
+{
+    quint32 streamId = in.readUInt32();
+    quint8 flags = in.readUInt8();
+    if (!in.isOk())
+        return;
+    // a dropped first chunk never opens the stream, so the rest of the message is dropped as well
+    if (!admitMessage(in.bytesLeft(), !(flags & Constants::chunkFirst)))
+        return;
+    if (flags & Constants::chunkFirst)
+    {
+        StreamRoute route;
+        route.kind = in.readUInt8();
+        route.isTruncated = false;
+        if (route.kind == Constants::comMessageToClients && this->getProtocolVersion() >= 3)
+            route.receiverIds = in.readUInt32List();
+        else if (route.kind == Constants::comMessageToClients)
+            route.receiverIds = chatServer->resolveReceivers(in.readString().split(","));
+        else if (route.kind != Constants::comMessageToAll)
+            return;
+        if (!in.isOk() || openStreams.size() >= Constants::maxOpenStreams)
+            return;
+        // the journal and the receivers who are away get the whole message
+        route.isCollected = chatServer->isJournalEnabled() ||
+                (route.kind == Constants::comMessageToClients && chatServer->hasAwayReceivers(route.receiverIds));
+        openStreams.insert(streamId, route);
+    }
+    QHash<quint32, StreamRoute>::iterator it = openStreams.find(streamId);
+    if (it == openStreams.end())
+        return;
+    MessageText piece = readMessageText(in);
+    if (!in.isOk())
+        return;
+    if (it->isCollected)
+    {
+        // the text is collected up to a limit
+        const QByteArray &utf8 = piece.utf8();
+        int room = Constants::journalMaxMessageBytes - it->text.size();
+        if (utf8.size() > room)
+        {
+            it->text.append(utf8.constData(), room);
+            it->isTruncated = true;
+        }
+        else
+            it->text.append(utf8);
+    }
+
+    // relay the chunk right away
+    if (it->kind == Constants::comMessageToAll)
+        chatServer->sendToAllMessageChunk(this, streamId, flags, piece);
+    else
+        chatServer->sendMessageChunkToClients(this, streamId, flags, piece, it->receiverIds);
+    if (flags & Constants::chunkLast)
+    {
+        if (it->isCollected)
+            chatServer->recordChunkedMessage(this, it->kind == Constants::comMessageToAll, it->receiverIds, it->text,
+                                             it->isTruncated ? JournalRecord::flagTruncated : 0);
+        // update log area of the server
+        if (chatServer->isMirrorSample())
+            emit chatServer->messageToGui("<i>(a long message has been relayed)</i>", this->getName(),
+                              chatServer->describeReceivers(it->receiverIds));
+        openStreams.erase(it);
+    }
+}
+
+void Client::setSessionId(quint32 id)
+{
+    this->sessionId = id;
+    relayHeader.resize(sizeof(quint32));
+    qToBigEndian<quint32>(id, reinterpret_cast<uchar *>(relayHeader.data()));
+}
+
+MessageText Client::readMessageText(FrameReader &in)
+{
+    // since protocol version 4 the text is relayed in UTF-8 as it has come, without decoding
+    if (this->getProtocolVersion() >= 4)
+        return MessageText::fromUtf8(in.readUtf8());
+    return MessageText::fromString(in.readString());
+}
+
+void Client::sendBlock(const QByteArray &block)
+{
+    if (!acceptsBlock(block))
+        return;
+    // the connection may be written from the thread of its worker only
+    if (QThread::currentThread() == worker->thread())
+        enqueueBlock(block);
+    else
+        worker->postBlock(this, block);
+}
+
+void Client::enqueueBlock(const QByteArray &block)
+{
+    if (isClosingSlowConsumer || isClosed)
+        return;
+    outQueue.enqueue(block);
+    queuedBytes += block.size();
+    chatServer->addOutboundBytes(block.size());
+    worker->scheduleFlush(this);
+    if (queuedBytes > chatServer->getOutboundQueueBytes()
+            || outQueue.size() > chatServer->getOutboundQueueMessages())
+        handleQueueOverflow();
+    chatServer->updateOutboundHighWater(queuedBytes);
+}
+
+QByteArray Client::takeQueuedBlock()
+{
+    QByteArray block = outQueue.dequeue();
+    queuedBytes -= block.size();
+    chatServer->addOutboundBytes(-block.size());
+    isDropNoticeQueued = false;
+    coalescedDrops = 0;
+    return block;
+}
+
+void Client::flushQueue()
+{
+    // all the frames queued within one turn of the event loop go out together
+    if (isClosed)
+        return;
+#if defined(Q_OS_UNIX) && defined(MSG_NOSIGNAL)
+    // nothing is waiting in the buffer of the connection, so the frames may go to the socket directly
+    if (connection->allowsDirectWrites() && connection->bytesToWrite() == 0)
+        writeQueueVectored();
+#endif
+    // the buffer of the connection is unbounded, so it gets not more than a little at a time
+    int framesCount = 0;
+    while (!outQueue.isEmpty() && connection->bytesToWrite() < Constants::socketWriteThreshold)
+    {
+        connection->write(takeQueuedBlock());
+        framesCount++;
+    }
+    chatServer->countBufferedWrites(framesCount);
+    // the next page of the offline messages or the history once the last one is in the socket,
+    // so a long backlog never floods the queue or holds up the other clients of the worker
+    if (outQueue.isEmpty() && connection->bytesToWrite() < Constants::socketWriteThreshold)
+    {
+        if (isOfflineDeliveryPending)
+            sendOfflinePage();
+        else if (isHistoryPending && !isHistoryReading)
+            sendHistoryPage();
+    }
+}
+
+void Client::startHistory(quint32 requestId, quint8 mode, quint64 first, quint64 second, int limit,
+                          const QStringList &peerNames)
+{
+    // a new request replaces the one in progress, the client tells them by the id
+    historyRequestId = requestId;
+    historyCursor = HistoryCursor();
+    if (!chatServer->isJournalEnabled())
+    {
+        isHistoryPending = false;
+        sendBlock(FrameBuilder(Constants::comHistoryPage).appendUInt32(requestId)
+                  .appendUInt8(Constants::historyLast | Constants::historyUnavailable).appendUInt32(0).finish());
+        return;
+    }
+    // a client sees the messages to all and its own conversations only
+    QString conversation = peerNames.isEmpty() ? HistoryIndex::publicConversation :
+                                                 HistoryIndex::conversationKey(this->getName(), peerNames);
+    const HistoryIndex &history = chatServer->getHistory();
+    if (mode == Constants::historyByTime)
+        historyCursor = history.findByTime(conversation, (qint64)first, (qint64)second, limit);
+    else if (mode == Constants::historyBefore)
+        historyCursor = history.findBefore(conversation, first, limit);
+    else if (mode == Constants::historyAfter)
+        historyCursor = history.findAfter(conversation, first, limit);
+    if (!peerNames.isEmpty())
+        historyCursor.participantUuid = this->getUUID();
+    isHistoryPending = true;
+    sendHistoryPage();
+}
+
+void Client::sendHistoryPage()
+{
+    // the segments are read by the history reader, the page comes back through the worker
+    isHistoryReading = true;
+    chatServer->getHistoryReader()->postRead(worker, connectionId, historyRequestId, historyCursor);
+}
+
+void Client::onHistoryPage(quint32 requestId, const HistoryCursor &cursor, const QByteArray &block)
+{
+    // the page of a request replaced or dropped meanwhile
+    if (!isHistoryReading || requestId != historyRequestId)
+        return;
+    isHistoryReading = false;
+    historyCursor = cursor;
+    isHistoryPending = !historyCursor.isDone();
+    sendBlock(block);
+}
+
+void Client::sendOfflinePage()
+{
+    int remaining = 0;
+    QList<JournalRecord> records = chatServer->getOfflineStore().take(this->getName(), this->getUUID(),
+                                                                      Constants::offlinePageMessages,
+                                                                      Constants::offlinePageBytes, &remaining);
+    isOfflineDeliveryPending = remaining > 0;
+    if (records.isEmpty())
+        return;
+    if (this->getProtocolVersion() >= 7)
+    {
+        int size = 8;
+        foreach (const JournalRecord &record, records)
+            size += record.utf8.size() + 128;
+        FrameBuilder frame(Constants::comOfflineMessages, size);
+        frame.appendUInt32(records.size());
+        foreach (const JournalRecord &record, records)
+            frame.appendUInt64(record.timestampMsec).appendUtf8String(record.senderUuid)
+                    .appendUtf8String(record.senderName).appendUtf8(record.utf8);
+        frame.appendUInt32(remaining);
+        sendBlock(frame.finish());
+        return;
+    }
+    // the older clients get every message as a private server message
+    quint8 version = this->getProtocolVersion();
+    foreach (const JournalRecord &record, records)
+    {
+        QString text = QString("<i>[%1] %2 (while you were away):</i><br>%3")
+                .arg(QDateTime::fromMSecsSinceEpoch(record.timestampMsec).toString("MM/dd/yy h:mm:ss AP"))
+                .arg(record.senderName).arg(QString::fromUtf8(record.utf8).toHtmlEscaped());
+        sendBlock(chatServer->buildServerMessage(Constants::comPrivateServerMessage, text, 1u << version)
+                  .forVersion(version));
+    }
+}
+
+void Client::writeQueueVectored()
+{
+    // where there's no MSG_NOSIGNAL the frames go through the connection only
+#if defined(Q_OS_UNIX) && defined(MSG_NOSIGNAL)
+    int fd = (int)connection->descriptor();
+    while (!outQueue.isEmpty())
+    {
+        struct iovec iov[Constants::maxFramesPerWrite];
+        int count = 0;
+        qint64 total = 0;
+        for (int i = 0; i < outQueue.size() && count < Constants::maxFramesPerWrite; ++i)
+        {
+            const QByteArray &block = outQueue.at(i);
+            iov[count].iov_base = const_cast<char *>(block.constData());
+            iov[count].iov_len = block.size();
+            count++;
+            total += block.size();
+            if (total >= Constants::socketWriteThreshold)
+                break;
+        }
+        // sendmsg() rather than writev(): a peer that has reset the connection must not SIGPIPE the server
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = iov;
+        message.msg_iovlen = count;
+        ssize_t written = ::sendmsg(fd, &message, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR)
+            continue;
+        // the kernel buffer is full or the socket is broken, the connection takes it from here
+        if (written <= 0)
+            return;
+        int framesCount = 0;
+        while (written > 0)
+        {
+            int headSize = outQueue.head().size();
+            if (headSize > written)
+            {
+                // the rest of the frame goes first through the buffer of the connection
+                QByteArray block = takeQueuedBlock();
+                connection->write(block.constData() + written, headSize - written);
+                framesCount++;
+                chatServer->countVectoredWrite(framesCount);
+                return;
+            }
+            takeQueuedBlock();
+            written -= headSize;
+            framesCount++;
+        }
+        chatServer->countVectoredWrite(framesCount);
+    }
+#endif
+}
+
+void Client::handleQueueOverflow()
+{
+    ChatServer::OverflowPolicy policy = chatServer->getOverflowPolicy();
+    if (policy == ChatServer::DisconnectSlowConsumer)
+    {
+        // what is in the socket already goes out, then the error, then the connection is closed
+        chatServer->countSlowConsumerDisconnect();
+        chatServer->countOutboundDrops(outQueue.size(), queuedBytes);
+        clearQueue();
+        isClosingSlowConsumer = true;
+        QByteArray block = FrameBuilder(Constants::comErrSlowConsumer).finish();
+        emit chatServer->addToLogArea("<div style='color:red'>* User <b>" + this->getUUID() +
+                                      "</b> doesn't read fast enough and is disconnected</div>");
+        connection->write(block);
+        connection->disconnectFromHost();
+        return;
+    }
+
+    // the oldest frames go first, the notice about the dropped ones stays ahead of the queue
+    if (isDropNoticeQueued)
+    {
+        QByteArray notice = outQueue.dequeue();
+        queuedBytes -= notice.size();
+        chatServer->addOutboundBytes(-notice.size());
+        isDropNoticeQueued = false;
+    }
+    int droppedCount = 0;
+    qint64 droppedBytes = 0;
+    while (!outQueue.isEmpty() && (queuedBytes > chatServer->getOutboundQueueBytes()
+                                   || outQueue.size() > chatServer->getOutboundQueueMessages()))
+    {
+        QByteArray block = outQueue.dequeue();
+        queuedBytes -= block.size();
+        droppedCount++;
+        droppedBytes += block.size();
+    }
+    chatServer->addOutboundBytes(-droppedBytes);
+    chatServer->countOutboundDrops(droppedCount, droppedBytes);
+    if (policy != ChatServer::CoalesceDropped)
+        return;
+
+    // a single notice stands for all the frames dropped since the last write
+    coalescedDrops += droppedCount;
+    QString text = QString("<div style='color:gray'>* %1 messages have been dropped, "
+                           "the connection is too slow</div>").arg(coalescedDrops);
+    quint32 versions = 1u << qMin(this->getProtocolVersion(), Constants::protocolVersion);
+    QByteArray notice = chatServer->buildServerMessage(Constants::comPrivateServerMessage, text, versions)
+            .forVersion(this->getProtocolVersion());
+    outQueue.prepend(notice);
+    queuedBytes += notice.size();
+    chatServer->addOutboundBytes(notice.size());
+    isDropNoticeQueued = true;
+}
+
+void Client::clearQueue()
+{
+    chatServer->addOutboundBytes(-queuedBytes);
+    outQueue.clear();
+    queuedBytes = 0;
+    coalescedDrops = 0;
+    isDropNoticeQueued = false;
+}
+
+void Client::onDeregisterByServer()
+{
+    sendCommand(Constants::comDeregisterClient);
+    QString name = this->getName();
+    chatServer->deregisterClient(this);
+    setHandshakePending(true);
+    emit chatServer->removeClientFromGui(this->getUUID(), name);
+}
+
+void Client::setHandshakePending(bool pending)
+{
+    if (pending == isHandshakePending)
+        return;
+    isHandshakePending = pending;
+    if (pending)
+    {
+        // a deregistered client has to register again in time, it isn't refused though
+        chatServer->getAdmission().acquirePending();
+        decoder.setFrameSizeLimit(Constants::handshakeFrameSize);
+        worker->watchHandshake(this);
+    }
+    else
+    {
+        chatServer->getAdmission().releasePending();
+        decoder.setFrameSizeLimit(FrameDecoder::maxFrameSize);
+    }
+}
+
+bool Client::admitMessage(int size, bool isContinuation)
+{
+    double messageRate = chatServer->getFloodMessageRate();
+    double byteRate = chatServer->getFloodByteRate();
+    if (messageRate <= 0 && byteRate <= 0)
+        return true;
+    qint64 nowMsec = worker->nowMsec();
+    if (messageRate > 0)
+        messageBucket.refill(messageRate, messageRate * Constants::floodBurstSeconds, nowMsec);
+    if (byteRate > 0)
+        byteBucket.refill(byteRate, byteRate * Constants::floodBurstSeconds, nowMsec);
+    // a message larger than the burst passes on a full bucket, the bytes go into debt
+    if (!isContinuation && ((messageRate > 0 && messageBucket.tokens < 1) || (byteRate > 0 && byteBucket.tokens <= 0)))
+    {
+        chatServer->countThrottled(size, throttledMessages == 0);
+        throttledMessages++;
+        throttledBytes += size;
+        sendSlowDown(nowMsec);
+        return false;
+    }
+    if (messageRate > 0 && !isContinuation)
+        messageBucket.tokens -= 1;
+    if (byteRate > 0)
+        byteBucket.tokens -= size;
+    return true;
+}
+
+void Client::sendSlowDown(qint64 nowMsec)
+{
+    if (lastSlowDownMsec != 0 && nowMsec - lastSlowDownMsec < Constants::slowDownNoticeMsec)
+        return;
+    lastSlowDownMsec = nowMsec;
+    // how long until both buckets let a message through
+    double waitMsec = 0;
+    double messageRate = chatServer->getFloodMessageRate();
+    double byteRate = chatServer->getFloodByteRate();
+    if (messageRate > 0 && messageBucket.tokens < 1)
+        waitMsec = (1 - messageBucket.tokens) * 1000 / messageRate;
+    if (byteRate > 0 && byteBucket.tokens <= 0)
+        waitMsec = qMax(waitMsec, (1 - byteBucket.tokens) * 1000 / byteRate);
+    sendBlock(FrameBuilder(Constants::comSlowDown).appendUInt32(qCeil(waitMsec)).finish());
+}
+
+void Client::sendPingRequest()
+{
+    sendBlock(FrameBuilder(Constants::comPingRequest).appendUInt32(nextPingSeq++)
+              .appendUInt64(worker->nowUsec()).finish());
+}
+
+void Client::sendPingReply(quint32 seq, quint64 sentUsec)
+{
+    sendBlock(FrameBuilder(Constants::comPingReply).appendUInt32(seq).appendUInt64(sentUsec).finish());
+}
+
+void Client::onPingReply(quint64 sentUsec)
+{
+    quint64 nowUsec = worker->nowUsec();
+    // a reply to nothing we've sent
+    if (sentUsec > nowUsec)
+        return;
+    qint64 rtt = nowUsec - sentUsec;
+    lastRttUsec.store(rtt);
+    // smoothed like the SRTT of TCP
+    qint64 smoothed = smoothedRttUsec.load();
+    smoothedRttUsec.store(smoothed == 0 ? rtt : smoothed + (rtt - smoothed) / 8);
+    if (rtt > maxRttUsec.load())
+        maxRttUsec.store(rtt);
+}
+
+void Client::closeWithError(quint8 error)
+{
+    sendCommand(error);
+    flushQueue();
+    connection->disconnectFromHost();
+}
+
+void Client::sendCommand(quint8 comm)
+{
+    sendBlock(FrameBuilder(comm).finish());
+}
+
+void Client::sendRegisteredClients()
+{
+    if (this->getProtocolVersion() >= 3)
+    {
+        // [count][session id, uuid, name]... in pages of rosterPageEntries clients
+        QVector<RosterEntry> roster = chatServer->getRoster();
+        for (int from = 0; from < roster.size(); from += Constants::rosterPageEntries)
+            sendRegisteredClientsPage(roster, from, qMin(Constants::rosterPageEntries, roster.size() - from));
+        return;
+    }
+    QStringList clientsList = chatServer->getRegisteredClients();
+    QString self = this->getName() + " " + this->getUUID();
+    // the roster goes in pages, every page is a complete list the client just appends,
+    // so no page ever grows beyond the frame size and no giant string is built
+    QString clientsStr;
+    foreach (const QString &item, clientsList)
+    {
+        if (item == self)
+            continue;
+        if (!clientsStr.isEmpty())
+            clientsStr += ",";
+        clientsStr += item;
+        if (clientsStr.length() >= Constants::rosterPageLength)
+        {
+            sendRegisteredClientsPage(clientsStr);
+            clientsStr.clear();
+        }
+    }
+    if (!clientsStr.isEmpty())
+        sendRegisteredClientsPage(clientsStr);
+}
+
+void Client::sendRegisteredClientsPage(const QString &clientsStr)
+{
+    sendBlock(FrameBuilder(Constants::comRegisteredClients).appendString(clientsStr).finish());
+}
+
+void Client::sendRegisteredClientsPage(const QVector<RosterEntry> &roster, int from, int count)
+{
+    FrameBuilder frame(Constants::comRegisteredClients);
+    // reserve space for the count, the client itself is skipped
+    frame.appendUInt32(0);
+    quint32 written = 0;
+    for (int i = from; i < from + count; ++i)
+    {
+        const RosterEntry &entry = roster.at(i);
+        if (entry.sessionId == this->getSessionId())
+            continue;
+        frame.appendUInt32(entry.sessionId);
+        if (this->getProtocolVersion() >= 4)
+            frame.appendUtf8String(entry.uuid).appendUtf8String(entry.name);
+        else
+            frame.appendString(entry.uuid).appendString(entry.name);
+        written++;
+    }
+    if (written == 0)
+        return;
+    frame.setUInt32At(0, written);
+    sendBlock(frame.finish());
+}
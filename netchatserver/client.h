@@ -1,59 +1,161 @@
-#ifndef CLIENT_H
-#define CLIENT_H
-
-#include <QObject>
-#include <QDebug>
-#include <QTcpSocket>
-#include <QtGui>
-#include <QRegExp>
-
-#include "server.h"
-#include "utils.h"
-
-class ChatServer;
-
-class Client : public QObject
-{
-    friend class ChatServer;
-    Q_OBJECT
-
-public:
-    explicit Client(qintptr socketDesc, ChatServer *chatServerPtr, QObject *parent = 0);
-    ~Client();
-
-    void setUUID(QString uuid) {this->clientUUID = uuid;}
-    QString getUUID() const {return this->clientUUID;}
-    void setName(QString name) {this->clientName = name;}
-    QString getName() const {return this->clientName;}
-    void setRegistered(bool isRegFlag = false) {this->isReg = isRegFlag;}
-    bool isRegistered() const {return this->isReg;}
-    void sendCommand(quint8 comm) const;
-    void sendRegisteredClients() const;
-
-private:
-    QString clientUUID;
-    QString clientName;
-    QTcpSocket *socket;
-    qintptr socketDescriptor;
-    quint16 blockSize;
-
-    ChatServer *chatServer;
-    bool isReg;
-    Utils *utils;
-
-signals:
-    void addClientToGui(QString clientUUID, QString clientName);
-    void addToLogArea(const QString &text, bool emptyLineIsNeeded = true);
-    void removeClientFromGui(QString clientUUID, QString clientName);
-    void removeClient(Client *client);
-    void messageToGui(QString message, QString from, const QStringList &clients);
-    void stopChatServer();
-
-private slots:
-    void onConnect();
-    void onDisconnect();
-    void onReadyRead();
-    void onError(QAbstractSocket::SocketError socketError) const;
-};
-
-#endif // CLIENT_H
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include <QHash>
+#include <QVector>
+#include <QQueue>
+#include <QDebug>
+#include <QRegExp>
+#include <QHostAddress>
+
+#include "server.h"
+#include "utils.h"
+#include "framecodec.h"
+#include "connection.h"
+#include "timerwheel.h"
+#include "historyindex.h"
+
+class ChatServer;
+class ServerWorker;
+struct RosterEntry;
+
+// the state of one connected client, no QObject: the events of its connection
+// come from the I/O backend, the notifications go out through the signals of the server
+class Client
+{
+    friend class ChatServer;
+    friend class ServerWorker;
+
+public:
+    Client(ServerWorker *workerPtr, quint64 connectionId, qintptr socketDesc, ChatServer *chatServerPtr);
+    ~Client();
+
+    // the client owns the connection
+    void setConnection(Connection *connection) {this->connection = connection;}
+    quint64 getConnectionId() const {return this->connectionId;}
+    ServerWorker *getWorker() const {return this->worker;}
+    void setPeerAddress(const QHostAddress &address) {this->peerAddress = address;}
+    QHostAddress getPeerAddress() const {return this->peerAddress;}
+
+    void setUUID(QString uuid) {this->clientUUID = uuid;}
+    QString getUUID() const {return this->clientUUID;}
+    void setName(QString name) {this->clientName = name;}
+    QString getName() const {return this->clientName;}
+    void setRegistered(bool isRegFlag = false) {this->isReg = isRegFlag;}
+    bool isRegistered() const {return this->isReg;}
+    qintptr getSocketDescriptor() const {return this->socketDescriptor;}
+    void setProtocolVersion(quint8 version) {this->protocolVersion = version;}
+    quint8 getProtocolVersion() const {return this->protocolVersion;}
+    void setSessionId(quint32 id);
+    quint32 getSessionId() const {return this->sessionId;}
+    // the session id as the relayed frames carry it
+    const QByteArray &getRelayHeader() const {return this->relayHeader;}
+    void sendCommand(quint8 comm);
+    void sendRegisteredClients();
+    void sendRegisteredClientsPage(const QString &clientsStr);
+    void sendRegisteredClientsPage(const QVector<RosterEntry> &roster, int from, int count);
+    void sendBlock(const QByteArray &block);
+    // the peers of the original protocol can't read the extended blocks
+    bool acceptsBlock(const QByteArray &block) const
+    {
+        return this->getProtocolVersion() >= 2 || !FrameBuilder::isExtendedFrame(block);
+    }
+
+    // the events of the connection
+    void onReadyRead();
+    void onDisconnect();
+    void onError(const QString &errorString);
+    void flushQueue();
+    void onDeregisterByServer();
+
+private:
+    QString clientUUID;
+    QString clientName;
+    ServerWorker *worker;
+    quint64 connectionId;
+    Connection *connection;
+    qintptr socketDescriptor;
+    bool isClosed;
+    FrameDecoder decoder;
+    QHostAddress peerAddress;
+    // admitted, but not registered yet: counted by the admission control and watched by the worker
+    bool isHandshakePending;
+    qint64 handshakeDeadline;
+    // the flood limits of the messages the client sends, and what they have dropped
+    TokenBucket messageBucket;
+    TokenBucket byteBucket;
+    qint64 throttledMessages;
+    qint64 throttledBytes;
+    qint64 lastSlowDownMsec;
+    // the heartbeat timer in the wheel of the worker and when the client was heard last
+    TimerWheelNode heartbeatNode;
+    qint64 lastReceivedMsec;
+    // the round trips of the pings of the server, read by the GUI thread
+    quint32 nextPingSeq;
+    QAtomicInteger<qint64> lastRttUsec;
+    QAtomicInteger<qint64> smoothedRttUsec;
+    QAtomicInteger<qint64> maxRttUsec;
+
+    ChatServer *chatServer;
+    bool isReg;
+    quint8 protocolVersion;
+    // assigned by the server on registration, the peers of protocol version 3 know the client by it
+    quint32 sessionId;
+    QByteArray relayHeader;
+    Utils *utils;
+
+    // where the chunks of a long message go, the message itself is held by the server
+    // only for the journal and the receivers who are away
+    struct StreamRoute
+    {
+        quint8 kind;
+        QList<quint32> receiverIds;
+        bool isCollected;
+        QByteArray text;
+        bool isTruncated;
+    };
+    QHash<quint32, StreamRoute> openStreams;
+
+    // the frames waiting for the socket, bounded by the limits of the server
+    QQueue<QByteArray> outQueue;
+    qint64 queuedBytes;
+    int coalescedDrops;
+    bool isDropNoticeQueued;
+    bool isClosingSlowConsumer;
+    // set and cleared by the worker
+    bool isFlushScheduled;
+    // more offline messages wait for the client, the next page goes when the queue is flushed
+    bool isOfflineDeliveryPending;
+    // the history request in progress, a page per flush as well
+    bool isHistoryPending;
+    // a page is being read by the history reader
+    bool isHistoryReading;
+    quint32 historyRequestId;
+    HistoryCursor historyCursor;
+
+    void processFrame(FrameReader &in);
+    void processMessageChunk(FrameReader &in);
+    MessageText readMessageText(FrameReader &in);
+    void enqueueBlock(const QByteArray &block);
+    QByteArray takeQueuedBlock();
+    void writeQueueVectored();
+    void handleQueueOverflow();
+    void clearQueue();
+    void setHandshakePending(bool pending);
+    // the error goes out with whatever is queued, then the connection is closed
+    void closeWithError(quint8 error);
+    // charges a message of that size to the flood limits before it's relayed, false - it's dropped;
+    // the continuation chunks of a message let through are always charged and never dropped
+    bool admitMessage(int size, bool isContinuation);
+    void sendSlowDown(qint64 nowMsec);
+    void sendPingRequest();
+    void sendPingReply(quint32 seq, quint64 sentUsec);
+    void onPingReply(quint64 sentUsec);
+    void sendOfflinePage();
+    void startHistory(quint32 requestId, quint8 mode, quint64 first, quint64 second, int limit,
+                      const QStringList &peerNames);
+    void sendHistoryPage();
+    void onHistoryPage(quint32 requestId, const HistoryCursor &cursor, const QByteArray &block);
+};
+
+#endif // CLIENT_H
@@ -0,0 +1,114 @@
+#include "clientregistry.h"
+#include "client.h"
+
+ClientRegistry::ClientRegistry()
+{
+    clear();
+}
+
+void ClientRegistry::addConnection(Client *client)
+{
+    clientsBySocket.insert(client->getSocketDescriptor(), client);
+}
+
+void ClientRegistry::removeConnection(Client *client)
+{
+    deregisterClient(client);
+    QHash<qintptr, Client *>::iterator it = clientsBySocket.find(client->getSocketDescriptor());
+    if (it != clientsBySocket.end() && it.value() == client)
+        clientsBySocket.erase(it);
+}
+
+void ClientRegistry::registerClient(Client *client)
+{
+    if (registeredEntries.contains(client))
+        deregisterClient(client);
+    RegisteredEntry entry;
+    entry.index = registeredClientsList.size();
+    entry.sessionId = client->getSessionId();
+    entry.protocolVersion = qMin(client->getProtocolVersion(), Constants::protocolVersion);
+    entry.uuidKey = client->getUUID();
+    entry.nameKey = nameKey(client->getName());
+    registeredClientsList.append(client);
+    clientsByUUID.insert(entry.uuidKey, client);
+    clientsBySessionId.insert(entry.sessionId, client);
+    clientsByName.insert(entry.nameKey, client);
+    registeredEntries.insert(client, entry);
+    registeredByVersion[entry.protocolVersion]++;
+}
+
+void ClientRegistry::deregisterClient(Client *client)
+{
+    QHash<Client *, RegisteredEntry>::iterator it = registeredEntries.find(client);
+    if (it == registeredEntries.end())
+        return;
+    RegisteredEntry entry = it.value();
+    registeredEntries.erase(it);
+    clientsByUUID.remove(entry.uuidKey);
+    clientsBySessionId.remove(entry.sessionId);
+    registeredByVersion[entry.protocolVersion]--;
+    clientsByName.remove(entry.nameKey);
+    // the peers still know the client by the session id, the messages to it may be kept for the name
+    DepartedEntry departed;
+    departed.name = client->getName();
+    departed.uuid = client->getUUID();
+    departedEntries.insert(entry.sessionId, departed);
+    departedOrder.enqueue(entry.sessionId);
+    if (departedOrder.size() > Constants::departedSessions)
+        departedEntries.remove(departedOrder.dequeue());
+
+    // order of delivery doesn't matter, so fill the gap with the last item
+    Client *last = registeredClientsList.last();
+    registeredClientsList[entry.index] = last;
+    registeredClientsList.removeLast();
+    if (last != client)
+        registeredEntries[last].index = entry.index;
+}
+
+void ClientRegistry::clear()
+{
+    clientsBySocket.clear();
+    clientsByUUID.clear();
+    clientsBySessionId.clear();
+    clientsByName.clear();
+    registeredClientsList.clear();
+    registeredEntries.clear();
+    departedEntries.clear();
+    departedOrder.clear();
+    for (int version = 0; version <= Constants::protocolVersion; ++version)
+        registeredByVersion[version] = 0;
+}
+
+quint32 ClientRegistry::getRegisteredVersions() const
+{
+    quint32 versions = 0;
+    for (int version = 0; version <= Constants::protocolVersion; ++version)
+        if (registeredByVersion[version] > 0)
+            versions |= 1u << version;
+    return versions;
+}
+
+Client *ClientRegistry::findByUUID(const QString &uuid) const
+{
+    return clientsByUUID.value(uuid, 0);
+}
+
+Client *ClientRegistry::findBySessionId(quint32 sessionId) const
+{
+    return clientsBySessionId.value(sessionId, 0);
+}
+
+QString ClientRegistry::findDepartedName(quint32 sessionId, QString *uuid) const
+{
+    QHash<quint32, DepartedEntry>::const_iterator it = departedEntries.constFind(sessionId);
+    if (it == departedEntries.constEnd())
+        return QString();
+    if (uuid != 0)
+        *uuid = it->uuid;
+    return it->name;
+}
+
+Client *ClientRegistry::findByName(const QString &name) const
+{
+    return clientsByName.value(nameKey(name), 0);
+}
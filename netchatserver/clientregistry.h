@@ -0,0 +1,76 @@
+#ifndef CLIENTREGISTRY_H
+#define CLIENTREGISTRY_H
+
+#include <QHash>
+#include <QVector>
+#include <QQueue>
+#include <QString>
+
+#include "constants.h"
+
+class Client;
+
+// all the connected clients indexed by socket descriptor, the registered ones
+// by UUID, by session id and by case-folded name as well, so every lookup is O(1);
+// not thread-safe, the owner guards it
+class ClientRegistry
+{
+public:
+    ClientRegistry();
+
+    void addConnection(Client *client);
+    // deregisters the client as well
+    void removeConnection(Client *client);
+    // indexes the client by its current UUID, session id and name
+    void registerClient(Client *client);
+    void deregisterClient(Client *client);
+    void clear();
+
+    Client *findByUUID(const QString &uuid) const;
+    Client *findByName(const QString &name) const;
+    Client *findBySessionId(quint32 sessionId) const;
+    bool isNameUsed(const QString &name) const {return findByName(name) != 0;}
+    bool isUUIDRegistered(const QString &uuid) const {return findByUUID(uuid) != 0;}
+    // the name a session id had before its client left, empty if it's unknown or forgotten;
+    // the UUID it had goes to uuid, if it's given
+    QString findDepartedName(quint32 sessionId, QString *uuid = 0) const;
+
+    const QHash<qintptr, Client *> &getConnections() const {return this->clientsBySocket;}
+    // walked by the broadcasts, no copies
+    const QVector<Client *> &getRegisteredClients() const {return this->registeredClientsList;}
+    int getConnectionsCount() const {return this->clientsBySocket.size();}
+    int getRegisteredCount() const {return this->registeredClientsList.size();}
+    // bit N is set if some registered client speaks protocol version N
+    quint32 getRegisteredVersions() const;
+
+private:
+    struct RegisteredEntry
+    {
+        int index;
+        quint32 sessionId;
+        quint8 protocolVersion;
+        QString uuidKey;
+        QString nameKey;
+    };
+
+    QHash<qintptr, Client *> clientsBySocket;
+    QHash<QString, Client *> clientsByUUID;
+    QHash<quint32, Client *> clientsBySessionId;
+    QHash<QString, Client *> clientsByName;
+    QVector<Client *> registeredClientsList;
+    QHash<Client *, RegisteredEntry> registeredEntries;
+    int registeredByVersion[Constants::protocolVersion + 1];
+    struct DepartedEntry
+    {
+        QString name;
+        QString uuid;
+    };
+
+    // the last Constants::departedSessions of them, the oldest are forgotten first
+    QHash<quint32, DepartedEntry> departedEntries;
+    QQueue<quint32> departedOrder;
+
+    static QString nameKey(const QString &name) {return name.toCaseFolded();}
+};
+
+#endif // CLIENTREGISTRY_H
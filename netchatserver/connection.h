@@ -0,0 +1,31 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <QtGlobal>
+#include <QString>
+
+class FrameDecoder;
+
+// the transport of one client, implemented by the I/O backends;
+// it's used from the thread of the client's worker only
+class Connection
+{
+public:
+    virtual ~Connection() {}
+
+    virtual qintptr descriptor() const = 0;
+    // appends everything the peer has sent so far to the decoder
+    virtual void readInto(FrameDecoder &decoder) = 0;
+    // whatever the socket doesn't take at once is buffered
+    virtual void write(const char *data, qint64 size) = 0;
+    void write(const QByteArray &data) {write(data.constData(), data.size());}
+    virtual qint64 bytesToWrite() const = 0;
+    // closes the connection once the buffered bytes are written
+    virtual void disconnectFromHost() = 0;
+    // closes the connection at once
+    virtual void abort() = 0;
+    // false when the writes mustn't go to the descriptor past the connection
+    virtual bool allowsDirectWrites() const {return true;}
+};
+
+#endif // CONNECTION_H
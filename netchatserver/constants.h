@@ -1,32 +1,143 @@
-#ifndef CONSTANTS_H
-#define CONSTANTS_H
-
-#include <QString>
-
-namespace Constants {
-
-static const QString constNameUnknown = ".Unknown";
-static const quint8 comRegisterRequest = 1;
-static const quint8 comRegisteredClients = 2;
-static const quint8 comClientJoined = 3;
-static const quint8 comClientLeft = 4;
-static const quint8 comMessageToAll = 5;
-static const quint8 comMessageToClients = 6;
-static const quint8 comPublicServerMessage = 7;
-static const quint8 comPrivateServerMessage = 8;
-static const quint8 comRegistrationSuccess = 9;
-static const quint8 comDisconnectClient = 10;
-static const quint8 comDeregisterRequest = 11;
-static const quint8 comDeregisterClient = 14;
-static const quint8 comPing = 15;
-static const quint8 comClientConnected = 16;
-
-static const quint8 comErrClientExists = 201;
-static const quint8 comErrNameInvalid = 202;
-static const quint8 comErrNameUsed = 203;
-static const quint8 comErrNameIllegal = 204;
-
-static const QString programName = "NetChatServer";
-}
-
-#endif // CONSTANTS_H
+#ifndef CONSTANTS_H
+#define CONSTANTS_H
+
+#include <QString>
+
+namespace Constants {
+
+static const QString constNameUnknown = ".Unknown";
+static const quint8 comRegisterRequest = 1;
+static const quint8 comRegisteredClients = 2;
+static const quint8 comClientJoined = 3;
+static const quint8 comClientLeft = 4;
+static const quint8 comMessageToAll = 5;
+static const quint8 comMessageToClients = 6;
+static const quint8 comPublicServerMessage = 7;
+static const quint8 comPrivateServerMessage = 8;
+static const quint8 comRegistrationSuccess = 9;
+static const quint8 comDisconnectClient = 10;
+static const quint8 comDeregisterRequest = 11;
+static const quint8 comDeregisterClient = 14;
+static const quint8 comPing = 15;
+static const quint8 comClientConnected = 16;
+// protocol negotiation: an empty hello from the client, the server answers with its version,
+// the client confirms the version both sides use from now on
+static const quint8 comProtocolHello = 17;
+static const quint8 comProtocolAccepted = 18;
+static const quint8 comProtocolVersion = 19;
+// a part of a long message (protocol version 2)
+static const quint8 comMessageChunk = 20;
+// the client sends faster than the server lets it, the messages are dropped: [quint32 msec to wait]
+static const quint8 comSlowDown = 21;
+// the server asks an idle client whether it's still there, the client answers with the same (protocol version 5)
+static const quint8 comHeartbeat = 22;
+// [quint32 sequence number][quint64 monotonic send time, usec of the sender's clock],
+// the receiver sends the same back as a reply at once (protocol version 6)
+static const quint8 comPingRequest = 23;
+static const quint8 comPingReply = 24;
+// the private messages sent to the client while it was away, a page of them after the registration
+// (protocol version 7): [quint32 count][quint64 msec since epoch][sender UUID][sender name][text]...
+// [quint32 messages left]
+static const quint8 comOfflineMessages = 25;
+// the history of the journal (protocol version 8): the client asks
+// [quint32 request id][quint8 mode][quint64 a][quint64 b][quint32 limit][quint32 count][peer name]...,
+// no peers - the messages to all, else the private conversation with them; the modes are
+// historyByTime (a, b - msec since epoch), historyBefore (a - message id, 0 - the newest ones)
+// and historyAfter (a - message id). The server answers with pages:
+// [quint32 request id][quint8 flags][quint32 count][quint64 message id][quint64 msec][sender name]
+// [quint8 record flags][text]..., the last page has historyLast
+static const quint8 comHistoryRequest = 26;
+static const quint8 comHistoryPage = 27;
+static const quint8 historyByTime = 1;
+static const quint8 historyBefore = 2;
+static const quint8 historyAfter = 3;
+static const quint8 historyLast = 0x01;
+// the server keeps no history (the journal is off)
+static const quint8 historyUnavailable = 0x02;
+
+static const quint8 comErrClientExists = 201;
+static const quint8 comErrNameInvalid = 202;
+static const quint8 comErrNameUsed = 203;
+static const quint8 comErrNameIllegal = 204;
+// the client doesn't read fast enough and is disconnected
+static const quint8 comErrSlowConsumer = 205;
+// too many registrations from the client's address, it's disconnected
+static const quint8 comErrTooManyRequests = 206;
+
+// 1 - the original protocol, 2 - extended frame sizes, paged roster, chunked messages,
+// 3 - the clients are referenced by the 32-bit session ids the server assigns on registration,
+// 4 - the strings are [quint32 size][UTF-8] instead of the UTF-16 of QDataStream,
+// 5 - the server checks the idle connections with heartbeats,
+// 6 - timestamped ping/pong in both directions,
+// 7 - the private messages to the clients who are away are kept and delivered when they come back,
+// 8 - the history requests
+static const quint8 protocolVersion = 8;
+static const quint8 chunkFirst = 0x01;
+static const quint8 chunkLast = 0x02;
+// messages longer than that are sent in chunks of that length
+static const int messageChunkLength = 8192;
+// the roster is sent in pages of about that length
+static const int rosterPageLength = 8192;
+// or of that many clients since protocol version 3
+static const int rosterPageEntries = 256;
+// not more than that many chunked messages may be in progress per client
+static const int maxOpenStreams = 8;
+// the default limits of the outbound queue of a client
+static const qint64 outboundQueueBytes = 4 * 1024 * 1024;
+static const int outboundQueueMessages = 10000;
+// the queue is drained into the socket while the socket holds less than that
+static const qint64 socketWriteThreshold = 64 * 1024;
+// not more than that many frames go to one vectored write
+static const int maxFramesPerWrite = 64;
+// the default admission limits: the new connections and the registrations per second per IP address
+// (with bursts of that many seconds' worth) and the connections that haven't registered yet
+static const double admissionConnectionsPerSecond = 50;
+static const double admissionRegistrationsPerSecond = 20;
+static const double admissionBurstSeconds = 4;
+static const int admissionMaxPending = 10000;
+static const qint64 admissionPruneMsec = 10 * 1000;
+// a connection that hasn't registered within that many seconds is closed
+static const int handshakeTimeoutSec = 120;
+// the frames of a connection that hasn't registered are not larger than that
+static const quint32 handshakeFrameSize = 4096;
+// the default flood limits of a registered client: the messages and the bytes per second,
+// with bursts of that many seconds' worth
+static const double floodMessagesPerSecond = 20;
+static const double floodBytesPerSecond = 1024 * 1024;
+static const double floodBurstSeconds = 2;
+// not more than one comSlowDown per that many milliseconds
+static const qint64 slowDownNoticeMsec = 1000;
+// a client silent for the interval gets a heartbeat, one silent for the timeout is closed
+static const int heartbeatIntervalSec = 30;
+static const int heartbeatTimeoutSec = 90;
+// the timer wheel of a worker: a tick per second, the deadlines up to that many ticks ahead take one turn
+static const int heartbeatWheelBuckets = 512;
+static const qint64 heartbeatTickMsec = 1000;
+// the message journal: a new segment file once the current one has grown that large,
+// the records waiting for the journal thread are dropped beyond that many bytes
+static const qint64 journalSegmentBytes = 64 * 1024 * 1024;
+static const qint64 journalMaxPendingBytes = 64 * 1024 * 1024;
+// 0 - every group commit is synced to the disk, N - at most one sync per N msec, -1 - never
+static const int journalFsyncMsec = 0;
+// the journal keeps not more than that of the text of a chunked message
+static const int journalMaxMessageBytes = 4 * 1024 * 1024;
+// the private messages to the clients who are away: the bytes of all the queues in memory
+// (the rest is spilled to the disk) and the messages kept per recipient
+static const qint64 offlineMemoryBytes = 16 * 1024 * 1024;
+static const int offlineMessagesPerRecipient = 1000;
+// they are delivered in pages of that many messages or about that many bytes, a page per flush
+static const int offlinePageMessages = 64;
+static const qint64 offlinePageBytes = 64 * 1024;
+// the history: a time mark per that many records of the journal, not more than that many messages
+// per request, sent in pages of that many messages or about that many bytes, a page per flush
+static const int historyTimeMarkRecords = 256;
+static const int historyMaxMessages = 1000;
+static const int historyPageMessages = 64;
+static const qint64 historyPageBytes = 64 * 1024;
+// the session ids of the clients who have left are remembered as names for that many of them
+static const int departedSessions = 65536;
+
+static const QString programName = "NetChatServer";
+}
+
+#endif // CONSTANTS_H
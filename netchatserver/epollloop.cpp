@@ -0,0 +1,213 @@
+#include <QSocketNotifier>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "epollloop.h"
+#include "framecodec.h"
+#include "client.h"
+#include "server.h"
+
+// the events handled per wake-up, the rest wait for the next turn of the event loop
+static const int maxEventsPerWait = 256;
+// the bytes read per recv() call
+static const int readChunkSize = 16 * 1024;
+
+EpollConnection::EpollConnection(EpollLoop *loopPtr, int socketDescriptor, Client *clientPtr) :
+    loop(loopPtr), fd(socketDescriptor), client(clientPtr)
+{
+    outPos = 0;
+    isPeerClosed = false;
+    isClosing = false;
+    isClosed = false;
+}
+
+EpollConnection::~EpollConnection()
+{
+    if (!isClosed)
+    {
+        loop->removeDescriptor(fd);
+        ::close(fd);
+    }
+}
+
+qintptr EpollConnection::descriptor() const
+{
+    return fd;
+}
+
+void EpollConnection::readInto(FrameDecoder &decoder)
+{
+    // edge-triggered: read until the kernel has nothing more
+    while (!isClosed)
+    {
+        char *data = decoder.beginAppend(readChunkSize);
+        ssize_t bytesRead = ::recv(fd, data, readChunkSize, 0);
+        loop->getServer()->countRecvCall();
+        decoder.endAppend(bytesRead > 0 ? (int)bytesRead : 0);
+        if (bytesRead > 0)
+            continue;
+        if (bytesRead < 0 && errno == EINTR)
+            continue;
+        if (bytesRead == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            isPeerClosed = true;
+        break;
+    }
+}
+
+void EpollConnection::write(const char *data, qint64 size)
+{
+    if (isClosed || size <= 0)
+        return;
+    if (outPos == outBuffer.size())
+    {
+        outBuffer.clear();
+        outPos = 0;
+        // nothing is waiting, so try the kernel first
+        while (size > 0)
+        {
+            ssize_t written = ::send(fd, data, size, MSG_NOSIGNAL);
+            loop->getServer()->countSendCall();
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                break;
+            data += written;
+            size -= written;
+        }
+        if (size == 0)
+            return;
+    }
+    // EPOLLOUT comes when the kernel takes more
+    outBuffer.append(data, (int)size);
+}
+
+qint64 EpollConnection::bytesToWrite() const
+{
+    return outBuffer.size() - outPos;
+}
+
+void EpollConnection::disconnectFromHost()
+{
+    isClosing = true;
+    if (bytesToWrite() == 0)
+        close();
+}
+
+void EpollConnection::abort()
+{
+    close();
+}
+
+bool EpollConnection::flushOut()
+{
+    while (outPos < outBuffer.size())
+    {
+        ssize_t written = ::send(fd, outBuffer.constData() + outPos, outBuffer.size() - outPos, MSG_NOSIGNAL);
+        loop->getServer()->countSendCall();
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        outPos += written;
+    }
+    outBuffer.clear();
+    outPos = 0;
+    return true;
+}
+
+void EpollConnection::handleEvents(quint32 events)
+{
+    // the client may close the connection while handling any of the events below
+    if (isClosed)
+        return;
+    if (events & (EPOLLIN | EPOLLRDHUP))
+        client->onReadyRead();
+    if (isClosed)
+        return;
+    if (events & EPOLLOUT)
+    {
+        if (flushOut())
+        {
+            if (isClosing)
+            {
+                close();
+                return;
+            }
+            // the socket takes more, let the client drain its queue
+            client->flushQueue();
+        }
+    }
+    if (isClosed)
+        return;
+    if (isPeerClosed || (events & (EPOLLERR | EPOLLHUP)))
+        close();
+}
+
+void EpollConnection::close()
+{
+    if (isClosed)
+        return;
+    isClosed = true;
+    loop->removeDescriptor(fd);
+    outBuffer.clear();
+    outPos = 0;
+    // the clients are indexed by descriptor, the client leaves the lists before
+    // another thread may accept a connection with the same descriptor
+    client->onDisconnect();
+    ::close(fd);
+}
+
+EpollLoop::EpollLoop(ChatServer *chatServerPtr, QObject *parent) :
+    QObject(parent), chatServer(chatServerPtr), notifier(0)
+{
+    epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0)
+        return;
+    // the epoll descriptor gets readable when any connection in the set has events
+    notifier = new QSocketNotifier(epollFd, QSocketNotifier::Read, this);
+    connect(notifier, SIGNAL(activated(int)), this, SLOT(onEpollReady()));
+}
+
+EpollLoop::~EpollLoop()
+{
+    delete notifier;
+    if (epollFd >= 0)
+        ::close(epollFd);
+}
+
+EpollConnection *EpollLoop::addConnection(qintptr socketDescriptor, Client *client)
+{
+    int fd = (int)socketDescriptor;
+    int flags = ::fcntl(fd, F_GETFL, 0);
+    ::fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    EpollConnection *connection = new EpollConnection(this, fd, client);
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = connection;
+    ::epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    chatServer->countControlCall();
+    return connection;
+}
+
+void EpollLoop::removeDescriptor(int fd)
+{
+    ::epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, 0);
+    chatServer->countControlCall();
+}
+
+void EpollLoop::onEpollReady()
+{
+    // the connections closed while handling this batch are deleted on the next turn only,
+    // so the pointers of the batch stay valid
+    struct epoll_event events[maxEventsPerWait];
+    int count = ::epoll_wait(epollFd, events, maxEventsPerWait, 0);
+    chatServer->countWaitCall();
+    for (int i = 0; i < count; ++i)
+    {
+        EpollConnection *connection = static_cast<EpollConnection *>(events[i].data.ptr);
+        connection->handleEvents(events[i].events);
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef EPOLLLOOP_H
+#define EPOLLLOOP_H
+
+#include <QObject>
+#include <QByteArray>
+
+#include "connection.h"
+
+class QSocketNotifier;
+class Client;
+class ChatServer;
+class EpollLoop;
+
+// a connection served by an edge-triggered epoll set, no QObject per connection;
+// the Linux-only alternative to QtConnection
+class EpollConnection : public Connection
+{
+public:
+    EpollConnection(EpollLoop *loopPtr, int socketDescriptor, Client *clientPtr);
+    ~EpollConnection();
+
+    qintptr descriptor() const;
+    void readInto(FrameDecoder &decoder);
+    void write(const char *data, qint64 size);
+    qint64 bytesToWrite() const;
+    void disconnectFromHost();
+    void abort();
+
+    void handleEvents(quint32 events);
+
+private:
+    EpollLoop *loop;
+    int fd;
+    Client *client;
+    // the bytes the kernel hasn't taken yet
+    QByteArray outBuffer;
+    int outPos;
+    bool isPeerClosed;
+    bool isClosing;
+    bool isClosed;
+
+    bool flushOut();
+    void close();
+};
+
+// one epoll set per worker thread, its descriptor is watched by the event loop of the thread
+class EpollLoop : public QObject
+{
+    Q_OBJECT
+
+public:
+    // the system calls are counted on the server
+    explicit EpollLoop(ChatServer *chatServerPtr, QObject *parent = 0);
+    ~EpollLoop();
+
+    bool isValid() const {return this->epollFd >= 0;}
+    // the connection is owned by the caller (the client), it leaves the set when it's closed
+    EpollConnection *addConnection(qintptr socketDescriptor, Client *client);
+    void removeDescriptor(int fd);
+    ChatServer *getServer() const {return this->chatServer;}
+
+private:
+    ChatServer *chatServer;
+    int epollFd;
+    QSocketNotifier *notifier;
+
+private slots:
+    void onEpollReady();
+};
+
+#endif // EPOLLLOOP_H
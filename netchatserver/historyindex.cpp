@@ -0,0 +1,242 @@
+#include <QFile>
+#include <algorithm>
+
+#include "historyindex.h"
+#include "constants.h"
+
+// the names are letters, digits and underscores only, so it's never a name
+const QString HistoryIndex::publicConversation = "*";
+
+HistoryIndex::HistoryIndex()
+{
+    maxTimeMsec = 0;
+    recordsCount = 0;
+}
+
+void HistoryIndex::clear()
+{
+    QWriteLocker locker(&lock);
+    segments.clear();
+    conversations.clear();
+    timeMarks.clear();
+    maxTimeMsec = 0;
+    recordsCount = 0;
+}
+
+quint32 HistoryIndex::addSegment(const QString &fileName)
+{
+    QWriteLocker locker(&lock);
+    segments.append(fileName);
+    return segments.size() - 1;
+}
+
+QString HistoryIndex::conversationKey(const QString &name, const QStringList &peerNames)
+{
+    QStringList names;
+    names.append(name.toCaseFolded());
+    foreach (const QString &peerName, peerNames)
+        if (!names.contains(peerName.toCaseFolded()))
+            names.append(peerName.toCaseFolded());
+    // the same key whoever of them has sent the message
+    names.sort();
+    return names.join(',');
+}
+
+QString HistoryIndex::conversationKey(const JournalRecord &record)
+{
+    if (!(record.flags & JournalRecord::flagPrivate))
+        return publicConversation;
+    // the journals written before the names of the receivers were recorded have no conversations
+    if (record.receiverNames.isEmpty())
+        return QString();
+    return conversationKey(record.senderName, record.receiverNames);
+}
+
+void HistoryIndex::add(const JournalRecord &record, const HistoryLocation &location)
+{
+    QWriteLocker locker(&lock);
+    addLocked(record, location);
+}
+
+void HistoryIndex::add(const QList<JournalRecord> &records, int from, const QVector<HistoryLocation> &locations)
+{
+    // a batch of the journal under one lock
+    QWriteLocker locker(&lock);
+    for (int i = 0; i < locations.size(); ++i)
+        addLocked(records.at(from + i), locations.at(i));
+}
+
+void HistoryIndex::addLocked(const JournalRecord &record, const HistoryLocation &location)
+{
+    maxTimeMsec = qMax(maxTimeMsec, record.timestampMsec);
+    if (recordsCount % Constants::historyTimeMarkRecords == 0)
+    {
+        TimeMark mark;
+        mark.messageId = record.messageId;
+        mark.maxTimeMsec = maxTimeMsec;
+        timeMarks.append(mark);
+    }
+    else
+        timeMarks.last().maxTimeMsec = maxTimeMsec;
+    recordsCount++;
+    QString key = conversationKey(record);
+    if (!key.isEmpty())
+        conversations[key].append(location);
+}
+
+bool HistoryIndex::isIdLess(const HistoryLocation &location, quint64 messageId)
+{
+    return location.messageId < messageId;
+}
+
+bool HistoryIndex::isIdGreater(quint64 messageId, const HistoryLocation &location)
+{
+    return messageId < location.messageId;
+}
+
+bool HistoryIndex::isTimeLess(const TimeMark &mark, qint64 timeMsec)
+{
+    return mark.maxTimeMsec < timeMsec;
+}
+
+bool HistoryIndex::isTimeGreater(qint64 timeMsec, const TimeMark &mark)
+{
+    return timeMsec < mark.maxTimeMsec;
+}
+
+HistoryCursor HistoryIndex::findByTime(const QString &conversation, qint64 fromMsec, qint64 toMsec, int limit) const
+{
+    QReadLocker locker(&lock);
+    HistoryCursor cursor;
+    cursor.conversation = conversation;
+    cursor.fromMsec = fromMsec;
+    cursor.toMsec = toMsec;
+    cursor.left = limit;
+    cursor.isTimeFiltered = true;
+    QHash<QString, QVector<HistoryLocation> >::const_iterator it = conversations.constFind(conversation);
+    if (it == conversations.constEnd() || fromMsec > toMsec)
+        return cursor;
+    // the marks bound the ids: all the records of the marks before the first one of the range
+    // are older than it (the latest time only grows), all the ones after the mark that goes past it
+    // are newer but for the few relayed out of order, which the time filter takes care of
+    QVector<TimeMark>::const_iterator first = std::lower_bound(timeMarks.constBegin(), timeMarks.constEnd(),
+                                                               fromMsec, isTimeLess);
+    if (first == timeMarks.constEnd())
+        return cursor;
+    quint64 fromId = first->messageId;
+    QVector<TimeMark>::const_iterator last = std::upper_bound(first, timeMarks.constEnd(), toMsec, isTimeGreater);
+    quint64 toId = Q_UINT64_C(0xffffffffffffffff);
+    if (last != timeMarks.constEnd() && last + 1 != timeMarks.constEnd())
+        toId = (last + 1)->messageId - 1;
+    const QVector<HistoryLocation> &locations = it.value();
+    cursor.pos = std::lower_bound(locations.constBegin(), locations.constEnd(), fromId, isIdLess) - locations.constBegin();
+    cursor.end = std::upper_bound(locations.constBegin(), locations.constEnd(), toId, isIdGreater) - locations.constBegin();
+    return cursor;
+}
+
+HistoryCursor HistoryIndex::findBefore(const QString &conversation, quint64 messageId, int limit) const
+{
+    QReadLocker locker(&lock);
+    HistoryCursor cursor;
+    cursor.conversation = conversation;
+    cursor.left = limit;
+    QHash<QString, QVector<HistoryLocation> >::const_iterator it = conversations.constFind(conversation);
+    if (it == conversations.constEnd())
+        return cursor;
+    const QVector<HistoryLocation> &locations = it.value();
+    cursor.end = messageId == 0 ? locations.size() :
+            std::lower_bound(locations.constBegin(), locations.constEnd(), messageId, isIdLess) - locations.constBegin();
+    cursor.pos = qMax(0, cursor.end - limit);
+    return cursor;
+}
+
+HistoryCursor HistoryIndex::findAfter(const QString &conversation, quint64 messageId, int limit) const
+{
+    QReadLocker locker(&lock);
+    HistoryCursor cursor;
+    cursor.conversation = conversation;
+    cursor.left = limit;
+    QHash<QString, QVector<HistoryLocation> >::const_iterator it = conversations.constFind(conversation);
+    if (it == conversations.constEnd())
+        return cursor;
+    const QVector<HistoryLocation> &locations = it.value();
+    cursor.pos = std::upper_bound(locations.constBegin(), locations.constEnd(), messageId, isIdGreater) - locations.constBegin();
+    cursor.end = qMin(locations.size(), cursor.pos + limit);
+    return cursor;
+}
+
+QList<JournalRecord> HistoryIndex::readPage(HistoryCursor *cursor, int maxCount, qint64 maxBytes) const
+{
+    QList<JournalRecord> records;
+    qint64 bytes = 0;
+    // a time range may skip some records, so it goes on until something is found
+    while (records.isEmpty() && !cursor->isDone())
+    {
+        // the locations are only appended, the ones of the cursor stay where they are
+        QVector<HistoryLocation> page;
+        QStringList files;
+        {
+            QReadLocker locker(&lock);
+            const QVector<HistoryLocation> &locations = conversations.value(cursor->conversation);
+            int count = qMin(qMin(maxCount, cursor->left), qMin(cursor->end, locations.size()) - cursor->pos);
+            if (count <= 0)
+            {
+                cursor->pos = cursor->end;
+                break;
+            }
+            page = locations.mid(cursor->pos, count);
+            files = segments;
+        }
+        // the records of one segment are read from one mapping
+        QFile file;
+        const char *data = 0;
+        qint64 size = 0;
+        quint32 mappedSegment = 0;
+        int read = 0;
+        for (; read < page.size() && records.size() < maxCount && (records.isEmpty() || bytes < maxBytes); ++read)
+        {
+            const HistoryLocation &location = page.at(read);
+            if (data == 0 || location.segment != mappedSegment)
+            {
+                if (data != 0)
+                    file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(data)));
+                file.close();
+                data = 0;
+                file.setFileName(files.value(location.segment));
+                if (file.open(QIODevice::ReadOnly) && (size = file.size()) > 0)
+                    data = reinterpret_cast<const char *>(file.map(0, size));
+                mappedSegment = location.segment;
+                if (data == 0)
+                    continue;
+            }
+            JournalRecord record;
+            int recordSize = location.offset < size ?
+                        MessageJournal::readRecord(data + location.offset, size - location.offset, &record) : 0;
+            if (recordSize == 0 || record.messageId != location.messageId)
+                continue;
+            if (cursor->isTimeFiltered && (record.timestampMsec < cursor->fromMsec || record.timestampMsec > cursor->toMsec))
+                continue;
+            if (!cursor->participantUuid.isEmpty() && record.senderUuid != cursor->participantUuid &&
+                    !record.receiverUuids.contains(cursor->participantUuid))
+                continue;
+            records.append(record);
+            bytes += recordSize;
+        }
+        if (data != 0)
+            file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(data)));
+        cursor->pos += read;
+    }
+    cursor->left -= records.size();
+    return records;
+}
+
+HistoryStats HistoryIndex::getStats() const
+{
+    QReadLocker locker(&lock);
+    HistoryStats stats;
+    stats.records = recordsCount;
+    stats.conversations = conversations.size();
+    stats.timeMarks = timeMarks.size();
+    stats.segments = segments.size();
+    return stats;
+}
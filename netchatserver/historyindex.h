@@ -0,0 +1,109 @@
+#ifndef HISTORYINDEX_H
+#define HISTORYINDEX_H
+
+#include <QHash>
+#include <QVector>
+#include <QStringList>
+#include <QReadWriteLock>
+#include <QMetaType>
+
+#include "messagejournal.h"
+
+// where a record of the journal is: its segment (the number in the index) and the offset in it
+struct HistoryLocation
+{
+    quint64 messageId;
+    quint32 segment;
+    quint32 offset;
+};
+
+// a history query in progress: the part of the conversation still to be read
+struct HistoryCursor
+{
+    HistoryCursor() : pos(0), end(0), fromMsec(0), toMsec(0), left(0), isTimeFiltered(false) {}
+
+    QString conversation;
+    // the positions in the locations of the conversation
+    int pos;
+    int end;
+    // the time range, the records out of it are skipped
+    qint64 fromMsec;
+    qint64 toMsec;
+    // the UUID the records of a private conversation must have as the sender or a receiver,
+    // the conversations are kept by the names and a name may have been taken by someone else since
+    QString participantUuid;
+    // the messages the query may still return
+    int left;
+    bool isTimeFiltered;
+
+    bool isDone() const {return this->left <= 0 || this->pos >= this->end;}
+};
+
+Q_DECLARE_METATYPE(HistoryCursor)
+
+struct HistoryStats
+{
+    HistoryStats() : records(0), conversations(0), timeMarks(0), segments(0) {}
+
+    qint64 records;
+    qint64 conversations;
+    qint64 timeMarks;
+    qint64 segments;
+};
+
+// the indices of the journal for the history queries, kept in memory: the locations of the records
+// of every conversation (all the messages to all are one conversation, the private ones are
+// by the set of the participants' names) in the order of the ids, and a sparse time index over
+// all the records, a mark per Constants::historyTimeMarkRecords of them. A query takes O(log n)
+// to find its range and then reads only the records it returns from the segments.
+// Filled by the journal thread, read by the workers
+class HistoryIndex
+{
+public:
+    HistoryIndex();
+
+    void clear();
+    // the journal thread: a new segment gets the next number, then its records are added
+    // in the order of their ids
+    quint32 addSegment(const QString &fileName);
+    void add(const JournalRecord &record, const HistoryLocation &location);
+    void add(const QList<JournalRecord> &records, int from, const QVector<HistoryLocation> &locations);
+
+    // the messages to all, or the private conversation of the client with the peers
+    static QString conversationKey(const QString &name, const QStringList &peerNames);
+    static QString conversationKey(const JournalRecord &record);
+    static const QString publicConversation;
+
+    // the messages of the time range (msec since epoch), in the order of the ids
+    HistoryCursor findByTime(const QString &conversation, qint64 fromMsec, qint64 toMsec, int limit) const;
+    // the last messages before the id (0 - the newest ones) or the first ones after it
+    HistoryCursor findBefore(const QString &conversation, quint64 messageId, int limit) const;
+    HistoryCursor findAfter(const QString &conversation, quint64 messageId, int limit) const;
+    // the next records of the query, not more than the count and (but at least one) about the bytes
+    QList<JournalRecord> readPage(HistoryCursor *cursor, int maxCount, qint64 maxBytes) const;
+    HistoryStats getStats() const;
+
+private:
+    // the first record of a run of Constants::historyTimeMarkRecords
+    struct TimeMark
+    {
+        quint64 messageId;
+        // the latest timestamp up to the end of the run, so the marks are ordered by the time as well
+        qint64 maxTimeMsec;
+    };
+
+    mutable QReadWriteLock lock;
+    QStringList segments;
+    QHash<QString, QVector<HistoryLocation> > conversations;
+    QVector<TimeMark> timeMarks;
+    qint64 maxTimeMsec;
+    qint64 recordsCount;
+
+    void addLocked(const JournalRecord &record, const HistoryLocation &location);
+    static bool isIdLess(const HistoryLocation &location, quint64 messageId);
+    static bool isIdGreater(quint64 messageId, const HistoryLocation &location);
+    static bool isTimeLess(const TimeMark &mark, qint64 timeMsec);
+    static bool isTimeGreater(qint64 timeMsec, const TimeMark &mark);
+};
+
+#endif // HISTORYINDEX_H
@@ -0,0 +1,50 @@
+#include "historyreader.h"
+#include "serverworker.h"
+#include "framecodec.h"
+#include "constants.h"
+
+HistoryReader::HistoryReader(const HistoryIndex *historyIndex, QObject *parent) :
+    QObject(parent), history(historyIndex)
+{
+}
+
+void HistoryReader::postRead(ServerWorker *worker, quint64 connectionId, quint32 requestId, const HistoryCursor &cursor)
+{
+    QMetaObject::invokeMethod(this, "onRead", Qt::QueuedConnection, Q_ARG(ServerWorker *, worker),
+                              Q_ARG(quint64, connectionId), Q_ARG(quint32, requestId), Q_ARG(HistoryCursor, cursor));
+}
+
+void HistoryReader::addWorker(ServerWorker *worker)
+{
+    QMutexLocker locker(&workersMutex);
+    workers.insert(worker);
+}
+
+void HistoryReader::removeWorker(ServerWorker *worker)
+{
+    QMutexLocker locker(&workersMutex);
+    workers.remove(worker);
+}
+
+// slot
+void HistoryReader::onRead(ServerWorker *worker, quint64 connectionId, quint32 requestId, HistoryCursor cursor)
+{
+    QList<JournalRecord> records = history->readPage(&cursor, Constants::historyPageMessages,
+                                                     Constants::historyPageBytes);
+    int size = 12;
+    foreach (const JournalRecord &record, records)
+        size += record.utf8.size() + record.senderName.size() * 3 + 32;
+    FrameBuilder frame(Constants::comHistoryPage, size);
+    frame.appendUInt32(requestId).appendUInt8(cursor.isDone() ? Constants::historyLast : 0)
+            .appendUInt32(records.size());
+    foreach (const JournalRecord &record, records)
+        frame.appendUInt64(record.messageId).appendUInt64(record.timestampMsec)
+                .appendUtf8String(record.senderName).appendUInt8(record.flags).appendUtf8(record.utf8);
+    // the client may be gone by then, the worker looks it up by the connection id;
+    // the worker itself is posted to under the lock, so it isn't deleted meanwhile
+    QMutexLocker locker(&workersMutex);
+    if (!workers.contains(worker))
+        return;
+    QMetaObject::invokeMethod(worker, "onHistoryPage", Qt::QueuedConnection, Q_ARG(quint64, connectionId),
+                              Q_ARG(quint32, requestId), Q_ARG(HistoryCursor, cursor), Q_ARG(QByteArray, frame.finish()));
+}
@@ -0,0 +1,37 @@
+#ifndef HISTORYREADER_H
+#define HISTORYREADER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QSet>
+
+#include "historyindex.h"
+
+class ServerWorker;
+
+// reads the pages of the history queries from the segments in its own thread, so the opening
+// and the mapping of the files never hold up the clients of a worker; the page goes back to
+// the worker of the client as a ready comHistoryPage frame together with the moved cursor
+class HistoryReader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit HistoryReader(const HistoryIndex *historyIndex, QObject *parent = 0);
+
+    // thread-safe: the page is read in the thread of the reader
+    void postRead(ServerWorker *worker, quint64 connectionId, quint32 requestId, const HistoryCursor &cursor);
+    // the pages go to the workers added only, a removed one gets nothing more and may be deleted
+    void addWorker(ServerWorker *worker);
+    void removeWorker(ServerWorker *worker);
+
+private:
+    const HistoryIndex *history;
+    QMutex workersMutex;
+    QSet<ServerWorker *> workers;
+
+private slots:
+    void onRead(ServerWorker *worker, quint64 connectionId, quint32 requestId, HistoryCursor cursor);
+};
+
+#endif // HISTORYREADER_H
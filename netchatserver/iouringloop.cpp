@@ -0,0 +1,398 @@
+#include <QSocketNotifier>
+#include <QVector>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include "iouringloop.h"
+#include "framecodec.h"
+#include "client.h"
+#include "server.h"
+
+// the submission queue size
+static const unsigned ringEntries = 1024;
+// the provided buffers the multishot recv picks from, the count must be a power of 2
+static const int bufferCount = 256;
+static const int bufferSize = 16 * 1024;
+static const int bufferGroupId = 1;
+
+// the kind of an operation is kept in the low bits of its user data
+enum {opRecv = 1, opSend = 2, opMask = 7};
+
+// the part of a connection the kernel refers to, it lives until the last operation completes
+struct IoUringState
+{
+    // 0 once the connection is deleted
+    IoUringConnection *connection;
+    int fd;
+    // the bytes of the send in flight, the kernel reads them until the completion
+    QByteArray sendBuffer;
+    int sendPos;
+    bool isSending;
+    bool isSendQueued;
+    bool isRecvArmed;
+    bool isClosed;
+    int pendingOps;
+};
+
+static inline bool isAlive(const IoUringState *state)
+{
+    return state->connection != 0 && !state->isClosed;
+}
+
+IoUringConnection::IoUringConnection(IoUringLoop *loopPtr, int socketDescriptor, Client *clientPtr) :
+    loop(loopPtr), client(clientPtr)
+{
+    inData = 0;
+    inSize = 0;
+    isClosing = false;
+    state = new IoUringState;
+    state->connection = this;
+    state->fd = socketDescriptor;
+    state->sendPos = 0;
+    state->isSending = false;
+    state->isSendQueued = false;
+    state->isRecvArmed = false;
+    state->isClosed = false;
+    state->pendingOps = 0;
+    loop->states.insert(state);
+}
+
+IoUringConnection::~IoUringConnection()
+{
+    close(false);
+    // the kernel may still complete some operations, the loop frees the state afterwards
+    state->connection = 0;
+    loop->sendList.removeAll(state);
+    if (state->pendingOps == 0)
+        loop->freeState(state);
+}
+
+qintptr IoUringConnection::descriptor() const
+{
+    return state->fd;
+}
+
+void IoUringConnection::readInto(FrameDecoder &decoder)
+{
+    // the received bytes are in a provided buffer, they go to the decoder before it's recycled
+    if (inSize == 0)
+        return;
+    memcpy(decoder.beginAppend(inSize), inData, inSize);
+    decoder.endAppend(inSize);
+    inSize = 0;
+}
+
+void IoUringConnection::write(const char *data, qint64 size)
+{
+    if (state->isClosed || size <= 0)
+        return;
+    // everything written within one turn of the event loop goes out in one send
+    outBuffer.append(data, (int)size);
+    loop->queueSend(state);
+}
+
+qint64 IoUringConnection::bytesToWrite() const
+{
+    qint64 bytes = outBuffer.size();
+    if (state->isSending)
+        bytes += state->sendBuffer.size() - state->sendPos;
+    return bytes;
+}
+
+void IoUringConnection::disconnectFromHost()
+{
+    isClosing = true;
+    if (bytesToWrite() == 0)
+        close(true);
+}
+
+void IoUringConnection::abort()
+{
+    close(true);
+}
+
+void IoUringConnection::startSend()
+{
+    state->sendBuffer.clear();
+    state->sendBuffer.swap(outBuffer);
+    state->sendPos = 0;
+    state->isSending = true;
+    loop->prepareSend(state);
+}
+
+void IoUringConnection::onReceived(const char *data, int size)
+{
+    inData = data;
+    inSize = size;
+    client->onReadyRead();
+    inSize = 0;
+}
+
+void IoUringConnection::onSent()
+{
+    if (!outBuffer.isEmpty())
+        startSend();
+    else if (isClosing)
+        close(true);
+    else
+        // the socket takes more, let the client drain its queue
+        client->flushQueue();
+}
+
+void IoUringConnection::close(bool notify)
+{
+    if (state->isClosed)
+        return;
+    state->isClosed = true;
+    // the operations in flight complete with -ECANCELED, the descriptor is closed after the cancel is submitted
+    loop->prepareCancel(state);
+    loop->submit();
+    outBuffer.clear();
+    // the client leaves the lists before its descriptor may be reused
+    if (notify)
+        client->onDisconnect();
+    ::close(state->fd);
+}
+
+IoUringLoop::IoUringLoop(ChatServer *chatServerPtr, QObject *parent) :
+    QObject(parent), chatServer(chatServerPtr), bufferRing(0), buffers(0), eventFd(-1), notifier(0)
+{
+    isReady = false;
+    isRingInitialized = false;
+    isMultishotRecv = true;
+    isSubmitScheduled = false;
+    // no io_uring at all (an old kernel or a seccomp filter), the caller falls back to epoll
+    if (io_uring_queue_init(ringEntries, &ring, 0) < 0)
+        return;
+    isRingInitialized = true;
+    // the buffer rings need Linux 5.19
+    int ret = 0;
+    bufferRing = io_uring_setup_buf_ring(&ring, bufferCount, bufferGroupId, 0, &ret);
+    if (bufferRing == 0)
+        return;
+    buffers = new char[bufferCount * bufferSize];
+    for (int i = 0; i < bufferCount; ++i)
+        io_uring_buf_ring_add(bufferRing, buffers + i * bufferSize, bufferSize, i,
+                              io_uring_buf_ring_mask(bufferCount), i);
+    io_uring_buf_ring_advance(bufferRing, bufferCount);
+    // the ring signals every completion on the eventfd, the event loop of the thread watches it
+    eventFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (eventFd < 0 || io_uring_register_eventfd(&ring, eventFd) < 0)
+        return;
+    notifier = new QSocketNotifier(eventFd, QSocketNotifier::Read, this);
+    connect(notifier, SIGNAL(activated(int)), this, SLOT(onEventFd()));
+    isReady = true;
+}
+
+IoUringLoop::~IoUringLoop()
+{
+    delete notifier;
+    if (bufferRing != 0)
+        io_uring_free_buf_ring(&ring, bufferRing, bufferCount, bufferGroupId);
+    // the kernel is done with the buffers once the ring is gone
+    if (isRingInitialized)
+        io_uring_queue_exit(&ring);
+    if (eventFd >= 0)
+        ::close(eventFd);
+    delete[] buffers;
+    foreach (IoUringState *state, states)
+        delete state;
+}
+
+IoUringConnection *IoUringLoop::addConnection(qintptr socketDescriptor, Client *client)
+{
+    int fd = (int)socketDescriptor;
+    // a blocking socket would send every operation to the kernel worker threads
+    int flags = ::fcntl(fd, F_GETFL, 0);
+    ::fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    IoUringConnection *connection = new IoUringConnection(this, fd, client);
+    prepareRecv(connection->state);
+    scheduleSubmit();
+    return connection;
+}
+
+void IoUringLoop::freeState(IoUringState *state)
+{
+    states.remove(state);
+    delete state;
+}
+
+struct io_uring_sqe *IoUringLoop::getSqe()
+{
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+    if (sqe == 0)
+    {
+        // the submission queue is full, it goes to the kernel earlier than planned
+        submit();
+        sqe = io_uring_get_sqe(&ring);
+    }
+    return sqe;
+}
+
+void IoUringLoop::prepareRecv(IoUringState *state)
+{
+    struct io_uring_sqe *sqe = getSqe();
+    if (isMultishotRecv)
+        io_uring_prep_recv_multishot(sqe, state->fd, 0, 0, 0);
+    else
+        io_uring_prep_recv(sqe, state->fd, 0, bufferSize, 0);
+    // the kernel picks a buffer from the ring when the data comes
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = bufferGroupId;
+    io_uring_sqe_set_data64(sqe, (quint64)(quintptr)state | opRecv);
+    state->isRecvArmed = true;
+    state->pendingOps++;
+}
+
+void IoUringLoop::prepareSend(IoUringState *state)
+{
+    struct io_uring_sqe *sqe = getSqe();
+    io_uring_prep_send(sqe, state->fd, state->sendBuffer.constData() + state->sendPos,
+                       state->sendBuffer.size() - state->sendPos, MSG_NOSIGNAL);
+    io_uring_sqe_set_data64(sqe, (quint64)(quintptr)state | opSend);
+    state->pendingOps++;
+}
+
+void IoUringLoop::prepareCancel(IoUringState *state)
+{
+    // the completion of the cancel itself carries no state and is skipped
+    struct io_uring_sqe *sqe = getSqe();
+    io_uring_prep_cancel_fd(sqe, state->fd, IORING_ASYNC_CANCEL_ALL);
+    io_uring_sqe_set_data64(sqe, 0);
+}
+
+void IoUringLoop::queueSend(IoUringState *state)
+{
+    if (!state->isSendQueued)
+    {
+        state->isSendQueued = true;
+        sendList.append(state);
+    }
+    scheduleSubmit();
+}
+
+void IoUringLoop::scheduleSubmit()
+{
+    if (isSubmitScheduled)
+        return;
+    isSubmitScheduled = true;
+    QMetaObject::invokeMethod(this, "onSubmit", Qt::QueuedConnection);
+}
+
+void IoUringLoop::onSubmit()
+{
+    isSubmitScheduled = false;
+    QVector<IoUringState *> list;
+    list.swap(sendList);
+    foreach (IoUringState *state, list)
+    {
+        state->isSendQueued = false;
+        if (isAlive(state) && !state->isSending && !state->connection->outBuffer.isEmpty())
+            state->connection->startSend();
+    }
+    // the sends and recvs of all the connections of this turn go to the kernel in one call
+    if (io_uring_sq_ready(&ring) > 0)
+        submit();
+}
+
+void IoUringLoop::submit()
+{
+    io_uring_submit(&ring);
+    chatServer->countSubmitCall();
+}
+
+void IoUringLoop::recycleBuffer(int bufferId)
+{
+    io_uring_buf_ring_add(bufferRing, buffers + bufferId * bufferSize, bufferSize, bufferId,
+                          io_uring_buf_ring_mask(bufferCount), 0);
+    io_uring_buf_ring_advance(bufferRing, 1);
+}
+
+void IoUringLoop::handleCompletion(struct io_uring_cqe *cqe)
+{
+    quint64 data = io_uring_cqe_get_data64(cqe);
+    IoUringState *state = (IoUringState *)(quintptr)(data & ~(quint64)opMask);
+    if (state == 0)
+        return;
+    int result = cqe->res;
+    if ((data & opMask) == opRecv)
+    {
+        // a multishot recv stays armed as long as the kernel says so
+        if (!(cqe->flags & IORING_CQE_F_MORE))
+        {
+            state->isRecvArmed = false;
+            state->pendingOps--;
+        }
+        int bufferId = -1;
+        if (cqe->flags & IORING_CQE_F_BUFFER)
+            bufferId = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        if (isAlive(state))
+        {
+            if (result > 0)
+                state->connection->onReceived(buffers + bufferId * bufferSize, result);
+            else if (result == -EINVAL && isMultishotRecv)
+                // the kernel is older than 6.0, a recv per completion from now on
+                isMultishotRecv = false;
+            else if (result != -ENOBUFS)
+                // 0 is the end of the stream
+                state->connection->close(true);
+        }
+        if (bufferId >= 0)
+            recycleBuffer(bufferId);
+        if (isAlive(state) && !state->isRecvArmed)
+            prepareRecv(state);
+    }
+    else
+    {
+        state->pendingOps--;
+        if (!isAlive(state))
+        {
+            state->isSending = false;
+            state->sendBuffer.clear();
+        }
+        else if (result < 0)
+        {
+            state->isSending = false;
+            state->sendBuffer.clear();
+            state->connection->close(true);
+        }
+        else
+        {
+            state->sendPos += result;
+            if (state->sendPos < state->sendBuffer.size())
+                prepareSend(state);
+            else
+            {
+                state->isSending = false;
+                state->sendBuffer.clear();
+                state->connection->onSent();
+            }
+        }
+    }
+    if (state->connection == 0 && state->pendingOps == 0)
+        freeState(state);
+}
+
+void IoUringLoop::onEventFd()
+{
+    quint64 value;
+    chatServer->countWakeup();
+    if (::read(eventFd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+        return;
+    // the connections closed while handling the completions are deleted on the next turn only,
+    // so the states of this batch stay valid
+    struct io_uring_cqe *cqe;
+    unsigned head;
+    unsigned count = 0;
+    io_uring_for_each_cqe(&ring, head, cqe)
+    {
+        handleCompletion(cqe);
+        count++;
+    }
+    io_uring_cq_advance(&ring, count);
+    onSubmit();
+}
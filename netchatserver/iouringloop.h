@@ -0,0 +1,106 @@
+#ifndef IOURINGLOOP_H
+#define IOURINGLOOP_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QSet>
+#include <QVector>
+#include <liburing.h>
+
+#include "connection.h"
+
+class QSocketNotifier;
+class Client;
+class ChatServer;
+class IoUringLoop;
+struct IoUringState;
+
+// a connection served by io_uring: one multishot recv into the provided buffer ring
+// and one send at a time, the sends of one turn of the event loop are submitted together
+class IoUringConnection : public Connection
+{
+    friend class IoUringLoop;
+
+public:
+    IoUringConnection(IoUringLoop *loopPtr, int socketDescriptor, Client *clientPtr);
+    ~IoUringConnection();
+
+    qintptr descriptor() const;
+    void readInto(FrameDecoder &decoder);
+    void write(const char *data, qint64 size);
+    qint64 bytesToWrite() const;
+    void disconnectFromHost();
+    void abort();
+    // the writes must go through the ring, so the sends stay in order
+    bool allowsDirectWrites() const {return false;}
+
+private:
+    IoUringLoop *loop;
+    Client *client;
+    // outlives the connection while the kernel still has operations on it
+    IoUringState *state;
+    // the bytes written while a send is in flight
+    QByteArray outBuffer;
+    // the received bytes being handed to the client
+    const char *inData;
+    int inSize;
+    bool isClosing;
+
+    void startSend();
+    void onReceived(const char *data, int size);
+    void onSent();
+    void close(bool notify);
+};
+
+// one ring per worker thread, the completions are signalled through an eventfd
+// watched by the event loop of the thread
+class IoUringLoop : public QObject
+{
+    Q_OBJECT
+
+public:
+    // the system calls are counted on the server
+    explicit IoUringLoop(ChatServer *chatServerPtr, QObject *parent = 0);
+    ~IoUringLoop();
+
+    // false when the kernel or the library lacks the features used here
+    bool isValid() const {return this->isReady;}
+    // the connection is owned by the caller (the client)
+    IoUringConnection *addConnection(qintptr socketDescriptor, Client *client);
+
+private:
+    ChatServer *chatServer;
+    struct io_uring ring;
+    struct io_uring_buf_ring *bufferRing;
+    char *buffers;
+    int eventFd;
+    QSocketNotifier *notifier;
+    bool isReady;
+    bool isRingInitialized;
+    // multishot recv needs Linux 6.0, the older kernels get a recv per completion
+    bool isMultishotRecv;
+    bool isSubmitScheduled;
+    // every state not freed yet, the ones left are freed together with the ring
+    QSet<IoUringState *> states;
+    // the connections written to in this turn of the event loop
+    QVector<IoUringState *> sendList;
+
+    void freeState(IoUringState *state);
+    struct io_uring_sqe *getSqe();
+    void prepareRecv(IoUringState *state);
+    void prepareSend(IoUringState *state);
+    void prepareCancel(IoUringState *state);
+    void queueSend(IoUringState *state);
+    void scheduleSubmit();
+    void handleCompletion(struct io_uring_cqe *cqe);
+    void recycleBuffer(int bufferId);
+    void submit();
+
+    friend class IoUringConnection;
+
+private slots:
+    void onEventFd();
+    void onSubmit();
+};
+
+#endif // IOURINGLOOP_H
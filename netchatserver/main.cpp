@@ -1,14 +1,14 @@
-#include <QApplication>
-#include "mainwindow.h"
-
-int main(int argc, char** argv)
-{
-    Q_INIT_RESOURCE(netchatserver);
-
-    QApplication app(argc, argv);
-
-    MainWindow window;
-    window.show();
-
-    return app.exec();
-}
+#include <QApplication>
+#include "mainwindow.h"
+
+int main(int argc, char** argv)
+{
+    Q_INIT_RESOURCE(netchatserver);
+
+    QApplication app(argc, argv);
+
+    MainWindow window;
+    window.show();
+
+    return app.exec();
+}
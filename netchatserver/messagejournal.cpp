@@ -0,0 +1,414 @@
+#include <QDir>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QtEndian>
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "messagejournal.h"
+#include "historyindex.h"
+#include "framecodec.h"
+#include "constants.h"
+
+// the CRC-32 of zlib, the table is built on the first use
+struct Crc32Table
+{
+    quint32 values[256];
+
+    Crc32Table()
+    {
+        for (quint32 i = 0; i < 256; ++i)
+        {
+            quint32 crc = i;
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (crc & 1) ? (crc >> 1) ^ 0xedb88320u : crc >> 1;
+            values[i] = crc;
+        }
+    }
+};
+
+MessageJournal::MessageJournal(const QString &directory, QObject *parent) :
+    QThread(parent), directory(directory), nextMessageId(1), historyIndex(0), segmentNumber(0),
+    pendingBytes(0), stopRequested(false)
+{
+    fsyncMsec = Constants::journalFsyncMsec;
+    segmentBytes = Constants::journalSegmentBytes;
+    maxPendingBytes = Constants::journalMaxPendingBytes;
+}
+
+MessageJournal::~MessageJournal()
+{
+    stop();
+}
+
+bool MessageJournal::open()
+{
+    if (!QDir().mkpath(directory))
+    {
+        error = "Cannot create the journal directory " + directory;
+        return false;
+    }
+    QStringList files = segmentFiles(directory);
+    segmentsCount.store(files.size());
+    if (files.isEmpty())
+        return openSegment(1);
+    // the older segments are complete, only the last one may have a torn tail
+    if (historyIndex != 0)
+        for (int i = 0; i < files.size() - 1; ++i)
+            indexSegment(files.at(i));
+    return recoverSegment(files.last());
+}
+
+void MessageJournal::indexSegment(const QString &fileName)
+{
+    quint32 number = historyIndex->addSegment(fileName);
+    QFile file(fileName);
+    qint64 size = file.open(QIODevice::ReadOnly) ? file.size() : 0;
+    const char *data = size > (qint64)sizeof(quint32) ? reinterpret_cast<const char *>(file.map(0, size)) : 0;
+    if (data == 0 || qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(data)) != segmentMagic)
+        return;
+    QList<JournalRecord> records;
+    QVector<HistoryLocation> locations;
+    qint64 pos = sizeof(quint32);
+    JournalRecord record;
+    int recordSize;
+    while ((recordSize = readRecord(data + pos, size - pos, &record)) > 0)
+    {
+        HistoryLocation location = {record.messageId, number, (quint32)pos};
+        records.append(record);
+        locations.append(location);
+        pos += recordSize;
+    }
+    file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(data)));
+    historyIndex->add(records, 0, locations);
+}
+
+QStringList MessageJournal::segmentFiles(const QString &directory)
+{
+    // the names are zero-padded hex ids, so the order of the names is the order of the ids
+    QDir dir(directory);
+    QStringList files;
+    foreach (const QString &name, dir.entryList(QStringList("*.seg"), QDir::Files, QDir::Name))
+        files.append(dir.filePath(name));
+    return files;
+}
+
+bool MessageJournal::openSegment(quint64 firstMessageId)
+{
+    if (segment.isOpen())
+    {
+        // the records of the old segment are as durable as the ones of the new one
+        if (fsyncMsec >= 0)
+            syncSegment();
+        segment.close();
+    }
+    segment.setFileName(QDir(directory).filePath(QString("%1.seg").arg(firstMessageId, 16, 16, QChar('0'))));
+    if (!segment.open(QIODevice::ReadWrite | QIODevice::Truncate | QIODevice::Unbuffered))
+    {
+        error = "Cannot create the journal segment " + segment.fileName() + ": " + segment.errorString();
+        return false;
+    }
+    uchar magic[sizeof(quint32)];
+    qToBigEndian<quint32>(segmentMagic, magic);
+    segment.write(reinterpret_cast<const char *>(magic), sizeof(magic));
+    segmentsCount.fetchAndAddRelaxed(1);
+    if (historyIndex != 0)
+        segmentNumber = historyIndex->addSegment(segment.fileName());
+    return true;
+}
+
+bool MessageJournal::recoverSegment(const QString &fileName)
+{
+    segment.setFileName(fileName);
+    if (!segment.open(QIODevice::ReadWrite | QIODevice::Unbuffered))
+    {
+        error = "Cannot open the journal segment " + fileName + ": " + segment.errorString();
+        return false;
+    }
+    bool ok = false;
+    nextMessageId = QFileInfo(fileName).baseName().toULongLong(&ok, 16);
+    qint64 size = segment.size();
+    if (!ok || size < (qint64)sizeof(quint32))
+    {
+        error = "Not a journal segment: " + fileName;
+        return false;
+    }
+    const char *data = reinterpret_cast<const char *>(segment.map(0, size));
+    if (data == 0 || qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(data)) != segmentMagic)
+    {
+        error = "Not a journal segment: " + fileName;
+        return false;
+    }
+    if (historyIndex != 0)
+        segmentNumber = historyIndex->addSegment(fileName);
+    // the records up to the first damaged one stay, the rest was being written when the server stopped
+    qint64 validSize = sizeof(quint32);
+    JournalRecord record;
+    int recordSize;
+    while ((recordSize = readRecord(data + validSize, size - validSize, &record)) > 0)
+    {
+        if (historyIndex != 0)
+        {
+            HistoryLocation location = {record.messageId, segmentNumber, (quint32)validSize};
+            historyIndex->add(record, location);
+        }
+        validSize += recordSize;
+        nextMessageId = record.messageId + 1;
+    }
+    segment.unmap(reinterpret_cast<uchar *>(const_cast<char *>(data)));
+    if (validSize < size)
+        segment.resize(validSize);
+    segment.seek(validSize);
+    return true;
+}
+
+void MessageJournal::append(const JournalRecord &record)
+{
+    // about the size of the record on the disk
+    qint64 size = record.utf8.size() + record.receiverUuids.size() * 64 + 96;
+    QMutexLocker locker(&mutex);
+    // a stuck disk must not eat all the memory
+    if (pendingBytes + size > maxPendingBytes)
+    {
+        droppedCount.fetchAndAddRelaxed(1);
+        return;
+    }
+    pendingRecords.append(record);
+    pendingBytes += size;
+    // the thread waits only while there is nothing to write
+    if (pendingRecords.size() == 1)
+        condition.wakeOne();
+}
+
+void MessageJournal::stop()
+{
+    {
+        QMutexLocker locker(&mutex);
+        stopRequested = true;
+        condition.wakeOne();
+    }
+    wait();
+}
+
+JournalStats MessageJournal::getStats() const
+{
+    JournalStats stats;
+    stats.records = recordsCount.load();
+    stats.bytes = bytesCount.load();
+    stats.commits = commitsCount.load();
+    stats.syncs = syncsCount.load();
+    stats.droppedRecords = droppedCount.load();
+    stats.writeErrors = writeErrorsCount.load();
+    stats.segments = segmentsCount.load();
+    return stats;
+}
+
+void MessageJournal::run()
+{
+    QElapsedTimer syncTimer;
+    syncTimer.start();
+    bool isDirty = false;
+    forever
+    {
+        QList<JournalRecord> records;
+        bool stopping = false;
+        {
+            QMutexLocker locker(&mutex);
+            while (pendingRecords.isEmpty() && !stopRequested)
+            {
+                // the written records wait for their sync at most the interval
+                if (isDirty && fsyncMsec > 0)
+                {
+                    qint64 timeLeft = fsyncMsec - syncTimer.elapsed();
+                    if (timeLeft <= 0)
+                        break;
+                    condition.wait(&mutex, timeLeft);
+                }
+                else
+                    condition.wait(&mutex);
+            }
+            // everything queued meanwhile goes in one commit, the relaying threads are not blocked by it
+            records.swap(pendingRecords);
+            pendingBytes = 0;
+            stopping = stopRequested;
+        }
+        if (!records.isEmpty())
+        {
+            writeBatch(records);
+            isDirty = true;
+        }
+        if (isDirty && (fsyncMsec == 0 || (fsyncMsec > 0 && (stopping || syncTimer.elapsed() >= fsyncMsec))))
+        {
+            syncSegment();
+            isDirty = false;
+            syncTimer.restart();
+        }
+        if (stopping)
+            break;
+    }
+    segment.close();
+}
+
+void MessageJournal::writeBatch(QList<JournalRecord> &records)
+{
+    QByteArray batch;
+    // where the records of the batch will be, for the history index
+    QVector<HistoryLocation> locations;
+    int batchStart = 0;
+    for (int i = 0; i < records.size(); ++i)
+    {
+        JournalRecord &record = records[i];
+        record.messageId = nextMessageId++;
+        QByteArray bytes = encodeRecord(record);
+        // a segment is never split inside a record
+        if (segment.pos() + batch.size() > (qint64)sizeof(quint32) &&
+                segment.pos() + batch.size() + bytes.size() > segmentBytes)
+        {
+            if (!batch.isEmpty())
+                commitBatch(batch, records, batchStart, locations);
+            batch.clear();
+            locations.clear();
+            batchStart = i;
+            if (!openSegment(record.messageId))
+            {
+                writeErrorsCount.fetchAndAddRelaxed(1);
+                droppedCount.fetchAndAddRelaxed(records.size() - i);
+                return;
+            }
+        }
+        HistoryLocation location = {record.messageId, segmentNumber, (quint32)(segment.pos() + batch.size())};
+        locations.append(location);
+        batch.append(bytes);
+    }
+    commitBatch(batch, records, batchStart, locations);
+}
+
+bool MessageJournal::commitBatch(const QByteArray &batch, const QList<JournalRecord> &records, int from,
+                                 const QVector<HistoryLocation> &locations)
+{
+    qint64 pos = segment.pos();
+    if (segment.write(batch) != batch.size())
+    {
+        // a partly written batch would be cut off on the recovery anyway
+        segment.resize(pos);
+        segment.seek(pos);
+        writeErrorsCount.fetchAndAddRelaxed(1);
+        droppedCount.fetchAndAddRelaxed(locations.size());
+        return false;
+    }
+    recordsCount.fetchAndAddRelaxed(locations.size());
+    bytesCount.fetchAndAddRelaxed(batch.size());
+    commitsCount.fetchAndAddRelaxed(1);
+    // the records can be read back by the queries from now on
+    if (historyIndex != 0)
+        historyIndex->add(records, from, locations);
+    return true;
+}
+
+void MessageJournal::syncSegment()
+{
+    if (!segment.isOpen())
+        return;
+#if defined(Q_OS_WIN)
+    ::_commit(segment.handle());
+#elif defined(Q_OS_LINUX)
+    // the file size changes with every append, fdatasync() writes it as well
+    ::fdatasync(segment.handle());
+#else
+    ::fsync(segment.handle());
+#endif
+    syncsCount.fetchAndAddRelaxed(1);
+}
+
+QByteArray MessageJournal::encodeRecord(const JournalRecord &record)
+{
+    // [id][timestamp][sender id][flags][sender UUID][sender name][receivers UUIDs][text][receivers names],
+    // then the CRC
+    FrameBuilder frame(recordMessage, record.utf8.size() + record.receiverUuids.size() * 64 + 96);
+    frame.appendUInt64(record.messageId).appendUInt64(record.timestampMsec)
+            .appendUInt32(record.senderSessionId).appendUInt8(record.flags)
+            .appendUtf8String(record.senderUuid).appendUtf8String(record.senderName)
+            .appendUInt32(record.receiverUuids.size());
+    foreach (const QString &uuid, record.receiverUuids)
+        frame.appendUtf8String(uuid);
+    frame.appendUtf8(record.utf8);
+    // [receivers names], added later, so it's optional for the reader
+    frame.appendUInt32(record.receiverNames.size());
+    foreach (const QString &name, record.receiverNames)
+        frame.appendUtf8String(name);
+    QByteArray bytes = frame.finish();
+    uchar crc[sizeof(quint32)];
+    qToBigEndian<quint32>(checksum(bytes.constData(), bytes.size()), crc);
+    bytes.append(reinterpret_cast<const char *>(crc), sizeof(crc));
+    return bytes;
+}
+
+int MessageJournal::recordSize(const char *data, qint64 size)
+{
+    const uchar *ptr = reinterpret_cast<const uchar *>(data);
+    if (size < (qint64)sizeof(quint16))
+        return 0;
+    int headerSize = sizeof(quint16);
+    quint32 frameSize = qFromBigEndian<quint16>(ptr);
+    if (frameSize == 0xffff)
+    {
+        if (size < (qint64)(sizeof(quint16) + sizeof(quint32)))
+            return 0;
+        frameSize = qFromBigEndian<quint32>(ptr + sizeof(quint16));
+        headerSize += sizeof(quint32);
+    }
+    if (frameSize == 0 || frameSize > FrameDecoder::maxFrameSize)
+        return 0;
+    return headerSize + frameSize + sizeof(quint32);
+}
+
+int MessageJournal::readRecord(const char *data, qint64 size, JournalRecord *record)
+{
+    const uchar *ptr = reinterpret_cast<const uchar *>(data);
+    int recordSize = MessageJournal::recordSize(data, size);
+    if (recordSize == 0 || size < recordSize)
+        return 0;
+    int frameEnd = recordSize - sizeof(quint32);
+    if (checksum(data, frameEnd) != qFromBigEndian<quint32>(ptr + frameEnd))
+        return 0;
+    int headerSize = qFromBigEndian<quint16>(ptr) == 0xffff ? sizeof(quint16) + sizeof(quint32) : sizeof(quint16);
+    int frameSize = frameEnd - headerSize;
+    FrameReader in(data + headerSize, frameSize);
+    if (in.readUInt8() != recordMessage)
+        return 0;
+    record->messageId = in.readUInt64();
+    record->timestampMsec = in.readUInt64();
+    record->senderSessionId = in.readUInt32();
+    record->flags = in.readUInt8();
+    record->senderUuid = in.readUtf8String();
+    record->senderName = in.readUtf8String();
+    quint32 count = in.readUInt32();
+    record->receiverUuids.clear();
+    for (quint32 i = 0; i < count && in.isOk(); ++i)
+        record->receiverUuids.append(in.readUtf8String());
+    // a deep copy, the data may be a mapped file
+    QByteArray utf8 = in.readUtf8();
+    record->utf8 = QByteArray(utf8.constData(), utf8.size());
+    record->receiverNames.clear();
+    if (in.bytesLeft() > 0)
+    {
+        count = in.readUInt32();
+        for (quint32 i = 0; i < count && in.isOk(); ++i)
+            record->receiverNames.append(in.readUtf8String());
+    }
+    return in.isOk() ? recordSize : 0;
+}
+
+quint32 MessageJournal::checksum(const char *data, int size)
+{
+    static const Crc32Table table;
+    quint32 crc = 0xffffffffu;
+    const uchar *ptr = reinterpret_cast<const uchar *>(data);
+    for (int i = 0; i < size; ++i)
+        crc = table.values[(crc ^ ptr[i]) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffffu;
+}
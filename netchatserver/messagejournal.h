@@ -0,0 +1,137 @@
+#ifndef MESSAGEJOURNAL_H
+#define MESSAGEJOURNAL_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QStringList>
+#include <QVector>
+#include <QFile>
+#include <QAtomicInteger>
+
+class HistoryIndex;
+struct HistoryLocation;
+
+// one relayed message as the journal keeps it
+struct JournalRecord
+{
+    JournalRecord() : messageId(0), timestampMsec(0), senderSessionId(0), flags(0) {}
+
+    // assigned by the journal, increasing over all the segments
+    quint64 messageId;
+    qint64 timestampMsec;
+    quint32 senderSessionId;
+    QString senderUuid;
+    QString senderName;
+    // the receivers of a private message (flagPrivate), the names include the ones who were away
+    QStringList receiverUuids;
+    QStringList receiverNames;
+    QByteArray utf8;
+    quint8 flags;
+
+    // the text of a chunked message has been cut at Constants::journalMaxMessageBytes
+    static const quint8 flagTruncated = 0x01;
+    // a message to some clients, not to all
+    static const quint8 flagPrivate = 0x02;
+};
+
+// what the journal has done so far, read from any thread
+struct JournalStats
+{
+    JournalStats() : records(0), bytes(0), commits(0), syncs(0), droppedRecords(0),
+        writeErrors(0), segments(0) {}
+
+    qint64 records;
+    qint64 bytes;
+    // the batches written with one write and the syncs of them to the disk
+    qint64 commits;
+    qint64 syncs;
+    // the records that didn't fit the pending limit or failed to be written
+    qint64 droppedRecords;
+    qint64 writeErrors;
+    qint64 segments;
+};
+
+// an append-only journal of the relayed messages in segment files, written by its own thread:
+// the relaying threads only queue the records, the thread takes everything queued at once,
+// writes it with one write (group commit) and syncs it to the disk as often as configured.
+// A segment is [magic][records], a record is a frame of the chat protocol (the size in front)
+// carrying the fields, followed by the CRC-32 of the frame; the segments are named after
+// the id of their first message
+class MessageJournal : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit MessageJournal(const QString &directory, QObject *parent = 0);
+    ~MessageJournal();
+
+    // 0 - every group commit is synced, N - at most one sync per N msec, -1 - never (the OS decides)
+    void setFsyncInterval(int msec) {this->fsyncMsec = msec;}
+    // the history index keeps 32-bit offsets
+    void setSegmentSize(qint64 bytes) {this->segmentBytes = qMin(bytes, Q_INT64_C(0x7fffffff));}
+    void setMaxPendingBytes(qint64 bytes) {this->maxPendingBytes = bytes;}
+    // the records are added to the index as they are written, and the ones of all the segments on open()
+    void setHistoryIndex(HistoryIndex *index) {this->historyIndex = index;}
+    // recovers the last segment (a torn tail is cut off), then the thread may start
+    bool open();
+    QString errorString() const {return this->error;}
+    QString getDirectory() const {return this->directory;}
+
+    // thread-safe and cheap: the record is queued, the id and the encoding are left to the thread
+    void append(const JournalRecord &record);
+    void stop();
+    JournalStats getStats() const;
+
+    // [frame][CRC], the message id as the record has it
+    static QByteArray encodeRecord(const JournalRecord &record);
+    // a record at data: its length, or 0 if it's incomplete or damaged
+    static int readRecord(const char *data, qint64 size, JournalRecord *record);
+    // the length of the record by its size field, which takes up to 6 bytes; 0 if it can't be told
+    static int recordSize(const char *data, qint64 size);
+    // the segments of the directory in the order of their ids
+    static QStringList segmentFiles(const QString &directory);
+
+    static const quint32 segmentMagic = 0x4e434a31; // "NCJ1"
+    static const quint8 recordMessage = 1;
+
+protected:
+    void run();
+
+private:
+    QString directory;
+    QString error;
+    int fsyncMsec;
+    qint64 segmentBytes;
+    qint64 maxPendingBytes;
+    QFile segment;
+    quint64 nextMessageId;
+    // 0 - nothing is indexed
+    HistoryIndex *historyIndex;
+    quint32 segmentNumber;
+
+    QMutex mutex;
+    QWaitCondition condition;
+    QList<JournalRecord> pendingRecords;
+    qint64 pendingBytes;
+    bool stopRequested;
+
+    QAtomicInteger<qint64> recordsCount;
+    QAtomicInteger<qint64> bytesCount;
+    QAtomicInteger<qint64> commitsCount;
+    QAtomicInteger<qint64> syncsCount;
+    QAtomicInteger<qint64> droppedCount;
+    QAtomicInteger<qint64> writeErrorsCount;
+    QAtomicInteger<qint64> segmentsCount;
+
+    bool openSegment(quint64 firstMessageId);
+    bool recoverSegment(const QString &fileName);
+    void indexSegment(const QString &fileName);
+    void writeBatch(QList<JournalRecord> &records);
+    bool commitBatch(const QByteArray &batch, const QList<JournalRecord> &records, int from,
+                     const QVector<HistoryLocation> &locations);
+    void syncSegment();
+    static quint32 checksum(const char *data, int size);
+};
+
+#endif // MESSAGEJOURNAL_H
@@ -0,0 +1,324 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QtEndian>
+
+#include "offlinestore.h"
+#include "constants.h"
+
+OfflineStore::OfflineStore()
+{
+    memoryLimit = Constants::offlineMemoryBytes;
+    recipientLimit = Constants::offlineMessagesPerRecipient;
+    memoryBytes = 0;
+    spilledMessages = 0;
+    queuedMessages = 0;
+}
+
+void OfflineStore::setLimits(qint64 memoryBytes, int messagesPerRecipient)
+{
+    QMutexLocker locker(&mutex);
+    this->memoryLimit = memoryBytes;
+    this->recipientLimit = messagesPerRecipient;
+}
+
+bool OfflineStore::setDirectory(const QString &directory, QString *error)
+{
+    QMutexLocker locker(&mutex);
+    if (directory == this->directory)
+        return true;
+    if (!directory.isEmpty() && !QDir().mkpath(directory))
+    {
+        *error = "Cannot create the offline messages directory " + directory;
+        return false;
+    }
+    this->directory = directory;
+    if (directory.isEmpty())
+        return true;
+    // the queues spilled before a restart are found by their files, the delivered part is skipped
+    QDir dir(directory);
+    foreach (const QString &name, dir.entryList(QStringList("*.q"), QDir::Files))
+    {
+        QString recipientKey = QString::fromUtf8(QByteArray::fromHex(QFileInfo(name).baseName().toLatin1()));
+        QFile file(dir.filePath(name));
+        // the queues kept by the name only, before the UUIDs, have nobody to go to, so they're removed
+        if (!recipientKey.contains(' '))
+        {
+            file.remove();
+            QFile::remove(file.fileName() + ".pos");
+            continue;
+        }
+        if (!file.open(QIODevice::ReadWrite))
+            continue;
+        RecipientQueue &queue = queues[recipientKey];
+        QFile posFile(fileName(recipientKey) + ".pos");
+        if (posFile.open(QIODevice::ReadOnly) && posFile.size() == sizeof(qint64))
+            queue.readPos = qFromBigEndian<qint64>(reinterpret_cast<const uchar *>(posFile.readAll().constData()));
+        qint64 size = file.size();
+        const char *data = size > 0 ? reinterpret_cast<const char *>(file.map(0, size)) : 0;
+        JournalRecord record;
+        int recordSize;
+        qint64 pos = queue.readPos;
+        while (data != 0 && pos < size && (recordSize = MessageJournal::readRecord(data + pos, size - pos, &record)) > 0)
+        {
+            pos += recordSize;
+            queue.spilledCount++;
+        }
+        // a torn tail of the last spill
+        if (data != 0)
+            file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(data)));
+        if (pos < size)
+            file.resize(pos);
+        file.close();
+        spilledMessages += queue.spilledCount;
+        queuedMessages += queue.spilledCount;
+        if (queue.spilledCount == 0)
+        {
+            file.remove();
+            posFile.remove();
+            removeQueue(recipientKey);
+        }
+    }
+    return true;
+}
+
+QString OfflineStore::fileName(const QString &recipientKey) const
+{
+    // the names may hold any letters, the file names are hex
+    return QDir(directory).filePath(QString::fromLatin1(recipientKey.toUtf8().toHex()) + ".q");
+}
+
+qint64 OfflineStore::recordBytes(const JournalRecord &record)
+{
+    return record.utf8.size() + (record.senderUuid.size() + record.senderName.size()) * 2 + 64;
+}
+
+void OfflineStore::store(const QString &recipient, const QString &uuid, const JournalRecord &record)
+{
+    QMutexLocker locker(&mutex);
+    if (!isEnabled())
+        return;
+    QString recipientKey = key(recipient, uuid);
+    RecipientQueue &queue = queues[recipientKey];
+    if (queue.memory.size() + queue.spilledCount >= recipientLimit)
+        dropOldest(recipientKey, queue);
+    qint64 bytes = recordBytes(record);
+    queue.memory.enqueue(record);
+    queue.memoryBytes += bytes;
+    memoryBytes += bytes;
+    queuedMessages++;
+    storedCount.fetchAndAddRelaxed(1);
+    if (memoryBytes > memoryLimit)
+        spillLargest();
+}
+
+bool OfflineStore::hasMessages(const QString &recipient, const QString &uuid) const
+{
+    QMutexLocker locker(&mutex);
+    return queues.contains(key(recipient, uuid));
+}
+
+void OfflineStore::dropOldest(const QString &recipientKey, RecipientQueue &queue)
+{
+    if (queue.spilledCount > 0)
+    {
+        // the oldest one is the first one left in the file, it's skipped
+        QFile file(fileName(recipientKey));
+        char header[sizeof(quint16) + sizeof(quint32)];
+        int recordSize = 0;
+        if (file.open(QIODevice::ReadOnly) && file.seek(queue.readPos))
+            recordSize = MessageJournal::recordSize(header, file.read(header, sizeof(header)));
+        if (recordSize > 0)
+        {
+            queue.readPos += recordSize;
+            queue.spilledCount--;
+            spilledMessages--;
+            queuedMessages--;
+        }
+        else
+        {
+            // the file is damaged, whatever is in it is lost
+            queuedMessages -= queue.spilledCount;
+            spilledMessages -= queue.spilledCount;
+            droppedCount.fetchAndAddRelaxed(queue.spilledCount - 1);
+            queue.spilledCount = 0;
+        }
+        file.close();
+        if (queue.spilledCount == 0)
+        {
+            file.remove();
+            QFile::remove(fileName(recipientKey) + ".pos");
+            queue.readPos = 0;
+        }
+        else
+            writeReadPos(recipientKey, queue);
+    }
+    else if (!queue.memory.isEmpty())
+    {
+        qint64 bytes = recordBytes(queue.memory.dequeue());
+        queue.memoryBytes -= bytes;
+        memoryBytes -= bytes;
+        queuedMessages--;
+    }
+    droppedCount.fetchAndAddRelaxed(1);
+}
+
+void OfflineStore::spillLargest()
+{
+    while (memoryBytes > memoryLimit)
+    {
+        // the queue that frees the most memory, so the spills are few and large
+        QHash<QString, RecipientQueue>::iterator largest = queues.end();
+        for (QHash<QString, RecipientQueue>::iterator it = queues.begin(); it != queues.end(); ++it)
+            if (largest == queues.end() || it->memoryBytes > largest->memoryBytes)
+                largest = it;
+        if (largest == queues.end() || largest->memory.isEmpty())
+            return;
+        if (!directory.isEmpty() && spill(largest.key(), largest.value()))
+            continue;
+        // no disk to spill to, the oldest message of the largest queue goes
+        dropOldest(largest.key(), largest.value());
+    }
+}
+
+bool OfflineStore::spill(const QString &recipientKey, RecipientQueue &queue)
+{
+    // the records in memory are newer than the spilled ones, so they go after them
+    QByteArray batch;
+    foreach (const JournalRecord &record, queue.memory)
+        batch.append(MessageJournal::encodeRecord(record));
+    QFile file(fileName(recipientKey));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+        return false;
+    qint64 size = file.size();
+    if (file.write(batch) != batch.size() || !file.flush())
+    {
+        file.resize(size);
+        return false;
+    }
+    queue.spilledCount += queue.memory.size();
+    spilledMessages += queue.memory.size();
+    memoryBytes -= queue.memoryBytes;
+    queue.memory.clear();
+    queue.memoryBytes = 0;
+    return true;
+}
+
+QList<JournalRecord> OfflineStore::take(const QString &recipient, const QString &uuid, int maxCount, qint64 maxBytes,
+                                        int *remaining)
+{
+    QMutexLocker locker(&mutex);
+    QList<JournalRecord> records;
+    QString recipientKey = key(recipient, uuid);
+    QHash<QString, RecipientQueue>::iterator it = queues.find(recipientKey);
+    if (it == queues.end())
+    {
+        *remaining = 0;
+        return records;
+    }
+    RecipientQueue &queue = it.value();
+    qint64 bytes = 0;
+    if (queue.spilledCount > 0)
+        records = readSpilled(recipientKey, queue, maxCount, maxBytes, &bytes);
+    while (!queue.memory.isEmpty() && records.size() < maxCount)
+    {
+        qint64 size = recordBytes(queue.memory.head());
+        if (!records.isEmpty() && bytes + size > maxBytes)
+            break;
+        records.append(queue.memory.dequeue());
+        queue.memoryBytes -= size;
+        memoryBytes -= size;
+        bytes += size;
+    }
+    queuedMessages -= records.size();
+    deliveredCount.fetchAndAddRelaxed(records.size());
+    *remaining = queue.memory.size() + queue.spilledCount;
+    if (*remaining == 0)
+        removeQueue(recipientKey);
+    return records;
+}
+
+QList<JournalRecord> OfflineStore::readSpilled(const QString &recipientKey, RecipientQueue &queue, int maxCount,
+                                               qint64 maxBytes, qint64 *bytes)
+{
+    QList<JournalRecord> records;
+    QFile file(fileName(recipientKey));
+    bool ok = file.open(QIODevice::ReadOnly);
+    while (ok && queue.spilledCount > 0 && records.size() < maxCount)
+    {
+        char header[sizeof(quint16) + sizeof(quint32)];
+        int recordSize = 0;
+        if (file.seek(queue.readPos))
+            recordSize = MessageJournal::recordSize(header, file.read(header, sizeof(header)));
+        if (recordSize == 0)
+        {
+            ok = false;
+            break;
+        }
+        if (!records.isEmpty() && *bytes + recordSize > maxBytes)
+            break;
+        file.seek(queue.readPos);
+        QByteArray data = file.read(recordSize);
+        JournalRecord record;
+        if (MessageJournal::readRecord(data.constData(), data.size(), &record) != recordSize)
+        {
+            ok = false;
+            break;
+        }
+        records.append(record);
+        *bytes += recordSize;
+        queue.readPos += recordSize;
+        queue.spilledCount--;
+        spilledMessages--;
+    }
+    file.close();
+    if (!ok)
+    {
+        // the rest of a damaged file is lost
+        queuedMessages -= queue.spilledCount;
+        spilledMessages -= queue.spilledCount;
+        droppedCount.fetchAndAddRelaxed(queue.spilledCount);
+        queue.spilledCount = 0;
+    }
+    if (queue.spilledCount == 0)
+    {
+        QFile::remove(fileName(recipientKey));
+        QFile::remove(fileName(recipientKey) + ".pos");
+        queue.readPos = 0;
+        return records;
+    }
+    writeReadPos(recipientKey, queue);
+    return records;
+}
+
+void OfflineStore::writeReadPos(const QString &recipientKey, const RecipientQueue &queue)
+{
+    // the delivered and the dropped records don't come back after a restart
+    QFile posFile(fileName(recipientKey) + ".pos");
+    if (posFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        uchar pos[sizeof(qint64)];
+        qToBigEndian<qint64>(queue.readPos, pos);
+        posFile.write(reinterpret_cast<const char *>(pos), sizeof(pos));
+    }
+}
+
+void OfflineStore::removeQueue(const QString &recipientKey)
+{
+    queues.remove(recipientKey);
+}
+
+OfflineStats OfflineStore::getStats() const
+{
+    QMutexLocker locker(&mutex);
+    OfflineStats stats;
+    stats.queuedMessages = queuedMessages;
+    stats.memoryBytes = memoryBytes;
+    stats.spilledMessages = spilledMessages;
+    stats.storedMessages = storedCount.load();
+    stats.deliveredMessages = deliveredCount.load();
+    stats.droppedMessages = droppedCount.load();
+    stats.recipients = queues.size();
+    return stats;
+}
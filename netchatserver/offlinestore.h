@@ -0,0 +1,95 @@
+#ifndef OFFLINESTORE_H
+#define OFFLINESTORE_H
+
+#include <QHash>
+#include <QQueue>
+#include <QMutex>
+#include <QStringList>
+#include <QAtomicInteger>
+
+#include "messagejournal.h"
+
+struct OfflineStats
+{
+    OfflineStats() : queuedMessages(0), memoryBytes(0), spilledMessages(0), storedMessages(0),
+        deliveredMessages(0), droppedMessages(0), recipients(0) {}
+
+    // waiting now: all of them, the bytes of the ones in memory, the ones on the disk
+    qint64 queuedMessages;
+    qint64 memoryBytes;
+    qint64 spilledMessages;
+    qint64 storedMessages;
+    qint64 deliveredMessages;
+    // over the per-recipient limit or lost to a disk error
+    qint64 droppedMessages;
+    qint64 recipients;
+};
+
+// the private messages to the clients who are away, kept by the name and the UUID they come back with
+// (the clients keep a UUID per name), so a new client who takes a free name gets nothing of the one
+// who had it: a queue per recipient, the newest messages in memory, the older ones spilled
+// to a file of the recipient once the memory limit is hit.
+// The records are the ones of the journal. Thread-safe, the relays come from all the workers
+class OfflineStore
+{
+public:
+    OfflineStore();
+
+    // the bytes of all the queues in memory and the messages kept for one recipient
+    // (the oldest ones are dropped beyond), 0 - the store is off
+    void setLimits(qint64 memoryBytes, int messagesPerRecipient);
+    qint64 getMemoryLimit() const {return this->memoryLimit;}
+    int getRecipientLimit() const {return this->recipientLimit;}
+    bool isEnabled() const {return this->memoryLimit > 0 && this->recipientLimit > 0;}
+    // where the queues are spilled and found again after a restart, without it the oldest
+    // messages beyond the memory limit are dropped
+    bool setDirectory(const QString &directory, QString *error);
+
+    void store(const QString &recipient, const QString &uuid, const JournalRecord &record);
+    bool hasMessages(const QString &recipient, const QString &uuid) const;
+    // the oldest messages of the recipient, not more than the count and (but at least one) the bytes;
+    // they leave the store, remaining tells how many are still there
+    QList<JournalRecord> take(const QString &recipient, const QString &uuid, int maxCount, qint64 maxBytes,
+                              int *remaining);
+    OfflineStats getStats() const;
+
+private:
+    struct RecipientQueue
+    {
+        RecipientQueue() : memoryBytes(0), spilledCount(0), readPos(0) {}
+
+        // newer than all the spilled ones
+        QQueue<JournalRecord> memory;
+        qint64 memoryBytes;
+        // the spilled records start at readPos of the file
+        int spilledCount;
+        qint64 readPos;
+    };
+
+    mutable QMutex mutex;
+    QHash<QString, RecipientQueue> queues;
+    QString directory;
+    qint64 memoryLimit;
+    int recipientLimit;
+    qint64 memoryBytes;
+    qint64 spilledMessages;
+    qint64 queuedMessages;
+    QAtomicInteger<qint64> storedCount;
+    QAtomicInteger<qint64> deliveredCount;
+    QAtomicInteger<qint64> droppedCount;
+
+    // the names have no spaces
+    static QString key(const QString &recipient, const QString &uuid) {return recipient.toCaseFolded() + ' ' + uuid;}
+    static qint64 recordBytes(const JournalRecord &record);
+    QString fileName(const QString &recipientKey) const;
+    void dropOldest(const QString &recipientKey, RecipientQueue &queue);
+    void spillLargest();
+    bool spill(const QString &recipientKey, RecipientQueue &queue);
+    QList<JournalRecord> readSpilled(const QString &recipientKey, RecipientQueue &queue, int maxCount,
+                                     qint64 maxBytes, qint64 *bytes);
+    // the start of the records left in the spill file, read back by setDirectory
+    void writeReadPos(const QString &recipientKey, const RecipientQueue &queue);
+    void removeQueue(const QString &recipientKey);
+};
+
+#endif // OFFLINESTORE_H
@@ -0,0 +1,70 @@
+#include "qtconnection.h"
+#include "framecodec.h"
+#include "client.h"
+
+QtConnection::QtConnection(qintptr socketDescriptor, Client *clientPtr, QObject *parent) :
+    QObject(parent), client(clientPtr)
+{
+    qRegisterMetaType<QAbstractSocket::SocketError>();
+    socket = new QTcpSocket(this);
+    // set the descriptor from incomingConnection()
+    socket->setSocketDescriptor(socketDescriptor);
+
+    connect(socket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+    connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    connect(socket, SIGNAL(bytesWritten(qint64)), this, SLOT(onBytesWritten(qint64)));
+    connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(onError(QAbstractSocket::SocketError)));
+}
+
+qintptr QtConnection::descriptor() const
+{
+    return socket->socketDescriptor();
+}
+
+void QtConnection::readInto(FrameDecoder &decoder)
+{
+    decoder.readFrom(socket);
+}
+
+void QtConnection::write(const char *data, qint64 size)
+{
+    socket->write(data, size);
+}
+
+qint64 QtConnection::bytesToWrite() const
+{
+    return socket->bytesToWrite();
+}
+
+void QtConnection::disconnectFromHost()
+{
+    socket->disconnectFromHost();
+}
+
+void QtConnection::abort()
+{
+    socket->abort();
+}
+
+void QtConnection::onReadyRead()
+{
+    client->onReadyRead();
+}
+
+void QtConnection::onBytesWritten(qint64 bytes)
+{
+    Q_UNUSED(bytes);
+    client->flushQueue();
+}
+
+void QtConnection::onDisconnected()
+{
+    client->onDisconnect();
+}
+
+void QtConnection::onError(QAbstractSocket::SocketError socketError)
+{
+    if (socketError == QAbstractSocket::RemoteHostClosedError)
+        return;
+    client->onError(socket->errorString());
+}
@@ -0,0 +1,37 @@
+#ifndef QTCONNECTION_H
+#define QTCONNECTION_H
+
+#include <QObject>
+#include <QTcpSocket>
+
+#include "connection.h"
+
+class Client;
+
+// the connection on a QTcpSocket, the signals of the socket go to the client
+class QtConnection : public QObject, public Connection
+{
+    Q_OBJECT
+
+public:
+    QtConnection(qintptr socketDescriptor, Client *clientPtr, QObject *parent = 0);
+
+    qintptr descriptor() const;
+    void readInto(FrameDecoder &decoder);
+    void write(const char *data, qint64 size);
+    qint64 bytesToWrite() const;
+    void disconnectFromHost();
+    void abort();
+
+private:
+    QTcpSocket *socket;
+    Client *client;
+
+private slots:
+    void onReadyRead();
+    void onBytesWritten(qint64 bytes);
+    void onDisconnected();
+    void onError(QAbstractSocket::SocketError socketError);
+};
+
+#endif // QTCONNECTION_H
@@ -1,257 +1,1153 @@
-#include <QtNetwork>
-#include <QtGui>
-#include <QMessageBox>
-
-#include "server.h"
-#include "mainwindow.h"
-#include "constants.h"
-
-ChatServer::ChatServer(QMainWindow *widget, QObject *parent) : QTcpServer(parent)
-{
-    mainWindow = widget;
-    fillReservedNamesList();
-
-    QObject::connect(this, SIGNAL(addToLogArea(QString,bool)), mainWindow, SLOT(onAddToLogArea(QString,bool)));
-    QObject::connect(this, SIGNAL(removeClientFromGui(QString,QString)), mainWindow, SLOT(onRemoveClientFromGui(QString,QString)));
-    QObject::connect(this, SIGNAL(clearMessageArea()), mainWindow, SLOT(onClearMessageArea()));
-}
-
-bool ChatServer::startChatServer(QHostAddress ipAddress, qint16 port)
-{
-    if (!listen(ipAddress, port))
-    {
-        return false;
-    }
-    return true;
-}
-
-void ChatServer::sendCommand(quint8 comm, QString uuid)
-{
-    QByteArray block;
-    QDataStream out(&block, QIODevice::WriteOnly);
-    out << (quint16)0 << comm;
-    out.device()->seek(0);
-    out << (quint16)(block.size() - sizeof(quint16));
-    quint16 clientsQuantity = getClientsList().length();
-    for (int i = 0; i < clientsQuantity; ++i)
-        if (getClientsList().at(i)->getUUID() == uuid)
-        {
-            getClientsList().at(i)->socket->write(block);
-            break;
-        }
-}
-
-void ChatServer::sendToAllHasJoined(QString uuid, QString name)
-{
-    QByteArray block;
-    QDataStream out(&block, QIODevice::WriteOnly);
-    // reserve space for block size
-    out << (quint16)0 << Constants::comClientJoined << uuid << name;
-    // write block size on reserved space
-    out.device()->seek(0);
-    out << (quint16)(block.size() - sizeof(quint16));
-    // send to all authorized except who has entered
-    for (int i = 0; i < getClientsList().length(); ++i)
-        if (getClientsList().at(i)->getUUID() != uuid && getClientsList().at(i)->isRegistered())
-            getClientsList().at(i)->socket->write(block);
-}
-
-void ChatServer::sendToAllHasLeft(QString uuid, QString name)
-{
-    QByteArray block;
-    QDataStream out(&block, QIODevice::WriteOnly);
-    out << (quint16)0 << Constants::comClientLeft << uuid << name;
-    out.device()->seek(0);
-    out << (quint16)(block.size() - sizeof(quint16));
-    for (int i = 0; i < getClientsList().length(); ++i)
-        if (getClientsList().at(i)->getUUID() != uuid && getClientsList().at(i)->isRegistered())
-            getClientsList().at(i)->socket->write(block);
-}
-
-void ChatServer::sendToAllMessage(QString message, QString fromClientUUID, QString fromClientName)
-{
-    QByteArray block;
-    QDataStream out(&block, QIODevice::WriteOnly);
-    out << (quint16)0 << Constants::comMessageToAll << fromClientUUID << fromClientName << message;
-    out.device()->seek(0);
-    out << (quint16)(block.size() - sizeof(quint16));
-    for (int i = 0; i < getClientsList().length(); ++i)
-        if (getClientsList().at(i)->isRegistered())
-            getClientsList().at(i)->socket->write(block);
-}
-
-QString ChatServer::retrieveUUIDFromStr(QString str)
-{
-    return str.right(str.length() - str.indexOf('{'));
-}
-
-void ChatServer::sendMessageToClients(QString message, const QStringList &clientsReceiversList,
-                                      QString fromClientUUID, QString fromClientName)
-{
-    QByteArray block;
-    QDataStream out(&block, QIODevice::WriteOnly);
-    out << (quint16)0 << Constants::comMessageToClients << clientsReceiversList;
-    out << fromClientUUID << fromClientName << message;
-    out.device()->seek(0);
-    out << (quint16)(block.size() - sizeof(quint16));
-
-    QStringList receiversUUIDsList;
-    foreach (QString item, clientsReceiversList) {
-        receiversUUIDsList.append(this->retrieveUUIDFromStr(item));
-    }
-
-    for (int j = 0; j < getClientsList().length(); ++j)
-        if (receiversUUIDsList.contains(getClientsList().at(j)->getUUID()))
-            getClientsList().at(j)->socket->write(block);         // to receivers
-        else if (getClientsList().at(j)->getUUID() == fromClientUUID)
-            getClientsList().at(j)->socket->write(block);         // to sender
-}
-
-void ChatServer::sendToAllServerMessage(QString message)
-{
-    QByteArray block;
-    QDataStream out(&block, QIODevice::WriteOnly);
-    out << (quint16)0 << Constants::comPublicServerMessage << message;
-    out.device()->seek(0);
-    out << (quint16)(block.size() - sizeof(quint16));
-    for (int i = 0; i < getClientsList().length(); ++i)
-        if (getClientsList().at(i)->isRegistered())
-            getClientsList().at(i)->socket->write(block);
-}
-
-void ChatServer::sendServerMessageToClients(QString message, const QStringList &clients)
-{
-    QByteArray block;
-    QDataStream out(&block, QIODevice::WriteOnly);
-    out << (quint16)0 << Constants::comPrivateServerMessage << message;
-    out.device()->seek(0);
-    out << (quint16)(block.size() - sizeof(quint16));
-
-    QStringList clientsUUIDsList;
-    foreach (QString item, clients) {
-        clientsUUIDsList.append(this->retrieveUUIDFromStr(item));
-    }
-
-    for (int j = 0; j < this->getClientsList().length(); ++j)
-        if (clientsUUIDsList.contains(this->getClientsList().at(j)->getUUID()))
-            this->getClientsList().at(j)->socket->write(block);
-}
-
-QStringList ChatServer::getRegisteredClients() const
-{
-    QStringList regClientsList;
-    QString strRegClientData;
-    foreach (Client *client, clientsList)
-        if (client->isRegistered())
-        {
-            strRegClientData = client->getName() + " " + client->getUUID();
-            regClientsList << strRegClientData;
-        }
-    return regClientsList;
-}
-
-bool ChatServer::isNameUsed(QString name) const
-{
-    quint16 clientsQuantity = clientsList.length();
-    for (int i = 0; i < clientsQuantity; ++i)
-        if (QString::compare(clientsList.at(i)->getName(), name, Qt::CaseInsensitive) == 0)
-            return true;
-    return false;
-}
-
-bool ChatServer::clientExists(QString uuid) const
-{
-    quint16 clientsQuantity = clientsList.length();
-    for (int i = 0; i < clientsQuantity; ++i)
-        if ((clientsList.at(i)->getUUID() == uuid) && clientsList.at(i)->isRegistered())
-            return true;
-    return false;
-}
-
-bool ChatServer::isNameIllegal(QString name) const
-{
-    QString item;
-    foreach (item, reservedNamesList)
-        if (QString::compare(name, item, Qt::CaseInsensitive) == 0)
-            return true;
-    return false;
-}
-
-void ChatServer::sendCommandToAll(quint8 command)
-{
-    quint16 clientsQuantity = getClientsList().length();
-    for (int i = 0; i < clientsQuantity; ++i)
-        getClientsList().at(i)->sendCommand(command);
-}
-
-void ChatServer::deregisterAll()
-{
-    sendCommandToAll(Constants::comDeregisterClient);
-    foreach (Client *item, getClientsList()) {
-        emit removeClientFromGui(item->getUUID(), item->getName());
-        item->setRegistered(false);
-        item->setName("");
-    }
-}
-
-void ChatServer::incomingConnection(qintptr handle)
-{
-    // create an client
-    Client *client = new Client(handle, this, this);
-    if (mainWindow != 0)
-    {
-        QObject::connect(client, SIGNAL(addClientToGui(QString,QString)), mainWindow, SLOT(onAddClientToGui(QString,QString)));
-        QObject::connect(client, SIGNAL(removeClientFromGui(QString,QString)), mainWindow, SLOT(onRemoveClientFromGui(QString,QString)));
-        QObject::connect(client, SIGNAL(messageToGui(QString,QString,QStringList)), mainWindow, SLOT(onMessageToGui(QString,QString,QStringList)));
-    }
-    QObject::connect(client, SIGNAL(removeClient(Client*)), this, SLOT(onRemoveClient(Client*)));
-    QObject::connect(client, SIGNAL(stopChatServer()), mainWindow, SLOT(onStopChatServer()));
-    QObject::connect(client, SIGNAL(addToLogArea(QString,bool)), mainWindow, SLOT(onAddToLogArea(QString,bool)));
-    clientsList.append(client);
-}
-
-void ChatServer::onRemoveClient(Client *client)
-{
-    clientsList.removeAt(getClientsList().indexOf(client));
-}
-
-void ChatServer::sendMessageFromServer(QString message, const QStringList &clients)
-{
-    if (clients.isEmpty())
-        sendToAllServerMessage(message);
-    else
-        sendServerMessageToClients(message, clients);
-}
-
-quint16 ChatServer::getRegisteredClientsQuantity()
-{
-    quint16 regClientsQuantity = 0;
-    quint16 clientsQuantity = getClientsList().length();
-    for (int i = 0; i < clientsQuantity; ++i)
-    {
-        if (getClientsList().at(i)->isRegistered())
-            regClientsQuantity++;
-    }
-    return regClientsQuantity;
-}
-
-bool ChatServer::isCommandExpected(QString text)
-{
-    if (text[0] == '#')
-        return true;
-    return false;
-}
-
-void ChatServer::processCommand(QString text)
-{
-    addToLogArea(tr("<div style='color:red'>Unknown command: \"%1\" </div>").arg(text.left(text.indexOf(' '))));
-}
-
-void ChatServer::fillReservedNamesList()
-{
-    reservedNamesList.append("server");
-    reservedNamesList.append("chatserver");
-    reservedNamesList.append("majechatserver");
-    reservedNamesList.append("client");
-}
-
+#include <QtNetwork>
+#include <algorithm>
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "server.h"
+#include "serverworker.h"
+#include "constants.h"
+
+ChatServer::ChatServer(QObject *parent) :
+    QTcpServer(parent), clientsMutex(QMutex::Recursive)
+{
+    broadcastsCount = 0;
+    nextSessionId = 1;
+    guiMirrorSampleRate = 1;
+    outboundQueueBytes = Constants::outboundQueueBytes;
+    outboundQueueMessages = Constants::outboundQueueMessages;
+    overflowPolicy = CoalesceDropped;
+    flushDelay = 0;
+    ioBackend = QtBackend;
+    isReusePort = false;
+    handshakeTimeout = Constants::handshakeTimeoutSec;
+    heartbeatInterval = Constants::heartbeatIntervalSec;
+    heartbeatTimeout = Constants::heartbeatTimeoutSec;
+    floodMessageRate = Constants::floodMessagesPerSecond;
+    floodByteRate = Constants::floodBytesPerSecond;
+    journal = 0;
+    journalFsyncMsec = Constants::journalFsyncMsec;
+    journalSegmentBytes = Constants::journalSegmentBytes;
+    workersCount = 0;
+    nextWorkerIndex = 0;
+    localWorker = new ServerWorker(this, this);
+    historyThread = new QThread(this);
+    historyReader = new HistoryReader(&history);
+    historyReader->moveToThread(historyThread);
+    historyReader->addWorker(localWorker);
+    fillReservedNamesList();
+    qRegisterMetaType<qintptr>("qintptr");
+    qRegisterMetaType<quint32>("quint32");
+    qRegisterMetaType<quint64>("quint64");
+    qRegisterMetaType<QVector<quint64> >("QVector<quint64>");
+    qRegisterMetaType<HistoryCursor>("HistoryCursor");
+    qRegisterMetaType<ServerWorker *>("ServerWorker*");
+}
+
+ChatServer::~ChatServer()
+{
+    stopWorkers();
+    // the local worker is deleted after it, so nothing is posted to it anymore
+    historyThread->quit();
+    historyThread->wait();
+    delete historyReader;
+    // the records queued by the clients are written before the thread ends
+    delete journal;
+}
+
+bool ChatServer::startChatServer(QHostAddress ipAddress, qint16 port)
+{
+    if (!startJournal())
+        return false;
+    if (isReusePort)
+    {
+        startWorkers();
+        if (!workersList.isEmpty() && startReusePortListeners(ipAddress, port))
+            return true;
+    }
+    if (!listen(ipAddress, port))
+    {
+        return false;
+    }
+    startWorkers();
+    return true;
+}
+
+void ChatServer::setJournal(const QString &directory, int fsyncMsec, qint64 segmentBytes)
+{
+    journalDirectory = directory;
+    journalFsyncMsec = fsyncMsec;
+    journalSegmentBytes = segmentBytes;
+}
+
+bool ChatServer::startJournal()
+{
+    // the journal outlives a restart of the listeners, the clients stay connected meanwhile
+    if (journal != 0 || journalDirectory.isEmpty())
+        return true;
+    MessageJournal *newJournal = new MessageJournal(journalDirectory);
+    newJournal->setFsyncInterval(journalFsyncMsec);
+    newJournal->setSegmentSize(journalSegmentBytes);
+    // the history is indexed from all the segments before the first message is relayed
+    history.clear();
+    newJournal->setHistoryIndex(&history);
+    if (!newJournal->open())
+    {
+        emit addToLogArea(tr("<div style='color:red'>%1</div>").arg(newJournal->errorString()));
+        delete newJournal;
+        return false;
+    }
+    newJournal->start();
+    journal = newJournal;
+    historyThread->start();
+    return true;
+}
+
+JournalRecord ChatServer::makeRecord(Client *sender, const QByteArray &utf8, quint8 flags) const
+{
+    JournalRecord record;
+    record.timestampMsec = QDateTime::currentMSecsSinceEpoch();
+    record.senderSessionId = sender->getSessionId();
+    record.senderUuid = sender->getUUID();
+    record.senderName = sender->getName();
+    // a deep copy: the text read from a frame points into the sender's decoder buffer, which is
+    // reused by the next read while the record waits for the journal thread or the sign in of the receiver
+    record.utf8 = QByteArray(utf8.constData(), utf8.size());
+    record.flags = flags;
+    return record;
+}
+
+void ChatServer::journalMessage(Client *sender, const QList<Client *> *receivers, const AwayReceivers &away,
+                                const QByteArray &utf8, quint8 flags)
+{
+    // only the fields are copied here, the encoding and the I/O are left to the journal thread
+    JournalRecord record = makeRecord(sender, utf8, flags);
+    if (receivers != 0)
+    {
+        // the names make the conversation of the history, the ones who were away are in it as well;
+        // the UUIDs tell the participants from the later clients of the same names
+        record.flags |= JournalRecord::flagPrivate;
+        foreach (Client *client, *receivers)
+        {
+            record.receiverUuids.append(client->getUUID());
+            record.receiverNames.append(client->getName());
+        }
+        record.receiverUuids.append(away.uuids);
+        record.receiverNames.append(away.names);
+    }
+    journal->append(record);
+}
+
+void ChatServer::recordChunkedMessage(Client *sender, bool isToAll, const QList<quint32> &receiverIds,
+                                      const QByteArray &utf8, quint8 flags)
+{
+    if (isToAll)
+    {
+        if (journal != 0)
+            journalMessage(sender, 0, AwayReceivers(), utf8, flags);
+        return;
+    }
+    QMutexLocker locker(&clientsMutex);
+    AwayReceivers away;
+    QList<Client *> receivers = findReceivers(receiverIds, sender, isAwayTracked() ? &away : 0);
+    if (journal != 0)
+        journalMessage(sender, &receivers, away, utf8, flags);
+    storeForAway(sender, away, utf8, flags);
+}
+
+bool ChatServer::hasAwayReceivers(const QList<quint32> &receiverIds) const
+{
+    if (!offlineStore.isEnabled())
+        return false;
+    QMutexLocker locker(&clientsMutex);
+    AwayReceivers away;
+    findReceivers(receiverIds, 0, &away);
+    return !away.isEmpty();
+}
+
+void ChatServer::storeForAway(Client *sender, const AwayReceivers &away, const QByteArray &utf8, quint8 flags)
+{
+    if (away.isEmpty() || !offlineStore.isEnabled())
+        return;
+    JournalRecord record = makeRecord(sender, utf8, flags | JournalRecord::flagPrivate);
+    for (int i = 0; i < away.names.size(); ++i)
+        offlineStore.store(away.names.at(i), away.uuids.at(i), record);
+    // the sender learns that the message is waiting, not lost
+    quint8 version = qMin(sender->getProtocolVersion(), Constants::protocolVersion);
+    QString notice = tr("<div style='color:gray'>%1 %2 away, the message will be delivered on their return</div>")
+            .arg(away.names.join(", ")).arg(away.names.size() == 1 ? "is" : "are");
+    sender->sendBlock(buildServerMessage(Constants::comPrivateServerMessage, notice, 1u << version).forVersion(version));
+}
+
+void ChatServer::stopChatServer()
+{
+    close();
+    foreach (ServerWorker *worker, workersList)
+        QMetaObject::invokeMethod(worker, "onStopListening", Qt::QueuedConnection);
+}
+
+bool ChatServer::startReusePortListeners(const QHostAddress &ipAddress, quint16 port)
+{
+    // this listener takes its share of the accepts too and reports the address and the port,
+    // the listeners of the workers join it on the same port (which matters for the port 0)
+    qintptr socketDescriptor = openReusePortSocket(ipAddress, port);
+    if (socketDescriptor < 0)
+        return false;
+    if (!setSocketDescriptor(socketDescriptor))
+    {
+#ifdef Q_OS_UNIX
+        ::close((int)socketDescriptor);
+#endif
+        return false;
+    }
+    int listenersCount = 1;
+    foreach (ServerWorker *worker, workersList)
+    {
+        socketDescriptor = openReusePortSocket(ipAddress, serverPort());
+        if (socketDescriptor < 0)
+            continue;
+        QMetaObject::invokeMethod(worker, "onListen", Qt::QueuedConnection, Q_ARG(qintptr, socketDescriptor));
+        listenersCount++;
+    }
+    emit addToLogArea("<div style='color:gray'>* Listening on " + QString::number(listenersCount) +
+                      " SO_REUSEPORT sockets</div>");
+    return true;
+}
+
+qintptr ChatServer::openReusePortSocket(const QHostAddress &ipAddress, quint16 port)
+{
+#if defined(Q_OS_UNIX) && defined(SO_REUSEPORT)
+    struct sockaddr_storage address;
+    socklen_t addressSize;
+    memset(&address, 0, sizeof(address));
+    bool isIPv6 = ipAddress.protocol() != QAbstractSocket::IPv4Protocol;
+    if (isIPv6)
+    {
+        struct sockaddr_in6 *address6 = (struct sockaddr_in6 *)&address;
+        address6->sin6_family = AF_INET6;
+        address6->sin6_port = htons(port);
+        // QHostAddress::Any listens on both IPv4 and IPv6
+        Q_IPV6ADDR ip6 = ipAddress.protocol() == QAbstractSocket::AnyIPProtocol ?
+                    QHostAddress(QHostAddress::AnyIPv6).toIPv6Address() : ipAddress.toIPv6Address();
+        memcpy(&address6->sin6_addr, &ip6, sizeof(ip6));
+        addressSize = sizeof(struct sockaddr_in6);
+    }
+    else
+    {
+        struct sockaddr_in *address4 = (struct sockaddr_in *)&address;
+        address4->sin_family = AF_INET;
+        address4->sin_port = htons(port);
+        address4->sin_addr.s_addr = htonl(ipAddress.toIPv4Address());
+        addressSize = sizeof(struct sockaddr_in);
+    }
+    int fd = ::socket(isIPv6 ? AF_INET6 : AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    int on = 1;
+    int off = 0;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (isIPv6 && ipAddress.protocol() == QAbstractSocket::AnyIPProtocol)
+        ::setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+    if (::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0 ||
+            ::bind(fd, (struct sockaddr *)&address, addressSize) < 0 ||
+            ::listen(fd, SOMAXCONN) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+#else
+    // no SO_REUSEPORT here, a single listener is used
+    Q_UNUSED(ipAddress);
+    Q_UNUSED(port);
+    return -1;
+#endif
+}
+
+void ChatServer::startWorkers()
+{
+    int count = workersCount;
+    if (count < 0)
+        count = qMax(QThread::idealThreadCount(), 1);
+    if (count == workersList.length())
+        return;
+    stopWorkers();
+    for (int i = 0; i < count; ++i)
+    {
+        QThread *thread = new QThread(this);
+        ServerWorker *worker = new ServerWorker(this);
+        worker->moveToThread(thread);
+        QObject::connect(thread, SIGNAL(finished()), worker, SLOT(deleteLater()));
+        thread->start();
+        workersList.append(worker);
+        workerThreadsList.append(thread);
+        historyReader->addWorker(worker);
+    }
+    nextWorkerIndex = 0;
+}
+
+void ChatServer::stopWorkers()
+{
+    // the clients are owned by the workers and go away together with them, without notifications
+    {
+        QMutexLocker locker(&clientsMutex);
+        foreach (Client *client, registry.getConnections())
+            if (client->getWorker() != localWorker)
+                registry.removeConnection(client);
+    }
+    foreach (ServerWorker *worker, workersList)
+        historyReader->removeWorker(worker);
+    foreach (QThread *thread, workerThreadsList)
+    {
+        thread->quit();
+        thread->wait();
+        delete thread;
+    }
+    workerThreadsList.clear();
+    workersList.clear();
+}
+
+void ChatServer::sendCommand(quint8 comm, QString uuid)
+{
+    QByteArray block = FrameBuilder(comm).finish();
+    QMutexLocker locker(&clientsMutex);
+    Client *client = registry.findByUUID(uuid);
+    if (client != 0)
+        client->sendBlock(block);
+}
+
+quint32 ChatServer::getRegisteredVersions() const
+{
+    QMutexLocker locker(&clientsMutex);
+    return registry.getRegisteredVersions();
+}
+
+void ChatServer::sendToAllHasJoined(Client *client)
+{
+    quint32 versions = getRegisteredVersions();
+    VersionedBlock block;
+    if (VersionedBlock::isNeeded(versions, 1, 2))
+    {
+        block.set(1, 2, FrameBuilder(Constants::comClientJoined).appendString(client->getUUID())
+                  .appendString(client->getName()).finish());
+    }
+    if (VersionedBlock::isNeeded(versions, 3, 3))
+    {
+        block.set(3, 3, FrameBuilder(Constants::comClientJoined).appendUInt32(client->getSessionId())
+                  .appendString(client->getUUID()).appendString(client->getName()).finish());
+    }
+    if (VersionedBlock::isNeeded(versions, 4, Constants::protocolVersion))
+    {
+        block.set(4, Constants::protocolVersion,
+                  FrameBuilder(Constants::comClientJoined).appendUInt32(client->getSessionId())
+                  .appendUtf8String(client->getUUID()).appendUtf8String(client->getName()).finish());
+    }
+    // send to all authorized except who has entered
+    broadcastBlock(block, client);
+}
+
+void ChatServer::sendToAllHasLeft(Client *client, const QString &name)
+{
+    quint32 versions = getRegisteredVersions();
+    VersionedBlock block;
+    if (VersionedBlock::isNeeded(versions, 1, 2))
+    {
+        block.set(1, 2, FrameBuilder(Constants::comClientLeft).appendString(client->getUUID())
+                  .appendString(name).finish());
+    }
+    if (VersionedBlock::isNeeded(versions, 3, Constants::protocolVersion))
+    {
+        // the peers know the name and the UUID behind the session id already
+        block.set(3, Constants::protocolVersion,
+                  FrameBuilder(Constants::comClientLeft).appendUInt32(client->getSessionId()).finish());
+    }
+    broadcastBlock(block, client);
+}
+
+void ChatServer::sendToAllMessage(Client *sender, const MessageText &message)
+{
+    quint32 versions = getRegisteredVersions();
+    VersionedBlock block;
+    if (VersionedBlock::isNeeded(versions, 1, 2))
+    {
+        block.set(1, 2, FrameBuilder(Constants::comMessageToAll, message.text().size() * 2 + 256)
+                  .appendString(sender->getUUID()).appendString(sender->getName())
+                  .appendString(message.text()).finish());
+    }
+    if (VersionedBlock::isNeeded(versions, 3, 3))
+    {
+        block.set(3, 3, FrameBuilder(Constants::comMessageToAll, message.text().size() * 2 + 8)
+                  .appendUInt32(sender->getSessionId()).appendString(message.text()).finish());
+    }
+    if (VersionedBlock::isNeeded(versions, 4, Constants::protocolVersion))
+    {
+        // the sender's UTF-8 bytes go on as they have come, after the sender's pre-built header
+        block.set(4, Constants::protocolVersion,
+                  FrameBuilder(Constants::comMessageToAll, sender->getRelayHeader().size() + 4 + message.utf8().size())
+                  .appendRaw(sender->getRelayHeader()).appendUtf8(message.utf8()).finish());
+    }
+    broadcastBlock(block);
+    if (journal != 0)
+        journalMessage(sender, 0, AwayReceivers(), message.utf8(), 0);
+}
+
+void ChatServer::broadcastBlock(const VersionedBlock &block, const Client *except)
+{
+    FanOut fanOut;
+    {
+        QMutexLocker locker(&clientsMutex);
+        collectBroadcast(&fanOut, block, except);
+    }
+    postFanOut(fanOut);
+}
+
+void ChatServer::collectBroadcast(FanOut *fanOut, const VersionedBlock &block, const Client *except)
+{
+    // every variant of the block is encoded once and shared (implicitly) by all the writes;
+    // the time is the part spent under the lock, the posts follow it
+    QElapsedTimer timer;
+    timer.start();
+    BroadcastStats stats;
+    const QVector<Client *> &registeredClientsList = registry.getRegisteredClients();
+    QVector<Client *>::const_iterator it = registeredClientsList.constBegin();
+    QVector<Client *>::const_iterator end = registeredClientsList.constEnd();
+    for (; it != end; ++it)
+    {
+        Client *client = *it;
+        if (client == except)
+            continue;
+        const QByteArray &clientBlock = block.forVersion(client->getProtocolVersion());
+        if (clientBlock.isEmpty())
+            continue;
+        addToFanOut(fanOut, client, clientBlock);
+        stats.clientsReached++;
+        stats.bytesQueued += clientBlock.size();
+    }
+    stats.elapsedUsec = timer.nsecsElapsed() / 1000;
+
+    lastBroadcastStats = stats;
+    totalBroadcastStats.clientsReached += stats.clientsReached;
+    totalBroadcastStats.bytesQueued += stats.bytesQueued;
+    totalBroadcastStats.elapsedUsec += stats.elapsedUsec;
+    broadcastsCount++;
+}
+
+void ChatServer::addToFanOut(FanOut *fanOut, Client *client, const QByteArray &block) const
+{
+    if (block.isEmpty() || !client->acceptsBlock(block))
+        return;
+    // the variants are shared, the same data is the same variant; there are few batches to look through
+    ServerWorker *worker = client->getWorker();
+    for (int i = fanOut->size() - 1; i >= 0; --i)
+    {
+        FanOutBatch &batch = (*fanOut)[i];
+        if (batch.worker == worker && batch.block.constData() == block.constData())
+        {
+            batch.connectionIds.append(client->getConnectionId());
+            return;
+        }
+    }
+    FanOutBatch batch;
+    batch.worker = worker;
+    batch.block = block;
+    batch.connectionIds.append(client->getConnectionId());
+    fanOut->append(batch);
+}
+
+void ChatServer::postFanOut(const FanOut &fanOut)
+{
+    // the workers find the clients by the connection ids, the ones gone meanwhile are skipped
+    foreach (const FanOutBatch &batch, fanOut)
+        batch.worker->postBlocks(batch.connectionIds, batch.block);
+}
+
+QString ChatServer::retrieveUUIDFromStr(QString str) const
+{
+    return str.right(str.length() - str.indexOf('{'));
+}
+
+QList<quint32> ChatServer::resolveReceivers(const QStringList &clientsReceiversList, AwayReceivers *away) const
+{
+    // "name {uuid}" strings of the original protocol to session ids, the unknown ones are skipped
+    QMutexLocker locker(&clientsMutex);
+    QList<quint32> receiverIds;
+    receiverIds.reserve(clientsReceiversList.size());
+    Utils utils;
+    foreach (const QString &item, clientsReceiversList)
+    {
+        QString uuid = this->retrieveUUIDFromStr(item);
+        Client *client = registry.findByUUID(uuid);
+        if (client == 0 && away != 0)
+        {
+            // a client who has left, its messages are kept for its UUID: a new client
+            // of the same name is somebody else as far as the server can tell
+            QString name = item.left(item.indexOf(' ')).trimmed();
+            if (!utils.isNameValid(name) || QUuid(uuid).isNull())
+                continue;
+            away->add(name, uuid);
+        }
+        if (client != 0)
+            receiverIds.append(client->getSessionId());
+    }
+    return receiverIds;
+}
+
+QStringList ChatServer::describeReceivers(const QList<quint32> &receiverIds) const
+{
+    QMutexLocker locker(&clientsMutex);
+    return describeClients(findReceivers(receiverIds, 0));
+}
+
+QList<Client *> ChatServer::findReceivers(const QList<quint32> &receiverIds, const Client *sender,
+                                          AwayReceivers *away) const
+{
+    // O(k) for k receivers, whatever the number of the clients is; the caller holds the lock
+    QList<Client *> receivers;
+    QSet<Client *> seen;
+    foreach (quint32 sessionId, receiverIds)
+    {
+        Client *client = registry.findBySessionId(sessionId);
+        if (client == 0 && away != 0)
+        {
+            // a client who has left: back under a new session id with the same UUID,
+            // or its messages are kept for that UUID
+            QString uuid;
+            QString name = registry.findDepartedName(sessionId, &uuid);
+            if (name.isEmpty())
+                continue;
+            client = registry.findByUUID(uuid);
+            if (client == 0)
+                away->add(name, uuid);
+        }
+        if (client == 0 || client == sender || seen.contains(client))
+            continue;
+        seen.insert(client);
+        receivers.append(client);
+    }
+    return receivers;
+}
+
+QStringList ChatServer::describeClients(const QList<Client *> &clients) const
+{
+    QStringList clientsList;
+    clientsList.reserve(clients.size());
+    foreach (Client *client, clients)
+        clientsList.append(client->getName() + " " + client->getUUID());
+    return clientsList;
+}
+
+QList<quint32> ChatServer::sessionIdsOf(const QList<Client *> &clients) const
+{
+    QList<quint32> sessionIds;
+    sessionIds.reserve(clients.size());
+    foreach (Client *client, clients)
+        sessionIds.append(client->getSessionId());
+    return sessionIds;
+}
+
+quint32 ChatServer::versionsOf(const QList<Client *> &clients, const Client *sender) const
+{
+    quint32 versions = 0;
+    foreach (Client *client, clients)
+        versions |= 1u << qMin(client->getProtocolVersion(), Constants::protocolVersion);
+    if (sender != 0)
+        versions |= 1u << qMin(sender->getProtocolVersion(), Constants::protocolVersion);
+    return versions;
+}
+
+void ChatServer::sendMessageToClients(Client *sender, const MessageText &message,
+                                      const QStringList &clientsReceiversList, QStringList *receiversDescription)
+{
+    AwayReceivers away;
+    QList<quint32> receiverIds = resolveReceivers(clientsReceiversList, isAwayTracked() ? &away : 0);
+    relayToClients(sender, message, receiverIds, away, receiversDescription);
+}
+
+void ChatServer::sendMessageToClients(Client *sender, const MessageText &message,
+                                      const QList<quint32> &receiverIds, QStringList *receiversDescription)
+{
+    relayToClients(sender, message, receiverIds, AwayReceivers(), receiversDescription);
+}
+
+void ChatServer::relayToClients(Client *sender, const MessageText &message, const QList<quint32> &receiverIds,
+                                AwayReceivers away, QStringList *receiversDescription)
+{
+    FanOut fanOut;
+    {
+        // the receivers are valid while the lock is held, the writes are posted after it
+        QMutexLocker locker(&clientsMutex);
+        QList<Client *> receivers = findReceivers(receiverIds, sender, isAwayTracked() ? &away : 0);
+        quint32 versions = versionsOf(receivers, sender);
+        VersionedBlock block;
+        if (VersionedBlock::isNeeded(versions, 1, 2))
+        {
+            block.set(1, 2, FrameBuilder(Constants::comMessageToClients, message.text().size() * 2 + 256)
+                      .appendStringList(describeClients(receivers)).appendString(sender->getUUID())
+                      .appendString(sender->getName()).appendString(message.text()).finish());
+        }
+        if (VersionedBlock::isNeeded(versions, 3, 3))
+        {
+            // [sender id][receivers ids][message]
+            block.set(3, 3, FrameBuilder(Constants::comMessageToClients, message.text().size() * 2 + receivers.size() * 4 + 12)
+                      .appendUInt32(sender->getSessionId()).appendUInt32List(sessionIdsOf(receivers))
+                      .appendString(message.text()).finish());
+        }
+        if (VersionedBlock::isNeeded(versions, 4, Constants::protocolVersion))
+        {
+            block.set(4, Constants::protocolVersion,
+                      FrameBuilder(Constants::comMessageToClients, message.utf8().size() + receivers.size() * 4 + 12)
+                      .appendUInt32(sender->getSessionId()).appendUInt32List(sessionIdsOf(receivers))
+                      .appendUtf8(message.utf8()).finish());
+        }
+        collectDelivery(&fanOut, block, receivers, sender);
+        if (journal != 0)
+            journalMessage(sender, &receivers, away, message.utf8(), 0);
+        storeForAway(sender, away, message.utf8(), 0);
+        if (receiversDescription != 0)
+            *receiversDescription = describeClients(receivers);
+    }
+    postFanOut(fanOut);
+}
+
+void ChatServer::collectDelivery(FanOut *fanOut, const VersionedBlock &block, const QList<Client *> &receivers,
+                                 Client *sender) const
+{
+    foreach (Client *client, receivers)
+        addToFanOut(fanOut, client, block.forVersion(client->getProtocolVersion()));    // to receivers
+    if (sender != 0)
+        addToFanOut(fanOut, sender, block.forVersion(sender->getProtocolVersion()));    // to sender
+}
+
+VersionedBlock ChatServer::buildMessageChunk(quint32 streamId, quint8 flags, quint8 kind,
+                                             const QList<Client *> &receivers, Client *sender,
+                                             const MessageText &piece, quint32 versions)
+{
+    // the peers of the original protocol don't get the chunks at all
+    VersionedBlock block;
+    if (VersionedBlock::isNeeded(versions, 2, 2))
+    {
+        // [streamId][flags][sender UUID][the 1st chunk only: kind, sender name, receivers][piece]
+        FrameBuilder frame(Constants::comMessageChunk, piece.text().size() * 2 + 256);
+        frame.appendUInt32(streamId).appendUInt8(flags).appendString(sender->getUUID());
+        if (flags & Constants::chunkFirst)
+        {
+            frame.appendUInt8(kind).appendString(sender->getName());
+            if (kind == Constants::comMessageToClients)
+                frame.appendStringList(describeClients(receivers));
+        }
+        frame.appendString(piece.text());
+        block.set(2, 2, frame.finish());
+    }
+    for (quint8 version = 3; version <= Constants::protocolVersion; ++version)
+    {
+        if (!VersionedBlock::isNeeded(versions, version, version))
+            continue;
+        // [streamId][flags][sender id][the 1st chunk only: kind, receivers ids][piece]
+        int pieceSize = version >= 4 ? piece.utf8().size() : piece.text().size() * 2;
+        FrameBuilder frame(Constants::comMessageChunk, pieceSize + receivers.size() * 4 + 20);
+        frame.appendUInt32(streamId).appendUInt8(flags).appendUInt32(sender->getSessionId());
+        if (flags & Constants::chunkFirst)
+        {
+            frame.appendUInt8(kind);
+            if (kind == Constants::comMessageToClients)
+                frame.appendUInt32List(sessionIdsOf(receivers));
+        }
+        if (version >= 4)
+            frame.appendUtf8(piece.utf8());
+        else
+            frame.appendString(piece.text());
+        block.set(version, version, frame.finish());
+    }
+    return block;
+}
+
+void ChatServer::sendToAllMessageChunk(Client *sender, quint32 streamId, quint8 flags, const MessageText &piece)
+{
+    VersionedBlock block = buildMessageChunk(streamId, flags, Constants::comMessageToAll, QList<Client *>(),
+                                             sender, piece, getRegisteredVersions());
+    broadcastBlock(block);
+}
+
+void ChatServer::sendMessageChunkToClients(Client *sender, quint32 streamId, quint8 flags, const MessageText &piece,
+                                           const QList<quint32> &receiverIds)
+{
+    FanOut fanOut;
+    {
+        QMutexLocker locker(&clientsMutex);
+        // the away receivers get the whole message at the end, see recordChunkedMessage()
+        AwayReceivers away;
+        QList<Client *> receivers = findReceivers(receiverIds, sender, isAwayTracked() ? &away : 0);
+        VersionedBlock block = buildMessageChunk(streamId, flags, Constants::comMessageToClients,
+                                                 receivers, sender, piece, versionsOf(receivers, sender));
+        collectDelivery(&fanOut, block, receivers, sender);
+    }
+    postFanOut(fanOut);
+}
+
+VersionedBlock ChatServer::buildServerMessage(quint8 command, const QString &message, quint32 versions)
+{
+    VersionedBlock block;
+    if (VersionedBlock::isNeeded(versions, 1, 3))
+    {
+        block.set(1, 3, FrameBuilder(command, message.size() * 2 + 4).appendString(message).finish());
+    }
+    if (VersionedBlock::isNeeded(versions, 4, Constants::protocolVersion))
+    {
+        block.set(4, Constants::protocolVersion, FrameBuilder(command).appendUtf8String(message).finish());
+    }
+    return block;
+}
+
+void ChatServer::sendToAllServerMessage(QString message)
+{
+    broadcastBlock(buildServerMessage(Constants::comPublicServerMessage, message, getRegisteredVersions()));
+}
+
+void ChatServer::sendServerMessageToClients(QString message, const QStringList &clients)
+{
+    FanOut fanOut;
+    {
+        QMutexLocker locker(&clientsMutex);
+        QList<Client *> targets;
+        foreach (const QString &item, clients)
+        {
+            Client *client = registry.findByUUID(this->retrieveUUIDFromStr(item));
+            if (client != 0 && !targets.contains(client))
+                targets.append(client);
+        }
+        collectDelivery(&fanOut, buildServerMessage(Constants::comPrivateServerMessage, message, versionsOf(targets, 0)),
+                        targets, 0);
+    }
+    postFanOut(fanOut);
+}
+
+QStringList ChatServer::getRegisteredClients() const
+{
+    QStringList regClientsList;
+    QString strRegClientData;
+    QMutexLocker locker(&clientsMutex);
+    regClientsList.reserve(registry.getRegisteredCount());
+    foreach (Client *client, registry.getRegisteredClients())
+    {
+        strRegClientData = client->getName() + " " + client->getUUID();
+        regClientsList << strRegClientData;
+    }
+    return regClientsList;
+}
+
+QVector<RosterEntry> ChatServer::getRoster() const
+{
+    QMutexLocker locker(&clientsMutex);
+    QVector<RosterEntry> roster;
+    roster.reserve(registry.getRegisteredCount());
+    foreach (Client *client, registry.getRegisteredClients())
+    {
+        RosterEntry entry;
+        entry.sessionId = client->getSessionId();
+        entry.uuid = client->getUUID();
+        entry.name = client->getName();
+        roster.append(entry);
+    }
+    return roster;
+}
+
+static bool isSlowerLink(const RttEntry &left, const RttEntry &right)
+{
+    return left.smoothedUsec > right.smoothedUsec;
+}
+
+QVector<RttEntry> ChatServer::getSlowestLinks(int count) const
+{
+    QMutexLocker locker(&clientsMutex);
+    QVector<RttEntry> links;
+    links.reserve(registry.getRegisteredCount());
+    foreach (Client *client, registry.getRegisteredClients())
+    {
+        // the clients that haven't answered a ping yet have nothing to show
+        qint64 smoothed = client->smoothedRttUsec.load();
+        if (smoothed == 0)
+            continue;
+        RttEntry entry;
+        entry.uuid = client->getUUID();
+        entry.name = client->getName();
+        entry.smoothedUsec = smoothed;
+        entry.lastUsec = client->lastRttUsec.load();
+        entry.maxUsec = client->maxRttUsec.load();
+        links.append(entry);
+    }
+    count = qMin(count, links.size());
+    std::partial_sort(links.begin(), links.begin() + count, links.end(), isSlowerLink);
+    links.resize(count);
+    return links;
+}
+
+bool ChatServer::isNameUsed(QString name) const
+{
+    QMutexLocker locker(&clientsMutex);
+    return registry.isNameUsed(name);
+}
+
+bool ChatServer::clientExists(QString uuid) const
+{
+    QMutexLocker locker(&clientsMutex);
+    return registry.isUUIDRegistered(uuid);
+}
+
+quint8 ChatServer::registerClient(Client *client, const QString &uuid, const QString &name)
+{
+    // checks and registration are done at once, so two threads can't take the same name
+    QMutexLocker locker(&clientsMutex);
+    if (clientExists(uuid))
+        return Constants::comErrClientExists;
+    if (isNameIllegal(name))
+        return Constants::comErrNameIllegal;
+    if (isNameUsed(name))
+        return Constants::comErrNameUsed;
+
+    client->setUUID(uuid);
+    client->setName(name);
+    client->setRegistered(true);
+    // 0 is never used, so the clients may take it for "nobody"
+    if (nextSessionId == 0)
+        nextSessionId++;
+    client->setSessionId(nextSessionId++);
+    registry.registerClient(client);
+    return 0;
+}
+
+void ChatServer::deregisterClient(Client *client)
+{
+    QMutexLocker locker(&clientsMutex);
+    registry.deregisterClient(client);
+    client->setRegistered(false);
+    client->setName("");
+}
+
+void ChatServer::setClientUUID(Client *client, const QString &uuid)
+{
+    QMutexLocker locker(&clientsMutex);
+    client->setUUID(uuid);
+}
+
+void ChatServer::setClientProtocolVersion(Client *client, quint8 version)
+{
+    QMutexLocker locker(&clientsMutex);
+    client->setProtocolVersion(version);
+}
+
+bool ChatServer::isNameIllegal(QString name) const
+{
+    QString item;
+    foreach (item, reservedNamesList)
+        if (QString::compare(name, item, Qt::CaseInsensitive) == 0)
+            return true;
+    return false;
+}
+
+void ChatServer::sendCommandToAll(quint8 command)
+{
+    QMutexLocker locker(&clientsMutex);
+    foreach (Client *client, registry.getConnections())
+        client->sendCommand(command);
+}
+
+void ChatServer::deregisterAll()
+{
+    // every client is deregistered in the thread of its worker
+    QMetaObject::invokeMethod(localWorker, "onDeregisterAll", Qt::QueuedConnection);
+    foreach (ServerWorker *worker, workersList)
+        QMetaObject::invokeMethod(worker, "onDeregisterAll", Qt::QueuedConnection);
+}
+
+void ChatServer::incomingConnection(qintptr handle)
+{
+    if (workersList.isEmpty())
+    {
+        localWorker->onAcceptConnection(handle);
+        return;
+    }
+    // spread the connections over the worker threads
+    ServerWorker *worker = workersList.at(nextWorkerIndex);
+    nextWorkerIndex = (nextWorkerIndex + 1) % workersList.length();
+    QMetaObject::invokeMethod(worker, "onAcceptConnection", Qt::QueuedConnection, Q_ARG(qintptr, handle));
+}
+
+void ChatServer::addClient(Client *client)
+{
+    // the client emits the notifications of the server itself and leaves the lists before its worker deletes it
+    QMutexLocker locker(&clientsMutex);
+    registry.addConnection(client);
+}
+
+void ChatServer::onRemoveClient(Client *client)
+{
+    QMutexLocker locker(&clientsMutex);
+    registry.removeConnection(client);
+}
+
+bool ChatServer::isMirrorSample()
+{
+    // the relay doesn't wait for the log, only every N-th message is decoded and mirrored
+    int rate = guiMirrorSampleRate;
+    if (rate <= 0)
+        return false;
+    if (rate == 1)
+        return true;
+    return (quint32)mirrorCounter.fetchAndAddRelaxed(1) % rate == 0;
+}
+
+void ChatServer::setOutboundLimits(qint64 bytes, int messages, OverflowPolicy policy)
+{
+    outboundQueueBytes = bytes;
+    outboundQueueMessages = messages;
+    overflowPolicy = policy;
+}
+
+ChatServer::OverflowPolicy ChatServer::overflowPolicyFromString(const QString &str, bool *ok)
+{
+    if (ok != 0)
+        *ok = true;
+    if (QString::compare(str, "drop", Qt::CaseInsensitive) == 0)
+        return DropOldest;
+    if (QString::compare(str, "disconnect", Qt::CaseInsensitive) == 0)
+        return DisconnectSlowConsumer;
+    if (QString::compare(str, "coalesce", Qt::CaseInsensitive) != 0 && ok != 0)
+        *ok = false;
+    return CoalesceDropped;
+}
+
+ChatServer::IoBackend ChatServer::ioBackendFromString(const QString &str, bool *ok)
+{
+    if (ok != 0)
+        *ok = true;
+    if (QString::compare(str, "qt", Qt::CaseInsensitive) == 0)
+        return QtBackend;
+#ifdef Q_OS_LINUX
+    if (QString::compare(str, "epoll", Qt::CaseInsensitive) == 0)
+        return EpollBackend;
+#ifdef NETCHAT_IOURING
+    if (QString::compare(str, "uring", Qt::CaseInsensitive) == 0)
+        return IoUringBackend;
+#endif
+    if (ok != 0)
+        *ok = false;
+    return EpollBackend;
+#else
+    if (ok != 0)
+        *ok = false;
+    return QtBackend;
+#endif
+}
+
+void ChatServer::updateOutboundHighWater(qint64 bytes)
+{
+    qint64 highWater = outboundHighWaterBytes.load();
+    while (bytes > highWater && !outboundHighWaterBytes.testAndSetRelaxed(highWater, bytes))
+        highWater = outboundHighWaterBytes.load();
+}
+
+void ChatServer::countOutboundDrops(int messages, qint64 bytes)
+{
+    if (messages == 0)
+        return;
+    outboundDroppedMessages.fetchAndAddRelaxed(messages);
+    outboundDroppedBytes.fetchAndAddRelaxed(bytes);
+}
+
+OutboundStats ChatServer::getOutboundStats() const
+{
+    OutboundStats stats;
+    stats.queuedBytes = outboundQueuedBytes.load();
+    stats.highWaterBytes = outboundHighWaterBytes.load();
+    stats.droppedMessages = outboundDroppedMessages.load();
+    stats.droppedBytes = outboundDroppedBytes.load();
+    stats.slowConsumerDisconnects = slowConsumerDisconnects.load();
+    stats.vectoredWrites = vectoredWrites.load();
+    stats.vectoredFrames = vectoredFrames.load();
+    stats.bufferedFrames = bufferedFrames.load();
+    return stats;
+}
+
+IoStats ChatServer::getIoStats() const
+{
+    IoStats stats;
+    stats.recvCalls = ioRecvCalls.load();
+    stats.sendCalls = ioSendCalls.load();
+    stats.waitCalls = ioWaitCalls.load();
+    stats.controlCalls = ioControlCalls.load();
+    stats.submitCalls = ioSubmitCalls.load();
+    stats.wakeups = ioWakeups.load();
+    return stats;
+}
+
+void ChatServer::setHeartbeat(int intervalSec, int timeoutSec)
+{
+    heartbeatInterval = intervalSec;
+    heartbeatTimeout = timeoutSec;
+}
+
+void ChatServer::setFloodLimits(double messagesPerSecond, double bytesPerSecond)
+{
+    floodMessageRate = messagesPerSecond;
+    floodByteRate = bytesPerSecond;
+}
+
+void ChatServer::countThrottled(qint64 bytes, bool isFirstForClient)
+{
+    throttledMessages.fetchAndAddRelaxed(1);
+    throttledBytes.fetchAndAddRelaxed(bytes);
+    if (isFirstForClient)
+        throttledClients.fetchAndAddRelaxed(1);
+}
+
+FloodStats ChatServer::getFloodStats() const
+{
+    FloodStats stats;
+    stats.throttledMessages = throttledMessages.load();
+    stats.throttledBytes = throttledBytes.load();
+    stats.throttledClients = throttledClients.load();
+    return stats;
+}
+
+bool ChatServer::hasClients() const
+{
+    QMutexLocker locker(&clientsMutex);
+    return registry.getConnectionsCount() > 0;
+}
+
+BroadcastStats ChatServer::getLastBroadcastStats() const
+{
+    QMutexLocker locker(&clientsMutex);
+    return lastBroadcastStats;
+}
+
+BroadcastStats ChatServer::getTotalBroadcastStats() const
+{
+    QMutexLocker locker(&clientsMutex);
+    return totalBroadcastStats;
+}
+
+quint64 ChatServer::getBroadcastsCount() const
+{
+    QMutexLocker locker(&clientsMutex);
+    return broadcastsCount;
+}
+
+void ChatServer::sendMessageFromServer(QString message, const QStringList &clients)
+{
+    if (clients.isEmpty())
+        sendToAllServerMessage(message);
+    else
+        sendServerMessageToClients(message, clients);
+}
+
+quint16 ChatServer::getRegisteredClientsQuantity()
+{
+    QMutexLocker locker(&clientsMutex);
+    return registry.getRegisteredCount();
+}
+
+bool ChatServer::isCommandExpected(QString text)
+{
+    if (text[0] == '#')
+        return true;
+    return false;
+}
+
+void ChatServer::processCommand(QString text)
+{
+    QRegExp statsCommandRegExp("^stats$");
+    statsCommandRegExp.setCaseSensitivity(Qt::CaseInsensitive);
+    if (statsCommandRegExp.indexIn(text) != -1)
+    {
+        BroadcastStats last = getLastBroadcastStats();
+        BroadcastStats total = getTotalBroadcastStats();
+        addToLogArea(tr("<div style='color:gray'>Last broadcast: %1 clients, %2 bytes, %3 us<br>"
+                        "Total: %4 broadcasts, %5 clients, %6 bytes, %7 us</div>")
+                     .arg(last.clientsReached).arg(last.bytesQueued).arg(last.elapsedUsec)
+                     .arg(getBroadcastsCount()).arg(total.clientsReached)
+                     .arg(total.bytesQueued).arg(total.elapsedUsec));
+        OutboundStats outbound = getOutboundStats();
+        addToLogArea(tr("<div style='color:gray'>Outbound queues: %1 bytes queued, high-water %2 bytes, "
+                        "%3 messages (%4 bytes) dropped, %5 slow consumers disconnected</div>")
+                     .arg(outbound.queuedBytes).arg(outbound.highWaterBytes)
+                     .arg(outbound.droppedMessages).arg(outbound.droppedBytes)
+                     .arg(outbound.slowConsumerDisconnects));
+        double framesPerWrite = outbound.vectoredWrites > 0 ?
+                    (double)outbound.vectoredFrames / outbound.vectoredWrites : 0;
+        addToLogArea(tr("<div style='color:gray'>Writes: %1 vectored writes for %2 frames (%3 frames per write), "
+                        "%4 frames through the socket buffers</div>")
+                     .arg(outbound.vectoredWrites).arg(outbound.vectoredFrames)
+                     .arg(framesPerWrite, 0, 'f', 2).arg(outbound.bufferedFrames));
+        IoStats io = getIoStats();
+        qint64 ioCalls = io.recvCalls + io.sendCalls + io.waitCalls + io.controlCalls + io.submitCalls
+                + io.wakeups + outbound.vectoredWrites;
+        quint64 broadcasts = getBroadcastsCount();
+        double callsPerBroadcast = broadcasts > 0 ? (double)ioCalls / broadcasts : 0;
+        addToLogArea(tr("<div style='color:gray'>System calls: %1 recv, %2 send, %3 epoll_wait, %4 epoll_ctl, "
+                        "%5 io_uring_submit, %6 eventfd wake-ups, %7 in all with the vectored writes "
+                        "(%8 per broadcast)</div>")
+                     .arg(io.recvCalls).arg(io.sendCalls).arg(io.waitCalls).arg(io.controlCalls)
+                     .arg(io.submitCalls).arg(io.wakeups).arg(ioCalls)
+                     .arg(callsPerBroadcast, 0, 'f', 2));
+        AdmissionStats admissionStats = admission.getStats();
+        addToLogArea(tr("<div style='color:gray'>Admission: %1 connections pending, %2 connections and "
+                        "%3 registrations refused, %4 handshake timeouts</div>")
+                     .arg(admissionStats.pendingConnections).arg(admissionStats.refusedConnections)
+                     .arg(admissionStats.refusedRegistrations).arg(admissionStats.handshakeTimeouts));
+        FloodStats flood = getFloodStats();
+        addToLogArea(tr("<div style='color:gray'>Flood limits: %1 messages (%2 bytes) dropped from %3 clients</div>")
+                     .arg(flood.throttledMessages).arg(flood.throttledBytes).arg(flood.throttledClients));
+        addToLogArea(tr("<div style='color:gray'>Heartbeats: %1 dead connections closed</div>")
+                     .arg(heartbeatTimeouts.load()));
+        if (journal != 0)
+        {
+            JournalStats journalStats = journal->getStats();
+            addToLogArea(tr("<div style='color:gray'>Journal: %1 records (%2 bytes) in %3 commits, %4 syncs, "
+                            "%5 segments, %6 records dropped, %7 write errors</div>")
+                         .arg(journalStats.records).arg(journalStats.bytes).arg(journalStats.commits)
+                         .arg(journalStats.syncs).arg(journalStats.segments)
+                         .arg(journalStats.droppedRecords).arg(journalStats.writeErrors));
+            HistoryStats historyStats = history.getStats();
+            addToLogArea(tr("<div style='color:gray'>History: %1 records indexed in %2 conversations, %3 time marks, "
+                            "%4 history requests</div>")
+                         .arg(historyStats.records).arg(historyStats.conversations)
+                         .arg(historyStats.timeMarks).arg(historyRequests.load()));
+        }
+        OfflineStats offline = offlineStore.getStats();
+        addToLogArea(tr("<div style='color:gray'>Offline messages: %1 waiting for %2 clients (%3 bytes in memory, "
+                        "%4 on the disk), %5 stored, %6 delivered, %7 dropped</div>")
+                     .arg(offline.queuedMessages).arg(offline.recipients).arg(offline.memoryBytes)
+                     .arg(offline.spilledMessages).arg(offline.storedMessages)
+                     .arg(offline.deliveredMessages).arg(offline.droppedMessages));
+        return;
+    }
+    QRegExp rttCommandRegExp("^rtt(?:\\s+(\\d+))?$");
+    rttCommandRegExp.setCaseSensitivity(Qt::CaseInsensitive);
+    if (rttCommandRegExp.indexIn(text) != -1)
+    {
+        int count = rttCommandRegExp.cap(1).isEmpty() ? 10 : rttCommandRegExp.cap(1).toInt();
+        QVector<RttEntry> links = getSlowestLinks(count);
+        if (links.isEmpty())
+            addToLogArea(tr("<div style='color:gray'>No round trips measured yet</div>"));
+        foreach (const RttEntry &link, links)
+            addToLogArea(tr("<div style='color:gray'><b>%1</b> %2: smoothed %3 ms, last %4 ms, max %5 ms</div>")
+                         .arg(link.name).arg(link.uuid).arg(link.smoothedUsec / 1000.0, 0, 'f', 1)
+                         .arg(link.lastUsec / 1000.0, 0, 'f', 1).arg(link.maxUsec / 1000.0, 0, 'f', 1), false);
+        return;
+    }
+    addToLogArea(tr("<div style='color:red'>Unknown command: \"%1\" </div>").arg(text.left(text.indexOf(' '))));
+}
+
+void ChatServer::fillReservedNamesList()
+{
+    reservedNamesList.append("server");
+    reservedNamesList.append("chatserver");
+    reservedNamesList.append("majechatserver");
+    reservedNamesList.append("client");
+}
+
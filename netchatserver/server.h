@@ -1,76 +1,428 @@
-#ifndef SERVER_H
-#define SERVER_H
-
-#include <QMainWindow>
-#include <QTcpServer>
-#include <QDebug>
-
-#include "client.h"
-
-class QTcpSocket;
-class QHostInfo;
-class QWidget;
-
-class Client;
-
-class ChatServer : public QTcpServer {
-    Q_OBJECT
-
-public:
-    explicit ChatServer(QMainWindow *widget = 0, QObject *parent = 0);
-
-private:
-    QString srvHost;
-    quint16 srvPort;
-    QList<Client *> clientsList;
-    QList<QString> reservedNamesList;
-    QWidget *mainWindow;
-
-    void fillReservedNamesList();
-    QString retrieveUUIDFromStr(QString str);
-    quint16 getRegisteredClientsQuantity();
-
-protected:
-    void incomingConnection(qintptr handle);
-
-public:
-    QString getServeclient() {return this->srvHost;}
-    quint16 getServerPort() {return this->srvPort;}
-    void setServerPort(quint16 port) {this->srvPort = port;}
-    void setServerHost(QString host) {this->srvHost = host;}
-    QList<Client *> getClientsList() {return this->clientsList;}
-
-    bool isCommandExpected(QString text);
-    void processCommand(QString text);
-
-    bool startChatServer(QHostAddress ipAddress, qint16 port);
-    void sendCommand(quint8 comm, QString uuid);
-    void sendToAllHasJoined(QString uuid, QString name);
-    void sendToAllHasLeft(QString uuid, QString name);
-    void sendToAllMessage(QString message, QString fromClientUUID, QString fromClientName);
-    void sendToAllServerMessage(QString message);
-    void sendServerMessageToClients(QString message, const QStringList &clients);
-    void sendMessageToClients(QString message, const QStringList &agentsReceiversList,
-                              QString fromAgentUUID, QString fromAgentName);
-    void sendAdvertisementToInitiator(QPixmap pixmap, QString initiatorUUID,
-                                      QString fromAgentUUID, QString fromAgentName);
-    QStringList getRegisteredClients() const;
-    bool isNameUsed(QString name) const;
-    bool isNameIllegal(QString name) const;
-    bool clientExists(QString uuid) const;
-
-    void sendCommandToAll(quint8 command);
-
-    void deregisterAll();
-
-signals:
-    void addToLogArea(const QString &text, bool emptyLineIsNeeded = true);
-    void removeClientFromGui(const QString &uuid, const QString &name);
-    void clearMessageArea();
-
-public slots:
-    void sendMessageFromServer(QString message, const QStringList &agents);
-    void onRemoveClient(Client *client);
-};
-
-#endif // SERVER_H
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <QTcpServer>
+#include <QVector>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QDebug>
+
+#include "client.h"
+#include "clientregistry.h"
+#include "admissioncontrol.h"
+#include "messagejournal.h"
+#include "offlinestore.h"
+#include "historyindex.h"
+#include "historyreader.h"
+#include "constants.h"
+
+class QTcpSocket;
+class QHostInfo;
+
+class Client;
+class ServerWorker;
+class QThread;
+
+// cost of one broadcast fan-out
+struct BroadcastStats
+{
+    BroadcastStats() : clientsReached(0), bytesQueued(0), elapsedUsec(0) {}
+
+    int clientsReached;
+    qint64 bytesQueued;
+    qint64 elapsedUsec;
+};
+
+// the writes of one fan-out to the clients of one worker, collected under the lock of the clients
+// and posted after it is released: one event per worker and variant of the block, not per receiver
+struct FanOutBatch
+{
+    ServerWorker *worker;
+    QByteArray block;
+    QVector<quint64> connectionIds;
+};
+typedef QVector<FanOutBatch> FanOut;
+
+// one frame encoded for the peers of every protocol version,
+// an empty block means the peers of that version don't get the frame
+struct VersionedBlock
+{
+    QByteArray blocks[Constants::protocolVersion + 1];
+
+    void set(quint8 fromVersion, quint8 toVersion, const QByteArray &block)
+    {
+        for (quint8 version = fromVersion; version <= toVersion; ++version)
+            blocks[version] = block;
+    }
+    void setAll(const QByteArray &block) {set(1, Constants::protocolVersion, block);}
+    const QByteArray &forVersion(quint8 version) const
+    {
+        return blocks[qMin(version, Constants::protocolVersion)];
+    }
+    // bit N of the versions stands for the peers of protocol version N,
+    // a variant nobody reads is not encoded at all
+    static bool isNeeded(quint32 versions, quint8 fromVersion, quint8 toVersion)
+    {
+        for (quint8 version = fromVersion; version <= toVersion; ++version)
+            if (versions & (1u << version))
+                return true;
+        return false;
+    }
+};
+
+// a registered client as the roster shows it
+struct RosterEntry
+{
+    quint32 sessionId;
+    QString uuid;
+    QString name;
+};
+
+// the round trips a client has shown on the pings of the server (protocol version 6)
+struct RttEntry
+{
+    QString uuid;
+    QString name;
+    qint64 smoothedUsec;
+    qint64 lastUsec;
+    qint64 maxUsec;
+};
+
+// the outbound queues of all the clients, updated from their threads
+struct OutboundStats
+{
+    OutboundStats() : queuedBytes(0), highWaterBytes(0), droppedMessages(0),
+        droppedBytes(0), slowConsumerDisconnects(0), vectoredWrites(0), vectoredFrames(0),
+        bufferedFrames(0) {}
+
+    qint64 queuedBytes;
+    qint64 highWaterBytes;
+    qint64 droppedMessages;
+    qint64 droppedBytes;
+    qint64 slowConsumerDisconnects;
+    // the vectored writes straight to the sockets and the frames they have carried,
+    // the rest of the frames go through the socket buffers of Qt
+    qint64 vectoredWrites;
+    qint64 vectoredFrames;
+    qint64 bufferedFrames;
+};
+
+// the messages the flood limits have dropped, updated from the clients' threads
+struct FloodStats
+{
+    FloodStats() : throttledMessages(0), throttledBytes(0), throttledClients(0) {}
+
+    qint64 throttledMessages;
+    qint64 throttledBytes;
+    // the clients throttled at least once
+    qint64 throttledClients;
+};
+
+// the system calls of the epoll and io_uring loops of all the workers,
+// the QTcpSocket backend isn't counted
+struct IoStats
+{
+    IoStats() : recvCalls(0), sendCalls(0), waitCalls(0), controlCalls(0), submitCalls(0), wakeups(0) {}
+
+    qint64 recvCalls;
+    qint64 sendCalls;
+    // epoll_wait
+    qint64 waitCalls;
+    // epoll_ctl
+    qint64 controlCalls;
+    // io_uring_submit
+    qint64 submitCalls;
+    // the reads of the eventfd of io_uring
+    qint64 wakeups;
+};
+
+// the receivers of a private message who have left: a name with the UUID the client had,
+// the messages are kept for that client only
+struct AwayReceivers
+{
+    QStringList names;
+    QStringList uuids;
+
+    bool isEmpty() const {return this->names.isEmpty();}
+    void add(const QString &name, const QString &uuid)
+    {
+        if (this->uuids.contains(uuid))
+            return;
+        this->names.append(name);
+        this->uuids.append(uuid);
+    }
+};
+
+class ChatServer : public QTcpServer {
+    Q_OBJECT
+
+public:
+    explicit ChatServer(QObject *parent = 0);
+    ~ChatServer();
+
+    // what happens when the outbound queue of a client is full
+    enum OverflowPolicy
+    {
+        DropOldest,
+        // the dropped frames are replaced with a single notice
+        CoalesceDropped,
+        // comErrSlowConsumer is sent and the connection is closed
+        DisconnectSlowConsumer
+    };
+
+    // how the sockets of the clients are driven
+    enum IoBackend
+    {
+        // a QTcpSocket per client
+        QtBackend,
+        // a non-blocking socket per client, one epoll set per worker (Linux only)
+        EpollBackend,
+        // one io_uring per worker, needs the iouring build option, falls back to epoll at runtime
+        IoUringBackend
+    };
+
+private:
+    QString srvHost;
+    quint16 srvPort;
+    // guards the clients lists, the clients' uuid/name/registered state and the stats,
+    // since the clients may live in different worker threads
+    mutable QMutex clientsMutex;
+    ClientRegistry registry;
+    QList<QString> reservedNamesList;
+
+    BroadcastStats lastBroadcastStats;
+    BroadcastStats totalBroadcastStats;
+    quint64 broadcastsCount;
+    quint32 nextSessionId;
+    int guiMirrorSampleRate;
+    QAtomicInt mirrorCounter;
+
+    qint64 outboundQueueBytes;
+    int outboundQueueMessages;
+    OverflowPolicy overflowPolicy;
+    QAtomicInteger<qint64> outboundQueuedBytes;
+    QAtomicInteger<qint64> outboundHighWaterBytes;
+    QAtomicInteger<qint64> outboundDroppedMessages;
+    QAtomicInteger<qint64> outboundDroppedBytes;
+    QAtomicInteger<qint64> slowConsumerDisconnects;
+    int flushDelay;
+    IoBackend ioBackend;
+    bool isReusePort;
+    AdmissionControl admission;
+    int handshakeTimeout;
+    int heartbeatInterval;
+    int heartbeatTimeout;
+    QAtomicInteger<qint64> heartbeatTimeouts;
+    QAtomicInteger<qint64> historyRequests;
+    double floodMessageRate;
+    double floodByteRate;
+    QAtomicInteger<qint64> throttledMessages;
+    QAtomicInteger<qint64> throttledBytes;
+    QAtomicInteger<qint64> throttledClients;
+    QAtomicInteger<qint64> vectoredWrites;
+    QAtomicInteger<qint64> vectoredFrames;
+    QAtomicInteger<qint64> bufferedFrames;
+    QAtomicInteger<qint64> ioRecvCalls;
+    QAtomicInteger<qint64> ioSendCalls;
+    QAtomicInteger<qint64> ioWaitCalls;
+    QAtomicInteger<qint64> ioControlCalls;
+    QAtomicInteger<qint64> ioSubmitCalls;
+    QAtomicInteger<qint64> ioWakeups;
+    // 0 while the journal is off
+    MessageJournal *journal;
+    OfflineStore offlineStore;
+    // of the journal, empty while it's off
+    HistoryIndex history;
+    // reads the history pages in its own thread, started with the journal
+    HistoryReader *historyReader;
+    QThread *historyThread;
+    QString journalDirectory;
+    int journalFsyncMsec;
+    qint64 journalSegmentBytes;
+
+    // accepts the connections when no worker threads are used
+    ServerWorker *localWorker;
+    QList<ServerWorker *> workersList;
+    QList<QThread *> workerThreadsList;
+    int workersCount;
+    int nextWorkerIndex;
+
+    void fillReservedNamesList();
+    void startWorkers();
+    void stopWorkers();
+    bool startReusePortListeners(const QHostAddress &ipAddress, quint16 port);
+    static qintptr openReusePortSocket(const QHostAddress &ipAddress, quint16 port);
+    // the caller doesn't hold clientsMutex, the writes are posted after it's released
+    void broadcastBlock(const VersionedBlock &block, const Client *except = 0);
+    // the caller holds clientsMutex and posts the fan-out with postFanOut() once it has released it
+    void collectBroadcast(FanOut *fanOut, const VersionedBlock &block, const Client *except);
+    void collectDelivery(FanOut *fanOut, const VersionedBlock &block, const QList<Client *> &receivers,
+                         Client *sender) const;
+    void addToFanOut(FanOut *fanOut, Client *client, const QByteArray &block) const;
+    void postFanOut(const FanOut &fanOut);
+    quint32 getRegisteredVersions() const;
+    // the clients who have left go to away unless they are back under the same UUID, if it's given
+    QList<Client *> findReceivers(const QList<quint32> &receiverIds, const Client *sender,
+                                  AwayReceivers *away = 0) const;
+    QStringList describeClients(const QList<Client *> &clients) const;
+    QList<quint32> sessionIdsOf(const QList<Client *> &clients) const;
+    quint32 versionsOf(const QList<Client *> &clients, const Client *sender) const;
+    VersionedBlock buildMessageChunk(quint32 streamId, quint8 flags, quint8 kind,
+                                     const QList<Client *> &receivers, Client *sender,
+                                     const MessageText &piece, quint32 versions);
+    JournalRecord makeRecord(Client *sender, const QByteArray &utf8, quint8 flags) const;
+    void journalMessage(Client *sender, const QList<Client *> *receivers, const AwayReceivers &away,
+                        const QByteArray &utf8, quint8 flags);
+    // the receivers who have left are found for the journal and the offline store only
+    bool isAwayTracked() const {return this->journal != 0 || this->offlineStore.isEnabled();}
+    void relayToClients(Client *sender, const MessageText &message, const QList<quint32> &receiverIds,
+                        AwayReceivers away, QStringList *receiversDescription);
+    void storeForAway(Client *sender, const AwayReceivers &away, const QByteArray &utf8, quint8 flags);
+    bool startJournal();
+    QString retrieveUUIDFromStr(QString str) const;
+    quint16 getRegisteredClientsQuantity();
+
+protected:
+    void incomingConnection(qintptr handle);
+
+public:
+    QString getServeclient() {return this->srvHost;}
+    quint16 getServerPort() {return this->srvPort;}
+    void setServerPort(quint16 port) {this->srvPort = port;}
+    void setServerHost(QString host) {this->srvHost = host;}
+    // 0 - all the clients live in the thread of the server, -1 - one worker thread per core
+    void setWorkersCount(int count) {this->workersCount = count;}
+    int getWorkersCount() const {return this->workersCount;}
+    // the relayed messages go to messageToGui: 0 - never, 1 - every one, N - every N-th one
+    void setGuiMirrorSampleRate(int rate) {this->guiMirrorSampleRate = rate;}
+    int getGuiMirrorSampleRate() const {return this->guiMirrorSampleRate;}
+    bool isMirrorSample();
+    // the limits of the outbound queue of every client, set before the server starts
+    void setOutboundLimits(qint64 bytes, int messages, OverflowPolicy policy);
+    qint64 getOutboundQueueBytes() const {return this->outboundQueueBytes;}
+    int getOutboundQueueMessages() const {return this->outboundQueueMessages;}
+    OverflowPolicy getOverflowPolicy() const {return this->overflowPolicy;}
+    static OverflowPolicy overflowPolicyFromString(const QString &str, bool *ok = 0);
+    void addOutboundBytes(qint64 bytes) {outboundQueuedBytes.fetchAndAddRelaxed(bytes);}
+    void updateOutboundHighWater(qint64 bytes);
+    void countOutboundDrops(int messages, qint64 bytes);
+    void countSlowConsumerDisconnect() {slowConsumerDisconnects.fetchAndAddRelaxed(1);}
+    OutboundStats getOutboundStats() const;
+    // a Nagle-like delay before the queued frames are flushed, 0 - flush at the end of the event loop turn
+    void setFlushDelay(int msec) {this->flushDelay = msec;}
+    int getFlushDelay() const {return this->flushDelay;}
+    // takes effect for the connections accepted afterwards
+    void setIoBackend(IoBackend backend) {this->ioBackend = backend;}
+    IoBackend getIoBackend() const {return this->ioBackend;}
+    static IoBackend ioBackendFromString(const QString &str, bool *ok = 0);
+    // every worker thread gets its own SO_REUSEPORT listener on the same port (Unix only),
+    // so the kernel spreads the accepts over the threads
+    void setReusePort(bool enabled) {this->isReusePort = enabled;}
+    bool isReusePortEnabled() const {return this->isReusePort;}
+    // the per-IP limits of the new connections and the registrations, the cap on the pending connections
+    AdmissionControl &getAdmission() {return this->admission;}
+    // in seconds, 0 - the connections may stay unregistered
+    void setHandshakeTimeout(int sec) {this->handshakeTimeout = sec;}
+    int getHandshakeTimeout() const {return this->handshakeTimeout;}
+    // in seconds: an idle client gets a heartbeat after the interval and is closed after the timeout,
+    // the interval of 0 turns the heartbeats off; takes effect for the connections accepted afterwards
+    void setHeartbeat(int intervalSec, int timeoutSec);
+    int getHeartbeatInterval() const {return this->heartbeatInterval;}
+    int getHeartbeatTimeout() const {return this->heartbeatTimeout;}
+    void countHeartbeatTimeout() {heartbeatTimeouts.fetchAndAddRelaxed(1);}
+    void countHistoryRequest() {historyRequests.fetchAndAddRelaxed(1);}
+    // the messages and the bytes per second every registered client may send, 0 - no limit
+    void setFloodLimits(double messagesPerSecond, double bytesPerSecond);
+    double getFloodMessageRate() const {return this->floodMessageRate;}
+    double getFloodByteRate() const {return this->floodByteRate;}
+    void countThrottled(qint64 bytes, bool isFirstForClient);
+    FloodStats getFloodStats() const;
+    void countVectoredWrite(int frames)
+    {
+        vectoredWrites.fetchAndAddRelaxed(1);
+        vectoredFrames.fetchAndAddRelaxed(frames);
+    }
+    void countBufferedWrites(int frames) {if (frames > 0) bufferedFrames.fetchAndAddRelaxed(frames);}
+    void countRecvCall() {ioRecvCalls.fetchAndAddRelaxed(1);}
+    void countSendCall() {ioSendCalls.fetchAndAddRelaxed(1);}
+    void countWaitCall() {ioWaitCalls.fetchAndAddRelaxed(1);}
+    void countControlCall() {ioControlCalls.fetchAndAddRelaxed(1);}
+    void countSubmitCall() {ioSubmitCalls.fetchAndAddRelaxed(1);}
+    void countWakeup() {ioWakeups.fetchAndAddRelaxed(1);}
+    IoStats getIoStats() const;
+    // every relayed message goes to the segment files in the directory (an empty one - the journal is off),
+    // see MessageJournal for the sync interval; takes effect when the server starts
+    void setJournal(const QString &directory, int fsyncMsec, qint64 segmentBytes);
+    bool isJournalEnabled() const {return this->journal != 0;}
+    // a relayed chunked message as a whole goes to the journal and to the receivers who are away,
+    // the receivers are ignored for a message to all
+    void recordChunkedMessage(Client *sender, bool isToAll, const QList<quint32> &receiverIds,
+                              const QByteArray &utf8, quint8 flags);
+    // some of the receivers have left and their messages are kept
+    bool hasAwayReceivers(const QList<quint32> &receiverIds) const;
+    // the private messages to the clients who are away, see OfflineStore
+    OfflineStore &getOfflineStore() {return this->offlineStore;}
+    // the queries of the history of the journal, see HistoryIndex
+    const HistoryIndex &getHistory() const {return this->history;}
+    HistoryReader *getHistoryReader() const {return this->historyReader;}
+    VersionedBlock buildServerMessage(quint8 command, const QString &message, quint32 versions);
+    bool hasClients() const;
+    BroadcastStats getLastBroadcastStats() const;
+    BroadcastStats getTotalBroadcastStats() const;
+    quint64 getBroadcastsCount() const;
+
+    bool isCommandExpected(QString text);
+    void processCommand(QString text);
+
+    bool startChatServer(QHostAddress ipAddress, qint16 port);
+    // stops listening on all the listeners, the connected clients stay
+    void stopChatServer();
+    void sendCommand(quint8 comm, QString uuid);
+    void sendToAllHasJoined(Client *client);
+    void sendToAllHasLeft(Client *client, const QString &name);
+    void sendToAllMessage(Client *sender, const MessageText &message);
+    void sendToAllServerMessage(QString message);
+    void sendServerMessageToClients(QString message, const QStringList &clients);
+    // the receivers are "name {uuid}" strings up to protocol version 2 and session ids since 3,
+    // the registered receivers are described as "name {uuid}" strings for the log on demand
+    void sendMessageToClients(Client *sender, const MessageText &message,
+                              const QStringList &clientsReceiversList, QStringList *receiversDescription = 0);
+    void sendMessageToClients(Client *sender, const MessageText &message,
+                              const QList<quint32> &receiverIds, QStringList *receiversDescription = 0);
+    void sendToAllMessageChunk(Client *sender, quint32 streamId, quint8 flags, const MessageText &piece);
+    void sendMessageChunkToClients(Client *sender, quint32 streamId, quint8 flags, const MessageText &piece,
+                                   const QList<quint32> &receiverIds);
+    QList<quint32> resolveReceivers(const QStringList &clientsReceiversList, AwayReceivers *away = 0) const;
+    QStringList describeReceivers(const QList<quint32> &receiverIds) const;
+    QStringList getRegisteredClients() const;
+    QVector<RosterEntry> getRoster() const;
+    // the registered clients with the largest smoothed round trips, the largest first
+    QVector<RttEntry> getSlowestLinks(int count) const;
+    bool isNameUsed(QString name) const;
+    bool isNameIllegal(QString name) const;
+    bool clientExists(QString uuid) const;
+    quint8 registerClient(Client *client, const QString &uuid, const QString &name);
+    void deregisterClient(Client *client);
+    void setClientUUID(Client *client, const QString &uuid);
+    void setClientProtocolVersion(Client *client, quint8 version);
+    void addClient(Client *client);
+
+    void sendCommandToAll(quint8 command);
+
+    void deregisterAll();
+
+signals:
+    // emitted by the clients in their own threads, so connect with care
+    // (an auto connection to a GUI object is queued as needed)
+    void addToLogArea(const QString &text, bool emptyLineIsNeeded = true);
+    void addClientToGui(const QString &uuid, const QString &name);
+    void removeClientFromGui(const QString &uuid, const QString &name);
+    void messageToGui(const QString &message, const QString &from, const QStringList &clients);
+    void clearMessageArea();
+
+public slots:
+    void sendMessageFromServer(QString message, const QStringList &agents);
+    void onRemoveClient(Client *client);
+};
+
+#endif // SERVER_H
@@ -0,0 +1,52 @@
+# the server without a user interface, shared by the GUI server, the daemon and the tests
+INCLUDEPATH += $$PWD
+
+HEADERS += \
+    $$PWD/client.h \
+    $$PWD/constants.h \
+    $$PWD/utils.h \
+    $$PWD/server.h \
+    $$PWD/serverworker.h \
+    $$PWD/connection.h \
+    $$PWD/qtconnection.h \
+    $$PWD/workerlistener.h \
+    $$PWD/clientregistry.h \
+    $$PWD/admissioncontrol.h \
+    $$PWD/timerwheel.h \
+    $$PWD/messagejournal.h \
+    $$PWD/offlinestore.h \
+    $$PWD/historyindex.h \
+    $$PWD/historyreader.h
+
+SOURCES += \
+    $$PWD/client.cpp \
+    $$PWD/utils.cpp \
+    $$PWD/server.cpp \
+    $$PWD/serverworker.cpp \
+    $$PWD/qtconnection.cpp \
+    $$PWD/workerlistener.cpp \
+    $$PWD/clientregistry.cpp \
+    $$PWD/admissioncontrol.cpp \
+    $$PWD/timerwheel.cpp \
+    $$PWD/messagejournal.cpp \
+    $$PWD/offlinestore.cpp \
+    $$PWD/historyindex.cpp \
+    $$PWD/historyreader.cpp
+
+linux {
+    HEADERS += $$PWD/epollloop.h
+    SOURCES += $$PWD/epollloop.cpp
+
+    # qmake CONFIG+=iouring, needs liburing
+    iouring {
+        DEFINES += NETCHAT_IOURING
+        LIBS += -luring
+        HEADERS += $$PWD/iouringloop.h
+        SOURCES += $$PWD/iouringloop.cpp
+    }
+}
+
+include(../common/common.pri)
+
+# getpeername() of the admission control
+win32:LIBS += -lws2_32
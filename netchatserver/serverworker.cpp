@@ -0,0 +1,319 @@
+#include <QTimer>
+#include <QHostAddress>
+#include <QThread>
+#ifdef Q_OS_WIN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "serverworker.h"
+#include "server.h"
+#include "client.h"
+#include "qtconnection.h"
+#include "workerlistener.h"
+#ifdef Q_OS_LINUX
+#include "epollloop.h"
+#endif
+#ifdef NETCHAT_IOURING
+#include "iouringloop.h"
+#endif
+
+ServerWorker::ServerWorker(ChatServer *chatServerPtr, QObject *parent) :
+    QObject(parent), chatServer(chatServerPtr),
+    heartbeatWheel(Constants::heartbeatWheelBuckets, Constants::heartbeatTickMsec)
+{
+    nextConnectionId = 1;
+    isFlushScheduled = false;
+    isDeleteScheduled = false;
+    epollLoop = 0;
+    ioUringLoop = 0;
+    listener = 0;
+    handshakeTimer = new QTimer(this);
+    handshakeTimer->setInterval(1000);
+    connect(handshakeTimer, SIGNAL(timeout()), this, SLOT(onHandshakeTimer()));
+    heartbeatTimer = new QTimer(this);
+    heartbeatTimer->setInterval(heartbeatWheel.getTickMsec());
+    connect(heartbeatTimer, SIGNAL(timeout()), this, SLOT(onHeartbeatTimer()));
+    clock.start();
+}
+
+static QHostAddress peerAddressOf(qintptr handle)
+{
+    struct sockaddr_storage address;
+    socklen_t addressSize = sizeof(address);
+    if (::getpeername(handle, (struct sockaddr *)&address, &addressSize) != 0)
+        return QHostAddress();
+    return QHostAddress((struct sockaddr *)&address);
+}
+
+static void closeDescriptor(qintptr handle)
+{
+#ifdef Q_OS_WIN
+    ::closesocket((SOCKET)handle);
+#else
+    ::close((int)handle);
+#endif
+}
+
+ServerWorker::~ServerWorker()
+{
+    // the connections are closed without any notifications, the server forgets the clients itself
+    qDeleteAll(clientsById);
+    qDeleteAll(closedClientsList);
+}
+
+void ServerWorker::onAcceptConnection(qintptr handle)
+{
+    // a refused connection is closed before anything is allocated for it
+    QHostAddress peerAddress = peerAddressOf(handle);
+    if (!chatServer->getAdmission().admitConnection(peerAddress))
+    {
+        closeDescriptor(handle);
+        return;
+    }
+    // the clients of protocol versions before 5 don't answer heartbeats, the kernel finds their dead connections
+    int on = 1;
+    ::setsockopt(handle, SOL_SOCKET, SO_KEEPALIVE, (const char *)&on, sizeof(on));
+    // the client and its connection are created in the thread of this worker,
+    // so all the socket events are handled by the event loop of this thread
+    quint64 connectionId = nextConnectionId++;
+    Client *client = new Client(this, connectionId, handle, chatServer);
+    client->setPeerAddress(peerAddress);
+    Connection *connection = 0;
+    ChatServer::IoBackend backend = chatServer->getIoBackend();
+#ifdef NETCHAT_IOURING
+    if (backend == ChatServer::IoUringBackend)
+    {
+        if (ioUringLoop == 0)
+        {
+            ioUringLoop = new IoUringLoop(chatServer, this);
+            if (!ioUringLoop->isValid())
+                emit chatServer->addToLogArea("<div style='color:red'>* io_uring isn't supported by the kernel, epoll is used instead</div>");
+        }
+        if (ioUringLoop->isValid())
+            connection = ioUringLoop->addConnection(handle, client);
+    }
+#endif
+#ifdef Q_OS_LINUX
+    if (connection == 0 && (backend == ChatServer::EpollBackend || backend == ChatServer::IoUringBackend))
+    {
+        if (epollLoop == 0)
+            epollLoop = new EpollLoop(chatServer, this);
+        if (epollLoop->isValid())
+            connection = epollLoop->addConnection(handle, client);
+    }
+#endif
+    if (connection == 0)
+        connection = new QtConnection(handle, client);
+    client->setConnection(connection);
+    clientsById.insert(connectionId, client);
+    chatServer->addClient(client);
+    watchHandshake(client);
+    watchHeartbeat(client);
+}
+
+void ServerWorker::watchHeartbeat(Client *client)
+{
+    int interval = chatServer->getHeartbeatInterval();
+    if (interval <= 0)
+        return;
+    heartbeatWheel.schedule(&client->heartbeatNode, client->lastReceivedMsec + interval * 1000);
+    if (!heartbeatTimer->isActive())
+        heartbeatTimer->start();
+}
+
+void ServerWorker::cancelHeartbeat(Client *client)
+{
+    heartbeatWheel.cancel(&client->heartbeatNode);
+}
+
+void ServerWorker::onHeartbeatTimer()
+{
+    qint64 now = nowMsec();
+    qint64 intervalMsec = chatServer->getHeartbeatInterval() * 1000;
+    qint64 timeoutMsec = chatServer->getHeartbeatTimeout() * 1000;
+    QVector<TimerWheelNode *> expired;
+    heartbeatWheel.advance(now, &expired);
+    // the traffic doesn't touch the wheel, a timer that fires for an active client is just moved on
+    foreach (TimerWheelNode *node, expired)
+    {
+        Client *client = static_cast<Client *>(node->owner);
+        // the older clients can't answer, they are left to the keep-alive of the socket
+        if (client->isClosed || intervalMsec <= 0 || client->getProtocolVersion() < 5)
+            continue;
+        qint64 idle = now - client->lastReceivedMsec;
+        if (timeoutMsec > 0 && idle >= timeoutMsec)
+        {
+            chatServer->countHeartbeatTimeout();
+            emit chatServer->addToLogArea("<div style='color:gray'>* User <b>" + client->getUUID() +
+                                          "</b> has stopped answering heartbeats</div>");
+            client->connection->abort();
+            continue;
+        }
+        // since protocol version 6 every client gets a timed ping each interval,
+        // it's the heartbeat and measures the round trip as well
+        if (client->getProtocolVersion() >= 6)
+            client->sendPingRequest();
+        else if (idle >= intervalMsec)
+            client->sendCommand(Constants::comHeartbeat);
+        else
+        {
+            heartbeatWheel.schedule(node, client->lastReceivedMsec + intervalMsec);
+            continue;
+        }
+        qint64 deadline = now + intervalMsec;
+        if (timeoutMsec > 0)
+            deadline = qMin(deadline, client->lastReceivedMsec + timeoutMsec);
+        heartbeatWheel.schedule(node, deadline);
+    }
+    if (heartbeatWheel.isEmpty())
+        heartbeatTimer->stop();
+}
+
+void ServerWorker::watchHandshake(Client *client)
+{
+    int timeout = chatServer->getHandshakeTimeout();
+    if (timeout <= 0)
+        return;
+    // the timeout is the same for all, so the queue stays sorted by the deadlines
+    client->handshakeDeadline = nowMsec() + timeout * 1000;
+    handshakeQueue.enqueue(qMakePair(client->getConnectionId(), client->handshakeDeadline));
+    if (!handshakeTimer->isActive())
+        handshakeTimer->start();
+}
+
+void ServerWorker::onHandshakeTimer()
+{
+    qint64 now = nowMsec();
+    while (!handshakeQueue.isEmpty() && handshakeQueue.head().second <= now)
+    {
+        QPair<quint64, qint64> entry = handshakeQueue.dequeue();
+        // the clients that have registered, gone away or started over are skipped
+        Client *client = clientsById.value(entry.first, 0);
+        if (client == 0 || !client->isHandshakePending || client->handshakeDeadline != entry.second)
+            continue;
+        chatServer->getAdmission().countHandshakeTimeout();
+        client->connection->abort();
+    }
+    if (handshakeQueue.isEmpty())
+        handshakeTimer->stop();
+}
+
+void ServerWorker::onListen(qintptr socketDescriptor)
+{
+    // the socket is already bound and listening, the kernel spreads the connections over the listeners
+    if (listener == 0)
+        listener = new WorkerListener(this);
+    listener->close();
+    if (!listener->setSocketDescriptor(socketDescriptor))
+        emit chatServer->addToLogArea("<div style='color:red'>* A worker failed to listen: " + listener->errorString() + "</div>");
+}
+
+void ServerWorker::onStopListening()
+{
+    if (listener != 0)
+        listener->close();
+}
+
+void ServerWorker::scheduleFlush(Client *client)
+{
+    if (client->isFlushScheduled)
+        return;
+    client->isFlushScheduled = true;
+    flushList.append(client);
+    // one flush for all the clients of the worker
+    if (isFlushScheduled)
+        return;
+    isFlushScheduled = true;
+    int delay = chatServer->getFlushDelay();
+    if (delay > 0)
+        QTimer::singleShot(delay, this, SLOT(onFlushClients()));
+    else
+        QMetaObject::invokeMethod(this, "onFlushClients", Qt::QueuedConnection);
+}
+
+void ServerWorker::onFlushClients()
+{
+    isFlushScheduled = false;
+    // a flush may schedule another one, that one goes to the next turn
+    QVector<Client *> clients;
+    clients.swap(flushList);
+    foreach (Client *client, clients)
+    {
+        client->isFlushScheduled = false;
+        client->flushQueue();
+    }
+}
+
+void ServerWorker::closeClient(Client *client)
+{
+    if (!clientsById.contains(client->getConnectionId()))
+        return;
+    clientsById.remove(client->getConnectionId());
+    int flushIndex = flushList.indexOf(client);
+    if (flushIndex >= 0)
+        flushList.remove(flushIndex);
+    closedClientsList.append(client);
+    if (isDeleteScheduled)
+        return;
+    isDeleteScheduled = true;
+    QMetaObject::invokeMethod(this, "onDeleteClosedClients", Qt::QueuedConnection);
+}
+
+void ServerWorker::onDeleteClosedClients()
+{
+    isDeleteScheduled = false;
+    qDeleteAll(closedClientsList);
+    closedClientsList.clear();
+}
+
+void ServerWorker::postBlock(Client *client, const QByteArray &block)
+{
+    // the client is looked up by the id, it may be gone when the write comes
+    QMetaObject::invokeMethod(this, "onWriteBlock", Qt::QueuedConnection,
+                              Q_ARG(quint64, client->getConnectionId()), Q_ARG(QByteArray, block));
+}
+
+void ServerWorker::onWriteBlock(quint64 connectionId, const QByteArray &block)
+{
+    Client *client = clientsById.value(connectionId, 0);
+    if (client != 0)
+        client->enqueueBlock(block);
+}
+
+void ServerWorker::postBlocks(const QVector<quint64> &connectionIds, const QByteArray &block)
+{
+    if (QThread::currentThread() == this->thread())
+        onWriteBlocks(connectionIds, block);
+    else
+        QMetaObject::invokeMethod(this, "onWriteBlocks", Qt::QueuedConnection,
+                                  Q_ARG(QVector<quint64>, connectionIds), Q_ARG(QByteArray, block));
+}
+
+void ServerWorker::onWriteBlocks(const QVector<quint64> &connectionIds, const QByteArray &block)
+{
+    // the clients that have gone meanwhile are skipped
+    foreach (quint64 connectionId, connectionIds)
+    {
+        Client *client = clientsById.value(connectionId, 0);
+        if (client != 0)
+            client->enqueueBlock(block);
+    }
+}
+
+void ServerWorker::onHistoryPage(quint64 connectionId, quint32 requestId, const HistoryCursor &cursor,
+                                 const QByteArray &block)
+{
+    Client *client = clientsById.value(connectionId, 0);
+    if (client != 0)
+        client->onHistoryPage(requestId, cursor, block);
+}
+
+void ServerWorker::onDeregisterAll()
+{
+    foreach (Client *client, clientsById)
+        client->onDeregisterByServer();
+}
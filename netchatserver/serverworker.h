@@ -0,0 +1,91 @@
+#ifndef SERVERWORKER_H
+#define SERVERWORKER_H
+
+#include <QObject>
+#include <QHash>
+#include <QVector>
+#include <QList>
+#include <QQueue>
+#include <QPair>
+#include <QElapsedTimer>
+
+#include "timerwheel.h"
+#include "historyindex.h"
+
+class ChatServer;
+class Client;
+class EpollLoop;
+class IoUringLoop;
+class WorkerListener;
+class QTimer;
+
+// owns the clients accepted on one thread (the GUI thread or a worker QThread)
+// and does the per-thread work for them: the flushes, the writes from other threads
+// and the deletion of the closed clients
+class ServerWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ServerWorker(ChatServer *chatServerPtr, QObject *parent = 0);
+    ~ServerWorker();
+
+    // the client's queue is flushed at the end of this turn of the event loop (or after the flush delay)
+    void scheduleFlush(Client *client);
+    // the client is deleted on the next turn of the event loop
+    void closeClient(Client *client);
+    // a write from another thread, it's done in the thread of this worker
+    void postBlock(Client *client, const QByteArray &block);
+    // the same block to many clients of this worker, one event for all of them
+    // (done at once when called from the thread of the worker)
+    void postBlocks(const QVector<quint64> &connectionIds, const QByteArray &block);
+    // the client is closed unless it registers within the handshake timeout
+    void watchHandshake(Client *client);
+    // milliseconds since the worker started, never 0 (what the new token buckets take)
+    qint64 nowMsec() const {return this->clock.elapsed() + 1;}
+    // the send times of the pings of the server
+    quint64 nowUsec() const {return this->clock.nsecsElapsed() / 1000;}
+    // the idle clients get heartbeats and the dead ones are closed
+    void watchHeartbeat(Client *client);
+    void cancelHeartbeat(Client *client);
+
+private:
+    ChatServer *chatServer;
+    quint64 nextConnectionId;
+    QHash<quint64, Client *> clientsById;
+    QVector<Client *> flushList;
+    bool isFlushScheduled;
+    QList<Client *> closedClientsList;
+    bool isDeleteScheduled;
+    // created in the thread of the worker on the first connection of the epoll backend
+    EpollLoop *epollLoop;
+    // the same for the io_uring backend
+    IoUringLoop *ioUringLoop;
+    // the own SO_REUSEPORT listener of the worker, if any
+    WorkerListener *listener;
+    // the pending clients by connection id with their deadlines, in the order of the deadlines
+    QQueue<QPair<quint64, qint64> > handshakeQueue;
+    QTimer *handshakeTimer;
+    QElapsedTimer clock;
+    // one timer for all the heartbeats of the worker
+    TimerWheel heartbeatWheel;
+    QTimer *heartbeatTimer;
+
+public slots:
+    void onAcceptConnection(qintptr handle);
+    void onListen(qintptr socketDescriptor);
+    void onStopListening();
+    void onWriteBlock(quint64 connectionId, const QByteArray &block);
+    void onWriteBlocks(const QVector<quint64> &connectionIds, const QByteArray &block);
+    // a page read by the history reader for the client
+    void onHistoryPage(quint64 connectionId, quint32 requestId, const HistoryCursor &cursor, const QByteArray &block);
+    void onDeregisterAll();
+
+private slots:
+    void onFlushClients();
+    void onDeleteClosedClients();
+    void onHandshakeTimer();
+    void onHeartbeatTimer();
+};
+
+#endif // SERVERWORKER_H
@@ -0,0 +1,5 @@
+TEMPLATE = subdirs
+
+SUBDIRS += tst_messagejournal
+SUBDIRS += tst_admissioncontrol
+SUBDIRS += tst_clientregistry
@@ -0,0 +1,143 @@
+#include <QtTest>
+
+#include "admissioncontrol.h"
+
+class TestAdmissionControl : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void newBucketIsFull();
+    void bucketRefillsAtRate();
+    void bucketRefillStopsAtBurst();
+    void bucketInDebt();
+    void connectionsPerAddress();
+    void mappedIPv4SharesBucket();
+    void pendingCap();
+    void registrationsPerAddress();
+    void limitsOff();
+};
+
+void TestAdmissionControl::newBucketIsFull()
+{
+    TokenBucket bucket;
+    QVERIFY(bucket.isFull(2, 4, 1000));
+    // the whole burst at once, then nothing until it refills
+    for (int i = 0; i < 4; ++i)
+        QVERIFY(bucket.take(2, 4, 1000));
+    QVERIFY(!bucket.take(2, 4, 1000));
+    QVERIFY(!bucket.isFull(2, 4, 1000));
+}
+
+void TestAdmissionControl::bucketRefillsAtRate()
+{
+    TokenBucket bucket;
+    for (int i = 0; i < 4; ++i)
+        QVERIFY(bucket.take(2, 4, 1000));
+    // 2 tokens per second: 0.8 of a token after 400 msec, 1.2 after 600
+    QVERIFY(!bucket.take(2, 4, 1400));
+    QVERIFY(bucket.take(2, 4, 1600));
+    QVERIFY(!bucket.take(2, 4, 1600));
+    QVERIFY(qAbs(bucket.tokens - 0.2) < 1e-9);
+}
+
+void TestAdmissionControl::bucketRefillStopsAtBurst()
+{
+    TokenBucket bucket;
+    QVERIFY(bucket.take(2, 4, 1000));
+    // an idle minute is worth the burst, not 120 tokens
+    bucket.refill(2, 4, 61000);
+    QCOMPARE(bucket.tokens, 4.0);
+    QVERIFY(bucket.isFull(2, 4, 61000));
+    for (int i = 0; i < 4; ++i)
+        QVERIFY(bucket.take(2, 4, 61000));
+    QVERIFY(!bucket.take(2, 4, 61000));
+}
+
+void TestAdmissionControl::bucketInDebt()
+{
+    // the flood limit charges the bytes of a message at once, larger than the burst
+    TokenBucket bucket;
+    bucket.refill(2, 4, 1000);
+    bucket.tokens -= 10;
+    QVERIFY(!bucket.take(2, 4, 1000));
+    // the debt is paid back at the rate before the bucket is full again
+    QVERIFY(!bucket.isFull(2, 4, 5999));
+    QVERIFY(bucket.isFull(2, 4, 6000));
+    QVERIFY(!bucket.take(2, 4, 4400));
+    QVERIFY(bucket.take(2, 4, 4600));
+}
+
+void TestAdmissionControl::connectionsPerAddress()
+{
+    AdmissionControl admission;
+    // 1 per second lets in a burst of 4
+    admission.setLimits(1, 0, 0);
+    QHostAddress first("192.0.2.1");
+    QHostAddress second("2001:db8::1");
+    for (int i = 0; i < 4; ++i)
+        QVERIFY(admission.admitConnection(first));
+    QVERIFY(!admission.admitConnection(first));
+    // the other addresses have buckets of their own
+    for (int i = 0; i < 4; ++i)
+        QVERIFY(admission.admitConnection(second));
+
+    AdmissionStats stats = admission.getStats();
+    QCOMPARE(stats.refusedConnections, Q_INT64_C(1));
+    QCOMPARE(stats.pendingConnections, Q_INT64_C(8));
+}
+
+void TestAdmissionControl::mappedIPv4SharesBucket()
+{
+    AdmissionControl admission;
+    admission.setLimits(1, 0, 0);
+    for (int i = 0; i < 4; ++i)
+        QVERIFY(admission.admitConnection(QHostAddress("192.0.2.7")));
+    // the same client through a dual-stack listener
+    QVERIFY(!admission.admitConnection(QHostAddress("::ffff:192.0.2.7")));
+}
+
+void TestAdmissionControl::pendingCap()
+{
+    AdmissionControl admission;
+    admission.setLimits(0, 0, 3);
+    QHostAddress address("192.0.2.1");
+    for (int i = 0; i < 3; ++i)
+        QVERIFY(admission.admitConnection(address));
+    QVERIFY(!admission.admitConnection(address));
+    // a connection that registered makes room for the next one
+    admission.releasePending();
+    QVERIFY(admission.admitConnection(address));
+    QCOMPARE(admission.getStats().pendingConnections, Q_INT64_C(3));
+    QCOMPARE(admission.getStats().refusedConnections, Q_INT64_C(1));
+}
+
+void TestAdmissionControl::registrationsPerAddress()
+{
+    AdmissionControl admission;
+    // the burst is one registration at least
+    admission.setLimits(0, 0.1, 0);
+    QHostAddress address("192.0.2.1");
+    QVERIFY(admission.admitRegistration(address));
+    QVERIFY(!admission.admitRegistration(address));
+    QVERIFY(admission.admitRegistration(QHostAddress("192.0.2.2")));
+    QCOMPARE(admission.getStats().refusedRegistrations, Q_INT64_C(1));
+}
+
+void TestAdmissionControl::limitsOff()
+{
+    AdmissionControl admission;
+    admission.setLimits(0, 0, 0);
+    QHostAddress address("192.0.2.1");
+    for (int i = 0; i < 1000; ++i)
+    {
+        QVERIFY(admission.admitConnection(address));
+        QVERIFY(admission.admitRegistration(address));
+    }
+    AdmissionStats stats = admission.getStats();
+    QCOMPARE(stats.refusedConnections + stats.refusedRegistrations, Q_INT64_C(0));
+}
+
+QTEST_GUILESS_MAIN(TestAdmissionControl)
+
+#include "tst_admissioncontrol.moc"
@@ -0,0 +1,13 @@
+TEMPLATE = app
+
+TARGET = tst_admissioncontrol
+
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+QT = core network testlib
+
+SOURCES += \
+    tst_admissioncontrol.cpp
+
+include(../../servercore.pri)
@@ -0,0 +1,302 @@
+#include <QtTest>
+#include <QUuid>
+
+#include "clientregistry.h"
+#include "client.h"
+#include "server.h"
+#include "serverworker.h"
+
+class TestClientRegistry : public QObject
+{
+    Q_OBJECT
+
+private:
+    ChatServer *server;
+    ServerWorker *worker;
+    ClientRegistry *registry;
+    QVector<Client *> clients;
+
+    // registered clients "userN", session id N + 1
+    void populate(int count);
+    // the clients the lookups look for, spread over the list
+    QVector<Client *> lookupTargets() const;
+    static void addClientCounts();
+    // the lookups as the server did them before the registry, over the list of the clients
+    static Client *scanByUUID(const QVector<Client *> &clients, const QString &uuid);
+    static Client *scanByName(const QVector<Client *> &clients, const QString &name);
+
+private slots:
+    void init();
+    void cleanup();
+
+    void lookups();
+    void deregisterKeepsOthers();
+    void departedSessions();
+    void departedForgotten();
+    void removeConnection();
+    void registeredVersions();
+
+    void findByUUID_data();
+    void findByUUID();
+    void scanByUUID_data();
+    void scanByUUID();
+    void findByName_data();
+    void findByName();
+    void scanByName_data();
+    void scanByName();
+};
+
+void TestClientRegistry::init()
+{
+    server = new ChatServer();
+    worker = new ServerWorker(server);
+    registry = new ClientRegistry();
+}
+
+void TestClientRegistry::cleanup()
+{
+    delete registry;
+    qDeleteAll(clients);
+    clients.clear();
+    delete worker;
+    delete server;
+}
+
+void TestClientRegistry::populate(int count)
+{
+    clients.reserve(count);
+    for (int i = 0; i < count; ++i)
+    {
+        Client *client = new Client(worker, i + 1, i + 1000, server);
+        client->setUUID(QUuid::createUuid().toString());
+        client->setName(QString("user%1").arg(i));
+        client->setSessionId(i + 1);
+        client->setProtocolVersion(Constants::protocolVersion);
+        client->setRegistered(true);
+        clients.append(client);
+        registry->addConnection(client);
+        registry->registerClient(client);
+    }
+}
+
+QVector<Client *> TestClientRegistry::lookupTargets() const
+{
+    QVector<Client *> targets;
+    for (int i = 0; i < 64; ++i)
+        targets.append(clients.at((i * 2 + 1) * clients.size() / 128));
+    return targets;
+}
+
+void TestClientRegistry::addClientCounts()
+{
+    QTest::addColumn<int>("count");
+
+    QTest::newRow("100 clients") << 100;
+    QTest::newRow("1000 clients") << 1000;
+    QTest::newRow("10000 clients") << 10000;
+}
+
+Client *TestClientRegistry::scanByUUID(const QVector<Client *> &clients, const QString &uuid)
+{
+    for (int i = 0; i < clients.size(); ++i)
+        if (clients.at(i)->getUUID() == uuid)
+            return clients.at(i);
+    return 0;
+}
+
+Client *TestClientRegistry::scanByName(const QVector<Client *> &clients, const QString &name)
+{
+    for (int i = 0; i < clients.size(); ++i)
+        if (QString::compare(clients.at(i)->getName(), name, Qt::CaseInsensitive) == 0)
+            return clients.at(i);
+    return 0;
+}
+
+void TestClientRegistry::lookups()
+{
+    populate(100);
+    Client *client = clients.at(42);
+    QCOMPARE(registry->findByUUID(client->getUUID()), client);
+    QCOMPARE(registry->findBySessionId(43), client);
+    // the names are taken case-insensitively
+    QCOMPARE(registry->findByName("USER42"), client);
+    QVERIFY(registry->isNameUsed("User42"));
+    QVERIFY(registry->isUUIDRegistered(client->getUUID()));
+
+    QVERIFY(registry->findByUUID(QUuid::createUuid().toString()) == 0);
+    QVERIFY(registry->findByName("user100") == 0);
+    QVERIFY(registry->findBySessionId(101) == 0);
+    QCOMPARE(registry->getRegisteredCount(), 100);
+    QCOMPARE(registry->getConnectionsCount(), 100);
+}
+
+void TestClientRegistry::deregisterKeepsOthers()
+{
+    populate(10);
+    // the last client fills the place of the removed one in the list
+    registry->deregisterClient(clients.at(3));
+    QCOMPARE(registry->getRegisteredCount(), 9);
+    QVERIFY(!registry->getRegisteredClients().contains(clients.at(3)));
+    QVERIFY(registry->findByName("user3") == 0);
+    QVERIFY(registry->findByUUID(clients.at(3)->getUUID()) == 0);
+    // still connected
+    QCOMPARE(registry->getConnectionsCount(), 10);
+
+    registry->deregisterClient(clients.at(9));
+    registry->deregisterClient(clients.at(0));
+    QCOMPARE(registry->getRegisteredCount(), 7);
+    for (int i = 1; i < 9; ++i)
+    {
+        if (i == 3)
+            continue;
+        QCOMPARE(registry->findByName(QString("user%1").arg(i)), clients.at(i));
+        QCOMPARE(registry->findBySessionId(i + 1), clients.at(i));
+        QVERIFY(registry->getRegisteredClients().contains(clients.at(i)));
+    }
+    // a name that has left can be taken
+    clients.at(3)->setName("USER0");
+    registry->registerClient(clients.at(3));
+    QCOMPARE(registry->findByName("user0"), clients.at(3));
+}
+
+void TestClientRegistry::departedSessions()
+{
+    populate(3);
+    QString uuid = clients.at(1)->getUUID();
+    registry->deregisterClient(clients.at(1));
+    // the peers still refer to the session id, the name and the UUID it had are kept
+    QString departedUuid;
+    QCOMPARE(registry->findDepartedName(2, &departedUuid), QString("user1"));
+    QCOMPARE(departedUuid, uuid);
+    QVERIFY(registry->findDepartedName(1).isEmpty());
+    QVERIFY(registry->findDepartedName(99).isEmpty());
+}
+
+void TestClientRegistry::departedForgotten()
+{
+    populate(1);
+    Client *client = clients.first();
+    registry->deregisterClient(client);
+    // one client under new session ids, the oldest departures are forgotten first
+    for (int i = 0; i < Constants::departedSessions; ++i)
+    {
+        client->setSessionId(1000 + i);
+        registry->registerClient(client);
+        registry->deregisterClient(client);
+    }
+    QVERIFY(registry->findDepartedName(1).isEmpty());
+    QCOMPARE(registry->findDepartedName(1000), QString("user0"));
+    QCOMPARE(registry->findDepartedName(1000 + Constants::departedSessions - 1), QString("user0"));
+}
+
+void TestClientRegistry::removeConnection()
+{
+    populate(2);
+    registry->removeConnection(clients.at(0));
+    QCOMPARE(registry->getConnectionsCount(), 1);
+    QCOMPARE(registry->getRegisteredCount(), 1);
+    QVERIFY(registry->findByName("user0") == 0);
+    QVERIFY(registry->getConnections().contains(clients.at(1)->getSocketDescriptor()));
+}
+
+void TestClientRegistry::registeredVersions()
+{
+    populate(3);
+    clients.at(0)->setProtocolVersion(1);
+    registry->registerClient(clients.at(0));
+    quint32 latest = 1u << Constants::protocolVersion;
+    QCOMPARE(registry->getRegisteredVersions(), latest | 2u);
+    registry->deregisterClient(clients.at(0));
+    QCOMPARE(registry->getRegisteredVersions(), latest);
+    registry->clear();
+    QCOMPARE(registry->getRegisteredVersions(), 0u);
+}
+
+void TestClientRegistry::findByUUID_data()
+{
+    addClientCounts();
+}
+
+void TestClientRegistry::findByUUID()
+{
+    QFETCH(int, count);
+    populate(count);
+    QStringList uuids;
+    foreach (Client *client, lookupTargets())
+        uuids.append(client->getUUID());
+    Client *found = 0;
+    QBENCHMARK
+    {
+        foreach (const QString &uuid, uuids)
+            found = registry->findByUUID(uuid);
+    }
+    QCOMPARE(found, lookupTargets().last());
+}
+
+void TestClientRegistry::scanByUUID_data()
+{
+    addClientCounts();
+}
+
+void TestClientRegistry::scanByUUID()
+{
+    QFETCH(int, count);
+    populate(count);
+    QStringList uuids;
+    foreach (Client *client, lookupTargets())
+        uuids.append(client->getUUID());
+    Client *found = 0;
+    QBENCHMARK
+    {
+        foreach (const QString &uuid, uuids)
+            found = scanByUUID(clients, uuid);
+    }
+    QCOMPARE(found, lookupTargets().last());
+}
+
+void TestClientRegistry::findByName_data()
+{
+    addClientCounts();
+}
+
+void TestClientRegistry::findByName()
+{
+    QFETCH(int, count);
+    populate(count);
+    // the way a new client asks for a name taken already, in another case
+    QStringList names;
+    foreach (Client *client, lookupTargets())
+        names.append(client->getName().toUpper());
+    Client *found = 0;
+    QBENCHMARK
+    {
+        foreach (const QString &name, names)
+            found = registry->findByName(name);
+    }
+    QCOMPARE(found, lookupTargets().last());
+}
+
+void TestClientRegistry::scanByName_data()
+{
+    addClientCounts();
+}
+
+void TestClientRegistry::scanByName()
+{
+    QFETCH(int, count);
+    populate(count);
+    QStringList names;
+    foreach (Client *client, lookupTargets())
+        names.append(client->getName().toUpper());
+    Client *found = 0;
+    QBENCHMARK
+    {
+        foreach (const QString &name, names)
+            found = scanByName(clients, name);
+    }
+    QCOMPARE(found, lookupTargets().last());
+}
+
+QTEST_GUILESS_MAIN(TestClientRegistry)
+
+#include "tst_clientregistry.moc"
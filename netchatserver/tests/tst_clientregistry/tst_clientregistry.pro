@@ -0,0 +1,13 @@
+TEMPLATE = app
+
+TARGET = tst_clientregistry
+
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+QT = core network testlib
+
+SOURCES += \
+    tst_clientregistry.cpp
+
+include(../../servercore.pri)
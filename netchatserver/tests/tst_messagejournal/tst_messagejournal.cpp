@@ -0,0 +1,271 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QtEndian>
+
+#include "messagejournal.h"
+#include "historyindex.h"
+
+class TestMessageJournal : public QObject
+{
+    Q_OBJECT
+
+private:
+    static JournalRecord makeRecord(int n);
+    // the records of all the segments of the directory, up to the first damaged one of each
+    static QList<JournalRecord> readAll(const QString &directory);
+    // the bitwise CRC-32 of zlib, to check the table driven one of the journal against
+    static quint32 referenceCrc32(const QByteArray &bytes);
+    static void writeRecords(MessageJournal *journal, int from, int count);
+
+private slots:
+    void recordRoundTrip();
+    void checksumIsCrc32();
+    void damagedRecord();
+    void incompleteRecord();
+    void tornTailRecovery_data();
+    void tornTailRecovery();
+    void segmentRollover();
+};
+
+JournalRecord TestMessageJournal::makeRecord(int n)
+{
+    JournalRecord record;
+    record.timestampMsec = Q_INT64_C(1700000000000) + n;
+    record.senderSessionId = n;
+    record.senderUuid = "{00000000-0000-0000-0000-00000000000" + QString::number(n % 10) + "}";
+    record.senderName = QString("sender%1").arg(n);
+    record.utf8 = QString::fromUtf8("message \xf0\x9f\x98\x80 %1").arg(n).toUtf8();
+    if (n % 2 == 0)
+    {
+        record.flags = JournalRecord::flagPrivate;
+        record.receiverUuids << "{11111111-1111-1111-1111-111111111111}";
+        record.receiverNames << "receiver" << "away";
+    }
+    return record;
+}
+
+QList<JournalRecord> TestMessageJournal::readAll(const QString &directory)
+{
+    QList<JournalRecord> records;
+    foreach (const QString &fileName, MessageJournal::segmentFiles(directory))
+    {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+            continue;
+        QByteArray data = file.readAll();
+        qint64 pos = sizeof(quint32);
+        JournalRecord record;
+        int recordSize;
+        while ((recordSize = MessageJournal::readRecord(data.constData() + pos, data.size() - pos, &record)) > 0)
+        {
+            records.append(record);
+            pos += recordSize;
+        }
+    }
+    return records;
+}
+
+quint32 TestMessageJournal::referenceCrc32(const QByteArray &bytes)
+{
+    quint32 crc = 0xffffffffu;
+    for (int i = 0; i < bytes.size(); ++i)
+    {
+        crc ^= (uchar)bytes.at(i);
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1)));
+    }
+    return ~crc;
+}
+
+void TestMessageJournal::writeRecords(MessageJournal *journal, int from, int count)
+{
+    QVERIFY2(journal->open(), qPrintable(journal->errorString()));
+    journal->start();
+    for (int n = from; n < from + count; ++n)
+        journal->append(makeRecord(n));
+    // everything queued is written before the thread ends
+    journal->stop();
+    QCOMPARE(journal->getStats().writeErrors, Q_INT64_C(0));
+}
+
+void TestMessageJournal::recordRoundTrip()
+{
+    JournalRecord record = makeRecord(2);
+    record.messageId = Q_UINT64_C(0x123456789a);
+    QByteArray bytes = MessageJournal::encodeRecord(record);
+    QCOMPARE(MessageJournal::recordSize(bytes.constData(), bytes.size()), bytes.size());
+
+    JournalRecord read;
+    QCOMPARE(MessageJournal::readRecord(bytes.constData(), bytes.size(), &read), bytes.size());
+    QCOMPARE(read.messageId, record.messageId);
+    QCOMPARE(read.timestampMsec, record.timestampMsec);
+    QCOMPARE(read.senderSessionId, record.senderSessionId);
+    QCOMPARE(read.flags, record.flags);
+    QCOMPARE(read.senderUuid, record.senderUuid);
+    QCOMPARE(read.senderName, record.senderName);
+    QCOMPARE(read.receiverUuids, record.receiverUuids);
+    QCOMPARE(read.receiverNames, record.receiverNames);
+    QCOMPARE(read.utf8, record.utf8);
+
+    // a text large enough for the extended size field
+    record.utf8 = QByteArray(100000, 'x');
+    bytes = MessageJournal::encodeRecord(record);
+    QCOMPARE(MessageJournal::readRecord(bytes.constData(), bytes.size(), &read), bytes.size());
+    QCOMPARE(read.utf8, record.utf8);
+}
+
+void TestMessageJournal::checksumIsCrc32()
+{
+    // the check value of CRC-32
+    QCOMPARE(referenceCrc32("123456789"), 0xcbf43926u);
+
+    for (int n = 1; n <= 4; ++n)
+    {
+        QByteArray bytes = MessageJournal::encodeRecord(makeRecord(n));
+        QByteArray frame = bytes.left(bytes.size() - 4);
+        quint32 stored = qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(bytes.constData()) + frame.size());
+        QCOMPARE(stored, referenceCrc32(frame));
+    }
+}
+
+void TestMessageJournal::damagedRecord()
+{
+    JournalRecord record = makeRecord(2);
+    record.messageId = 7;
+    QByteArray bytes = MessageJournal::encodeRecord(record);
+    // any bit flipped anywhere, the CRC included, and the record is refused
+    for (int i = 0; i < bytes.size(); ++i)
+    {
+        for (int bit = 0; bit < 8; ++bit)
+        {
+            QByteArray damaged = bytes;
+            damaged[i] = damaged.at(i) ^ (char)(1 << bit);
+            JournalRecord read;
+            QVERIFY2(MessageJournal::readRecord(damaged.constData(), damaged.size(), &read) == 0,
+                     qPrintable(QString("byte %1, bit %2").arg(i).arg(bit)));
+        }
+    }
+}
+
+void TestMessageJournal::incompleteRecord()
+{
+    JournalRecord record = makeRecord(3);
+    record.messageId = 8;
+    QByteArray bytes = MessageJournal::encodeRecord(record);
+    for (int size = 0; size < bytes.size(); ++size)
+    {
+        JournalRecord read;
+        QCOMPARE(MessageJournal::readRecord(bytes.constData(), size, &read), 0);
+    }
+}
+
+void TestMessageJournal::tornTailRecovery_data()
+{
+    // the bytes of the next record left on the disk, or (below 0) the ones missing from its end
+    QTest::addColumn<int>("tailSize");
+    QTest::addColumn<bool>("isGarbage");
+
+    // the server stopped in the middle of a write: a part of the next record is on the disk
+    QTest::newRow("one byte") << 1 << false;
+    QTest::newRow("the size field") << 2 << false;
+    QTest::newRow("half a record") << 80 << false;
+    QTest::newRow("all but the CRC") << -4 << false;
+    QTest::newRow("all but a byte") << -1 << false;
+    // or the blocks of the file were never written
+    QTest::newRow("zeros") << 64 << true;
+}
+
+void TestMessageJournal::tornTailRecovery()
+{
+    QFETCH(int, tailSize);
+    QFETCH(bool, isGarbage);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    {
+        MessageJournal journal(dir.path());
+        journal.setFsyncInterval(-1);
+        writeRecords(&journal, 1, 3);
+    }
+    QStringList files = MessageJournal::segmentFiles(dir.path());
+    QCOMPARE(files.size(), 1);
+    QFile file(files.first());
+    qint64 validSize = file.size();
+    {
+        JournalRecord record = makeRecord(4);
+        record.messageId = 4;
+        QByteArray tail = MessageJournal::encodeRecord(record);
+        if (isGarbage)
+            tail = QByteArray(tailSize, '\0');
+        else if (tailSize < 0)
+            tail.chop(-tailSize);
+        else
+            tail = tail.left(tailSize);
+        QVERIFY(file.open(QIODevice::Append));
+        QCOMPARE(file.write(tail), (qint64)tail.size());
+        file.close();
+    }
+
+    HistoryIndex history;
+    {
+        MessageJournal journal(dir.path());
+        journal.setFsyncInterval(-1);
+        journal.setHistoryIndex(&history);
+        QVERIFY(journal.open());
+        // the tail is cut off on the open, the records before it are indexed
+        QCOMPARE(QFileInfo(files.first()).size(), validSize);
+        HistoryCursor cursor = history.findAfter(HistoryIndex::publicConversation, 0, 100);
+        QCOMPARE(history.readPage(&cursor, 100, 1 << 20).size(), 2);
+        journal.start();
+        journal.append(makeRecord(5));
+        journal.stop();
+    }
+
+    // the ids go on after the last valid record
+    QList<JournalRecord> records = readAll(dir.path());
+    QCOMPARE(records.size(), 4);
+    for (int i = 0; i < records.size(); ++i)
+        QCOMPARE(records.at(i).messageId, (quint64)(i + 1));
+    QCOMPARE(records.last().senderName, QString("sender5"));
+}
+
+void TestMessageJournal::segmentRollover()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    int recordBytes = MessageJournal::encodeRecord(makeRecord(1)).size();
+    {
+        MessageJournal journal(dir.path());
+        journal.setFsyncInterval(-1);
+        // about three records in a segment
+        journal.setSegmentSize(sizeof(quint32) + recordBytes * 3 + recordBytes / 2);
+        writeRecords(&journal, 1, 10);
+    }
+    {
+        MessageJournal journal(dir.path());
+        journal.setFsyncInterval(-1);
+        journal.setSegmentSize(sizeof(quint32) + recordBytes * 3 + recordBytes / 2);
+        writeRecords(&journal, 11, 5);
+    }
+
+    QStringList files = MessageJournal::segmentFiles(dir.path());
+    QVERIFY(files.size() >= 5);
+    QList<JournalRecord> records = readAll(dir.path());
+    QCOMPARE(records.size(), 15);
+    for (int i = 0; i < records.size(); ++i)
+        QCOMPARE(records.at(i).messageId, (quint64)(i + 1));
+    // a segment is named after the id of its first record
+    foreach (const QString &fileName, files)
+    {
+        QFile file(fileName);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QByteArray data = file.readAll();
+        JournalRecord first;
+        QVERIFY(MessageJournal::readRecord(data.constData() + 4, data.size() - 4, &first) > 0);
+        QCOMPARE(QFileInfo(fileName).baseName().toULongLong(0, 16), first.messageId);
+    }
+}
+
+QTEST_GUILESS_MAIN(TestMessageJournal)
+
+#include "tst_messagejournal.moc"
@@ -0,0 +1,13 @@
+TEMPLATE = app
+
+TARGET = tst_messagejournal
+
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+QT = core network testlib
+
+SOURCES += \
+    tst_messagejournal.cpp
+
+include(../../servercore.pri)
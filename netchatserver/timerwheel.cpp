@@ -0,0 +1,70 @@
+#include "timerwheel.h"
+
+TimerWheel::TimerWheel(int bucketsCount, qint64 tickMsec) :
+    buckets(bucketsCount), tickMsec(tickMsec)
+{
+    currentTick = 0;
+    nodesCount = 0;
+    for (int i = 0; i < buckets.size(); ++i)
+    {
+        buckets[i].prev = &buckets[i];
+        buckets[i].next = &buckets[i];
+    }
+}
+
+TimerWheel::~TimerWheel()
+{
+    // the owners may outlive the wheel, their nodes mustn't point into it
+    for (int i = 0; i < buckets.size(); ++i)
+        while (buckets[i].next != &buckets[i])
+            cancel(buckets[i].next);
+}
+
+void TimerWheel::schedule(TimerWheelNode *node, qint64 deadlineMsec)
+{
+    if (node->isScheduled())
+        cancel(node);
+    node->deadlineMsec = deadlineMsec;
+    // a deadline in the past goes to the next tick
+    qint64 tick = qMax(tickOf(deadlineMsec), currentTick + 1);
+    TimerWheelNode *head = &buckets[tick % buckets.size()];
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+    nodesCount++;
+}
+
+void TimerWheel::cancel(TimerWheelNode *node)
+{
+    if (!node->isScheduled())
+        return;
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = 0;
+    node->next = 0;
+    nodesCount--;
+}
+
+void TimerWheel::advance(qint64 nowMsec, QVector<TimerWheelNode *> *expired)
+{
+    qint64 nowTick = nowMsec / tickMsec;
+    // after a long stall one turn visits every bucket
+    qint64 fromTick = qMax(currentTick + 1, nowTick - buckets.size() + 1);
+    for (qint64 tick = fromTick; tick <= nowTick; ++tick)
+    {
+        TimerWheelNode *head = &buckets[tick % buckets.size()];
+        TimerWheelNode *node = head->next;
+        while (node != head)
+        {
+            TimerWheelNode *next = node->next;
+            if (node->deadlineMsec <= nowMsec)
+            {
+                cancel(node);
+                expired->append(node);
+            }
+            node = next;
+        }
+    }
+    currentTick = qMax(currentTick, nowTick);
+}
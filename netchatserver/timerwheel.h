@@ -0,0 +1,48 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <QtGlobal>
+#include <QVector>
+
+// a timer of the wheel, embedded into its owner; linked into one bucket at a time
+struct TimerWheelNode
+{
+    TimerWheelNode() : prev(0), next(0), deadlineMsec(0), owner(0) {}
+
+    TimerWheelNode *prev;
+    TimerWheelNode *next;
+    qint64 deadlineMsec;
+    void *owner;
+
+    bool isScheduled() const {return this->next != 0;}
+};
+
+// a hashed timer wheel: scheduling and cancelling are O(1), a tick visits one bucket;
+// the deadlines further than one turn of the wheel stay in their bucket for another turn.
+// Not thread-safe, every worker has its own
+class TimerWheel
+{
+public:
+    TimerWheel(int bucketsCount, qint64 tickMsec);
+    ~TimerWheel();
+
+    qint64 getTickMsec() const {return this->tickMsec;}
+    bool isEmpty() const {return this->nodesCount == 0;}
+    // (re)schedules the node, the deadline is rounded up to a tick
+    void schedule(TimerWheelNode *node, qint64 deadlineMsec);
+    void cancel(TimerWheelNode *node);
+    // unlinks the nodes due by now and appends them to expired
+    void advance(qint64 nowMsec, QVector<TimerWheelNode *> *expired);
+
+private:
+    // the sentinels of the circular lists of the buckets
+    QVector<TimerWheelNode> buckets;
+    qint64 tickMsec;
+    // the last tick advanced to
+    qint64 currentTick;
+    int nodesCount;
+
+    qint64 tickOf(qint64 msec) const {return (msec + tickMsec - 1) / tickMsec;}
+};
+
+#endif // TIMERWHEEL_H
@@ -0,0 +1,12 @@
+#include "workerlistener.h"
+#include "serverworker.h"
+
+WorkerListener::WorkerListener(ServerWorker *workerPtr) :
+    QTcpServer(workerPtr), worker(workerPtr)
+{
+}
+
+void WorkerListener::incomingConnection(qintptr handle)
+{
+    worker->onAcceptConnection(handle);
+}
@@ -0,0 +1,24 @@
+#ifndef WORKERLISTENER_H
+#define WORKERLISTENER_H
+
+#include <QTcpServer>
+
+class ServerWorker;
+
+// one of the SO_REUSEPORT listeners, it accepts in the thread of its worker
+// and hands the connections to that worker only
+class WorkerListener : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    explicit WorkerListener(ServerWorker *workerPtr);
+
+protected:
+    void incomingConnection(qintptr handle);
+
+private:
+    ServerWorker *worker;
+};
+
+#endif // WORKERLISTENER_H
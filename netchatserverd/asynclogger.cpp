@@ -0,0 +1,117 @@
+#include <QFile>
+#include <QTextStream>
+#include <QDateTime>
+#include <QRegExp>
+#include <QMutexLocker>
+
+#include "asynclogger.h"
+
+AsyncLogger::AsyncLogger(const QString &fileName, QObject *parent) :
+    QThread(parent), logFileName(fileName), stopRequested(false), droppedLines(0)
+{
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    stop();
+}
+
+void AsyncLogger::log(const QString &text)
+{
+    QString line = "[" + QDateTime::currentDateTime().toString("MM/dd/yy h:mm:ss AP") + "] " + text;
+    QMutexLocker locker(&mutex);
+    // never let a stuck output eat all the memory
+    if (pendingLines.length() >= maxPendingLines)
+    {
+        droppedLines++;
+        return;
+    }
+    pendingLines.append(line);
+    condition.wakeOne();
+}
+
+void AsyncLogger::stop()
+{
+    {
+        QMutexLocker locker(&mutex);
+        stopRequested = true;
+        condition.wakeOne();
+    }
+    wait();
+}
+
+void AsyncLogger::run()
+{
+    QFile file;
+    if (logFileName.isEmpty())
+    {
+        file.open(stderr, QIODevice::WriteOnly | QIODevice::Text);
+    }
+    else
+    {
+        file.setFileName(logFileName);
+        file.open(QIODevice::Append | QIODevice::Text);
+    }
+    QTextStream out(&file);
+
+    forever
+    {
+        QStringList lines;
+        quint64 dropped = 0;
+        bool stopping = false;
+        {
+            QMutexLocker locker(&mutex);
+            while (pendingLines.isEmpty() && !stopRequested)
+                condition.wait(&mutex);
+            // take the whole batch at once, the writers are not blocked while it is written
+            lines.swap(pendingLines);
+            dropped = droppedLines;
+            droppedLines = 0;
+            stopping = stopRequested;
+        }
+        if (dropped > 0)
+            out << "* " << dropped << " log lines were dropped\n";
+        foreach (const QString &line, lines)
+            out << line << "\n";
+        out.flush();
+        if (stopping)
+            break;
+    }
+}
+
+QString AsyncLogger::stripHtml(QString text) const
+{
+    text.replace("<br>", " ");
+    text.remove(QRegExp("<[^>]*>"));
+    text.replace("&nbsp;", " ");
+    text.replace("&lt;", "<");
+    text.replace("&gt;", ">");
+    text.replace("&quot;", "\"");
+    text.replace("&amp;", "&");
+    return text.trimmed();
+}
+
+void AsyncLogger::onAddToLogArea(const QString &text, bool emptyLineIsNeeded)
+{
+    Q_UNUSED(emptyLineIsNeeded);
+    // the server speaks HTML to the GUI log area
+    log(stripHtml(text));
+}
+
+void AsyncLogger::onAddClient(const QString &uuid, const QString &name)
+{
+    log("* User " + name + " " + uuid + " has signed in");
+}
+
+void AsyncLogger::onRemoveClient(const QString &uuid, const QString &name)
+{
+    log("* User " + name + " " + uuid + " has signed out");
+}
+
+void AsyncLogger::onMessage(const QString &message, const QString &from, const QStringList &clients)
+{
+    if (clients.isEmpty())
+        log("Message from " + from + " to all: " + message);
+    else
+        log("Message from " + from + " to " + clients.join(", ") + ": " + message);
+}
@@ -0,0 +1,45 @@
+#ifndef ASYNCLOGGER_H
+#define ASYNCLOGGER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QStringList>
+
+// writes the log lines from its own thread, so logging never blocks
+// the threads of the chat server on I/O
+class AsyncLogger : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit AsyncLogger(const QString &fileName = QString(), QObject *parent = 0);
+    ~AsyncLogger();
+
+    // thread-safe, just queues the line
+    void log(const QString &text);
+    void stop();
+
+protected:
+    void run();
+
+private:
+    QString logFileName;
+    QMutex mutex;
+    QWaitCondition condition;
+    QStringList pendingLines;
+    bool stopRequested;
+    quint64 droppedLines;
+
+    static const int maxPendingLines = 100000;
+
+    QString stripHtml(QString text) const;
+
+public slots:
+    void onAddToLogArea(const QString &text, bool emptyLineIsNeeded = true);
+    void onAddClient(const QString &uuid, const QString &name);
+    void onRemoveClient(const QString &uuid, const QString &name);
+    void onMessage(const QString &message, const QString &from, const QStringList &clients);
+};
+
+#endif // ASYNCLOGGER_H
@@ -0,0 +1,285 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QHostAddress>
+
+#include "server.h"
+#include "asynclogger.h"
+#include "constants.h"
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("netchatserverd");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless " + Constants::programName);
+    parser.addHelpOption();
+    QCommandLineOption addressOption(QStringList() << "a" << "address",
+                                     "Address to listen on.", "address", "0.0.0.0");
+    QCommandLineOption portOption(QStringList() << "p" << "port",
+                                  "Port to listen on.", "port", "1616");
+    QCommandLineOption workersOption(QStringList() << "w" << "workers",
+                                     "Number of worker threads (0 - none, -1 - one per core).", "count", "-1");
+    QCommandLineOption mirrorOption(QStringList() << "m" << "mirror-rate",
+                                    "Log every N-th relayed message (0 - none).", "N", "1");
+    QCommandLineOption queueBytesOption("queue-bytes",
+                                        "Outbound queue limit per client in bytes.", "bytes",
+                                        QString::number(Constants::outboundQueueBytes));
+    QCommandLineOption queueMessagesOption("queue-messages",
+                                           "Outbound queue limit per client in messages.", "count",
+                                           QString::number(Constants::outboundQueueMessages));
+    QCommandLineOption slowPolicyOption("slow-policy",
+                                        "What to do with a full outbound queue: drop, coalesce or disconnect.",
+                                        "policy", "coalesce");
+    QCommandLineOption flushDelayOption("flush-delay",
+                                        "Delay the writes by that many milliseconds to batch more frames.",
+                                        "msec", "0");
+    QCommandLineOption backendOption("backend",
+                                     "The socket I/O backend: qt, epoll (Linux only) or uring (the iouring build only).",
+                                     "backend", "qt");
+    QCommandLineOption reusePortOption("reuseport",
+                                       "Give every worker thread its own SO_REUSEPORT listener.");
+    QCommandLineOption connectionRateOption("conn-rate",
+                                            "New connections per second per IP address (0 - unlimited).", "rate",
+                                            QString::number(Constants::admissionConnectionsPerSecond));
+    QCommandLineOption registrationRateOption("reg-rate",
+                                              "Registrations per second per IP address (0 - unlimited).", "rate",
+                                              QString::number(Constants::admissionRegistrationsPerSecond));
+    QCommandLineOption maxPendingOption("max-pending",
+                                        "Connections that haven't registered yet (0 - unlimited).", "count",
+                                        QString::number(Constants::admissionMaxPending));
+    QCommandLineOption handshakeTimeoutOption("handshake-timeout",
+                                              "Close the connections that don't register in time (0 - never).", "sec",
+                                              QString::number(Constants::handshakeTimeoutSec));
+    QCommandLineOption messageRateOption("msg-rate",
+                                         "Messages per second a client may send (0 - unlimited).", "rate",
+                                         QString::number(Constants::floodMessagesPerSecond));
+    QCommandLineOption byteRateOption("byte-rate",
+                                      "Message bytes per second a client may send (0 - unlimited).", "rate",
+                                      QString::number(Constants::floodBytesPerSecond));
+    QCommandLineOption heartbeatOption("heartbeat",
+                                       "Send a heartbeat to a client idle for that long (0 - no heartbeats).", "sec",
+                                       QString::number(Constants::heartbeatIntervalSec));
+    QCommandLineOption heartbeatTimeoutOption("heartbeat-timeout",
+                                              "Close a client silent for that long (0 - never).", "sec",
+                                              QString::number(Constants::heartbeatTimeoutSec));
+    QCommandLineOption journalOption("journal",
+                                     "Write every relayed message to the segment files in the directory.", "dir");
+    QCommandLineOption journalFsyncOption("journal-fsync",
+                                          "Sync the journal to the disk at most once per that many milliseconds "
+                                          "(0 - after every group commit, -1 - never).", "msec",
+                                          QString::number(Constants::journalFsyncMsec));
+    QCommandLineOption journalSegmentOption("journal-segment",
+                                            "Start a new journal segment once the current one has that many megabytes.",
+                                            "MB", QString::number(Constants::journalSegmentBytes / (1024 * 1024)));
+    QCommandLineOption offlineDirOption("offline-dir",
+                                        "Spill the messages kept for the clients who are away to the directory "
+                                        "and keep them over restarts.", "dir");
+    QCommandLineOption offlineMemoryOption("offline-memory",
+                                           "Keep that many megabytes of the messages to the clients who are away in memory "
+                                           "(0 - don't keep the messages).", "MB",
+                                           QString::number(Constants::offlineMemoryBytes / (1024 * 1024)));
+    QCommandLineOption offlinePerUserOption("offline-per-user",
+                                            "Keep that many last messages for a client who is away.", "count",
+                                            QString::number(Constants::offlineMessagesPerRecipient));
+    QCommandLineOption logFileOption(QStringList() << "l" << "log-file",
+                                     "Append the log to the file instead of stderr.", "file");
+    parser.addOption(addressOption);
+    parser.addOption(portOption);
+    parser.addOption(workersOption);
+    parser.addOption(mirrorOption);
+    parser.addOption(queueBytesOption);
+    parser.addOption(queueMessagesOption);
+    parser.addOption(slowPolicyOption);
+    parser.addOption(flushDelayOption);
+    parser.addOption(backendOption);
+    parser.addOption(reusePortOption);
+    parser.addOption(connectionRateOption);
+    parser.addOption(registrationRateOption);
+    parser.addOption(maxPendingOption);
+    parser.addOption(handshakeTimeoutOption);
+    parser.addOption(messageRateOption);
+    parser.addOption(byteRateOption);
+    parser.addOption(heartbeatOption);
+    parser.addOption(heartbeatTimeoutOption);
+    parser.addOption(journalOption);
+    parser.addOption(journalFsyncOption);
+    parser.addOption(journalSegmentOption);
+    parser.addOption(offlineDirOption);
+    parser.addOption(offlineMemoryOption);
+    parser.addOption(offlinePerUserOption);
+    parser.addOption(logFileOption);
+    parser.process(app);
+
+    QHostAddress address;
+    if (!address.setAddress(parser.value(addressOption)))
+    {
+        qCritical("Invalid address: %s", qPrintable(parser.value(addressOption)));
+        return 1;
+    }
+    bool ok = false;
+    quint16 port = parser.value(portOption).toUShort(&ok);
+    if (!ok)
+    {
+        qCritical("Invalid port: %s", qPrintable(parser.value(portOption)));
+        return 1;
+    }
+    int workersCount = parser.value(workersOption).toInt(&ok);
+    if (!ok)
+    {
+        qCritical("Invalid workers count: %s", qPrintable(parser.value(workersOption)));
+        return 1;
+    }
+
+    int mirrorRate = parser.value(mirrorOption).toInt(&ok);
+    if (!ok)
+    {
+        qCritical("Invalid mirror rate: %s", qPrintable(parser.value(mirrorOption)));
+        return 1;
+    }
+
+    qint64 queueBytes = parser.value(queueBytesOption).toLongLong(&ok);
+    if (!ok || queueBytes <= 0)
+    {
+        qCritical("Invalid queue size: %s", qPrintable(parser.value(queueBytesOption)));
+        return 1;
+    }
+    int queueMessages = parser.value(queueMessagesOption).toInt(&ok);
+    if (!ok || queueMessages <= 0)
+    {
+        qCritical("Invalid queue length: %s", qPrintable(parser.value(queueMessagesOption)));
+        return 1;
+    }
+    ChatServer::OverflowPolicy slowPolicy = ChatServer::overflowPolicyFromString(parser.value(slowPolicyOption), &ok);
+    if (!ok)
+    {
+        qCritical("Invalid slow consumer policy: %s", qPrintable(parser.value(slowPolicyOption)));
+        return 1;
+    }
+    int flushDelay = parser.value(flushDelayOption).toInt(&ok);
+    if (!ok || flushDelay < 0)
+    {
+        qCritical("Invalid flush delay: %s", qPrintable(parser.value(flushDelayOption)));
+        return 1;
+    }
+    ChatServer::IoBackend ioBackend = ChatServer::ioBackendFromString(parser.value(backendOption), &ok);
+    if (!ok)
+    {
+        qCritical("Invalid I/O backend: %s", qPrintable(parser.value(backendOption)));
+        return 1;
+    }
+    double connectionRate = parser.value(connectionRateOption).toDouble(&ok);
+    if (!ok || connectionRate < 0)
+    {
+        qCritical("Invalid connection rate: %s", qPrintable(parser.value(connectionRateOption)));
+        return 1;
+    }
+    double registrationRate = parser.value(registrationRateOption).toDouble(&ok);
+    if (!ok || registrationRate < 0)
+    {
+        qCritical("Invalid registration rate: %s", qPrintable(parser.value(registrationRateOption)));
+        return 1;
+    }
+    int maxPending = parser.value(maxPendingOption).toInt(&ok);
+    if (!ok || maxPending < 0)
+    {
+        qCritical("Invalid pending connections cap: %s", qPrintable(parser.value(maxPendingOption)));
+        return 1;
+    }
+    int handshakeTimeout = parser.value(handshakeTimeoutOption).toInt(&ok);
+    if (!ok || handshakeTimeout < 0)
+    {
+        qCritical("Invalid handshake timeout: %s", qPrintable(parser.value(handshakeTimeoutOption)));
+        return 1;
+    }
+    double messageRate = parser.value(messageRateOption).toDouble(&ok);
+    if (!ok || messageRate < 0)
+    {
+        qCritical("Invalid message rate: %s", qPrintable(parser.value(messageRateOption)));
+        return 1;
+    }
+    double byteRate = parser.value(byteRateOption).toDouble(&ok);
+    if (!ok || byteRate < 0)
+    {
+        qCritical("Invalid byte rate: %s", qPrintable(parser.value(byteRateOption)));
+        return 1;
+    }
+    int heartbeatInterval = parser.value(heartbeatOption).toInt(&ok);
+    if (!ok || heartbeatInterval < 0)
+    {
+        qCritical("Invalid heartbeat interval: %s", qPrintable(parser.value(heartbeatOption)));
+        return 1;
+    }
+    int heartbeatTimeout = parser.value(heartbeatTimeoutOption).toInt(&ok);
+    if (!ok || heartbeatTimeout < 0)
+    {
+        qCritical("Invalid heartbeat timeout: %s", qPrintable(parser.value(heartbeatTimeoutOption)));
+        return 1;
+    }
+    int journalFsync = parser.value(journalFsyncOption).toInt(&ok);
+    if (!ok || journalFsync < -1)
+    {
+        qCritical("Invalid journal sync interval: %s", qPrintable(parser.value(journalFsyncOption)));
+        return 1;
+    }
+    qint64 journalSegment = parser.value(journalSegmentOption).toLongLong(&ok);
+    if (!ok || journalSegment <= 0)
+    {
+        qCritical("Invalid journal segment size: %s", qPrintable(parser.value(journalSegmentOption)));
+        return 1;
+    }
+    qint64 offlineMemory = parser.value(offlineMemoryOption).toLongLong(&ok);
+    if (!ok || offlineMemory < 0)
+    {
+        qCritical("Invalid offline messages memory: %s", qPrintable(parser.value(offlineMemoryOption)));
+        return 1;
+    }
+    int offlinePerUser = parser.value(offlinePerUserOption).toInt(&ok);
+    if (!ok || offlinePerUser <= 0)
+    {
+        qCritical("Invalid offline messages per user: %s", qPrintable(parser.value(offlinePerUserOption)));
+        return 1;
+    }
+
+    AsyncLogger logger(parser.value(logFileOption));
+    logger.start();
+
+    ChatServer chatServer;
+    // the logger only queues the lines, so let the clients' threads call it directly
+    QObject::connect(&chatServer, SIGNAL(addToLogArea(QString,bool)),
+                     &logger, SLOT(onAddToLogArea(QString,bool)), Qt::DirectConnection);
+    QObject::connect(&chatServer, SIGNAL(addClientToGui(QString,QString)),
+                     &logger, SLOT(onAddClient(QString,QString)), Qt::DirectConnection);
+    QObject::connect(&chatServer, SIGNAL(removeClientFromGui(QString,QString)),
+                     &logger, SLOT(onRemoveClient(QString,QString)), Qt::DirectConnection);
+    QObject::connect(&chatServer, SIGNAL(messageToGui(QString,QString,QStringList)),
+                     &logger, SLOT(onMessage(QString,QString,QStringList)), Qt::DirectConnection);
+
+    chatServer.setWorkersCount(workersCount);
+    chatServer.setGuiMirrorSampleRate(mirrorRate);
+    chatServer.setOutboundLimits(queueBytes, queueMessages, slowPolicy);
+    chatServer.setFlushDelay(flushDelay);
+    chatServer.setIoBackend(ioBackend);
+    chatServer.setReusePort(parser.isSet(reusePortOption));
+    chatServer.getAdmission().setLimits(connectionRate, registrationRate, maxPending);
+    chatServer.setHandshakeTimeout(handshakeTimeout);
+    chatServer.setFloodLimits(messageRate, byteRate);
+    chatServer.setHeartbeat(heartbeatInterval, heartbeatTimeout);
+    chatServer.setJournal(parser.value(journalOption), journalFsync, journalSegment * 1024 * 1024);
+    chatServer.getOfflineStore().setLimits(offlineMemory * 1024 * 1024, offlinePerUser);
+    QString offlineError;
+    if (!chatServer.getOfflineStore().setDirectory(parser.value(offlineDirOption), &offlineError))
+    {
+        qCritical("%s", qPrintable(offlineError));
+        return 1;
+    }
+    if (!chatServer.startChatServer(address, port))
+    {
+        logger.log("ChatServer failed to start: " + chatServer.errorString());
+        return 1;
+    }
+    logger.log("ChatServer started at " + chatServer.serverAddress().toString() + ":" +
+               QString::number(chatServer.serverPort()));
+
+    return app.exec();
+}
@@ -0,0 +1,17 @@
+TEMPLATE = app
+
+TARGET = netchatserverd
+
+CONFIG += console
+CONFIG -= app_bundle
+
+QT = core network
+
+HEADERS += \
+    asynclogger.h
+
+SOURCES += \
+    main.cpp \
+    asynclogger.cpp
+
+include(../netchatserver/servercore.pri)